@@ -47,6 +47,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
 
 iBeginPublic
 
+iDeclareType(ThreadPool)
+
 struct Impl_Array {
     char *data;
     iRanges range; // elements
@@ -89,7 +91,33 @@ void        reserve_Array   (iArray *, size_t reservedSize);
 void        clear_Array     (iArray *);
 void        resize_Array    (iArray *, size_t size);
 void        fill_Array      (iArray *, char value);
-void        sort_Array      (iArray *, int (*cmp)(const void *, const void *));
+
+/**
+ * Sorts the elements with a stable merge sort. Already ordered runs are merged in linear
+ * time. The comparison function gets pointers to two elements.
+ */
+void        sort_Array          (iArray *, int (*cmp)(const void *, const void *));
+void        sortContext_Array   (iArray *, int (*cmp)(const void *, const void *, void *context),
+                                 void *context);
+
+/**
+ * Sorts the elements according to an integer key. The key function is called once per
+ * element and the keys are compared inline, which is faster than calling a comparison
+ * function. The sort is stable.
+ */
+void        sortKey_Array       (iArray *, int64_t (*key)(const void *element));
+
+/**
+ * Sorts the elements using the threads of a pool. Large arrays are split into chunks that
+ * are sorted in parallel and then merged in parallel. Small arrays are sorted in the calling
+ * thread. The result is the same as with sort_Array().
+ *
+ * The calling thread takes part in the sorting, so this may also be called from a thread
+ * of the same pool.
+ */
+void        sortParallel_Array  (iArray *, int (*cmp)(const void *, const void *),
+                                 iThreadPool *pool);
+
 
 void        setN_Array      (iArray *, size_t pos, const void *value, size_t count);
 void        pushBackN_Array (iArray *, const void *value, size_t count);
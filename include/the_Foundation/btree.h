@@ -0,0 +1,118 @@
+#pragma once
+
+/** @file the_Foundation/btree.h  Ordered map of integer keys stored in a B+tree.
+
+BTree is an alternative to Map for large, read-heavy ordered indexes. Keys are stored
+contiguously in wide nodes, so a lookup touches only a few cache lines per level instead of
+following a pointer for every comparison. All key/value pairs are in the leaves, which are
+linked for fast in-order and reverse scans.
+
+BTree does not have ownership of the values. A value is an arbitrary non-NULL pointer.
+
+@authors Copyright (c) 2021 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+@par License
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+<small>THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
+*/
+
+#include "map.h"
+
+iBeginPublic
+
+iDeclareType(BTree)
+iDeclareType(BTreeNode)
+
+struct Impl_BTree {
+    size_t size;
+    iBTreeNode *root;
+    iMapNodeCmpFunc cmp;
+};
+
+/**
+ * Constructs an empty tree.
+ *
+ * @param cmp  Key comparison function. Set to NULL to compare the keys as integers, which
+ *             avoids a function call per comparison.
+ */
+iDeclareTypeConstructionArgs(BTree, iMapNodeCmpFunc cmp)
+
+iLocalDef size_t    size_BTree      (const iBTree *d) { return d->size; }
+iLocalDef iBool     isEmpty_BTree   (const iBTree *d) { return size_BTree(d) == 0; }
+
+iBool       contains_BTree  (const iBTree *, iMapKey key);
+void *      value_BTree     (const iBTree *, iMapKey key);
+
+void        clear_BTree     (iBTree *);
+
+/**
+ * Inserts a value into the tree.
+ *
+ * @param key    Key of the value.
+ * @param value  Value to insert. Must not be NULL. Ownership not taken.
+ *
+ * @return Previous value with the same key that was replaced, or NULL. The caller should
+ * delete the value or take any other necessary actions, since it is no longer in the tree.
+ */
+void *      insert_BTree    (iBTree *, iMapKey key, void *value);
+
+void *      remove_BTree    (iBTree *, iMapKey key);
+
+/** @name Iterators */
+///@{
+iDeclareIterator(BTree, iBTree *)
+void *remove_BTreeIterator(iBTreeIterator *d);
+void *remove_BTreeReverseIterator(iBTreeReverseIterator *d);
+struct IteratorImpl_BTree {
+    void *value;
+    iMapKey key;
+    iBTree *tree;
+    iBTreeNode *leaf;
+    int pos;
+};
+
+iDeclareConstIterator(BTree, const iBTree *)
+struct ConstIteratorImpl_BTree {
+    const void *value;
+    iMapKey key;
+    const iBTree *tree;
+    const iBTreeNode *leaf;
+    int pos;
+};
+
+/**
+ * Range queries. A forward iterator initialized with a lower bound starts from the first
+ * key that is not less than @a key, and with an upper bound from the first key that is
+ * greater than @a key. Like in reversed C++ iterators, a reverse iterator starts from the
+ * key preceding that position, i.e., the last key less than @a key (lower bound) or not
+ * greater than @a key (upper bound).
+ */
+void    initLowerBound_BTreeIterator                (iBTreeIterator *, iBTree *, iMapKey key);
+void    initUpperBound_BTreeIterator                (iBTreeIterator *, iBTree *, iMapKey key);
+void    initLowerBound_BTreeConstIterator           (iBTreeConstIterator *, const iBTree *, iMapKey key);
+void    initUpperBound_BTreeConstIterator           (iBTreeConstIterator *, const iBTree *, iMapKey key);
+void    initLowerBound_BTreeReverseIterator         (iBTreeReverseIterator *, iBTree *, iMapKey key);
+void    initUpperBound_BTreeReverseIterator         (iBTreeReverseIterator *, iBTree *, iMapKey key);
+void    initLowerBound_BTreeReverseConstIterator    (iBTreeReverseConstIterator *, const iBTree *, iMapKey key);
+void    initUpperBound_BTreeReverseConstIterator    (iBTreeReverseConstIterator *, const iBTree *, iMapKey key);
+///@}
+
+iEndPublic
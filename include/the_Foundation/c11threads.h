@@ -33,6 +33,10 @@ typedef pthread_cond_t cnd_t;
 typedef pthread_key_t tss_t;
 typedef pthread_once_t once_flag;
 
+#if defined (iHavePThread)
+#  define ONCE_FLAG_INIT PTHREAD_ONCE_INIT
+#endif
+
 typedef int (*thrd_start_t)(void*);
 typedef void (*tss_dtor_t)(void*);
 
@@ -0,0 +1,116 @@
+#pragma once
+
+/** @file the_Foundation/concurrenthash.h  Thread-safe hash of objects with Block keys.
+
+ConcurrentHash can be shared by many threads without external locking. The keys are
+divided into shards by their hash, and each shard has its own lock, so threads working
+on different keys rarely wait for each other. Lookups return a new reference to the
+value, so the value stays valid even if another thread removes it from the hash.
+
+Unlike BlockHash, the keys are compared in full: different keys with the same hash are
+stored separately.
+
+@authors Copyright (c) 2021 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+@par License
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+<small>THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
+*/
+
+#include "block.h"
+#include "object.h"
+#include "string.h"
+
+iBeginPublic
+
+iDeclareClass(ConcurrentHash)
+iDeclareType(ConcurrentHashShard)
+
+/**
+ * Creates a value for a key that is missing from the hash.
+ *
+ * @return New value object. The hash takes ownership of the returned reference.
+ */
+typedef iAnyObject *(*iConcurrentHashCreateFunc)(const iBlock *key, void *context);
+
+struct Impl_ConcurrentHash {
+    iObject object;
+    iConcurrentHashShard *shards; /* aligned to a cache line within `shardMemory` */
+    void *shardMemory;
+};
+
+iDeclareObjectConstruction(ConcurrentHash)
+
+/** Number of elements in the hash. Other threads may change it at any time. */
+size_t      size_ConcurrentHash     (const iConcurrentHash *);
+
+iBool       contains_ConcurrentHash (const iConcurrentHash *, const iBlock *key);
+
+/**
+ * Looks up a value.
+ *
+ * @return Value object with a new reference added, or NULL if the key is not in the hash.
+ * The caller must release the reference.
+ */
+iAnyObject *value_ConcurrentHash    (const iConcurrentHash *, const iBlock *key);
+
+/**
+ * Looks up a value, creating and inserting it if the key is not in the hash yet.
+ * @a create is called at most once per missing key, even if several threads look up the
+ * same key at the same time. It is called while the key's shard is locked, so it must
+ * not access the same hash.
+ *
+ * @return Value object with a new reference added. The caller must release the reference.
+ */
+iAnyObject *valueOrCreate_ConcurrentHash(iConcurrentHash *, const iBlock *key,
+                                         iConcurrentHashCreateFunc create, void *context);
+
+/**
+ * Inserts a value. The hash holds a reference to the value. An existing value with the
+ * same key is replaced and released.
+ *
+ * @return @c iTrue, if a new key was added. @c iFalse, if an existing value was replaced.
+ */
+iBool       insert_ConcurrentHash   (iConcurrentHash *, const iBlock *key, const iAnyObject *value);
+
+iBool       remove_ConcurrentHash   (iConcurrentHash *, const iBlock *key);
+void        clear_ConcurrentHash    (iConcurrentHash *);
+
+iLocalDef iBool containsString_ConcurrentHash(const iConcurrentHash *d, const iString *key) {
+    return contains_ConcurrentHash(d, &key->chars);
+}
+iLocalDef iAnyObject *valueString_ConcurrentHash(const iConcurrentHash *d, const iString *key) {
+    return value_ConcurrentHash(d, &key->chars);
+}
+iLocalDef iAnyObject *valueOrCreateString_ConcurrentHash(iConcurrentHash *d, const iString *key,
+                                                         iConcurrentHashCreateFunc create,
+                                                         void *context) {
+    return valueOrCreate_ConcurrentHash(d, &key->chars, create, context);
+}
+iLocalDef iBool insertString_ConcurrentHash(iConcurrentHash *d, const iString *key,
+                                            const iAnyObject *value) {
+    return insert_ConcurrentHash(d, &key->chars, value);
+}
+iLocalDef iBool removeString_ConcurrentHash(iConcurrentHash *d, const iString *key) {
+    return remove_ConcurrentHash(d, &key->chars);
+}
+
+iEndPublic
@@ -0,0 +1,87 @@
+#pragma once
+
+/** @file the_Foundation/cpu.h  CPU feature detection for choosing SIMD code paths.
+
+The library is built for a baseline instruction set. Its performance-critical kernels
+have variants for wider instruction sets, and the variant is chosen at runtime based on
+the features of the CPU the program is running on.
+
+@authors Copyright (c) 2021 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+@par License
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+<small>THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
+*/
+
+#include "defs.h"
+
+iBeginPublic
+
+iDeclareType(String)
+
+#if (defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))) || \
+    (defined (_MSC_VER) && (defined (_M_X64) || defined (_M_IX86)))
+#   define iHaveCpuDispatch
+#   if defined (__GNUC__)
+        /* Compiles a function for a specific instruction set, e.g., "avx2". */
+#       define iCpuTarget(isa)  __attribute__((target(isa)))
+#   else
+#       define iCpuTarget(isa)
+#   endif
+#endif
+
+enum iCpuFeature {
+    sse2_CpuFeature     = iBit(1),
+    sse41_CpuFeature    = iBit(2),
+    sse42_CpuFeature    = iBit(3),
+    pclmul_CpuFeature   = iBit(4),
+    avx_CpuFeature      = iBit(5),
+    fma_CpuFeature      = iBit(6),
+    avx2_CpuFeature     = iBit(7),
+    avx512f_CpuFeature  = iBit(8),
+    avx512bw_CpuFeature = iBit(9),
+    sha_CpuFeature      = iBit(10),
+    all_CpuFeature      = 0x3ff,
+};
+
+int             features_Cpu        (void); /* detected and enabled */
+int             detectedFeatures_Cpu(void);
+
+iLocalDef iBool has_Cpu(enum iCpuFeature feature) {
+    return (features_Cpu() & feature) == (int) feature;
+}
+
+/**
+ * Limits the features that the library's kernels may use. Detected features that are
+ * not in @a enabled are ignored, so the narrower code paths can be tested and compared
+ * on a capable CPU. Use all_CpuFeature to enable everything again.
+ */
+void            setEnabledFeatures_Cpu(int enabled);
+
+/**
+ * Returns the name of the widest instruction set used by the kernels: "avx2", "sse4.1",
+ * "sse2", or "generic".
+ */
+const char *    kernelPath_Cpu      (void);
+
+iString *       describe_Cpu        (void);
+
+iEndPublic
@@ -0,0 +1,167 @@
+#pragma once
+
+/** @file the_Foundation/digest.h  Message digests and content hashes.
+
+@authors Copyright (c) 2021 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+@par License
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+<small>THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
+*/
+
+#include "defs.h"
+
+iBeginPublic
+
+/* Forward declarations */
+iDeclareType(Block)
+iDeclareType(Stream)
+iDeclareType(ThreadPool)
+
+/*
+ * Incremental hashing: initialize a context, feed it any number of updates, and finally
+ * write out the digest. The context must be initialized again before it is reused.
+ */
+
+iDeclareType(Md5Context)
+iDeclareType(Sha1Context)
+iDeclareType(Sha256Context)
+iDeclareType(Blake3Context)
+
+struct Impl_Md5Context {
+    uint32_t state[4];
+    uint32_t count[2]; /* bits */
+    uint8_t  buffer[64];
+};
+
+struct Impl_Sha1Context {
+    uint32_t state[5];
+    uint64_t count; /* bytes */
+    uint8_t  buffer[64];
+};
+
+struct Impl_Sha256Context {
+    uint32_t state[8];
+    uint64_t count; /* bytes */
+    uint8_t  buffer[64];
+};
+
+struct Impl_Blake3Context {
+    uint32_t key[8];
+    uint32_t chunkCv[8];
+    uint64_t chunkCounter;
+    uint8_t  block[64];
+    uint8_t  blockLen;
+    uint8_t  blocksCompressed;
+    uint8_t  stackLen;
+    uint32_t stack[54][8]; /* chaining values of completed subtrees */
+};
+
+void    init_Md5Context         (iMd5Context *);
+void    update_Md5Context       (iMd5Context *, const void *data, size_t size);
+void    final_Md5Context        (iMd5Context *, uint8_t md5_out[16]);
+
+void    init_Sha1Context        (iSha1Context *);
+void    update_Sha1Context      (iSha1Context *, const void *data, size_t size);
+void    final_Sha1Context       (iSha1Context *, uint8_t sha1_out[20]);
+
+void    init_Sha256Context      (iSha256Context *);
+void    update_Sha256Context    (iSha256Context *, const void *data, size_t size);
+void    final_Sha256Context     (iSha256Context *, uint8_t sha256_out[32]);
+
+/**
+ * BLAKE3 is much faster than the other algorithms, especially with SIMD instructions, so
+ * it is the best choice for content hashes and checksums of large files. The input is
+ * hashed as a tree of 1 KB chunks, which allows hashing separate parts of the input
+ * in parallel without changing the result.
+ */
+void    init_Blake3Context      (iBlake3Context *);
+void    update_Blake3Context    (iBlake3Context *, const void *data, size_t size);
+void    final_Blake3Context     (const iBlake3Context *, uint8_t blake3_out[32]);
+
+/**
+ * Hashes a large amount of data using the threads of @a pool. The result is the same as
+ * with update_Blake3Context().
+ */
+void    updateParallel_Blake3Context(iBlake3Context *, const void *data, size_t size,
+                                     iThreadPool *pool);
+
+/*-------------------------------------------------------------------------------------*/
+
+enum iDigestAlgorithm {
+    md5_DigestAlgorithm,
+    sha1_DigestAlgorithm,
+    sha256_DigestAlgorithm,
+    blake3_DigestAlgorithm,
+};
+
+#define iDigestMaxSize  32
+
+size_t  size_DigestAlgorithm    (enum iDigestAlgorithm);
+const char *name_DigestAlgorithm(enum iDigestAlgorithm);
+
+/**
+ * Incremental hashing with any of the supported algorithms.
+ */
+iDeclareType(Digest)
+iDeclareTypeConstructionArgs(Digest, enum iDigestAlgorithm algorithm)
+
+struct Impl_Digest {
+    enum iDigestAlgorithm algorithm;
+    union {
+        iMd5Context    md5;
+        iSha1Context   sha1;
+        iSha256Context sha256;
+        iBlake3Context blake3;
+    } context;
+};
+
+void        reset_Digest        (iDigest *);
+void        update_Digest       (iDigest *, const void *data, size_t size);
+void        updateBlock_Digest  (iDigest *, const iBlock *data);
+
+/**
+ * Hashes everything that can be read from a stream, for example an iFile. The data is
+ * read in fixed-size pieces, so the stream does not need to fit in memory.
+ *
+ * @param pool  Thread pool for hashing in parallel. Only BLAKE3 can be computed in
+ *              parallel; the other algorithms ignore this. Can be NULL.
+ *
+ * @return Number of bytes read.
+ */
+size_t      updateStream_Digest (iDigest *, iStream *stream, iThreadPool *pool);
+
+/**
+ * Writes out the digest, which is size_DigestAlgorithm() bytes long. The context is
+ * reset afterwards.
+ */
+void        final_Digest        (iDigest *, uint8_t *digest_out);
+iBlock *    finalBlock_Digest   (iDigest *);
+
+iLocalDef enum iDigestAlgorithm algorithm_Digest(const iDigest *d) {
+    return d->algorithm;
+}
+
+iLocalDef size_t size_Digest(const iDigest *d) {
+    return size_DigestAlgorithm(d->algorithm);
+}
+
+iEndPublic
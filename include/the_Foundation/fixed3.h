@@ -64,7 +64,7 @@ iLocalDef iFixed3 initv_X3(const iFixed *v) {
 }
 
 iLocalDef iFixed3 zero_X3(void) {
-    return (iFixed3){ .x = { 0 } };
+    return init1_X3(zero_Fixed());
 }
 
 iLocalDef iFixed3 one_X3(void) {
@@ -171,3 +171,20 @@ iLocalDef iFixed3 sqrt_X3(const iFixed3 a) {
 iLocalDef iFixed3 mix_X3(const iFixed3 a, const iFixed3 b, const iFixed t) {
     return add_X3(a, mul_X3(sub_X3(b, a), init1_X3(t)));
 }
+
+/*-------------------------------------------------------------------------------------*/
+
+/* Bulk operations over arrays of vectors. SIMD instructions are used when the CPU supports
+   them, and the results are always exactly the same as with the per-vector operations
+   above. Output arrays may be the input arrays. */
+
+iBeginPublic
+
+void    addArray_X3         (const iFixed3 *a, const iFixed3 *b, size_t count, iFixed3 *out);
+void    subArray_X3         (const iFixed3 *a, const iFixed3 *b, size_t count, iFixed3 *out);
+void    mulArray_X3         (const iFixed3 *a, const iFixed3 *b, size_t count, iFixed3 *out);
+void    mixArray_X3         (const iFixed3 *a, const iFixed3 *b, iFixed t, size_t count, iFixed3 *out);
+void    lengthArray_X3      (const iFixed3 *vecs, size_t count, iFixed *lengths_out);
+void    normalizeArray_X3   (const iFixed3 *vecs, size_t count, iFixed3 *vecs_out);
+
+iEndPublic
@@ -47,6 +47,10 @@ iIntSet *   newCmp_IntSet   (iIntSetCompareFunc cmp);
 
 void        initCmp_IntSet  (iIntSet *, iIntSetCompareFunc cmp);
 
+/** Constructs an IntSet from an unsorted buffer of values (for instance, the data of an
+    iArray of ints). See insertN_IntSet(). */
+iIntSet *   newN_IntSet     (const int *values, size_t count);
+
 iBool       contains_IntSet (const iIntSet *, int value);
 iBool       locate_IntSet   (const iIntSet *, int value, size_t *pos_out);
 int         at_IntSet       (const iIntSet *, size_t pos);
@@ -61,6 +65,17 @@ iLocalDef void  clear_IntSet  (iIntSet *d) { clear_SortedArray(d); }
 iBool       insert_IntSet   (iIntSet *, int value);
 iBool       remove_IntSet   (iIntSet *, int value);
 
+/**
+ * Inserts many values at once. The values may be in any order and contain duplicates.
+ * With the default comparison function the values are radix sorted, otherwise
+ * insertN_SortedArray() is used.
+ */
+void        insertN_IntSet  (iIntSet *, const int *values, size_t count);
+
+/** Inserts all the values of @a other in O(n + m) time. Both sets must use the same
+    comparison function. */
+void        merge_IntSet    (iIntSet *, const iIntSet *other);
+
 /** @name Iterators */
 ///@{
 iDeclareIterator(IntSet, iIntSet *)
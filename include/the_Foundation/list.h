@@ -77,8 +77,16 @@ iAny *      popFront_List       (iList *);
 iAny *      popBack_List        (iList *);
 
 typedef int (*iListCompareFunc)(const iAny *, const iAny *);
-
+typedef int (*iListCompareContextFunc)(const iAny *, const iAny *, void *context);
+
+/**
+ * Sorts the nodes of the list. This is a stable merge sort that takes O(n log n) time
+ * and no additional memory. Already sorted input is handled in linear time.
+ *
+ * @param cmp  Compares two nodes.
+ */
 void        sort_List           (iList *, iListCompareFunc cmp);
+void        sortContext_List    (iList *, iListCompareContextFunc cmp, void *context);
 
 /** @name Iterators */
 ///@{
@@ -56,6 +56,7 @@ struct Impl_MapNode {
     iMapNode *parent;
     iMapNode *child[2];
     int flags;
+    size_t count; /* nodes in the subtree */
     iMapKey key;
 };
 
@@ -67,6 +68,33 @@ iLocalDef iBool     isEmpty_Map (const iMap *d) { return size_Map(d) == 0; }
 iBool       contains_Map    (const iMap *, iMapKey key);
 iMapNode *  value_Map       (const iMap *, iMapKey key);
 
+/**
+ * Finds the node with the largest key that is not greater than @a key.
+ *
+ * @return Node, or NULL if all keys are greater than @a key.
+ */
+iMapNode *  floor_Map       (const iMap *, iMapKey key);
+
+/**
+ * Finds the node with the smallest key that is not less than @a key.
+ *
+ * @return Node, or NULL if all keys are less than @a key.
+ */
+iMapNode *  ceiling_Map     (const iMap *, iMapKey key);
+
+/**
+ * Returns the number of nodes whose key is less than @a key. Takes O(log n) time.
+ * The number of keys in a range [a, b) is `rank_Map(d, b) - rank_Map(d, a)`.
+ */
+size_t      rank_Map        (const iMap *, iMapKey key);
+
+/**
+ * Returns the node at position @a pos in key order. Takes O(log n) time.
+ *
+ * @return Node, or NULL if @a pos is not less than the size of the map.
+ */
+iMapNode *  at_Map          (const iMap *, size_t pos);
+
 void        clear_Map   (iMap *);
 
 /**
@@ -101,6 +129,22 @@ struct ConstIteratorImpl_Map {
     const iMapNode *value;
     const iMap *map;
 };
+
+/**
+ * Range queries. A forward iterator initialized with a lower bound starts from the first
+ * key that is not less than @a key, and with an upper bound from the first key that is
+ * greater than @a key. A reverse iterator starts from the key preceding that position,
+ * i.e., the last key less than @a key (lower bound) or not greater than @a key (upper
+ * bound).
+ */
+void    initLowerBound_MapIterator              (iMapIterator *, iMap *, iMapKey key);
+void    initUpperBound_MapIterator              (iMapIterator *, iMap *, iMapKey key);
+void    initLowerBound_MapConstIterator         (iMapConstIterator *, const iMap *, iMapKey key);
+void    initUpperBound_MapConstIterator         (iMapConstIterator *, const iMap *, iMapKey key);
+void    initLowerBound_MapReverseIterator       (iMapReverseIterator *, iMap *, iMapKey key);
+void    initUpperBound_MapReverseIterator       (iMapReverseIterator *, iMap *, iMapKey key);
+void    initLowerBound_MapReverseConstIterator  (iMapReverseConstIterator *, const iMap *, iMapKey key);
+void    initUpperBound_MapReverseConstIterator  (iMapReverseConstIterator *, const iMap *, iMapKey key);
 ///@}
 
 iEndPublic
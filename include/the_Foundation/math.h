@@ -97,6 +97,33 @@ void    perspective_Mat4(iMat4 *, float xFovDeg, float aspect, float znear, floa
 void    frame_Mat4      (iMat4 *, iFloat3 front, iFloat3 up, iBool mirror);
 void    lookAt_Mat4     (iMat4 *, iFloat3 target, iFloat3 eyePos, iFloat3 up);
 
+/*-------------------------------------------------------------------------------------*/
+
+/* Bulk operations over arrays of vectors. The widest SIMD instruction set supported by
+   the CPU is chosen at runtime, and every code path gives the same results as the
+   per-vector operations evaluated left to right. Output arrays may be the input arrays. */
+
+iDeclareType(Float3Soa)
+
+/* Three-component vectors stored as separate component arrays (structure of arrays). */
+struct Impl_Float3Soa {
+    float *x;
+    float *y;
+    float *z;
+};
+
+void    mulArray_Mat4F3 (const iMat4 *, const iFloatVec3 *points, size_t count, iFloatVec3 *points_out);
+void    mulArray_Mat4F4 (const iMat4 *, const iFloatVec4 *vecs, size_t count, iFloatVec4 *vecs_out);
+void    mulSoa_Mat4F3   (const iMat4 *, const iFloat3Soa *points, size_t count, const iFloat3Soa *points_out);
+
+void    dotSoa_F3       (const iFloat3Soa *a, const iFloat3Soa *b, size_t count, float *dots_out);
+void    crossSoa_F3     (const iFloat3Soa *a, const iFloat3Soa *b, size_t count, const iFloat3Soa *cross_out);
+void    normalizeSoa_F3 (const iFloat3Soa *vecs, size_t count, const iFloat3Soa *vecs_out);
+
+/* Bounding box of the points. Both corners are zero if there are no points. */
+void    boundsArray_F3  (const iFloatVec3 *points, size_t count, iFloatVec3 *min_out, iFloatVec3 *max_out);
+void    boundsSoa_F3    (const iFloat3Soa *points, size_t count, iFloatVec3 *min_out, iFloatVec3 *max_out);
+
 #include "vec2.h"
 
 iEndPublic
@@ -31,12 +31,31 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
 
 /* Forward declarations */
 iDeclareType(Stream)
+iDeclareType(ThreadPool)
 
 iDeclareType(Noise)
 iDeclareTypeConstructionArgs(Noise, iInt2 size)
 iDeclareTypeSerialization(Noise)
 
-float   eval_Noise  (const iNoise *, float normX, float normY);
+float   eval_Noise      (const iNoise *, float normX, float normY);
+
+/**
+ * Evaluates the noise at @a count points. The coordinates are given as separate arrays
+ * (structure of arrays), and several points are evaluated at once using SIMD instructions
+ * when available. The results are the same as from eval_Noise().
+ */
+void    evalArray_Noise (const iNoise *, const float *normX, const float *normY, size_t count,
+                         float *values_out);
+
+/**
+ * Fills a grid of samples covering the normalized range [0, 1) on both axes. The sample
+ * at (x, y) is evaluated at (x / gridSize.x, y / gridSize.y) and stored at
+ * `values_out[y * gridSize.x + x]`.
+ *
+ * @param pool  Thread pool for evaluating the rows in parallel. Can be NULL, in which case
+ *              the calling thread evaluates everything.
+ */
+void    evalGrid_Noise  (const iNoise *, iInt2 gridSize, float *values_out, iThreadPool *pool);
 
 /*-----------------------------------------------------------------------------------------------*/
 
@@ -53,6 +72,10 @@ iDeclareTypeConstructionArgs(CombinedNoise, const iNoiseComponent *components, s
 iDeclareTypeSerialization(CombinedNoise)
 
 float       eval_CombinedNoise          (const iCombinedNoise *, float normX, float normY);
+void        evalArray_CombinedNoise     (const iCombinedNoise *, const float *normX,
+                                         const float *normY, size_t count, float *values_out);
+void        evalGrid_CombinedNoise      (const iCombinedNoise *, iInt2 gridSize, float *values_out,
+                                         iThreadPool *pool); /* see evalGrid_Noise() */
 iFloat3     randomCoord_CombinedNoise   (const iCombinedNoise *, iBool (*rangeCheck)(float));
 
 void        setOffset_CombinedNoise     (iCombinedNoise *, size_t index, float offset);
@@ -81,6 +81,15 @@ void            removeNode_ObjectList   (iObjectList *, iObjectListNode *node);
 void            popFront_ObjectList     (iObjectList *);
 void            popBack_ObjectList      (iObjectList *);
 
+typedef int (*iObjectListCompareFunc)(const iAnyObject *, const iAnyObject *);
+
+/**
+ * Sorts the list in place with a stable merge sort (see sort_List()).
+ *
+ * @param cmp  Compares two objects of the list.
+ */
+void            sort_ObjectList         (iObjectList *, iObjectListCompareFunc cmp);
+
 /**
  * Pops the front object. Caller is responsible for releasing the returned object.
  */
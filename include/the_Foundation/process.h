@@ -28,6 +28,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
 */
 
 #include "object.h"
+#include "audience.h"
 #include <sys/types.h>
 
 #if defined (iPlatformWindows)
@@ -41,10 +42,18 @@ iBeginPublic
 iDeclareType(String)
 iDeclareType(StringList)
 iDeclareType(Block)
+iDeclareType(Stream)
 
 iDeclareClass(Process)
 iDeclareObjectConstruction(Process)
 
+iDeclareNotifyFuncArgs(Process, OutputReceived, const iBlock *data)
+iDeclareNotifyFuncArgs(Process, ErrorReceived, const iBlock *data)
+iDeclareNotifyFuncArgs(Process, Finished, int exitStatus)
+iDeclareAudienceGetter(Process, outputReceived)
+iDeclareAudienceGetter(Process, errorReceived)
+iDeclareAudienceGetter(Process, finished)
+
 void        setArguments_Process        (iProcess *, const iStringList *args);
 void        setEnvironment_Process      (iProcess *, const iStringList *env); /* additions to environ; "name=value" */
 void        setWorkingDirectory_Process (iProcess *, const iString *cwd);
@@ -60,6 +69,34 @@ iBlock *    readError_Process       (iProcess *);
 
 iBlock *    readOutputUntilClosed_Process   (iProcess *); /* blocking */
 
+/**
+ * Sets the stream that is fed to the child's standard input after startAsync_Process().
+ * The stream is read in chunks only when the child is ready to accept more input, and
+ * the child's stdin is closed when the end of the stream is reached. The Process keeps
+ * a reference to the stream until then.
+ */
+void        setInput_Process        (iProcess *, iStream *input);
+
+/**
+ * Starts the process and hands its I/O to a background thread shared by all
+ * asynchronously running processes. Output is delivered in chunks via the
+ * outputReceived and errorReceived audiences (in the I/O thread); if no one is observing,
+ * it is buffered for readOutput_Process() and readError_Process(). The finished audience
+ * is notified after both output streams have closed and the child has exited.
+ *
+ * If no input stream has been set with setInput_Process(), the child's standard input
+ * is closed right away so it sees end-of-file.
+ *
+ * The Process is kept alive until it has finished.
+ */
+iBool       startAsync_Process      (iProcess *);
+
+/**
+ * Exit status of a process started with startAsync_Process(), or -1 if it has not
+ * finished yet or was terminated by a signal.
+ */
+int         exitStatus_Process      (const iProcess *);
+
 iLocalDef iProcessId currentId_Process(void) {
     return pid_Process(NULL);
 }
@@ -0,0 +1,150 @@
+#pragma once
+
+/** @file the_Foundation/promise.h  Value-carrying promise with continuations.
+
+A Promise is a placeholder for an object that becomes available later. Instead of waiting
+for the value in a blocked thread, continuations can be attached with then_Promise(): they
+are called when the value is ready, optionally as jobs in a thread pool, and each returns
+a new Promise for its own result. This lets a pipeline of stages flow through a pool
+without any thread sleeping between the stages.
+
+A Promise is settled once, either fulfilled with a value or canceled. Cancellation
+propagates to all the promises that depend on a canceled one, and their continuations are
+not called.
+
+@authors Copyright (c) 2021 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+@par License
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+<small>THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
+*/
+
+#include "object.h"
+
+iBeginPublic
+
+iDeclareClass(Promise)
+iDeclareType(ThreadPool)
+
+enum iPromiseState {
+    pending_PromiseState,
+    fulfilled_PromiseState,
+    canceled_PromiseState,
+};
+
+/**
+ * Produces the value of a promise created with newRun_Promise(). Long-running work can
+ * check isCanceled_Promise() to stop early.
+ *
+ * @return New reference to the value object, or NULL. The promise takes the reference.
+ */
+typedef iAnyObject *(*iPromiseRunFunc)(iPromise *promise, void *context);
+
+/**
+ * Continuation called with the value of a fulfilled promise.
+ *
+ * @return New reference to the value object of the continuation's promise, or NULL.
+ * The promise takes the reference. If the returned object is itself a Promise, the
+ * continuation's promise is settled the same way as that one when it is settled.
+ */
+typedef iAnyObject *(*iPromiseThenFunc)(const iAnyObject *value, void *context);
+
+/**
+ * Called when a promise has been settled, either fulfilled or canceled.
+ */
+typedef void (*iPromiseSettledFunc)(iPromise *promise, void *context);
+
+iDeclareObjectConstruction(Promise)
+
+/**
+ * Creates a promise whose value is produced by calling @a func as a job in @a pool.
+ */
+iPromise *  newRun_Promise      (iThreadPool *pool, iPromiseRunFunc func, void *context);
+
+/**
+ * Creates a promise that is fulfilled when all of the given promises are fulfilled, or
+ * canceled as soon as one of them is canceled. The value is an ObjectList of the given
+ * promises, in the same order.
+ *
+ * The group does not keep pending promises alive: a promise whose last reference is
+ * released before it is fulfilled is canceled, and so is the group.
+ */
+iPromise *  newAll_Promise      (iPromise * const *promises, size_t count);
+
+/**
+ * Creates a promise that is fulfilled with the value of the first of the given promises
+ * to be fulfilled. It is canceled if all of them are canceled.
+ */
+iPromise *  newAny_Promise      (iPromise * const *promises, size_t count);
+
+enum iPromiseState state_Promise(const iPromise *);
+
+iLocalDef iBool isSettled_Promise(const iPromise *d) {
+    return state_Promise(d) != pending_PromiseState;
+}
+iLocalDef iBool isCanceled_Promise(const iPromise *d) {
+    return state_Promise(d) == canceled_PromiseState;
+}
+
+/**
+ * Returns the value of a fulfilled promise, or NULL if the promise is not fulfilled.
+ */
+const iAnyObject *value_Promise (const iPromise *);
+
+/**
+ * Fulfills the promise. Continuations are called before this returns, or queued in
+ * their thread pools.
+ *
+ * @param value  Value object. The promise holds a reference to it. May be NULL.
+ *
+ * @return @c iTrue, if the promise was fulfilled. @c iFalse, if it had already been
+ * settled, for example canceled.
+ */
+iBool       fulfill_Promise     (iPromise *, const iAnyObject *value);
+
+/**
+ * Cancels the promise and all promises that depend on it, unless already settled.
+ */
+iBool       cancel_Promise      (iPromise *);
+
+/**
+ * Calls @a func with the value when the promise is fulfilled.
+ *
+ * @param pool  Thread pool where @a func is called. If NULL, @a func is called in the
+ *              thread that fulfills the promise, or right away if it is already fulfilled.
+ *
+ * @return Promise for the value returned by @a func. Caller gets a reference.
+ */
+iPromise *  then_Promise        (iPromise *, iThreadPool *pool, iPromiseThenFunc func,
+                                 void *context);
+
+/**
+ * Calls @a func when the promise is settled, in the thread that settles it. If the promise
+ * is already settled, @a func is called right away.
+ */
+void        whenSettled_Promise (iPromise *, iPromiseSettledFunc func, void *context);
+
+/**
+ * Blocks until the promise is settled. Prefer continuations in pooled threads.
+ */
+enum iPromiseState wait_Promise (const iPromise *);
+
+iEndPublic
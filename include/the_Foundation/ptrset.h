@@ -58,6 +58,17 @@ iLocalDef void *    back_PtrSet   (const iPtrSet *d) { return at_PtrSet(d, size_
 iBool       insert_PtrSet   (iPtrSet *, const void *ptr);
 iBool       remove_PtrSet   (iPtrSet *, const void *ptr);
 
+/**
+ * Inserts many pointers at once. The pointers may be in any order and contain duplicates.
+ * With the default comparison function the pointers are radix sorted, otherwise
+ * insertN_SortedArray() is used.
+ */
+void        insertN_PtrSet  (iPtrSet *, const void * const *ptrs, size_t count);
+
+/** Inserts all the pointers of @a other in O(n + m) time. Both sets must use the same
+    comparison function. */
+void        merge_PtrSet    (iPtrSet *, const iPtrSet *other);
+
 iLocalDef void  clear_PtrSet    (iPtrSet *d) { clear_SortedArray(d); }
 
 void        serializeObjects_PtrSet     (const iPtrSet *, iStream *);
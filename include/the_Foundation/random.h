@@ -31,11 +31,63 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
 
 iBeginPublic
 
-/* Note: As with Range, `start` is inclusive and `end` is exclusive. */
+/* Note: As with Range, `start` is inclusive and `end` is exclusive. The functions use
+   the calling thread's default engine (see current_RandomEngine()). */
 
 int         iRandom (int start, int end);
 unsigned    iRandomu(unsigned start, unsigned end);
 size_t      iRandoms(size_t start, size_t end);
 float       iRandomf(void);
 
+/*-------------------------------------------------------------------------------------*/
+
+/**
+ * Seedable xoshiro256** generator. The engine runs four lanes that start 2^128 values
+ * apart from each other, and the output cycles through them. The lanes can therefore be
+ * advanced together with SIMD instructions when filling arrays, and a bulk fill produces
+ * exactly the same values as calling next_RandomEngine() repeatedly.
+ *
+ * Engines are not thread-safe. Each thread has its own default engine, split off a shared
+ * engine seeded from the clock. For deterministic parallel work, seed one engine and use
+ * split_RandomEngine() to give each task a stream of its own.
+ */
+iDeclareType(RandomEngine)
+iDeclareTypeConstructionArgs(RandomEngine, uint64_t seed)
+
+struct Impl_RandomEngine {
+    uint64_t state[4][4]; /* [word][lane] */
+    unsigned lane;        /* produces the next value */
+};
+
+void        seed_RandomEngine       (iRandomEngine *, uint64_t seed);
+uint64_t    next_RandomEngine       (iRandomEngine *);
+uint32_t    nextU32_RandomEngine    (iRandomEngine *);
+float       nextf_RandomEngine      (iRandomEngine *); /* [0, 1) with 24 bits */
+double      nextd_RandomEngine      (iRandomEngine *); /* [0, 1) with 53 bits */
+
+/**
+ * Returns a uniformly distributed value in the range [0, @a bound). The value is not biased
+ * toward any part of the range: draws that would cause a bias are rejected.
+ */
+uint64_t    bounded_RandomEngine    (iRandomEngine *, uint64_t bound);
+int         range_RandomEngine      (iRandomEngine *, int start, int end);
+
+/**
+ * Advances the engine by 2^192 values. This is equivalent to generating that many values,
+ * so streams that have been jumped a different number of times never overlap.
+ */
+void        jump_RandomEngine       (iRandomEngine *);
+
+/**
+ * Initializes @a split_out with the current state of the engine and jumps the engine
+ * forward. The two continue as independent streams.
+ */
+void        split_RandomEngine      (iRandomEngine *, iRandomEngine *split_out);
+
+void        fill_RandomEngine       (iRandomEngine *, uint64_t *values, size_t count);
+void        fillf_RandomEngine      (iRandomEngine *, float *values, size_t count);
+void        fillRange_RandomEngine  (iRandomEngine *, int *values, size_t count, int start, int end);
+
+iRandomEngine * current_RandomEngine(void);
+
 iEndPublic
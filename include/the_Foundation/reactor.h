@@ -0,0 +1,98 @@
+#pragma once
+
+/** @file the_Foundation/reactor.h  Event loop for file descriptors and timers.
+
+A Reactor runs a thread that waits for file descriptors to become readable or writable,
+and for timers to expire. When that happens, it calls the function given when the wait
+was registered. Any number of descriptors and timers share the one thread, so the
+callbacks should only hand the work over somewhere else, for example to a thread pool,
+instead of doing much themselves.
+
+All waits are one-shot: a callback is called once and then the registration is removed.
+
+Descriptors are watched with epoll or kqueue where available, falling back to poll(),
+and timers are kept in a heap. Starting, ending, or canceling a wait therefore does not
+depend on how many other waits are pending. A descriptor must not be closed while a wait
+on it is pending; cancel the wait first.
+
+@authors Copyright (c) 2021 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+@par License
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+<small>THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
+*/
+
+#include "object.h"
+
+iBeginPublic
+
+iDeclareClass(Reactor)
+
+enum iReactorEvent {
+    readable_ReactorEvent = 0x1,
+    writable_ReactorEvent = 0x2,
+    hangup_ReactorEvent   = 0x4, /* closed by the peer, or an error */
+    timeout_ReactorEvent  = 0x8,
+};
+
+/**
+ * Called in the reactor thread when a wait ends.
+ *
+ * @param events  Events that occurred (see iReactorEvent).
+ */
+typedef void (*iReactorFunc)(void *context, int events);
+
+iDeclareObjectConstruction(Reactor)
+
+/**
+ * Waits for a file descriptor to become readable and/or writable.
+ *
+ * @param events          readable_ReactorEvent and/or writable_ReactorEvent.
+ * @param timeoutSeconds  Maximum time to wait. Zero or less means no time limit.
+ *
+ * @return Identifier of the wait, for cancel_Reactor().
+ */
+uint32_t    watch_Reactor       (iReactor *, int fd, int events, double timeoutSeconds,
+                                 iReactorFunc func, void *context);
+
+/**
+ * Calls @a func with timeout_ReactorEvent after @a seconds have passed.
+ *
+ * @return Identifier of the timer, for cancel_Reactor().
+ */
+uint32_t    addTimer_Reactor    (iReactor *, double seconds, iReactorFunc func, void *context);
+
+/**
+ * Cancels a wait. The callback is not called after this returns, unless it was already
+ * being called in the reactor thread. This holds even if the wait has already ended
+ * during the current round of the event loop but its callback has not been called yet.
+ *
+ * @return @c iTrue, if the wait was canceled before its callback was called.
+ */
+iBool       cancel_Reactor      (iReactor *, uint32_t id);
+
+/**
+ * Determines if the calling thread is the reactor thread, i.e., the caller is one of the
+ * reactor's callbacks. Blocking there until another callback has run would deadlock.
+ */
+iBool       isCurrentThread_Reactor(const iReactor *);
+
+iEndPublic
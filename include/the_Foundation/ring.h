@@ -0,0 +1,101 @@
+#pragma once
+
+/** @file the_Foundation/ring.h  Bounded lock-free ring buffer.
+
+Ring passes fixed-size elements from producer threads to a single consumer thread. The
+elements are copied into a preallocated buffer, so unlike Queue, no objects or list nodes
+are allocated per item. Pushing and popping do not lock anything; a mutex and conditions
+are used only for putting a thread to sleep when the ring is empty or full.
+
+There may only be one consumer thread at a time. In the single-producer mode, there may
+also be only one producer thread at a time; multi-producer mode allows any number of
+producers at a small extra cost.
+
+@authors Copyright (c) 2021 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+@par License
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+<small>THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
+*/
+
+#include "defs.h"
+
+iBeginPublic
+
+iDeclareType(Ring)
+
+enum iRingMode {
+    singleProducer_RingMode = 0,
+    multiProducer_RingMode  = 1,
+};
+
+/**
+ * Constructs a ring buffer.
+ *
+ * @param elementSize  Size of one element in bytes.
+ * @param capacity     Maximum number of elements in the ring. Rounded up to a power of two.
+ * @param mode         Whether several threads may push at the same time.
+ */
+iDeclareTypeConstructionArgs(Ring, size_t elementSize, size_t capacity, enum iRingMode mode)
+
+size_t      elementSize_Ring    (const iRing *);
+size_t      capacity_Ring       (const iRing *);
+
+/** Number of elements in the ring. Other threads may change it at any time. */
+size_t      size_Ring           (const iRing *);
+
+iLocalDef iBool isEmpty_Ring(const iRing *d) {
+    return size_Ring(d) == 0;
+}
+
+iBool       tryPush_Ring        (iRing *, const void *element);
+void        push_Ring           (iRing *, const void *element);
+iBool       pushTimeout_Ring    (iRing *, const void *element, double timeoutSeconds);
+
+/**
+ * Pushes as many of the elements as there is room for, without blocking.
+ *
+ * @return Number of elements pushed, from the beginning of @a elements.
+ */
+size_t      tryPushN_Ring       (iRing *, const void *elements, size_t count);
+
+/** Pushes all the elements, blocking whenever the ring is full. */
+void        pushN_Ring          (iRing *, const void *elements, size_t count);
+
+iBool       tryPop_Ring         (iRing *, void *element_out);
+void        pop_Ring            (iRing *, void *element_out);
+iBool       popTimeout_Ring     (iRing *, void *element_out, double timeoutSeconds);
+
+/**
+ * Pops up to @a maxCount elements without blocking.
+ *
+ * @return Number of elements popped.
+ */
+size_t      tryPopN_Ring        (iRing *, void *elements_out, size_t maxCount);
+
+/**
+ * Pops up to @a maxCount elements, blocking until at least one is available.
+ *
+ * @return Number of elements popped.
+ */
+size_t      popN_Ring           (iRing *, void *elements_out, size_t maxCount);
+
+iEndPublic
@@ -35,14 +35,61 @@ iBeginPublic
 iDeclareClass(Service)
 
 iDeclareType(Socket)
+iDeclareType(TlsCertificate)
+iDeclareType(ThreadPool)
 
 iDeclareObjectConstructionArgs(Service, uint16_t port)
 
 iDeclareNotifyFuncArgs(Service, IncomingAccepted, iSocket *incoming)
 
+enum iServiceFlag {
+    reusePort_ServiceFlag   = 0x1, /* each listening thread has its own socket (SO_REUSEPORT) */
+    deferAccept_ServiceFlag = 0x2, /* accept after the client has sent data (TCP_DEFER_ACCEPT) */
+    fastOpen_ServiceFlag    = 0x4, /* allow data in the SYN (TCP_FASTOPEN) */
+};
+
+/* The following must be called before opening the service. Flags not supported by the
+   platform are ignored. */
+void    setFlags_Service            (iService *, int flags);
+void    setListenerCount_Service    (iService *, int count);
+void    setBacklog_Service          (iService *, int backlog); /* default: SOMAXCONN */
+
+/**
+ * Sets a thread pool for setting up accepted connections. By default, incomingAccepted
+ * is notified in the listening thread and no new connections are accepted until the
+ * observers return. With a pool, the notifications are done in pooled threads.
+ *
+ * Note that with multiple listeners or a pool, incomingAccepted may be notified
+ * concurrently from several threads.
+ *
+ * @param pool  Thread pool. The service holds a reference to it. Use NULL to notify
+ *              in the listening thread.
+ */
+void    setThreadPool_Service       (iService *, iThreadPool *pool);
+
+int     flags_Service               (const iService *);
+
+/**
+ * Enables TLS for incoming connections. Handshakes are performed without blocking on
+ * the I/O thread of each accepted Socket, and the Sockets passed to incomingAccepted
+ * read and write decrypted data. Must be called before opening the service.
+ *
+ * @param cert  Server certificate with a private key. Any intermediate certificates
+ *              in its chain are sent to clients as well. Use NULL to disable TLS.
+ *
+ * @return @c iTrue, if the certificate was accepted.
+ */
+iBool   setCertificate_Service  (iService *, const iTlsCertificate *cert);
+
 iBool   open_Service    (iService *);
 void    close_Service   (iService *);
 
+/**
+ * Determines if the service is accepting connections. Errors on individual connections
+ * are logged and the service keeps listening, but if the listening socket itself fails,
+ * its listeners stop with a warning. When all of them have stopped, the service is no
+ * longer open, although close_Service() may still be called as usual.
+ */
 iBool   isOpen_Service  (const iService *);
 
 iDeclareAudienceGetter(Service, incomingAccepted)
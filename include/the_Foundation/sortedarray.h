@@ -77,6 +77,29 @@ iLocalDef size_t size_SortedArray(const iSortedArray *d) {
  */
 iRanges     locateRange_SortedArray (const iSortedArray *, const void *value, iSortedArrayCompareElemFunc relaxed);
 
+/**
+ * Returns the position of the first element that is not less than @a value. This is also
+ * the rank of @a value, i.e., the number of elements less than it.
+ */
+size_t      lowerBound_SortedArray  (const iSortedArray *, const void *value);
+
+/** Returns the position of the first element that is greater than @a value. */
+size_t      upperBound_SortedArray  (const iSortedArray *, const void *value);
+
+/**
+ * Finds the last element that is not greater than @a value.
+ *
+ * @return True if there is such an element; its position is written to @a pos_out.
+ */
+iBool       floor_SortedArray       (const iSortedArray *, const void *value, size_t *pos_out);
+
+/**
+ * Finds the first element that is not less than @a value.
+ *
+ * @return True if there is such an element; its position is written to @a pos_out.
+ */
+iBool       ceiling_SortedArray     (const iSortedArray *, const void *value, size_t *pos_out);
+
 #define     at_SortedArray(d, pos)  at_Array(&(d)->values, pos)
 #define     isEmpty_SortedArray(d)  isEmpty_Array(&(d)->values)
 
@@ -99,6 +122,25 @@ iBool       remove_SortedArray  (iSortedArray *, const void *value);
  */
 iBool       insertIf_SortedArray(iSortedArray *, const void *value, iSortedArrayCompareElemFunc pred);
 
+/**
+ * Inserts many elements at once. The values do not need to be in any particular order.
+ * They are sorted and deduplicated first, and then merged with the existing elements, so
+ * building a large array this way takes O(n log n) time instead of the O(n^2) of repeated
+ * insert_SortedArray() calls. As with insert_SortedArray(), an inserted value replaces an
+ * existing equal element; of equal values in the batch, the last one is kept.
+ *
+ * @param values  Array of @a count elements.
+ * @param count   Number of elements.
+ */
+void        insertN_SortedArray (iSortedArray *, const void *values, size_t count);
+
+/**
+ * Merges a batch of values that are already sorted with the array's comparison function
+ * and contain no duplicates. Takes O(n + m) time. An inserted value replaces an existing
+ * equal element.
+ */
+void        merge_SortedArray   (iSortedArray *, const void *sortedValues, size_t count);
+
 iLocalDef void removeRange_SortedArray(iSortedArray *d, iRanges range) {
     removeRange_Array(&d->values, range);
 }
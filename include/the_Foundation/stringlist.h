@@ -91,6 +91,15 @@ iString *       take_StringList     (iStringList *, size_t pos);
 
 iString *       joinCStr_StringList (const iStringList *, const char *delim);
 
+typedef int (*iStringListCompareFunc)(const iString *, const iString *);
+
+/**
+ * Sorts the strings with a stable merge sort.
+ *
+ * @param cmp  Compares two strings. If NULL, strings are sorted in case-sensitive order.
+ */
+void            sort_StringList     (iStringList *, iStringListCompareFunc cmp);
+
 /** @name Iterators */
 ///@{
 iDeclareIterator(StringList, iStringList *)
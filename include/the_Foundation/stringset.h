@@ -34,6 +34,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
 iBeginPublic
 
 iDeclareClass(StringSet)
+iDeclareType(StringList)
 
 typedef int (*iStringSetCompareFunc)(const iString *, const iString *);
 
@@ -45,6 +46,8 @@ struct Impl_StringSet {
 iDeclareObjectConstruction(StringSet)
 
 iStringSet *newCmp_StringSet    (iStringSetCompareFunc cmp);
+iStringSet *newN_StringSet      (const iString * const *strings, size_t count);
+iStringSet *newStringList_StringSet (const iStringList *);
 
 iStringSet *copy_StringSet      (const iStringSet *);
 iBool       contains_StringSet  (const iStringSet *, const iString *value);
@@ -97,6 +100,20 @@ iBool       remove_StringSet  (iStringSet *, const iString *value);
  */
 iBool       insertIf_StringSet  (iStringSet *, const iString *value, iStringSetCompareFunc pred);
 
+/**
+ * Inserts copies of many strings at once. The strings may be in any order and contain
+ * duplicates. With the default comparison function the strings are sorted with a
+ * multikey quicksort that examines each character only a few times; otherwise the set's
+ * comparison function is used. The sorted batch is then merged with the existing strings,
+ * which are kept if equal strings are inserted.
+ */
+void        insertN_StringSet   (iStringSet *, const iString * const *strings, size_t count);
+void        insertStringList_StringSet  (iStringSet *, const iStringList *strings);
+
+/** Inserts copies of all the strings of @a other in O(n + m) time. Both sets must use
+    the same comparison function. */
+void        merge_StringSet     (iStringSet *, const iStringSet *other);
+
 iLocalDef void removeRange_StringSet(iStringSet *d, iRanges range) {
     removeRange_SortedArray(&d->strings, range);
 }
@@ -0,0 +1,172 @@
+#pragma once
+
+/** @file the_Foundation/task.h  Stackless tasks multiplexed on a thread pool.
+
+A task is a function that can suspend itself at await points and later continue where it
+left off. While a task is suspended it occupies no thread: the Scheduler's Reactor watches
+for the awaited event and then queues the task to continue in the thread pool. This way
+thousands of tasks doing sequential protocol logic can share a few threads.
+
+Tasks are stackless, in the style of protothreads. The task function is re-entered from
+the top each time the task continues, and iTaskBegin() jumps to the await point where the
+task was suspended. Therefore local variables do not keep their values across await
+points; state that is needed later must be kept in the task's context. Also, the await
+macros can only be used directly in the task function, not in functions it calls, and
+there can be only one await per source line.
+
+The awaits work on file descriptors owned by the task. An iSocket does its I/O in a
+thread of its own, so it does not expose its descriptor for awaiting; a task can instead
+await a Promise that is fulfilled from the Socket's audiences.
+
+@code
+static enum iTaskStep echo_(iTask *task) {
+    iEcho *d = context_Task(task);
+    iTaskBegin(task);
+    for (;;) {
+        iAwaitReadable(task, d->fd, 5.0);
+        if (task->events & (timeout_ReactorEvent | hangup_ReactorEvent)) break;
+        ...
+    }
+    iTaskEnd(task);
+}
+@endcode
+
+@authors Copyright (c) 2021 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+@par License
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+<small>THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
+*/
+
+#include "atomic.h"
+#include "promise.h"
+#include "reactor.h"
+
+iBeginPublic
+
+iDeclareClass(Scheduler)
+iDeclareType(Task)
+iDeclareType(ThreadPool)
+
+enum iTaskStep {
+    suspended_TaskStep,
+    finished_TaskStep,
+};
+
+typedef enum iTaskStep (*iTaskFunc)(iTask *);
+
+struct Impl_Task {
+    int          resumePoint; /* used by iTaskBegin() */
+    int          events;      /* reactor events that ended the latest await */
+    iScheduler * scheduler;
+    iTaskFunc    func;
+    void *       context;
+    iPromise *   finished;
+    iAnyObject * result;
+    /* Managed by the Scheduler while the task is suspended. */
+    iTask *      prevSuspended;
+    iTask *      nextSuspended;
+    uint32_t     wait;        /* pending Reactor wait */
+    iAtomicInt   promiseWait; /* awaiting a Promise; see task.c */
+};
+
+iLocalDef void *context_Task(const iTask *d) {
+    return d->context;
+}
+
+/**
+ * Sets the value that the task's promise is fulfilled with when the task finishes.
+ */
+void        setResult_Task          (iTask *, const iAnyObject *result);
+
+/* Suspending the task. Use the await macros below instead of calling these directly. */
+void        suspendReadable_Task    (iTask *, int fd, double timeoutSeconds);
+void        suspendWritable_Task    (iTask *, int fd, double timeoutSeconds);
+void        suspendTimeout_Task     (iTask *, double seconds);
+void        suspendPromise_Task     (iTask *, iPromise *promise);
+void        suspendYield_Task       (iTask *);
+
+#define iTaskBegin(task)    switch ((task)->resumePoint) { case 0:
+#define iTaskEnd(task)      } return finished_TaskStep;
+
+#define iTaskAwait_(task, suspendCall) \
+    do { \
+        (task)->resumePoint = __LINE__; \
+        suspendCall; \
+        return suspended_TaskStep; \
+        case __LINE__:; \
+    } while (0)
+
+/** Waits until @a fd is readable, it is closed, or the timeout expires. */
+#define iAwaitReadable(task, fd, timeoutSeconds) \
+    iTaskAwait_(task, suspendReadable_Task((task), (fd), (timeoutSeconds)))
+
+/** Waits until @a fd is writable, it is closed, or the timeout expires. */
+#define iAwaitWritable(task, fd, timeoutSeconds) \
+    iTaskAwait_(task, suspendWritable_Task((task), (fd), (timeoutSeconds)))
+
+/** Waits until @a seconds have passed. */
+#define iAwaitTimeout(task, seconds) \
+    iTaskAwait_(task, suspendTimeout_Task((task), (seconds)))
+
+/** Waits until @a promise is settled, either fulfilled or canceled. */
+#define iAwaitPromise(task, promise) \
+    iTaskAwait_(task, suspendPromise_Task((task), (promise)))
+
+/** Lets other queued work run before continuing. */
+#define iYieldTask(task) \
+    iTaskAwait_(task, suspendYield_Task(task))
+
+/*----------------------------------------------------------------------------------------------*/
+
+/**
+ * Constructs a scheduler that runs tasks in @a pool. If @a pool is NULL, the scheduler
+ * creates a pool of its own.
+ */
+iDeclareObjectConstructionArgs(Scheduler, iThreadPool *pool)
+
+iReactor *  reactor_Scheduler       (const iScheduler *);
+size_t      numTasks_Scheduler      (const iScheduler *);
+
+/**
+ * Starts a new task. The task function is first called in a pooled thread.
+ *
+ * @return Promise that is fulfilled with the task's result when it finishes. Caller gets
+ * a reference.
+ */
+iPromise *  spawn_Scheduler         (iScheduler *, iTaskFunc func, void *context);
+
+/**
+ * Blocks until all tasks have finished.
+ */
+void        wait_Scheduler          (iScheduler *);
+
+/**
+ * Cancels all tasks. Suspended tasks are not continued, and running tasks are stopped
+ * at their next await. The promises of canceled tasks are canceled. Tasks spawned
+ * afterwards are canceled at their first await.
+ *
+ * Deleting the scheduler cancels the tasks that are still unfinished, so call
+ * wait_Scheduler() first to let them finish.
+ */
+void        cancel_Scheduler        (iScheduler *);
+
+iEndPublic
@@ -27,6 +27,7 @@ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
 */
 
+#include "array.h"
 #include "thread.h"
 #include "queue.h"
 
@@ -37,8 +38,28 @@ iDeclareClass(ThreadPool)
 struct Impl_ThreadPool {
     iQueue queue;
     iObjectList *threads;
+    iArray jobs; /* iThreadPoolJob; guarded by the queue's mutex */
+    size_t jobsHead; /* index of the next pending job; earlier ones have been taken */
 };
 
+typedef void (*iThreadPoolJobFunc)(void *context);
+
+/**
+ * Processes the elements `[begin, end)` of a parallel loop.
+ */
+typedef void (*iParallelForFunc)(void *context, size_t begin, size_t end);
+
+/**
+ * Reduces the elements `[begin, end)` of a parallel loop into @a partial, which initially
+ * contains a copy of the identity value.
+ */
+typedef void (*iParallelReduceFunc)(void *context, size_t begin, size_t end, void *partial);
+
+/**
+ * Combines a partial result into @a result.
+ */
+typedef void (*iParallelCombineFunc)(void *context, void *result, const void *partial);
+
 iDeclareObjectConstruction(ThreadPool)
 
 /**
@@ -55,6 +76,47 @@ void        initLimits_ThreadPool   (iThreadPool *, int minThreads, int reserved
 void        deinit_ThreadPool       (iThreadPool *);
 
 iThread *   run_ThreadPool          (iThreadPool *, iThread *thread);
+size_t      numThreads_ThreadPool   (const iThreadPool *);
+
+/**
+ * Queues a function to be called in one of the pooled threads. This is much lighter than
+ * running an iThread: nothing is allocated for the job and no result is kept.
+ */
+void        post_ThreadPool         (iThreadPool *, iThreadPoolJobFunc func, void *context);
+
+/**
+ * Calls @a func once for each of the @a count contexts in the @a contexts array, using
+ * the pooled threads, and waits until all the calls have returned. The calling thread
+ * runs some of the calls itself, so this can also be used in a thread of the same pool.
+ *
+ * @param contexts     Array of contexts. @a func gets a pointer to one element.
+ * @param contextSize  Size of one context element in bytes.
+ */
+void        runBatch_ThreadPool     (iThreadPool *, iThreadPoolJobFunc func, void *contexts,
+                                     size_t contextSize, size_t count);
+
+/**
+ * Splits the index range `[begin, end)` into chunks and processes them in parallel. Returns
+ * after all the chunks have been processed. The calling thread processes chunks, too.
+ *
+ * @param grain  Number of indices in a chunk. Use zero to choose the size automatically
+ *               based on the number of threads.
+ */
+void        parallelFor_ThreadPool  (iThreadPool *, size_t begin, size_t end, size_t grain,
+                                     iParallelForFunc func, void *context);
+
+/**
+ * Reduces the index range `[begin, end)` in parallel. Each chunk is reduced into its own
+ * partial result, and the partial results are then combined into @a result in index
+ * order, so the result does not depend on how the chunks were scheduled.
+ *
+ * @param resultSize  Size of the result value in bytes.
+ * @param result      On entry, the identity value of the reduction. On return, the result.
+ */
+void        parallelReduce_ThreadPool(iThreadPool *, size_t begin, size_t end, size_t grain,
+                                      size_t resultSize, void *result,
+                                      iParallelReduceFunc reduce, iParallelCombineFunc combine,
+                                      void *context);
 
 /**
  * Use the calling thread to run another queud thread. Returns immediately after a queued thread
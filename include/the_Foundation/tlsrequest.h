@@ -107,6 +107,13 @@ iBlock *            privateKeyFingerprint_TlsCertificate(const iTlsCertificate *
 
 /*----------------------------------------------------------------------------------------------*/
 
+/* On POSIX systems, requests are driven by a few shared Reactor threads (up to one per
+   CPU core), which also send the notifications. Each request stays in one reactor thread
+   from submission to finish; a request submitted in a notification callback uses the
+   caller's thread. A request must not be canceled or deleted in one of its own
+   notification callbacks. Canceling a request of another reactor thread in a callback
+   waits until that thread gets to it, so two callbacks must not do that to each other. */
+
 iDeclareClass(TlsRequest)
 iDeclareObjectConstruction(TlsRequest)
 
@@ -129,6 +136,16 @@ void        setHost_TlsRequest          (iTlsRequest *, const iString *hostName,
 void        setContent_TlsRequest       (iTlsRequest *, const iBlock *content);
 void        setCertificate_TlsRequest   (iTlsRequest *, const iTlsCertificate *cert);
 
+/**
+ * Pins the server's public key. When set, the server certificate is accepted only if
+ * its public key matches the fingerprint, and the more expensive verification of the
+ * certificate chain against the CA store is skipped.
+ *
+ * @param publicKeyFingerprint  SHA-256 fingerprint of the public key, as returned by
+ *                              publicKeyFingerprint_TlsCertificate(). Use NULL to unpin.
+ */
+void        setPinnedPublicKey_TlsRequest(iTlsRequest *, const iBlock *publicKeyFingerprint);
+
 void        submit_TlsRequest           (iTlsRequest *);
 void        cancel_TlsRequest           (iTlsRequest *);
 void        waitForFinished_TlsRequest  (iTlsRequest *);
@@ -140,6 +157,7 @@ enum iTlsRequestStatus  status_TlsRequest           (const iTlsRequest *);
 const iString *         errorMessage_TlsRequest     (const iTlsRequest *);
 const iTlsCertificate * serverCertificate_TlsRequest(const iTlsRequest *);
 iBool                   isVerified_TlsRequest       (const iTlsRequest *);
+iBool                   isResumed_TlsRequest        (const iTlsRequest *); /* abbreviated handshake */
 
 typedef iBool (*iTlsRequestVerifyFunc)(iTlsRequest *, const iTlsCertificate *, int depth);
 
@@ -147,4 +165,19 @@ void        setCACertificates_TlsRequest(const iString *caFile, const iString *c
 void        setCiphers_TlsRequest       (const char *cipherList);
 void        setVerifyFunc_TlsRequest    (iTlsRequestVerifyFunc verifyFunc);
 
+/* Client sessions (session IDs and TLS 1.3 tickets) are cached per host and port, so
+   reconnecting to the same server can skip the full handshake. Enabled by default. */
+void        setSessionCacheEnabled_TlsRequest   (iBool enable);
+void        clearSessionCache_TlsRequest        (void);
+
+iDeclareType(TlsHandshakeStats)
+
+struct Impl_TlsHandshakeStats {
+    int numFull;
+    int numResumed;
+};
+
+void        handshakeStats_TlsRequest           (iTlsHandshakeStats *stats_out);
+void        resetHandshakeStats_TlsRequest      (void);
+
 iEndPublic
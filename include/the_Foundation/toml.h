@@ -44,7 +44,8 @@ iDeclareType(TomlValue)
 struct Impl_TomlValue {
     enum iTomlType type;
     union {
-        const iString *string;
+        const iString *string; /* with range handlers, strings are in `range` instead */
+        iRangecc       range;
         int64_t        int64;
         double         float64;
         iBool          boolean;
@@ -62,7 +63,15 @@ typedef void (*iTomlTableFunc)(void *context, const iString *table, iBool isStar
 typedef void (*iTomlKeyValueFunc)(void *context, const iString *table, const iString *key,
                                   const iTomlValue *value);
 
-void    setHandlers_TomlParser   (iTomlParser *, iTomlTableFunc table, iTomlKeyValueFunc kv, void *);
+/* The range handlers get the table names, keys, and values as ranges of the source or of a
+   temporary buffer. They are valid only during the callback. */
+typedef void (*iTomlTableRangeFunc)(void *context, iRangecc table, iBool isStart);
+typedef void (*iTomlKeyValueRangeFunc)(void *context, iRangecc table, iRangecc key,
+                                       const iTomlValue *value);
 
-iBool   parse_TomlParser         (iTomlParser *, const iString *toml); /* returns true if no errors found */
+void    setHandlers_TomlParser      (iTomlParser *, iTomlTableFunc table, iTomlKeyValueFunc kv, void *);
+void    setRangeHandlers_TomlParser (iTomlParser *, iTomlTableRangeFunc table,
+                                     iTomlKeyValueRangeFunc kv, void *);
+
+iBool   parse_TomlParser            (iTomlParser *, const iString *toml); /* returns true if no errors found */
 
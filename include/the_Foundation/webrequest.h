@@ -36,21 +36,43 @@ iBeginPublic
 iDeclareType(StringArray)
 
 iDeclareClass(WebRequest)
+iDeclareClass(WebSession)
 iDeclareObjectConstruction(WebRequest)
 
 iDeclareNotifyFuncArgs(WebRequest, Progress, size_t currentBytes, size_t totalBytes)
 iDeclareNotifyFunc    (WebRequest, ReadyRead)
+iDeclareNotifyFunc    (WebRequest, Finished)
 iDeclareAudienceGetter(WebRequest, progress)
 iDeclareAudienceGetter(WebRequest, readyRead)
+iDeclareAudienceGetter(WebRequest, finished)
+
+enum iWebRequestStatus {
+    initialized_WebRequestStatus,
+    submitted_WebRequestStatus,
+    finished_WebRequestStatus,
+    error_WebRequestStatus,
+};
 
 void    clear_WebRequest        (iWebRequest *);
 
 void    setUrl_WebRequest       (iWebRequest *, const iString *url);
 void    setUserAgent_WebRequest (iWebRequest *, const iString *userAgent);
 void    setPostData_WebRequest  (iWebRequest *, const char *contentType, const iBlock *data);
+void    setTimeout_WebRequest   (iWebRequest *, double seconds); /* zero for no timeout */
+
+/**
+ * Makes the request use a session's shared DNS cache, TLS session cache, and connection
+ * pool. Subsequent requests to the same host can then reuse an existing keep-alive
+ * connection instead of doing a new TCP and TLS handshake.
+ *
+ * @param session  Session to join. The request holds a reference to it. Use NULL to
+ *                 detach the request from its current session.
+ */
+void    setSession_WebRequest   (iWebRequest *, iWebSession *session);
 
 iBool   get_WebRequest          (iWebRequest *);
 iBool   post_WebRequest         (iWebRequest *);
+void    waitForFinished_WebRequest(iWebRequest *);
 
 iBlock *read_WebRequest         (iWebRequest *);
 
@@ -58,6 +80,8 @@ const iBlock *          result_WebRequest       (const iWebRequest *);
 size_t                  contentLength_WebRequest(const iWebRequest *);
 const iStringArray *    headers_WebRequest      (const iWebRequest *);
 const iString *         errorMessage_WebRequest (const iWebRequest *);
+enum iWebRequestStatus  status_WebRequest       (const iWebRequest *);
+iWebSession *           session_WebRequest      (const iWebRequest *);
 
 /**
  * Finds the value of an HTTP header from the result.
@@ -70,4 +94,34 @@ const iString *         errorMessage_WebRequest (const iWebRequest *);
  */
 iBool   headerValue_WebRequest  (const iWebRequest *, const char *header, iString *value_out);
 
+/*----------------------------------------------------------------------------------------------*/
+
+iDeclareObjectConstruction(WebSession)
+
+iDeclareNotifyFuncArgs(WebSession, Finished, iWebRequest *request)
+iDeclareAudienceGetter(WebSession, finished)
+
+void    setMaxConnections_WebSession(iWebSession *, size_t maxTotal, size_t maxPerHost);
+
+/**
+ * Submits a request to be performed asynchronously. All of the session's requests are
+ * multiplexed on a single background thread. When a request completes, the request's
+ * `finished` audience is notified first, followed by the session's `finished` audience.
+ * Notifications are done in the session's thread.
+ *
+ * The request joins the session (see setSession_WebRequest()) and the session holds a
+ * reference to the request until it has finished.
+ *
+ * @param request  Request to submit. Configure the URL and other options beforehand.
+ *                 If post data has been set, a POST request is made; otherwise GET.
+ *
+ * @return @c iTrue, if the request was submitted; @c iFalse, if the request is already
+ * ongoing.
+ */
+iBool   submit_WebSession           (iWebSession *, iWebRequest *request);
+
+void    cancel_WebSession           (iWebSession *, iWebRequest *request);
+void    waitForIdle_WebSession      (iWebSession *);
+size_t  numOngoing_WebSession       (const iWebSession *);
+
 iEndPublic
@@ -28,34 +28,107 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
 */
 
 #include "the_Foundation/ptrarray.h"
+#include "the_Foundation/stream.h"
 #include "the_Foundation/string.h"
 
 iDeclareType(XmlDocument)
 iDeclareType(XmlElement)
 iDeclareType(XmlAttribute)
+iDeclareType(XmlArena)
+iDeclareType(XmlIndex)
 
 struct Impl_XmlAttribute {
     iRangecc name;
     iRangecc value;
 };
 
+/* Elements and their attributes are allocated from an arena owned by the document, and
+   they remain valid until the document is deleted or parsed again.
+
+   Compatibility: elements used to have `children` (iPtrArray) and `attribs` (iArray)
+   members and could be constructed on their own. The children are now a sibling list
+   starting at `firstChild`, and `attribs` is a plain array of `numAttribs` attributes.
+   children_XmlElement() and attributes_XmlElement() return copies in the old form. */
 struct Impl_XmlElement {
     iRangecc name;
-    iArray attribs;
     iRangecc content;
-    iPtrArray children; /* pointers to XmlElements */
+    const iXmlDocument *doc;
+    const iXmlAttribute *attribs;
+    size_t numAttribs;
+    const iXmlElement *firstChild;
+    const iXmlElement *nextSibling;
 };
 
 struct Impl_XmlDocument {
     iString source;
     iXmlElement root;
+    iXmlArena *arena;
+    iXmlIndex *index;
 };
 
 iDeclareTypeConstruction(XmlElement)
 iDeclareTypeConstruction(XmlDocument)
 
-iBool       parse_XmlDocument   (iXmlDocument *, const iString *source);
+iBool       parse_XmlDocument       (iXmlDocument *, const iString *source);
+
+/**
+ * Builds a lookup index over the parsed document. Element and attribute names are
+ * interned, and afterwards child_XmlElement() and attribute_XmlElement() take constant
+ * time instead of scanning. The index is discarded if the document is parsed again.
+ */
+void        buildIndex_XmlDocument  (iXmlDocument *);
 
 const iXmlElement * child_XmlElement            (const iXmlElement *, const char *name);
 iRangecc            attribute_XmlElement        (const iXmlElement *, const char *name);
 iString *           decodedContent_XmlElement   (const iXmlElement *);
+
+/* Deprecated: for code written against the old element members. Each call returns a new
+   array that the caller must delete. */
+iPtrArray *         children_XmlElement         (const iXmlElement *); /* const iXmlElement * */
+iArray *            attributes_XmlElement       (const iXmlElement *); /* iXmlAttribute */
+
+/* Deprecated: a standalone element is empty and does not belong to any document. Only
+   the elements of a parsed XmlDocument have children and attributes. */
+void                init_XmlElement             (iXmlElement *);
+void                deinit_XmlElement           (iXmlElement *);
+
+/*----------------------------------------------------------------------------------------------*/
+
+/**
+ * Streaming pull parser. The input stream is read in chunks and each call to
+ * next_XmlReader() produces one event without building a tree, so memory use stays bounded
+ * regardless of the document size: only the current tag and the names of the open elements
+ * are kept in memory. Long character data and CDATA sections are delivered in several
+ * consecutive events.
+ *
+ * Names, texts, and attributes refer to the reader's buffer and remain valid only until
+ * the next call to next_XmlReader(). Texts and attribute values are returned undecoded.
+ * Comments and DOCTYPE declarations are skipped.
+ *
+ * The document must have exactly one root element. Outside of it, only whitespace,
+ * comments, declarations, and processing instructions are accepted.
+ */
+iDeclareType(XmlReader)
+iDeclareTypeConstructionArgs(XmlReader, iStream *input)
+
+enum iXmlReaderEvent {
+    end_XmlReaderEvent,             /* no more input */
+    error_XmlReaderEvent,           /* malformed input; see errorMessage_XmlReader() */
+    startElement_XmlReaderEvent,    /* name and attributes */
+    endElement_XmlReaderEvent,      /* name (also sent after an empty element tag) */
+    text_XmlReaderEvent,            /* character data */
+    cdata_XmlReaderEvent,           /* contents of a CDATA section */
+    instruction_XmlReaderEvent,     /* name is the target, e.g., "xml" */
+};
+
+void                    setMaxTokenSize_XmlReader   (iXmlReader *, size_t maxSize);
+
+enum iXmlReaderEvent    next_XmlReader              (iXmlReader *);
+enum iXmlReaderEvent    event_XmlReader             (const iXmlReader *);
+iRangecc                name_XmlReader              (const iXmlReader *);
+iRangecc                text_XmlReader              (const iXmlReader *);
+const iArray *          attributes_XmlReader        (const iXmlReader *); /* iXmlAttribute */
+iRangecc                attribute_XmlReader         (const iXmlReader *, const char *name);
+size_t                  depth_XmlReader             (const iXmlReader *);
+const char *            errorMessage_XmlReader      (const iXmlReader *);
+iString *               decodedText_XmlReader       (const iXmlReader *);
@@ -26,6 +26,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
 */
 
 #include "the_Foundation/array.h"
+#include "the_Foundation/threadpool.h"
 
 #include <stdlib.h>
 
@@ -343,10 +344,341 @@ void move_Array(iArray *d, iRanges range, iArray *dest, size_t destPos) {
     removeRange_Array(d, range);
 }
 
+/*-------------------------------------------------------------------------------------*/
+
+#define iArraySortRun           16      /* sorted with insertion sort before merging */
+#define iArrayParallelMinChunk  0x4000  /* smallest range sorted by one pooled job */
+
+iDeclareType(ArraySort)
+
+struct Impl_ArraySort {
+    size_t elementSize;
+    int  (*cmp)(const void *, const void *);
+    int  (*cmpContext)(const void *, const void *, void *);
+    void  *context;
+};
+
+iLocalDef int compare_ArraySort_(const iArraySort *d, const void *a, const void *b) {
+    return d->cmp ? d->cmp(a, b) : d->cmpContext(a, b, d->context);
+}
+
+/* Defines a bottom-up merge sort. Elements of `ES` bytes are compared with `CMP(ctx, a, b)`.
+   When `ES` is a constant, the element copies compile into plain moves. Equal elements are
+   kept in their original order. */
+#define iDefineMergeSort_(name, ctxType, ES, CMP) \
+    static void insertionSort_##name##_(ctxType ctx, char *base, size_t count, size_t elementSize, \
+                                        char *scratch) { \
+        const size_t es = (ES); \
+        iUnused(elementSize); \
+        for (size_t i = 1; i < count; i++) { \
+            char *elem = base + i * es; \
+            if (CMP(ctx, elem - es, elem) <= 0) continue; \
+            memcpy(scratch, elem, es); \
+            size_t j = i - 1; \
+            while (j > 0 && CMP(ctx, base + (j - 1) * es, scratch) > 0) j--; \
+            memmove(base + (j + 1) * es, base + j * es, (i - j) * es); \
+            memcpy(base + j * es, scratch, es); \
+        } \
+    } \
+    static void merge_##name##_(ctxType ctx, const char *a, size_t na, const char *b, size_t nb, \
+                                char *out, size_t elementSize) { \
+        const size_t es = (ES); \
+        iUnused(elementSize); \
+        if (na && nb && CMP(ctx, a + (na - 1) * es, b) <= 0) { \
+            na += nb; /* already in order */ \
+            nb = 0; \
+        } \
+        while (na && nb) { \
+            /* Branchless selection; the outcome of the comparison is unpredictable. */ \
+            const size_t takeB = (CMP(ctx, b, a) < 0); \
+            memcpy(out, takeB ? b : a, es); \
+            a  += (takeB ^ 1) * es; \
+            na -= (takeB ^ 1); \
+            b  += takeB * es; \
+            nb -= takeB; \
+            out += es; \
+        } \
+        memcpy(out, na ? a : b, (na + nb) * es); \
+    } \
+    static void mergeSort_##name##_(ctxType ctx, char *base, char *tmp, size_t count, \
+                                    size_t elementSize) { \
+        const size_t es = (ES); \
+        for (size_t i = 0; i < count; i += iArraySortRun) { \
+            insertionSort_##name##_(ctx, base + i * es, iMin(iArraySortRun, count - i), \
+                                    elementSize, tmp); \
+        } \
+        char *src = base, *dst = tmp; \
+        for (size_t width = iArraySortRun; width < count; width *= 2) { \
+            for (size_t i = 0; i < count; i += 2 * width) { \
+                const size_t na = iMin(width, count - i); \
+                const size_t nb = iMin(width, count - i - na); \
+                merge_##name##_(ctx, src + i * es, na, src + (i + na) * es, nb, dst + i * es, \
+                                elementSize); \
+            } \
+            char *swap = src; src = dst; dst = swap; \
+        } \
+        if (src != base) { \
+            memcpy(base, src, count * es); \
+        } \
+    }
+
+iDefineMergeSort_(Elements4,  const iArraySort *, 4,           compare_ArraySort_)
+iDefineMergeSort_(Elements8,  const iArraySort *, 8,           compare_ArraySort_)
+iDefineMergeSort_(Elements16, const iArraySort *, 16,          compare_ArraySort_)
+iDefineMergeSort_(Elements,   const iArraySort *, elementSize, compare_ArraySort_)
+
+static void mergeSort_ArraySort_(const iArraySort *d, char *base, char *tmp, size_t count) {
+    switch (d->elementSize) {
+        case 4:
+            mergeSort_Elements4_(d, base, tmp, count, 4);
+            break;
+        case 8:
+            mergeSort_Elements8_(d, base, tmp, count, 8);
+            break;
+        case 16:
+            mergeSort_Elements16_(d, base, tmp, count, 16);
+            break;
+        default:
+            mergeSort_Elements_(d, base, tmp, count, d->elementSize);
+            break;
+    }
+}
+
+static void merge_ArraySort_(const iArraySort *d, const char *a, size_t na, const char *b,
+                             size_t nb, char *out) {
+    switch (d->elementSize) {
+        case 4:
+            merge_Elements4_(d, a, na, b, nb, out, 4);
+            break;
+        case 8:
+            merge_Elements8_(d, a, na, b, nb, out, 8);
+            break;
+        case 16:
+            merge_Elements16_(d, a, na, b, nb, out, 16);
+            break;
+        default:
+            merge_Elements_(d, a, na, b, nb, out, d->elementSize);
+            break;
+    }
+}
+
+static void sort_ArraySort_(const iArraySort *d, iArray *array) {
+    const size_t count = size_Array(array);
+    if (count > 1) {
+        char *tmp = malloc(count * d->elementSize);
+        mergeSort_ArraySort_(d, front_Array(array), tmp, count);
+        free(tmp);
+    }
+}
+
 void sort_Array(iArray *d, int (*cmp)(const void *, const void *)) {
-    if (size_Array(d) > 1) {
-        qsort(front_Array(d), size_Array(d), d->elementSize, cmp);
+    const iArraySort sorter = { .elementSize = d->elementSize, .cmp = cmp };
+    sort_ArraySort_(&sorter, d);
+}
+
+void sortContext_Array(iArray *d, int (*cmp)(const void *, const void *, void *), void *context) {
+    const iArraySort sorter = { .elementSize = d->elementSize, .cmpContext = cmp, .context = context };
+    sort_ArraySort_(&sorter, d);
+}
+
+/*-------------------------------------------------------------------------------------*/
+
+iDeclareType(ArraySortKey)
+
+struct Impl_ArraySortKey {
+    int64_t key;
+    size_t index;
+};
+
+iLocalDef int compare_ArraySortKey_(const void *ctx, const void *a, const void *b) {
+    iUnused(ctx);
+    const int64_t x = ((const iArraySortKey *) a)->key;
+    const int64_t y = ((const iArraySortKey *) b)->key;
+    return (x > y) - (x < y);
+}
+
+iDefineMergeSort_(Keys, const void *, sizeof(iArraySortKey), compare_ArraySortKey_)
+
+#define iArrayRadixSortMin  256 /* fewer keys are merge sorted */
+
+/* Stable LSD radix sort of the keys, one byte at a time. Returns the buffer that has the
+   sorted keys. Passes where all keys have the same byte value are skipped. */
+static iArraySortKey *radixSort_ArraySortKey_(iArraySortKey *keys, iArraySortKey *tmp,
+                                              size_t count) {
+    size_t (*hist)[256] = calloc(8, sizeof(*hist));
+    for (size_t i = 0; i < count; i++) {
+        const uint64_t k = (uint64_t) keys[i].key ^ (UINT64_C(1) << 63); /* signed order */
+        for (int b = 0; b < 8; b++) {
+            hist[b][(k >> (8 * b)) & 0xff]++;
+        }
+    }
+    iArraySortKey *src = keys, *dst = tmp;
+    for (int b = 0; b < 8; b++) {
+        const unsigned shift = 8 * b;
+        const uint64_t first = (uint64_t) src[0].key ^ (UINT64_C(1) << 63);
+        if (hist[b][(first >> shift) & 0xff] == count) {
+            continue;
+        }
+        size_t offset[256];
+        size_t sum = 0;
+        for (int v = 0; v < 256; v++) {
+            offset[v] = sum;
+            sum += hist[b][v];
+        }
+        for (size_t i = 0; i < count; i++) {
+            const uint64_t k = (uint64_t) src[i].key ^ (UINT64_C(1) << 63);
+            dst[offset[(k >> shift) & 0xff]++] = src[i];
+        }
+        iArraySortKey *swap = src; src = dst; dst = swap;
+    }
+    free(hist);
+    return src;
+}
+
+void sortKey_Array(iArray *d, int64_t (*key)(const void *)) {
+    const size_t count = size_Array(d);
+    if (count < 2) {
+        return;
+    }
+    const size_t es = d->elementSize;
+    char *base = front_Array(d);
+    /* Extract the keys once. They are sorted without calling back to the user. */
+    iArraySortKey *buf = malloc(sizeof(iArraySortKey) * count * 2);
+    iArraySortKey *keys = buf;
+    for (size_t i = 0; i < count; i++) {
+        keys[i].key   = key(base + i * es);
+        keys[i].index = i;
+    }
+    if (count < iArrayRadixSortMin) {
+        mergeSort_Keys_(NULL, (char *) keys, (char *) (keys + count), count, sizeof(iArraySortKey));
+    }
+    else {
+        keys = radixSort_ArraySortKey_(keys, keys + count, count);
+    }
+    /* Gather the elements in sorted order. */
+    char *sorted = malloc(count * es);
+    for (size_t i = 0; i < count; i++) {
+        memcpy(sorted + i * es, base + keys[i].index * es, es);
+    }
+    memcpy(base, sorted, count * es);
+    free(sorted);
+    free(buf);
+}
+
+/*-------------------------------------------------------------------------------------*/
+
+iDeclareType(ArraySortTask)
+
+/* A range to sort in place, or a part of the merge of two sorted ranges. */
+struct Impl_ArraySortTask {
+    const iArraySort *sort;
+    const char *a;
+    size_t na;
+    const char *b;
+    size_t nb;
+    char *out;
+};
+
+static void run_ArraySortTask_(void *context) {
+    const iArraySortTask *d = context;
+    if (d->b) {
+        merge_ArraySort_(d->sort, d->a, d->na, d->b, d->nb, d->out);
+    }
+    else {
+        mergeSort_ArraySort_(d->sort, iConstCast(char *, d->a), d->out, d->na);
+    }
+}
+
+/* Number of elements of `a` among the first `pos` elements of the merged output. */
+static size_t coRank_ArraySort_(const iArraySort *d, size_t pos, const char *a, size_t na,
+                                const char *b, size_t nb) {
+    const size_t es = d->elementSize;
+    size_t lo = pos > nb ? pos - nb : 0;
+    size_t hi = iMin(pos, na);
+    while (lo < hi) {
+        const size_t i = (lo + hi) / 2;
+        if (compare_ArraySort_(d, a + i * es, b + (pos - i - 1) * es) <= 0) {
+            lo = i + 1;
+        }
+        else {
+            hi = i;
+        }
+    }
+    return lo;
+}
+
+static void runTasks_ArraySort_(iArraySortTask *tasks, size_t count, iThreadPool *pool) {
+    runBatch_ThreadPool(pool, run_ArraySortTask_, tasks, sizeof(iArraySortTask), count);
+}
+
+void sortParallel_Array(iArray *d, int (*cmp)(const void *, const void *), iThreadPool *pool) {
+    const size_t count = size_Array(d);
+    const size_t numThreads = pool ? numThreads_ThreadPool(pool) : 1;
+    size_t numChunks = 2;
+    while (numChunks < numThreads) {
+        numChunks *= 2;
+    }
+    while (numChunks > 1 && count / numChunks < iArrayParallelMinChunk) {
+        numChunks /= 2;
+    }
+    if (!pool || numChunks < 2) {
+        sort_Array(d, cmp);
+        return;
+    }
+    const iArraySort sorter = { .elementSize = d->elementSize, .cmp = cmp };
+    const size_t es = d->elementSize;
+    char *src = front_Array(d);
+    char *dst = malloc(count * es);
+    size_t *bounds = malloc(sizeof(size_t) * (numChunks + 1));
+    iArraySortTask *tasks = malloc(sizeof(iArraySortTask) * numChunks);
+    /* Sort each chunk separately. */
+    for (size_t i = 0; i <= numChunks; i++) {
+        bounds[i] = i * count / numChunks;
+    }
+    for (size_t i = 0; i < numChunks; i++) {
+        tasks[i] = (iArraySortTask){ .sort = &sorter,
+                                     .a    = src + bounds[i] * es,
+                                     .na   = bounds[i + 1] - bounds[i],
+                                     .out  = dst + bounds[i] * es };
+    }
+    runTasks_ArraySort_(tasks, numChunks, pool);
+    /* Merge pairs of sorted runs until one remains. Each merge is split into parts of
+       equal output size, so all the threads have work until the end. */
+    for (size_t numRuns = numChunks; numRuns > 1; numRuns /= 2) {
+        const size_t partsPerMerge = numChunks / (numRuns / 2);
+        size_t numTasks = 0;
+        for (size_t r = 0; r < numRuns; r += 2) {
+            const char *a  = src + bounds[r] * es;
+            const char *b  = src + bounds[r + 1] * es;
+            const size_t na = bounds[r + 1] - bounds[r];
+            const size_t nb = bounds[r + 2] - bounds[r + 1];
+            size_t prevPos = 0, prevA = 0;
+            for (size_t p = 1; p <= partsPerMerge; p++) {
+                const size_t pos  = (na + nb) * p / partsPerMerge;
+                const size_t posA = coRank_ArraySort_(&sorter, pos, a, na, b, nb);
+                tasks[numTasks++] = (iArraySortTask){ .sort = &sorter,
+                                                      .a    = a + prevA * es,
+                                                      .na   = posA - prevA,
+                                                      .b    = b + (prevPos - prevA) * es,
+                                                      .nb   = (pos - posA) - (prevPos - prevA),
+                                                      .out  = dst + (bounds[r] + prevPos) * es };
+                prevPos = pos;
+                prevA   = posA;
+            }
+        }
+        runTasks_ArraySort_(tasks, numTasks, pool);
+        for (size_t r = 0; r <= numRuns / 2; r++) {
+            bounds[r] = bounds[2 * r];
+        }
+        char *swap = src; src = dst; dst = swap;
+    }
+    if (src != front_Array(d)) {
+        memcpy(front_Array(d), src, count * es);
+        dst = src;
     }
+    free(dst);
+    free(tasks);
+    free(bounds);
 }
 
 /*-------------------------------------------------------------------------------------*/
@@ -0,0 +1,448 @@
+/** @file blake3.c  BLAKE3 hash function.
+
+@authors Copyright (c) 2021 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+@par License
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+<small>THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
+*/
+
+#include "the_Foundation/digest.h"
+#include "the_Foundation/cpu.h"
+#include "the_Foundation/threadpool.h"
+
+#include <stdlib.h>
+
+#if defined (iHaveCpuDispatch) && defined (__GNUC__)
+#   define iBlake3HaveAvx2
+#   include <immintrin.h>
+#endif
+
+/* For reference, see: https://github.com/BLAKE3-team/BLAKE3-specs */
+
+#define iBlake3ChunkSize    1024
+#define iBlake3SubtreeSize  (256 * iBlake3ChunkSize) /* unit of parallel work */
+
+enum iBlake3Flag {
+    chunkStart_Blake3Flag = iBit(1),
+    chunkEnd_Blake3Flag   = iBit(2),
+    parent_Blake3Flag     = iBit(3),
+    root_Blake3Flag       = iBit(4),
+};
+
+static const uint32_t iv_[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+/* Message word order of each round. */
+static const uint8_t schedule_[7][16] = {
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+    {  2,  6,  3, 10,  7,  0,  4, 13,  1, 11, 12,  5,  9, 14, 15,  8 },
+    {  3,  4, 10, 12, 13,  2,  7, 14,  6,  5,  9,  0, 11, 15,  8,  1 },
+    { 10,  7, 12,  9, 14,  3, 13, 15,  4,  0, 11,  2,  5,  8,  1,  6 },
+    { 12, 13,  9, 11, 15, 10, 14,  8,  7,  2,  5,  3,  0,  1,  6,  4 },
+    {  9, 14, 11,  5,  8, 12, 15,  1, 13,  3,  0, 10,  2,  6,  4,  7 },
+    { 11, 15,  5,  0,  1,  9,  8,  6, 14, 10,  2, 12,  3,  4,  7, 13 },
+};
+
+iLocalDef uint32_t rotr_(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+iLocalDef uint32_t load32LE_(const uint8_t *p) {
+    return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) |
+           ((uint32_t) p[3] << 24);
+}
+
+iLocalDef void g_(uint32_t *v, int a, int b, int c, int d, uint32_t mx, uint32_t my) {
+    v[a] = v[a] + v[b] + mx;
+    v[d] = rotr_(v[d] ^ v[a], 16);
+    v[c] = v[c] + v[d];
+    v[b] = rotr_(v[b] ^ v[c], 12);
+    v[a] = v[a] + v[b] + my;
+    v[d] = rotr_(v[d] ^ v[a], 8);
+    v[c] = v[c] + v[d];
+    v[b] = rotr_(v[b] ^ v[c], 7);
+}
+
+/* Returns the first eight words of the compression output in @a out. */
+static void compress_(const uint32_t cv[8], const uint8_t block[64], uint64_t counter,
+                      uint32_t blockLen, uint32_t flags, uint32_t out[8]) {
+    uint32_t m[16], v[16];
+    for (int i = 0; i < 16; i++) {
+        m[i] = load32LE_(block + 4 * i);
+    }
+    memcpy(v, cv, 32);
+    memcpy(v + 8, iv_, 16);
+    v[12] = (uint32_t) counter;
+    v[13] = (uint32_t) (counter >> 32);
+    v[14] = blockLen;
+    v[15] = flags;
+    for (int r = 0; r < 7; r++) {
+        const uint8_t *s = schedule_[r];
+        g_(v, 0, 4,  8, 12, m[s[0]],  m[s[1]]);
+        g_(v, 1, 5,  9, 13, m[s[2]],  m[s[3]]);
+        g_(v, 2, 6, 10, 14, m[s[4]],  m[s[5]]);
+        g_(v, 3, 7, 11, 15, m[s[6]],  m[s[7]]);
+        g_(v, 0, 5, 10, 15, m[s[8]],  m[s[9]]);
+        g_(v, 1, 6, 11, 12, m[s[10]], m[s[11]]);
+        g_(v, 2, 7,  8, 13, m[s[12]], m[s[13]]);
+        g_(v, 3, 4,  9, 14, m[s[14]], m[s[15]]);
+    }
+    for (int i = 0; i < 8; i++) {
+        out[i] = v[i] ^ v[i + 8];
+    }
+}
+
+static void parentCv_(const uint32_t key[8], const uint32_t left[8], const uint32_t right[8],
+                      uint32_t flags, uint32_t cv_out[8]) {
+    uint8_t block[64];
+    for (int i = 0; i < 8; i++) {
+        for (int j = 0; j < 4; j++) {
+            block[4 * i + j]      = (uint8_t) (left[i] >> (8 * j));
+            block[32 + 4 * i + j] = (uint8_t) (right[i] >> (8 * j));
+        }
+    }
+    compress_(key, block, 0, 64, parent_Blake3Flag | flags, cv_out);
+}
+
+static void chunkCv_(const uint32_t key[8], const uint8_t *chunk, uint64_t counter,
+                     uint32_t cv_out[8]) {
+    memcpy(cv_out, key, 32);
+    for (int i = 0; i < 16; i++) {
+        const uint32_t flags = (i == 0 ? chunkStart_Blake3Flag : 0) |
+                               (i == 15 ? chunkEnd_Blake3Flag : 0);
+        compress_(cv_out, chunk + 64 * i, counter, 64, flags, cv_out);
+    }
+}
+
+#if defined (iBlake3HaveAvx2)
+
+iCpuTarget("avx2")
+iLocalDef __m256i rot16_(__m256i x) {
+    return _mm256_shuffle_epi8(x, _mm256_set_epi8(13, 12, 15, 14, 9, 8, 11, 10,
+                                                  5, 4, 7, 6, 1, 0, 3, 2,
+                                                  13, 12, 15, 14, 9, 8, 11, 10,
+                                                  5, 4, 7, 6, 1, 0, 3, 2));
+}
+
+iCpuTarget("avx2")
+iLocalDef __m256i rot8_(__m256i x) {
+    return _mm256_shuffle_epi8(x, _mm256_set_epi8(12, 15, 14, 13, 8, 11, 10, 9,
+                                                  4, 7, 6, 5, 0, 3, 2, 1,
+                                                  12, 15, 14, 13, 8, 11, 10, 9,
+                                                  4, 7, 6, 5, 0, 3, 2, 1));
+}
+
+iCpuTarget("avx2")
+iLocalDef void g8_(__m256i *v, int a, int b, int c, int d, __m256i mx, __m256i my) {
+    v[a] = _mm256_add_epi32(_mm256_add_epi32(v[a], v[b]), mx);
+    v[d] = rot16_(_mm256_xor_si256(v[d], v[a]));
+    v[c] = _mm256_add_epi32(v[c], v[d]);
+    v[b] = _mm256_xor_si256(v[b], v[c]);
+    v[b] = _mm256_or_si256(_mm256_srli_epi32(v[b], 12), _mm256_slli_epi32(v[b], 20));
+    v[a] = _mm256_add_epi32(_mm256_add_epi32(v[a], v[b]), my);
+    v[d] = rot8_(_mm256_xor_si256(v[d], v[a]));
+    v[c] = _mm256_add_epi32(v[c], v[d]);
+    v[b] = _mm256_xor_si256(v[b], v[c]);
+    v[b] = _mm256_or_si256(_mm256_srli_epi32(v[b], 7), _mm256_slli_epi32(v[b], 25));
+}
+
+/* Rows become columns: word i of row j moves to word j of row i. */
+iCpuTarget("avx2")
+static void transpose8_(__m256i *r) {
+    const __m256i t0 = _mm256_unpacklo_epi32(r[0], r[1]);
+    const __m256i t1 = _mm256_unpackhi_epi32(r[0], r[1]);
+    const __m256i t2 = _mm256_unpacklo_epi32(r[2], r[3]);
+    const __m256i t3 = _mm256_unpackhi_epi32(r[2], r[3]);
+    const __m256i t4 = _mm256_unpacklo_epi32(r[4], r[5]);
+    const __m256i t5 = _mm256_unpackhi_epi32(r[4], r[5]);
+    const __m256i t6 = _mm256_unpacklo_epi32(r[6], r[7]);
+    const __m256i t7 = _mm256_unpackhi_epi32(r[6], r[7]);
+    const __m256i u0 = _mm256_unpacklo_epi64(t0, t2);
+    const __m256i u1 = _mm256_unpackhi_epi64(t0, t2);
+    const __m256i u2 = _mm256_unpacklo_epi64(t1, t3);
+    const __m256i u3 = _mm256_unpackhi_epi64(t1, t3);
+    const __m256i u4 = _mm256_unpacklo_epi64(t4, t6);
+    const __m256i u5 = _mm256_unpackhi_epi64(t4, t6);
+    const __m256i u6 = _mm256_unpacklo_epi64(t5, t7);
+    const __m256i u7 = _mm256_unpackhi_epi64(t5, t7);
+    r[0] = _mm256_permute2x128_si256(u0, u4, 0x20);
+    r[1] = _mm256_permute2x128_si256(u1, u5, 0x20);
+    r[2] = _mm256_permute2x128_si256(u2, u6, 0x20);
+    r[3] = _mm256_permute2x128_si256(u3, u7, 0x20);
+    r[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+    r[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+    r[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+    r[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+}
+
+/* Eight consecutive whole chunks at once, one in each lane. */
+iCpuTarget("avx2")
+static void chunkCvs8Avx2_(const uint32_t key[8], const uint8_t *chunks, uint64_t counter,
+                           uint32_t cvs_out[8][8]) {
+    __m256i h[8];
+    for (int i = 0; i < 8; i++) {
+        h[i] = _mm256_set1_epi32((int) key[i]);
+    }
+    uint32_t counterLow[8], counterHigh[8];
+    for (int j = 0; j < 8; j++) {
+        counterLow[j]  = (uint32_t) (counter + j);
+        counterHigh[j] = (uint32_t) ((counter + j) >> 32);
+    }
+    const __m256i ctrLow  = _mm256_loadu_si256((const __m256i *) counterLow);
+    const __m256i ctrHigh = _mm256_loadu_si256((const __m256i *) counterHigh);
+    for (int b = 0; b < 16; b++) {
+        __m256i m[16], v[16];
+        for (int j = 0; j < 8; j++) {
+            const uint8_t *block = chunks + j * iBlake3ChunkSize + 64 * b;
+            m[j]     = _mm256_loadu_si256((const __m256i *) block);
+            m[j + 8] = _mm256_loadu_si256((const __m256i *) (block + 32));
+        }
+        transpose8_(m);
+        transpose8_(m + 8);
+        const int flags = (b == 0 ? chunkStart_Blake3Flag : 0) |
+                          (b == 15 ? chunkEnd_Blake3Flag : 0);
+        for (int i = 0; i < 8; i++) {
+            v[i] = h[i];
+        }
+        for (int i = 0; i < 4; i++) {
+            v[8 + i] = _mm256_set1_epi32((int) iv_[i]);
+        }
+        v[12] = ctrLow;
+        v[13] = ctrHigh;
+        v[14] = _mm256_set1_epi32(64);
+        v[15] = _mm256_set1_epi32(flags);
+        for (int r = 0; r < 7; r++) {
+            const uint8_t *s = schedule_[r];
+            g8_(v, 0, 4,  8, 12, m[s[0]],  m[s[1]]);
+            g8_(v, 1, 5,  9, 13, m[s[2]],  m[s[3]]);
+            g8_(v, 2, 6, 10, 14, m[s[4]],  m[s[5]]);
+            g8_(v, 3, 7, 11, 15, m[s[6]],  m[s[7]]);
+            g8_(v, 0, 5, 10, 15, m[s[8]],  m[s[9]]);
+            g8_(v, 1, 6, 11, 12, m[s[10]], m[s[11]]);
+            g8_(v, 2, 7,  8, 13, m[s[12]], m[s[13]]);
+            g8_(v, 3, 4,  9, 14, m[s[14]], m[s[15]]);
+        }
+        for (int i = 0; i < 8; i++) {
+            h[i] = _mm256_xor_si256(v[i], v[i + 8]);
+        }
+    }
+    transpose8_(h);
+    for (int j = 0; j < 8; j++) {
+        _mm256_storeu_si256((__m256i *) cvs_out[j], h[j]);
+    }
+}
+
+#endif /* iBlake3HaveAvx2 */
+
+/* Chaining values of whole chunks. */
+static void chunkCvs_(const uint32_t key[8], const uint8_t *chunks, size_t count,
+                      uint64_t counter, uint32_t cvs_out[][8]) {
+    size_t i = 0;
+#if defined (iBlake3HaveAvx2)
+    if (features_Cpu() & avx2_CpuFeature) {
+        for (; i + 8 <= count; i += 8) {
+            chunkCvs8Avx2_(key, chunks + i * iBlake3ChunkSize, counter + i, cvs_out + i);
+        }
+    }
+#endif
+    for (; i < count; i++) {
+        chunkCv_(key, chunks + i * iBlake3ChunkSize, counter + i, cvs_out[i]);
+    }
+}
+
+/*-------------------------------------------------------------------------------------*/
+
+static size_t chunkLen_Blake3Context_(const iBlake3Context *d) {
+    return 64 * (size_t) d->blocksCompressed + d->blockLen;
+}
+
+static void resetChunk_Blake3Context_(iBlake3Context *d, uint64_t counter) {
+    memcpy(d->chunkCv, d->key, 32);
+    d->chunkCounter     = counter;
+    d->blockLen         = 0;
+    d->blocksCompressed = 0;
+}
+
+/* Adds the chaining value of a subtree that ends at @a total units, and merges every
+   subtree that it completes. A unit is the size of the added subtree. */
+static void pushCv_Blake3Context_(iBlake3Context *d, const uint32_t cv[8], uint64_t total) {
+    uint32_t merged[8];
+    memcpy(merged, cv, 32);
+    while ((total & 1) == 0) {
+        parentCv_(d->key, d->stack[--d->stackLen], merged, 0, merged);
+        total >>= 1;
+    }
+    memcpy(d->stack[d->stackLen++], merged, 32);
+}
+
+/* A full chunk is kept until more input arrives, because the final chunk is compressed
+   with different flags. */
+static void finishChunk_Blake3Context_(iBlake3Context *d) {
+    uint32_t cv[8];
+    compress_(d->chunkCv, d->block, d->chunkCounter, d->blockLen,
+              chunkEnd_Blake3Flag | (d->blocksCompressed == 0 ? chunkStart_Blake3Flag : 0),
+              cv);
+    pushCv_Blake3Context_(d, cv, d->chunkCounter + 1);
+    resetChunk_Blake3Context_(d, d->chunkCounter + 1);
+}
+
+static void updateChunk_Blake3Context_(iBlake3Context *d, const uint8_t *input, size_t size) {
+    while (size) {
+        if (d->blockLen == 64) {
+            compress_(d->chunkCv, d->block, d->chunkCounter, 64,
+                      d->blocksCompressed == 0 ? chunkStart_Blake3Flag : 0, d->chunkCv);
+            d->blocksCompressed++;
+            d->blockLen = 0;
+        }
+        const size_t take = iMin(size, 64u - d->blockLen);
+        memcpy(d->block + d->blockLen, input, take);
+        d->blockLen += (uint8_t) take;
+        input += take;
+        size -= take;
+    }
+}
+
+void init_Blake3Context(iBlake3Context *d) {
+    memcpy(d->key, iv_, 32);
+    d->stackLen = 0;
+    resetChunk_Blake3Context_(d, 0);
+}
+
+void update_Blake3Context(iBlake3Context *d, const void *data, size_t size) {
+    const uint8_t *input = data;
+    while (size) {
+        if (chunkLen_Blake3Context_(d) == iBlake3ChunkSize) {
+            finishChunk_Blake3Context_(d);
+        }
+        if (chunkLen_Blake3Context_(d) == 0 && size > iBlake3ChunkSize) {
+            /* Whole chunks followed by more input. */
+            uint32_t cvs[64][8];
+            const size_t count = iMin((size - 1) / iBlake3ChunkSize, iElemCount(cvs));
+            chunkCvs_(d->key, input, count, d->chunkCounter, cvs);
+            for (size_t i = 0; i < count; i++) {
+                pushCv_Blake3Context_(d, cvs[i], d->chunkCounter + i + 1);
+            }
+            resetChunk_Blake3Context_(d, d->chunkCounter + count);
+            input += count * iBlake3ChunkSize;
+            size  -= count * iBlake3ChunkSize;
+            continue;
+        }
+        const size_t take = iMin(size, iBlake3ChunkSize - chunkLen_Blake3Context_(d));
+        updateChunk_Blake3Context_(d, input, take);
+        input += take;
+        size -= take;
+    }
+}
+
+void final_Blake3Context(const iBlake3Context *d, uint8_t blake3_out[32]) {
+    const uint32_t chunkFlags = chunkEnd_Blake3Flag |
+                                (d->blocksCompressed == 0 ? chunkStart_Blake3Flag : 0);
+    uint32_t out[8];
+    if (d->stackLen == 0) {
+        /* The only chunk is the root. */
+        uint8_t block[64];
+        memcpy(block, d->block, d->blockLen);
+        memset(block + d->blockLen, 0, 64 - d->blockLen);
+        compress_(d->chunkCv, block, 0, d->blockLen, chunkFlags | root_Blake3Flag, out);
+    }
+    else {
+        uint8_t block[64];
+        memcpy(block, d->block, d->blockLen);
+        memset(block + d->blockLen, 0, 64 - d->blockLen);
+        compress_(d->chunkCv, block, d->chunkCounter, d->blockLen, chunkFlags, out);
+        for (int i = d->stackLen - 1; i >= 0; i--) {
+            parentCv_(d->key, d->stack[i], out, i == 0 ? root_Blake3Flag : 0, out);
+        }
+    }
+    for (int i = 0; i < 8; i++) {
+        for (int j = 0; j < 4; j++) {
+            blake3_out[4 * i + j] = (uint8_t) (out[i] >> (8 * j));
+        }
+    }
+}
+
+/*-------------------------------------------------------------------------------------*/
+
+iDeclareType(Blake3Subtrees)
+
+struct Impl_Blake3Subtrees {
+    const uint32_t *key;
+    const uint8_t  *input;
+    uint64_t        counter; /* of the first chunk */
+    uint32_t      (*cvs)[8];
+};
+
+static void hashSubtrees_Blake3_(void *context, size_t begin, size_t end) {
+    const iBlake3Subtrees *d = context;
+    enum { numChunks = iBlake3SubtreeSize / iBlake3ChunkSize };
+    uint32_t (*cvs)[8] = malloc(sizeof(uint32_t[8]) * numChunks);
+    for (size_t t = begin; t < end; t++) {
+        chunkCvs_(d->key,
+                  d->input + t * iBlake3SubtreeSize,
+                  numChunks,
+                  d->counter + t * numChunks,
+                  cvs);
+        /* Merge pairs until one chaining value is left. */
+        for (size_t n = numChunks; n > 1; n /= 2) {
+            for (size_t i = 0; i < n / 2; i++) {
+                parentCv_(d->key, cvs[2 * i], cvs[2 * i + 1], 0, cvs[i]);
+            }
+        }
+        memcpy(d->cvs[t], cvs[0], 32);
+    }
+    free(cvs);
+}
+
+void updateParallel_Blake3Context(iBlake3Context *d, const void *data, size_t size,
+                                  iThreadPool *pool) {
+    enum { numChunks = iBlake3SubtreeSize / iBlake3ChunkSize };
+    const uint8_t *input = data;
+    if (pool) {
+        /* Subtrees must start at a multiple of their size. */
+        const uint64_t pos = d->chunkCounter * iBlake3ChunkSize + chunkLen_Blake3Context_(d);
+        const size_t skip = (size_t) ((iBlake3SubtreeSize - pos % iBlake3SubtreeSize) %
+                                      iBlake3SubtreeSize);
+        if (size > skip + iBlake3SubtreeSize) {
+            update_Blake3Context(d, input, skip);
+            input += skip;
+            size -= skip;
+            if (chunkLen_Blake3Context_(d) == iBlake3ChunkSize) {
+                finishChunk_Blake3Context_(d);
+            }
+            /* The last subtree may be the root, so it is left for the sequential update. */
+            const size_t count = (size - 1) / iBlake3SubtreeSize;
+            iBlake3Subtrees subtrees = {
+                d->key, input, d->chunkCounter, malloc(sizeof(uint32_t[8]) * count)
+            };
+            parallelFor_ThreadPool(pool, 0, count, 1, hashSubtrees_Blake3_, &subtrees);
+            for (size_t t = 0; t < count; t++) {
+                pushCv_Blake3Context_(d, subtrees.cvs[t], d->chunkCounter / numChunks + t + 1);
+            }
+            free(subtrees.cvs);
+            resetChunk_Blake3Context_(d, d->chunkCounter + count * numChunks);
+            input += count * iBlake3SubtreeSize;
+            size  -= count * iBlake3SubtreeSize;
+        }
+    }
+    update_Blake3Context(d, input, size);
+}
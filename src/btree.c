@@ -0,0 +1,534 @@
+/** @file btree.c  Ordered map of integer keys stored in a B+tree.
+
+Inner nodes hold separator keys: every key in `child[i + 1]` is greater than or equal to
+`keys[i]`, and every key in `child[i]` is less than it. Separators are not updated when keys
+are removed from the leaves, as they still bound the subtrees correctly.
+
+Nodes are split and merged on the way down, so insertion and removal are single passes
+without parent pointers.
+
+@authors Copyright (c) 2021 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+@par License
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+<small>THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
+*/
+
+#include "the_Foundation/btree.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define iBTreeMaxKeys   64
+
+enum iBTreeLimits {
+    minLeafKeys_BTree   = iBTreeMaxKeys / 2,
+    minBranchKeys_BTree = (iBTreeMaxKeys - 1) / 2,
+};
+
+struct Impl_BTreeNode {
+    int count; /* keys */
+    iBool isLeaf;
+    iMapKey keys[iBTreeMaxKeys];
+    union {
+        struct {
+            void *values[iBTreeMaxKeys];
+            iBTreeNode *prev;
+            iBTreeNode *next;
+        } leaf;
+        iBTreeNode *child[iBTreeMaxKeys + 1];
+    };
+};
+
+static iBTreeNode *new_BTreeNode_(iBool isLeaf) {
+    iBTreeNode *d = malloc(sizeof(iBTreeNode));
+    d->count  = 0;
+    d->isLeaf = isLeaf;
+    if (isLeaf) {
+        d->leaf.prev = d->leaf.next = NULL;
+    }
+    return d;
+}
+
+static void delete_BTreeNode_(iBTreeNode *d) {
+    if (!d->isLeaf) {
+        for (int i = 0; i <= d->count; i++) {
+            delete_BTreeNode_(d->child[i]);
+        }
+    }
+    free(d);
+}
+
+iLocalDef iBool isMinimal_BTreeNode_(const iBTreeNode *d) {
+    return d->count <= (d->isLeaf ? minLeafKeys_BTree : minBranchKeys_BTree);
+}
+
+iLocalDef iBool isEqual_BTree_(const iBTree *d, iMapKey a, iMapKey b) {
+    return d->cmp ? d->cmp(a, b) == 0 : a == b;
+}
+
+/* Index of the first key in the node that is not less than `key`. Without a comparison
+   function the search does not need to call anything. */
+static int lowerBound_BTree_(const iBTree *d, const iBTreeNode *node, iMapKey key) {
+    const iMapKey *keys = node->keys;
+    int pos = 0;
+    int n = node->count;
+    if (!d->cmp) {
+        while (n > 0) {
+            const int half = n / 2;
+            if (keys[pos + half] < key) {
+                pos += half + 1;
+                n -= half + 1;
+            }
+            else {
+                n = half;
+            }
+        }
+    }
+    else {
+        while (n > 0) {
+            const int half = n / 2;
+            if (d->cmp(keys[pos + half], key) < 0) {
+                pos += half + 1;
+                n -= half + 1;
+            }
+            else {
+                n = half;
+            }
+        }
+    }
+    return pos;
+}
+
+/* Index of the first key in the node that is greater than `key`. In an inner node, this
+   is the index of the child whose subtree may contain `key`. */
+static int upperBound_BTree_(const iBTree *d, const iBTreeNode *node, iMapKey key) {
+    const iMapKey *keys = node->keys;
+    int pos = 0;
+    int n = node->count;
+    if (!d->cmp) {
+        while (n > 0) {
+            const int half = n / 2;
+            if (keys[pos + half] <= key) {
+                pos += half + 1;
+                n -= half + 1;
+            }
+            else {
+                n = half;
+            }
+        }
+    }
+    else {
+        while (n > 0) {
+            const int half = n / 2;
+            if (d->cmp(keys[pos + half], key) <= 0) {
+                pos += half + 1;
+                n -= half + 1;
+            }
+            else {
+                n = half;
+            }
+        }
+    }
+    return pos;
+}
+
+static const iBTreeNode *findLeaf_BTree_(const iBTree *d, iMapKey key) {
+    const iBTreeNode *node = d->root;
+    while (node && !node->isLeaf) {
+        node = node->child[upperBound_BTree_(d, node, key)];
+    }
+    return node;
+}
+
+/* Splits the full child at `index` in two. The node itself must not be full. */
+static void splitChild_BTreeNode_(iBTreeNode *d, int index) {
+    iBTreeNode *left  = d->child[index];
+    iBTreeNode *right = new_BTreeNode_(left->isLeaf);
+    iMapKey separator;
+    if (left->isLeaf) {
+        const int half = left->count / 2;
+        right->count = left->count - half;
+        memcpy(right->keys, left->keys + half, sizeof(iMapKey) * right->count);
+        memcpy(right->leaf.values, left->leaf.values + half, sizeof(void *) * right->count);
+        left->count = half;
+        right->leaf.prev = left;
+        right->leaf.next = left->leaf.next;
+        if (right->leaf.next) {
+            right->leaf.next->leaf.prev = right;
+        }
+        left->leaf.next = right;
+        separator = right->keys[0];
+    }
+    else {
+        /* The middle key moves up. */
+        const int mid = left->count / 2;
+        separator = left->keys[mid];
+        right->count = left->count - mid - 1;
+        memcpy(right->keys, left->keys + mid + 1, sizeof(iMapKey) * right->count);
+        memcpy(right->child, left->child + mid + 1, sizeof(iBTreeNode *) * (right->count + 1));
+        left->count = mid;
+    }
+    memmove(d->keys + index + 1, d->keys + index, sizeof(iMapKey) * (d->count - index));
+    memmove(d->child + index + 2, d->child + index + 1, sizeof(iBTreeNode *) * (d->count - index));
+    d->keys[index] = separator;
+    d->child[index + 1] = right;
+    d->count++;
+}
+
+static void borrowFromLeft_BTreeNode_(iBTreeNode *d, int index) {
+    iBTreeNode *child = d->child[index];
+    iBTreeNode *left  = d->child[index - 1];
+    memmove(child->keys + 1, child->keys, sizeof(iMapKey) * child->count);
+    if (child->isLeaf) {
+        memmove(child->leaf.values + 1, child->leaf.values, sizeof(void *) * child->count);
+        child->keys[0] = left->keys[left->count - 1];
+        child->leaf.values[0] = left->leaf.values[left->count - 1];
+        d->keys[index - 1] = child->keys[0];
+    }
+    else {
+        memmove(child->child + 1, child->child, sizeof(iBTreeNode *) * (child->count + 1));
+        child->keys[0] = d->keys[index - 1];
+        child->child[0] = left->child[left->count];
+        d->keys[index - 1] = left->keys[left->count - 1];
+    }
+    left->count--;
+    child->count++;
+}
+
+static void borrowFromRight_BTreeNode_(iBTreeNode *d, int index) {
+    iBTreeNode *child = d->child[index];
+    iBTreeNode *right = d->child[index + 1];
+    if (child->isLeaf) {
+        child->keys[child->count] = right->keys[0];
+        child->leaf.values[child->count] = right->leaf.values[0];
+        memmove(right->leaf.values, right->leaf.values + 1, sizeof(void *) * (right->count - 1));
+        memmove(right->keys, right->keys + 1, sizeof(iMapKey) * (right->count - 1));
+        d->keys[index] = right->keys[0];
+    }
+    else {
+        child->keys[child->count] = d->keys[index];
+        child->child[child->count + 1] = right->child[0];
+        d->keys[index] = right->keys[0];
+        memmove(right->keys, right->keys + 1, sizeof(iMapKey) * (right->count - 1));
+        memmove(right->child, right->child + 1, sizeof(iBTreeNode *) * right->count);
+    }
+    right->count--;
+    child->count++;
+}
+
+/* Merges the child at `index + 1` into the child at `index`. */
+static void mergeChildren_BTreeNode_(iBTreeNode *d, int index) {
+    iBTreeNode *left  = d->child[index];
+    iBTreeNode *right = d->child[index + 1];
+    if (left->isLeaf) {
+        memcpy(left->keys + left->count, right->keys, sizeof(iMapKey) * right->count);
+        memcpy(left->leaf.values + left->count, right->leaf.values, sizeof(void *) * right->count);
+        left->count += right->count;
+        left->leaf.next = right->leaf.next;
+        if (left->leaf.next) {
+            left->leaf.next->leaf.prev = left;
+        }
+    }
+    else {
+        left->keys[left->count] = d->keys[index];
+        memcpy(left->keys + left->count + 1, right->keys, sizeof(iMapKey) * right->count);
+        memcpy(left->child + left->count + 1, right->child, sizeof(iBTreeNode *) * (right->count + 1));
+        left->count += 1 + right->count;
+    }
+    free(right);
+    memmove(d->keys + index, d->keys + index + 1, sizeof(iMapKey) * (d->count - index - 1));
+    memmove(d->child + index + 1, d->child + index + 2, sizeof(iBTreeNode *) * (d->count - index - 1));
+    d->count--;
+}
+
+/* Gives the child at `index` more than the minimum number of keys, so that one can be
+   removed from its subtree. */
+static void fixChild_BTreeNode_(iBTreeNode *d, int index) {
+    if (index > 0 && !isMinimal_BTreeNode_(d->child[index - 1])) {
+        borrowFromLeft_BTreeNode_(d, index);
+    }
+    else if (index < d->count && !isMinimal_BTreeNode_(d->child[index + 1])) {
+        borrowFromRight_BTreeNode_(d, index);
+    }
+    else {
+        mergeChildren_BTreeNode_(d, index > 0 ? index - 1 : index);
+    }
+}
+
+/*-------------------------------------------------------------------------------------*/
+
+iDefineTypeConstructionArgs(BTree, (iMapNodeCmpFunc cmp), cmp)
+
+void init_BTree(iBTree *d, iMapNodeCmpFunc cmp) {
+    d->size = 0;
+    d->root = NULL;
+    d->cmp  = cmp;
+}
+
+void deinit_BTree(iBTree *d) {
+    clear_BTree(d);
+}
+
+iBool contains_BTree(const iBTree *d, iMapKey key) {
+    return value_BTree(d, key) != NULL;
+}
+
+void *value_BTree(const iBTree *d, iMapKey key) {
+    const iBTreeNode *leaf = findLeaf_BTree_(d, key);
+    if (leaf) {
+        const int pos = lowerBound_BTree_(d, leaf, key);
+        if (pos < leaf->count && isEqual_BTree_(d, leaf->keys[pos], key)) {
+            return leaf->leaf.values[pos];
+        }
+    }
+    return NULL;
+}
+
+void clear_BTree(iBTree *d) {
+    if (d->root) {
+        delete_BTreeNode_(d->root);
+        d->root = NULL;
+    }
+    d->size = 0;
+}
+
+void *insert_BTree(iBTree *d, iMapKey key, void *value) {
+    iAssert(value);
+    if (!d->root) {
+        d->root = new_BTreeNode_(iTrue);
+    }
+    if (d->root->count == iBTreeMaxKeys) {
+        iBTreeNode *root = new_BTreeNode_(iFalse);
+        root->child[0] = d->root;
+        d->root = root;
+        splitChild_BTreeNode_(root, 0);
+    }
+    iBTreeNode *node = d->root;
+    while (!node->isLeaf) {
+        int index = upperBound_BTree_(d, node, key);
+        if (node->child[index]->count == iBTreeMaxKeys) {
+            splitChild_BTreeNode_(node, index);
+            if (!d->cmp ? key >= node->keys[index] : d->cmp(key, node->keys[index]) >= 0) {
+                index++;
+            }
+        }
+        node = node->child[index];
+    }
+    const int pos = lowerBound_BTree_(d, node, key);
+    if (pos < node->count && isEqual_BTree_(d, node->keys[pos], key)) {
+        void *old = node->leaf.values[pos];
+        node->leaf.values[pos] = value;
+        return old;
+    }
+    memmove(node->keys + pos + 1, node->keys + pos, sizeof(iMapKey) * (node->count - pos));
+    memmove(node->leaf.values + pos + 1, node->leaf.values + pos,
+            sizeof(void *) * (node->count - pos));
+    node->keys[pos] = key;
+    node->leaf.values[pos] = value;
+    node->count++;
+    d->size++;
+    return NULL;
+}
+
+void *remove_BTree(iBTree *d, iMapKey key) {
+    iBTreeNode *node = d->root;
+    if (!node) {
+        return NULL;
+    }
+    while (!node->isLeaf) {
+        int index = upperBound_BTree_(d, node, key);
+        if (isMinimal_BTreeNode_(node->child[index])) {
+            fixChild_BTreeNode_(node, index);
+            index = upperBound_BTree_(d, node, key);
+        }
+        node = node->child[index];
+    }
+    void *removed = NULL;
+    const int pos = lowerBound_BTree_(d, node, key);
+    if (pos < node->count && isEqual_BTree_(d, node->keys[pos], key)) {
+        removed = node->leaf.values[pos];
+        memmove(node->keys + pos, node->keys + pos + 1, sizeof(iMapKey) * (node->count - pos - 1));
+        memmove(node->leaf.values + pos, node->leaf.values + pos + 1,
+                sizeof(void *) * (node->count - pos - 1));
+        node->count--;
+        d->size--;
+    }
+    /* Merging may have left the root with a single child. */
+    while (!d->root->isLeaf && d->root->count == 0) {
+        iBTreeNode *root = d->root;
+        d->root = root->child[0];
+        free(root);
+    }
+    if (d->root->isLeaf && d->root->count == 0) {
+        free(d->root);
+        d->root = NULL;
+    }
+    return removed;
+}
+
+/*-------------------------------------------------------------------------------------*/
+
+static const iBTreeNode *firstLeaf_BTree_(const iBTree *d, int dir) {
+    const iBTreeNode *node = d->root;
+    while (node && !node->isLeaf) {
+        node = node->child[dir > 0 ? 0 : node->count];
+    }
+    return node;
+}
+
+/* Position of the lower or upper bound of `key`. The position may be one past the end
+   of the leaf, if the bound is the first key of the next leaf. */
+static const iBTreeNode *seek_BTree_(const iBTree *d, iMapKey key, iBool upper, int *pos_out) {
+    const iBTreeNode *leaf = findLeaf_BTree_(d, key);
+    *pos_out = !leaf ? 0 : upper ? upperBound_BTree_(d, leaf, key) : lowerBound_BTree_(d, leaf, key);
+    return leaf;
+}
+
+/* Moves the iterator to `pos` of `leaf`, continuing to the adjacent leaf in the direction
+   of iteration if `pos` is outside the leaf. */
+static void set_BTreeConstIterator_(iBTreeConstIterator *d, const iBTreeNode *leaf, int pos,
+                                    int dir) {
+    if (dir > 0) {
+        while (leaf && pos >= leaf->count) {
+            leaf = leaf->leaf.next;
+            pos = 0;
+        }
+    }
+    else {
+        while (leaf && pos < 0) {
+            leaf = leaf->leaf.prev;
+            pos = leaf ? leaf->count - 1 : 0;
+        }
+    }
+    d->leaf = leaf;
+    d->pos  = pos;
+    if (leaf) {
+        d->key   = leaf->keys[pos];
+        d->value = leaf->leaf.values[pos];
+    }
+    else {
+        d->key   = 0;
+        d->value = NULL;
+    }
+}
+
+#define set_BTreeIterator_(d, leaf, pos, dir) \
+    set_BTreeConstIterator_((iBTreeConstIterator *) (d), leaf, pos, dir)
+
+static void initFirst_BTreeConstIterator_(iBTreeConstIterator *d, const iBTree *tree, int dir) {
+    const iBTreeNode *leaf = firstLeaf_BTree_(tree, dir);
+    d->tree = tree;
+    set_BTreeConstIterator_(d, leaf, leaf && dir < 0 ? leaf->count - 1 : 0, dir);
+}
+
+static void initBound_BTreeConstIterator_(iBTreeConstIterator *d, const iBTree *tree,
+                                          iMapKey key, iBool upper, int dir) {
+    int pos;
+    const iBTreeNode *leaf = seek_BTree_(tree, key, upper, &pos);
+    d->tree = tree;
+    /* A reverse iterator starts from the key before the bound. */
+    set_BTreeConstIterator_(d, leaf, dir > 0 ? pos : pos - 1, dir);
+}
+
+/* After removing the current key, the tree structure may have changed. The iterator is
+   placed just before the bound of the removed key, so that the next step lands on it. */
+static void *removeCurrent_BTreeConstIterator_(iBTreeConstIterator *d, int dir) {
+    void *removed = remove_BTree(iConstCast(iBTree *, d->tree), d->key);
+    int pos;
+    d->leaf = seek_BTree_(d->tree, d->key, iFalse, &pos);
+    d->pos  = dir > 0 ? pos - 1 : pos;
+    return removed;
+}
+
+void init_BTreeIterator(iBTreeIterator *d, iBTree *tree) {
+    initFirst_BTreeConstIterator_((iBTreeConstIterator *) d, tree, +1);
+}
+
+void next_BTreeIterator(iBTreeIterator *d) {
+    set_BTreeIterator_(d, d->leaf, d->pos + 1, +1);
+}
+
+void *remove_BTreeIterator(iBTreeIterator *d) {
+    return removeCurrent_BTreeConstIterator_((iBTreeConstIterator *) d, +1);
+}
+
+void init_BTreeConstIterator(iBTreeConstIterator *d, const iBTree *tree) {
+    initFirst_BTreeConstIterator_(d, tree, +1);
+}
+
+void next_BTreeConstIterator(iBTreeConstIterator *d) {
+    set_BTreeConstIterator_(d, d->leaf, d->pos + 1, +1);
+}
+
+void init_BTreeReverseIterator(iBTreeReverseIterator *d, iBTree *tree) {
+    initFirst_BTreeConstIterator_((iBTreeConstIterator *) d, tree, -1);
+}
+
+void next_BTreeReverseIterator(iBTreeReverseIterator *d) {
+    set_BTreeIterator_(d, d->leaf, d->pos - 1, -1);
+}
+
+void *remove_BTreeReverseIterator(iBTreeReverseIterator *d) {
+    return removeCurrent_BTreeConstIterator_((iBTreeConstIterator *) d, -1);
+}
+
+void init_BTreeReverseConstIterator(iBTreeReverseConstIterator *d, const iBTree *tree) {
+    initFirst_BTreeConstIterator_(d, tree, -1);
+}
+
+void next_BTreeReverseConstIterator(iBTreeReverseConstIterator *d) {
+    set_BTreeConstIterator_(d, d->leaf, d->pos - 1, -1);
+}
+
+void initLowerBound_BTreeIterator(iBTreeIterator *d, iBTree *tree, iMapKey key) {
+    initBound_BTreeConstIterator_((iBTreeConstIterator *) d, tree, key, iFalse, +1);
+}
+
+void initUpperBound_BTreeIterator(iBTreeIterator *d, iBTree *tree, iMapKey key) {
+    initBound_BTreeConstIterator_((iBTreeConstIterator *) d, tree, key, iTrue, +1);
+}
+
+void initLowerBound_BTreeConstIterator(iBTreeConstIterator *d, const iBTree *tree, iMapKey key) {
+    initBound_BTreeConstIterator_(d, tree, key, iFalse, +1);
+}
+
+void initUpperBound_BTreeConstIterator(iBTreeConstIterator *d, const iBTree *tree, iMapKey key) {
+    initBound_BTreeConstIterator_(d, tree, key, iTrue, +1);
+}
+
+void initLowerBound_BTreeReverseIterator(iBTreeReverseIterator *d, iBTree *tree, iMapKey key) {
+    initBound_BTreeConstIterator_((iBTreeConstIterator *) d, tree, key, iFalse, -1);
+}
+
+void initUpperBound_BTreeReverseIterator(iBTreeReverseIterator *d, iBTree *tree, iMapKey key) {
+    initBound_BTreeConstIterator_((iBTreeConstIterator *) d, tree, key, iTrue, -1);
+}
+
+void initLowerBound_BTreeReverseConstIterator(iBTreeReverseConstIterator *d, const iBTree *tree,
+                                              iMapKey key) {
+    initBound_BTreeConstIterator_(d, tree, key, iFalse, -1);
+}
+
+void initUpperBound_BTreeReverseConstIterator(iBTreeReverseConstIterator *d, const iBTree *tree,
+                                              iMapKey key) {
+    initBound_BTreeConstIterator_(d, tree, key, iTrue, -1);
+}
@@ -0,0 +1,267 @@
+/** @file concurrenthash.c  Thread-safe hash of objects with Block keys.
+
+@authors Copyright (c) 2021 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+@par License
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+<small>THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
+*/
+
+#include "the_Foundation/concurrenthash.h"
+#include "the_Foundation/mutex.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define iConcurrentHashShardBits    6
+#define iConcurrentHashShardCount   (1 << iConcurrentHashShardBits)
+#define iConcurrentHashMinBuckets   16
+#define iConcurrentHashShardAlign   128
+
+iDeclareType(ConcurrentHashNode)
+
+struct Impl_ConcurrentHashNode {
+    iConcurrentHashNode *next;
+    uint32_t hash;
+    iBlock key;
+    iAnyObject *value;
+};
+
+struct Impl_ConcurrentHashShard {
+    union {
+        struct {
+            iMutex mutex;
+            size_t size;
+            size_t mask; /* number of buckets minus one */
+            iConcurrentHashNode **buckets;
+        };
+        char padding_[iConcurrentHashShardAlign]; /* each shard on its own cache lines */
+    };
+};
+
+static iConcurrentHashNode *new_ConcurrentHashNode_(uint32_t hash, const iBlock *key,
+                                                    iAnyObject *value) {
+    iConcurrentHashNode *d = iMalloc(ConcurrentHashNode);
+    d->next  = NULL;
+    d->hash  = hash;
+    initCopy_Block(&d->key, key);
+    d->value = value;
+    return d;
+}
+
+static void delete_ConcurrentHashNode_(iConcurrentHashNode *d) {
+    deinit_Block(&d->key);
+    iRelease(d->value);
+    free(d);
+}
+
+static void deleteChain_ConcurrentHashNode_(iConcurrentHashNode *d) {
+    while (d) {
+        iConcurrentHashNode *next = d->next;
+        delete_ConcurrentHashNode_(d);
+        d = next;
+    }
+}
+
+iLocalDef iConcurrentHashShard *shard_ConcurrentHash_(const iConcurrentHash *d, uint32_t hash) {
+    return &d->shards[hash >> (32 - iConcurrentHashShardBits)];
+}
+
+/* The shard must be locked. Returns the link that points to the key's node, or to NULL
+   at the end of the bucket if the key is not present. */
+static iConcurrentHashNode **find_ConcurrentHashShard_(iConcurrentHashShard *d, uint32_t hash,
+                                                       const iBlock *key) {
+    iConcurrentHashNode **link = &d->buckets[hash & d->mask];
+    for (; *link; link = &(*link)->next) {
+        const iConcurrentHashNode *node = *link;
+        if (node->hash == hash && size_Block(&node->key) == size_Block(key) &&
+            !memcmp(constData_Block(&node->key), constData_Block(key), size_Block(key))) {
+            break;
+        }
+    }
+    return link;
+}
+
+/* The shard must be locked. */
+static void add_ConcurrentHashShard_(iConcurrentHashShard *d, iConcurrentHashNode *node) {
+    iConcurrentHashNode **bucket = &d->buckets[node->hash & d->mask];
+    node->next = *bucket;
+    *bucket = node;
+    if (++d->size > d->mask + 1) {
+        /* Double the number of buckets. */
+        const size_t numBuckets = 2 * (d->mask + 1);
+        iConcurrentHashNode **buckets = calloc(numBuckets, sizeof(iConcurrentHashNode *));
+        for (size_t i = 0; i <= d->mask; i++) {
+            for (iConcurrentHashNode *n = d->buckets[i], *next; n; n = next) {
+                next = n->next;
+                iConcurrentHashNode **b = &buckets[n->hash & (numBuckets - 1)];
+                n->next = *b;
+                *b = n;
+            }
+        }
+        free(d->buckets);
+        d->buckets = buckets;
+        d->mask    = numBuckets - 1;
+    }
+}
+
+/*-------------------------------------------------------------------------------------*/
+
+iDefineObjectConstruction(ConcurrentHash)
+
+void init_ConcurrentHash(iConcurrentHash *d) {
+    /* calloc only guarantees alignment for the basic types, so the allocation is padded
+       to place the shards on cache line boundaries. */
+    d->shardMemory = calloc(1, iConcurrentHashShardCount * sizeof(iConcurrentHashShard) +
+                                   iConcurrentHashShardAlign - 1);
+    d->shards = (iConcurrentHashShard *) (((uintptr_t) d->shardMemory +
+                                           iConcurrentHashShardAlign - 1) &
+                                          ~(uintptr_t) (iConcurrentHashShardAlign - 1));
+    for (int i = 0; i < iConcurrentHashShardCount; i++) {
+        iConcurrentHashShard *shard = &d->shards[i];
+        init_Mutex(&shard->mutex);
+        shard->mask    = iConcurrentHashMinBuckets - 1;
+        shard->buckets = calloc(iConcurrentHashMinBuckets, sizeof(iConcurrentHashNode *));
+    }
+}
+
+void deinit_ConcurrentHash(iConcurrentHash *d) {
+    clear_ConcurrentHash(d);
+    for (int i = 0; i < iConcurrentHashShardCount; i++) {
+        deinit_Mutex(&d->shards[i].mutex);
+        free(d->shards[i].buckets);
+    }
+    free(d->shardMemory);
+}
+
+size_t size_ConcurrentHash(const iConcurrentHash *d) {
+    size_t size = 0;
+    for (int i = 0; i < iConcurrentHashShardCount; i++) {
+        const iConcurrentHashShard *shard = &d->shards[i];
+        iGuardMutex(&shard->mutex, size += shard->size);
+    }
+    return size;
+}
+
+iBool contains_ConcurrentHash(const iConcurrentHash *d, const iBlock *key) {
+    const uint32_t hash = crc32_Block(key);
+    iConcurrentHashShard *shard = shard_ConcurrentHash_(d, hash);
+    iBool found;
+    iGuardMutex(&shard->mutex, found = (*find_ConcurrentHashShard_(shard, hash, key) != NULL));
+    return found;
+}
+
+iAnyObject *value_ConcurrentHash(const iConcurrentHash *d, const iBlock *key) {
+    const uint32_t hash = crc32_Block(key);
+    iConcurrentHashShard *shard = shard_ConcurrentHash_(d, hash);
+    iAnyObject *value = NULL;
+    lock_Mutex(&shard->mutex);
+    const iConcurrentHashNode *node = *find_ConcurrentHashShard_(shard, hash, key);
+    if (node) {
+        value = ref_Object(node->value);
+    }
+    unlock_Mutex(&shard->mutex);
+    return value;
+}
+
+iAnyObject *valueOrCreate_ConcurrentHash(iConcurrentHash *d, const iBlock *key,
+                                         iConcurrentHashCreateFunc create, void *context) {
+    const uint32_t hash = crc32_Block(key);
+    iConcurrentHashShard *shard = shard_ConcurrentHash_(d, hash);
+    iAnyObject *value = NULL;
+    lock_Mutex(&shard->mutex);
+    const iConcurrentHashNode *node = *find_ConcurrentHashShard_(shard, hash, key);
+    if (node) {
+        value = ref_Object(node->value);
+    }
+    else {
+        value = create(key, context);
+        if (value) {
+            add_ConcurrentHashShard_(shard, new_ConcurrentHashNode_(hash, key, ref_Object(value)));
+        }
+    }
+    unlock_Mutex(&shard->mutex);
+    return value;
+}
+
+iBool insert_ConcurrentHash(iConcurrentHash *d, const iBlock *key, const iAnyObject *value) {
+    const uint32_t hash = crc32_Block(key);
+    iConcurrentHashShard *shard = shard_ConcurrentHash_(d, hash);
+    iAnyObject *old = NULL;
+    iConcurrentHashNode *node = new_ConcurrentHashNode_(hash, key, ref_Object(value));
+    lock_Mutex(&shard->mutex);
+    iConcurrentHashNode *existing = *find_ConcurrentHashShard_(shard, hash, key);
+    if (existing) {
+        old = existing->value;
+        existing->value = node->value;
+        node->value = NULL;
+    }
+    else {
+        add_ConcurrentHashShard_(shard, node);
+        node = NULL;
+    }
+    unlock_Mutex(&shard->mutex);
+    /* Objects are released outside the lock, as deleting them may take a while. */
+    if (node) {
+        delete_ConcurrentHashNode_(node);
+    }
+    iRelease(old);
+    return old == NULL;
+}
+
+iBool remove_ConcurrentHash(iConcurrentHash *d, const iBlock *key) {
+    const uint32_t hash = crc32_Block(key);
+    iConcurrentHashShard *shard = shard_ConcurrentHash_(d, hash);
+    lock_Mutex(&shard->mutex);
+    iConcurrentHashNode **link = find_ConcurrentHashShard_(shard, hash, key);
+    iConcurrentHashNode *node = *link;
+    if (node) {
+        *link = node->next;
+        shard->size--;
+    }
+    unlock_Mutex(&shard->mutex);
+    if (node) {
+        delete_ConcurrentHashNode_(node);
+        return iTrue;
+    }
+    return iFalse;
+}
+
+void clear_ConcurrentHash(iConcurrentHash *d) {
+    for (int i = 0; i < iConcurrentHashShardCount; i++) {
+        iConcurrentHashShard *shard = &d->shards[i];
+        iConcurrentHashNode *removed = NULL;
+        lock_Mutex(&shard->mutex);
+        for (size_t b = 0; b <= shard->mask; b++) {
+            for (iConcurrentHashNode *n = shard->buckets[b], *next; n; n = next) {
+                next = n->next;
+                n->next = removed;
+                removed = n;
+            }
+            shard->buckets[b] = NULL;
+        }
+        shard->size = 0;
+        unlock_Mutex(&shard->mutex);
+        deleteChain_ConcurrentHashNode_(removed);
+    }
+}
+
+iDefineClass(ConcurrentHash)
@@ -0,0 +1,159 @@
+/** @file cpu.c  CPU feature detection.
+
+@authors Copyright (c) 2021 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+@par License
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+<small>THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
+*/
+
+#include "the_Foundation/cpu.h"
+#include "the_Foundation/atomic.h"
+#include "the_Foundation/string.h"
+
+#if defined (iHaveCpuDispatch)
+#   if defined (_MSC_VER)
+#       include <intrin.h>
+#   else
+#       include <cpuid.h>
+#   endif
+#endif
+
+#define detected_CpuFeature_    iBit(31) /* detection has been done */
+
+static iAtomicInt detected_;
+static iAtomicInt disabled_;
+
+#if defined (iHaveCpuDispatch)
+static void cpuid_(unsigned leaf, unsigned regs[4]) {
+#   if defined (_MSC_VER)
+    __cpuidex((int *) regs, (int) leaf, 0);
+#   else
+    __cpuid_count(leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+#   endif
+}
+
+static uint64_t xgetbv_(void) {
+#   if defined (_MSC_VER)
+    return _xgetbv(0);
+#   else
+    unsigned lo, hi;
+    __asm__ volatile ("xgetbv" : "=a" (lo), "=d" (hi) : "c" (0));
+    return ((uint64_t) hi << 32) | lo;
+#   endif
+}
+#endif
+
+static int detect_Cpu_(void) {
+    int features = 0;
+#if defined (iHaveCpuDispatch)
+    unsigned regs[4]; /* eax, ebx, ecx, edx */
+    cpuid_(0, regs);
+    const unsigned maxLeaf = regs[0];
+    if (maxLeaf < 1) {
+        return 0;
+    }
+    cpuid_(1, regs);
+    if (regs[3] & iBit(27)) features |= sse2_CpuFeature;
+    if (regs[2] & iBit(20)) features |= sse41_CpuFeature;
+    if (regs[2] & iBit(21)) features |= sse42_CpuFeature;
+    if (regs[2] & iBit(2))  features |= pclmul_CpuFeature;
+    /* AVX registers are usable only if the OS saves them on context switches. */
+    const uint64_t xcr0 = (regs[2] & iBit(28)) ? xgetbv_() : 0; /* OSXSAVE */
+    const iBool haveYmm = (xcr0 & 0x06) == 0x06;
+    const iBool haveZmm = (xcr0 & 0xe6) == 0xe6;
+    if (haveYmm) {
+        if (regs[2] & iBit(29)) features |= avx_CpuFeature;
+        if (regs[2] & iBit(13)) features |= fma_CpuFeature;
+    }
+    if (maxLeaf >= 7) {
+        cpuid_(7, regs);
+        if (haveYmm && (regs[1] & iBit(6)))  features |= avx2_CpuFeature;
+        if (haveZmm && (regs[1] & iBit(17))) features |= avx512f_CpuFeature;
+        if (haveZmm && (regs[1] & iBit(31))) features |= avx512bw_CpuFeature;
+        if (regs[1] & iBit(30)) features |= sha_CpuFeature;
+    }
+#endif
+    return features;
+}
+
+int detectedFeatures_Cpu(void) {
+    int features = value_Atomic(&detected_);
+    if (!features) {
+        /* Detecting more than once in parallel is harmless. */
+        features = detect_Cpu_() | detected_CpuFeature_;
+        set_Atomic(&detected_, features);
+    }
+    return features & ~detected_CpuFeature_;
+}
+
+int features_Cpu(void) {
+    return detectedFeatures_Cpu() & ~value_Atomic(&disabled_);
+}
+
+void setEnabledFeatures_Cpu(int enabled) {
+    set_Atomic(&disabled_, ~enabled & all_CpuFeature);
+}
+
+const char *kernelPath_Cpu(void) {
+    const int features = features_Cpu();
+    if (features & avx2_CpuFeature) {
+        return "avx2";
+    }
+    if (features & sse41_CpuFeature) {
+        return "sse4.1";
+    }
+    if (features & sse2_CpuFeature) {
+        return "sse2";
+    }
+    return "generic";
+}
+
+iString *describe_Cpu(void) {
+    static const struct {
+        int feature;
+        const char *name;
+    } names_[] = {
+        { sse2_CpuFeature, "sse2" },
+        { sse41_CpuFeature, "sse4.1" },
+        { sse42_CpuFeature, "sse4.2" },
+        { pclmul_CpuFeature, "pclmul" },
+        { avx_CpuFeature, "avx" },
+        { fma_CpuFeature, "fma" },
+        { avx2_CpuFeature, "avx2" },
+        { avx512f_CpuFeature, "avx512f" },
+        { avx512bw_CpuFeature, "avx512bw" },
+        { sha_CpuFeature, "sha" },
+    };
+    const int detected = detectedFeatures_Cpu();
+    const int enabled  = features_Cpu();
+    iString *str = new_String();
+    iForIndices(i, names_) {
+        if (detected & names_[i].feature) {
+            appendFormat_String(str,
+                                "%s%s ",
+                                names_[i].name,
+                                enabled & names_[i].feature ? "" : " (disabled)");
+        }
+    }
+    appendFormat_String(str, "(kernels: %s)", kernelPath_Cpu());
+    return str;
+}
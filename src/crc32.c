@@ -26,6 +26,11 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
 */
 
 #include "the_Foundation/defs.h"
+#include "the_Foundation/cpu.h"
+
+#if defined (iHaveCpuDispatch)
+#   include <immintrin.h>
+#endif
 
 /* ====================================================================== */
 /*  COPYRIGHT (C) 1986 Gary S. Brown.  You may use this program, or       */
@@ -67,7 +72,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
 /*                                                                        */
 /*  --------------------------------------------------------------------  */
 
-uint32_t iCrc32(const char *data, size_t size) {
+static uint32_t update_Crc32_(uint32_t crc32, const char *data, size_t size) {
     static const uint32_t crc32_tab[] = {
         0x00000000L, 0x77073096L, 0xee0e612cL, 0x990951baL, 0x076dc419L,
         0x706af48fL, 0xe963a535L, 0x9e6495a3L, 0x0edb8832L, 0x79dcb8a4L,
@@ -123,9 +128,83 @@ uint32_t iCrc32(const char *data, size_t size) {
         0x2d02ef8dL
     };
 
-    uint32_t crc32 = 0;
     for (size_t i = 0; i < size; ++i) {
         crc32 = crc32_tab[(crc32 ^ data[i]) & 0xff] ^ (crc32 >> 8);
     }
     return crc32;
 }
+
+#if defined (iHaveCpuDispatch)
+/* Folds 64 bytes at a time using carry-less multiplication, and finally reduces the
+   remainder to 32 bits with Barrett reduction. See Intel's white paper "Fast CRC
+   Computation for Generic Polynomials Using PCLMULQDQ Instruction" (2009). The constants
+   are for the reflected polynomial above. @a size must be at least 64 and a multiple
+   of 16. */
+iCpuTarget("pclmul,sse4.1")
+static uint32_t fold_Crc32_(uint32_t crc32, const uint8_t *data, size_t size) {
+    const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+    const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+    const __m128i k5k0 = _mm_set_epi64x(0x0000000000, 0x0163cd6124);
+    const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+    const __m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
+    __m128i x1 = _mm_loadu_si128((const __m128i *) (data));
+    __m128i x2 = _mm_loadu_si128((const __m128i *) (data + 16));
+    __m128i x3 = _mm_loadu_si128((const __m128i *) (data + 32));
+    __m128i x4 = _mm_loadu_si128((const __m128i *) (data + 48));
+    __m128i x5, x6, x7, x8;
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int) crc32));
+    data += 64;
+    size -= 64;
+    /* Parallel fold of four 128-bit lanes. */
+    for (; size >= 64; data += 64, size -= 64) {
+        x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i *) (data)));
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i *) (data + 16)));
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i *) (data + 32)));
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i *) (data + 48)));
+    }
+    /* Fold the lanes into one. */
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), x2), x5);
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), x3), x5);
+    x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+    x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11), x4), x5);
+    /* Remaining 16-byte blocks. */
+    for (; size >= 16; data += 16, size -= 16) {
+        x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+        x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k3k4, 0x11),
+                                         _mm_loadu_si128((const __m128i *) data)),
+                           x5);
+    }
+    /* Fold 128 bits to 64 bits. */
+    x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_xor_si128(_mm_clmulepi64_si128(_mm_and_si128(x1, mask), k5k0, 0x00), x2);
+    /* Barrett reduction to 32 bits. */
+    x2 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask), poly, 0x10);
+    x2 = _mm_clmulepi64_si128(_mm_and_si128(x2, mask), poly, 0x00);
+    return (uint32_t) _mm_extract_epi32(_mm_xor_si128(x1, x2), 1);
+}
+#endif
+
+uint32_t iCrc32(const char *data, size_t size) {
+    uint32_t crc32 = 0;
+#if defined (iHaveCpuDispatch)
+    if (size >= 64 && has_Cpu(pclmul_CpuFeature | sse41_CpuFeature)) {
+        const size_t folded = size & ~(size_t) 15;
+        crc32 = fold_Crc32_(crc32, (const uint8_t *) data, folded);
+        data += folded;
+        size -= folded;
+    }
+#endif
+    return update_Crc32_(crc32, data, size);
+}
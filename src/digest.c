@@ -0,0 +1,477 @@
+/** @file digest.c  Message digests.
+
+@authors Copyright (c) 2021 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+@par License
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+<small>THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
+*/
+
+#include "the_Foundation/digest.h"
+#include "the_Foundation/block.h"
+#include "the_Foundation/cpu.h"
+#include "the_Foundation/stream.h"
+#include "the_Foundation/threadpool.h"
+
+#if defined (iHaveCpuDispatch) && defined (__GNUC__)
+#   define iDigestHaveShaNi
+#   include <immintrin.h>
+#endif
+
+iLocalDef uint32_t load32BE_(const uint8_t *p) {
+    return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | p[3];
+}
+
+iLocalDef void store32BE_(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t) (v >> 24);
+    p[1] = (uint8_t) (v >> 16);
+    p[2] = (uint8_t) (v >> 8);
+    p[3] = (uint8_t) v;
+}
+
+iLocalDef uint32_t rotl32_(uint32_t x, int n) {
+    return (x << n) | (x >> (32 - n));
+}
+
+iLocalDef uint32_t rotr32_(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+typedef void (*iDigestBlocksFunc)(uint32_t *state, const uint8_t *data, size_t numBlocks);
+
+/* SHA-1 and SHA-256 share the Merkle-Damgård buffering and padding. */
+static void updateBlocks_(uint32_t *state, uint64_t *count, uint8_t *buffer, const void *data,
+                          size_t size, iDigestBlocksFunc blocks) {
+    const uint8_t *input = data;
+    size_t index = (size_t) (*count & 63);
+    *count += size;
+    if (index) {
+        const size_t part = iMin(size, 64 - index);
+        memcpy(buffer + index, input, part);
+        input += part;
+        size -= part;
+        if (index + part < 64) {
+            return;
+        }
+        blocks(state, buffer, 1);
+    }
+    if (size >= 64) {
+        blocks(state, input, size / 64);
+        input += size & ~(size_t) 63;
+        size &= 63;
+    }
+    memcpy(buffer, input, size);
+}
+
+static void finalBlocks_(uint32_t *state, uint64_t count, uint8_t *buffer,
+                         iDigestBlocksFunc blocks) {
+    size_t index = (size_t) (count & 63);
+    buffer[index++] = 0x80;
+    if (index > 56) {
+        memset(buffer + index, 0, 64 - index);
+        blocks(state, buffer, 1);
+        index = 0;
+    }
+    memset(buffer + index, 0, 56 - index);
+    const uint64_t bits = count << 3;
+    store32BE_(buffer + 56, (uint32_t) (bits >> 32));
+    store32BE_(buffer + 60, (uint32_t) bits);
+    blocks(state, buffer, 1);
+}
+
+/*-------------------------------------------------------------------------------------*/
+
+static void sha1Blocks_(uint32_t *state, const uint8_t *data, size_t numBlocks) {
+    for (; numBlocks; numBlocks--, data += 64) {
+        uint32_t w[80];
+        for (int i = 0; i < 16; i++) {
+            w[i] = load32BE_(data + 4 * i);
+        }
+        for (int i = 16; i < 80; i++) {
+            w[i] = rotl32_(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        }
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+        for (int i = 0; i < 80; i++) {
+            uint32_t f, k;
+            if (i < 20) {
+                f = (b & c) | (~b & d);
+                k = 0x5a827999;
+            }
+            else if (i < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ed9eba1;
+            }
+            else if (i < 60) {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8f1bbcdc;
+            }
+            else {
+                f = b ^ c ^ d;
+                k = 0xca62c1d6;
+            }
+            const uint32_t t = rotl32_(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = rotl32_(b, 30);
+            b = a;
+            a = t;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+    }
+}
+
+static const uint32_t sha256K_[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static void sha256Blocks_(uint32_t *state, const uint8_t *data, size_t numBlocks) {
+    for (; numBlocks; numBlocks--, data += 64) {
+        uint32_t w[64];
+        for (int i = 0; i < 16; i++) {
+            w[i] = load32BE_(data + 4 * i);
+        }
+        for (int i = 16; i < 64; i++) {
+            const uint32_t s0 = rotr32_(w[i - 15], 7) ^ rotr32_(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            const uint32_t s1 = rotr32_(w[i - 2], 17) ^ rotr32_(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; i++) {
+            const uint32_t s1 = rotr32_(e, 6) ^ rotr32_(e, 11) ^ rotr32_(e, 25);
+            const uint32_t t1 = h + s1 + ((e & f) ^ (~e & g)) + sha256K_[i] + w[i];
+            const uint32_t s0 = rotr32_(a, 2) ^ rotr32_(a, 13) ^ rotr32_(a, 22);
+            const uint32_t t2 = s0 + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+}
+
+#if defined (iDigestHaveShaNi)
+
+/* Four rounds per step. Each step also advances the message schedule for the following
+   steps, as far as there are rounds left. */
+#define iSha1Step_(g, e, eNext, m0, m1, m2, m3) { \
+    if ((g) == 0) { e = _mm_add_epi32(e, m0); } else { e = _mm_sha1nexte_epu32(e, m0); } \
+    eNext = abcd; \
+    if ((g) >= 3 && (g) <= 18) { m1 = _mm_sha1msg2_epu32(m1, m0); } \
+    abcd = _mm_sha1rnds4_epu32(abcd, e, (g) / 5); \
+    if ((g) >= 1 && (g) <= 16) { m3 = _mm_sha1msg1_epu32(m3, m0); } \
+    if ((g) >= 2 && (g) <= 17) { m2 = _mm_xor_si128(m2, m0); } }
+
+iCpuTarget("sha,sse4.1")
+static void sha1BlocksShaNi_(uint32_t *state, const uint8_t *data, size_t numBlocks) {
+    const __m128i mask = _mm_set_epi64x(0x0001020304050607, 0x08090a0b0c0d0e0f);
+    __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *) state), 0x1b);
+    __m128i e0   = _mm_set_epi32((int) state[4], 0, 0, 0);
+    __m128i e1;
+    for (; numBlocks; numBlocks--, data += 64) {
+        const __m128i abcdSaved = abcd;
+        const __m128i eSaved    = e0;
+        __m128i m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) data), mask);
+        __m128i m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + 16)), mask);
+        __m128i m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + 32)), mask);
+        __m128i m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + 48)), mask);
+        iSha1Step_( 0, e0, e1, m0, m1, m2, m3);
+        iSha1Step_( 1, e1, e0, m1, m2, m3, m0);
+        iSha1Step_( 2, e0, e1, m2, m3, m0, m1);
+        iSha1Step_( 3, e1, e0, m3, m0, m1, m2);
+        iSha1Step_( 4, e0, e1, m0, m1, m2, m3);
+        iSha1Step_( 5, e1, e0, m1, m2, m3, m0);
+        iSha1Step_( 6, e0, e1, m2, m3, m0, m1);
+        iSha1Step_( 7, e1, e0, m3, m0, m1, m2);
+        iSha1Step_( 8, e0, e1, m0, m1, m2, m3);
+        iSha1Step_( 9, e1, e0, m1, m2, m3, m0);
+        iSha1Step_(10, e0, e1, m2, m3, m0, m1);
+        iSha1Step_(11, e1, e0, m3, m0, m1, m2);
+        iSha1Step_(12, e0, e1, m0, m1, m2, m3);
+        iSha1Step_(13, e1, e0, m1, m2, m3, m0);
+        iSha1Step_(14, e0, e1, m2, m3, m0, m1);
+        iSha1Step_(15, e1, e0, m3, m0, m1, m2);
+        iSha1Step_(16, e0, e1, m0, m1, m2, m3);
+        iSha1Step_(17, e1, e0, m1, m2, m3, m0);
+        iSha1Step_(18, e0, e1, m2, m3, m0, m1);
+        iSha1Step_(19, e1, e0, m3, m0, m1, m2);
+        e0   = _mm_sha1nexte_epu32(e0, eSaved);
+        abcd = _mm_add_epi32(abcd, abcdSaved);
+    }
+    _mm_storeu_si128((__m128i *) state, _mm_shuffle_epi32(abcd, 0x1b));
+    state[4] = (uint32_t) _mm_extract_epi32(e0, 3);
+}
+
+#define iSha256Step_(g, m0, m1, m2, m3) { \
+    __m128i msg_ = _mm_add_epi32(m0, _mm_loadu_si128((const __m128i *) (sha256K_ + 4 * (g)))); \
+    state1 = _mm_sha256rnds2_epu32(state1, state0, msg_); \
+    if ((g) >= 3 && (g) <= 14) { \
+        m1 = _mm_sha256msg2_epu32(_mm_add_epi32(m1, _mm_alignr_epi8(m0, m3, 4)), m0); \
+    } \
+    state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg_, 0x0e)); \
+    if ((g) >= 1 && (g) <= 12) { m3 = _mm_sha256msg1_epu32(m3, m0); } }
+
+iCpuTarget("sha,sse4.1")
+static void sha256BlocksShaNi_(uint32_t *state, const uint8_t *data, size_t numBlocks) {
+    const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0b, 0x0405060700010203);
+    /* The instructions use the state words in the order ABEF and CDGH. */
+    const __m128i cdab = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *) state), 0xb1);
+    const __m128i efgh = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *) (state + 4)), 0x1b);
+    __m128i state0 = _mm_alignr_epi8(cdab, efgh, 8);
+    __m128i state1 = _mm_blend_epi16(efgh, cdab, 0xf0);
+    for (; numBlocks; numBlocks--, data += 64) {
+        const __m128i abefSaved = state0;
+        const __m128i cdghSaved = state1;
+        __m128i m0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) data), mask);
+        __m128i m1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + 16)), mask);
+        __m128i m2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + 32)), mask);
+        __m128i m3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + 48)), mask);
+        iSha256Step_( 0, m0, m1, m2, m3);
+        iSha256Step_( 1, m1, m2, m3, m0);
+        iSha256Step_( 2, m2, m3, m0, m1);
+        iSha256Step_( 3, m3, m0, m1, m2);
+        iSha256Step_( 4, m0, m1, m2, m3);
+        iSha256Step_( 5, m1, m2, m3, m0);
+        iSha256Step_( 6, m2, m3, m0, m1);
+        iSha256Step_( 7, m3, m0, m1, m2);
+        iSha256Step_( 8, m0, m1, m2, m3);
+        iSha256Step_( 9, m1, m2, m3, m0);
+        iSha256Step_(10, m2, m3, m0, m1);
+        iSha256Step_(11, m3, m0, m1, m2);
+        iSha256Step_(12, m0, m1, m2, m3);
+        iSha256Step_(13, m1, m2, m3, m0);
+        iSha256Step_(14, m2, m3, m0, m1);
+        iSha256Step_(15, m3, m0, m1, m2);
+        state0 = _mm_add_epi32(state0, abefSaved);
+        state1 = _mm_add_epi32(state1, cdghSaved);
+    }
+    const __m128i feba = _mm_shuffle_epi32(state0, 0x1b);
+    const __m128i dchg = _mm_shuffle_epi32(state1, 0xb1);
+    _mm_storeu_si128((__m128i *) state, _mm_blend_epi16(feba, dchg, 0xf0));
+    _mm_storeu_si128((__m128i *) (state + 4), _mm_alignr_epi8(dchg, feba, 8));
+}
+
+#endif /* iDigestHaveShaNi */
+
+static iDigestBlocksFunc sha1BlocksFunc_(void) {
+#if defined (iDigestHaveShaNi)
+    if (has_Cpu(sha_CpuFeature | sse41_CpuFeature)) {
+        return sha1BlocksShaNi_;
+    }
+#endif
+    return sha1Blocks_;
+}
+
+static iDigestBlocksFunc sha256BlocksFunc_(void) {
+#if defined (iDigestHaveShaNi)
+    if (has_Cpu(sha_CpuFeature | sse41_CpuFeature)) {
+        return sha256BlocksShaNi_;
+    }
+#endif
+    return sha256Blocks_;
+}
+
+void init_Sha1Context(iSha1Context *d) {
+    static const uint32_t initial[5] = {
+        0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0
+    };
+    memcpy(d->state, initial, sizeof(initial));
+    d->count = 0;
+}
+
+void update_Sha1Context(iSha1Context *d, const void *data, size_t size) {
+    updateBlocks_(d->state, &d->count, d->buffer, data, size, sha1BlocksFunc_());
+}
+
+void final_Sha1Context(iSha1Context *d, uint8_t sha1_out[20]) {
+    finalBlocks_(d->state, d->count, d->buffer, sha1BlocksFunc_());
+    for (int i = 0; i < 5; i++) {
+        store32BE_(sha1_out + 4 * i, d->state[i]);
+    }
+}
+
+void init_Sha256Context(iSha256Context *d) {
+    static const uint32_t initial[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(d->state, initial, sizeof(initial));
+    d->count = 0;
+}
+
+void update_Sha256Context(iSha256Context *d, const void *data, size_t size) {
+    updateBlocks_(d->state, &d->count, d->buffer, data, size, sha256BlocksFunc_());
+}
+
+void final_Sha256Context(iSha256Context *d, uint8_t sha256_out[32]) {
+    finalBlocks_(d->state, d->count, d->buffer, sha256BlocksFunc_());
+    for (int i = 0; i < 8; i++) {
+        store32BE_(sha256_out + 4 * i, d->state[i]);
+    }
+}
+
+/*-------------------------------------------------------------------------------------*/
+
+size_t size_DigestAlgorithm(enum iDigestAlgorithm algorithm) {
+    switch (algorithm) {
+        case md5_DigestAlgorithm:
+            return 16;
+        case sha1_DigestAlgorithm:
+            return 20;
+        case sha256_DigestAlgorithm:
+        case blake3_DigestAlgorithm:
+            return 32;
+    }
+    return 0;
+}
+
+const char *name_DigestAlgorithm(enum iDigestAlgorithm algorithm) {
+    switch (algorithm) {
+        case md5_DigestAlgorithm:
+            return "MD5";
+        case sha1_DigestAlgorithm:
+            return "SHA-1";
+        case sha256_DigestAlgorithm:
+            return "SHA-256";
+        case blake3_DigestAlgorithm:
+            return "BLAKE3";
+    }
+    return "";
+}
+
+void init_Digest(iDigest *d, enum iDigestAlgorithm algorithm) {
+    d->algorithm = algorithm;
+    reset_Digest(d);
+}
+
+void deinit_Digest(iDigest *d) {
+    iUnused(d);
+}
+
+iDefineTypeConstructionArgs(Digest, (enum iDigestAlgorithm algorithm), algorithm)
+
+void reset_Digest(iDigest *d) {
+    switch (d->algorithm) {
+        case md5_DigestAlgorithm:
+            init_Md5Context(&d->context.md5);
+            break;
+        case sha1_DigestAlgorithm:
+            init_Sha1Context(&d->context.sha1);
+            break;
+        case sha256_DigestAlgorithm:
+            init_Sha256Context(&d->context.sha256);
+            break;
+        case blake3_DigestAlgorithm:
+            init_Blake3Context(&d->context.blake3);
+            break;
+    }
+}
+
+void update_Digest(iDigest *d, const void *data, size_t size) {
+    switch (d->algorithm) {
+        case md5_DigestAlgorithm:
+            update_Md5Context(&d->context.md5, data, size);
+            break;
+        case sha1_DigestAlgorithm:
+            update_Sha1Context(&d->context.sha1, data, size);
+            break;
+        case sha256_DigestAlgorithm:
+            update_Sha256Context(&d->context.sha256, data, size);
+            break;
+        case blake3_DigestAlgorithm:
+            update_Blake3Context(&d->context.blake3, data, size);
+            break;
+    }
+}
+
+void updateBlock_Digest(iDigest *d, const iBlock *data) {
+    update_Digest(d, constData_Block(data), size_Block(data));
+}
+
+#define iDigestStreamPiece  (4 * 1024 * 1024)
+
+size_t updateStream_Digest(iDigest *d, iStream *stream, iThreadPool *pool) {
+    const iBool isParallel = pool && d->algorithm == blake3_DigestAlgorithm;
+    uint8_t *buf = malloc(iDigestStreamPiece);
+    size_t total = 0;
+    for (;;) {
+        const size_t num = readData_Stream(stream, iDigestStreamPiece, buf);
+        if (num == 0) {
+            break;
+        }
+        if (isParallel) {
+            updateParallel_Blake3Context(&d->context.blake3, buf, num, pool);
+        }
+        else {
+            update_Digest(d, buf, num);
+        }
+        total += num;
+    }
+    free(buf);
+    return total;
+}
+
+void final_Digest(iDigest *d, uint8_t *digest_out) {
+    switch (d->algorithm) {
+        case md5_DigestAlgorithm:
+            final_Md5Context(&d->context.md5, digest_out);
+            break;
+        case sha1_DigestAlgorithm:
+            final_Sha1Context(&d->context.sha1, digest_out);
+            break;
+        case sha256_DigestAlgorithm:
+            final_Sha256Context(&d->context.sha256, digest_out);
+            break;
+        case blake3_DigestAlgorithm:
+            final_Blake3Context(&d->context.blake3, digest_out);
+            break;
+    }
+    reset_Digest(d);
+}
+
+iBlock *finalBlock_Digest(iDigest *d) {
+    iBlock *digest = new_Block(size_Digest(d));
+    final_Digest(d, data_Block(digest));
+    return digest;
+}
@@ -0,0 +1,373 @@
+/** @file fixed3.c  Bulk operations over arrays of fixed-point vectors.
+
+@authors Copyright (c) 2021 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+@par License
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+<small>THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
+*/
+
+#include "the_Foundation/fixed3.h"
+#include "the_Foundation/cpu.h"
+
+/* The vector kernels rely on the scalar operations being exact, which requires 128-bit
+   intermediate products. */
+#if defined (iHaveCpuDispatch) && defined (__GNUC__) && defined (__SIZEOF_INT128__)
+#   define iFixedHaveAvx2
+#   include <immintrin.h>
+#endif
+
+/* Every code path gives exactly the same results as the corresponding iFixed3 operation.
+   A vector kernel returns the number of elements it processed; the rest are done with
+   the scalar operations. Add, sub, mul, and mix work on each component separately, so the
+   arrays are processed as flat arrays of iFixed values. */
+
+static void add_(const iFixed *a, const iFixed *b, size_t count, iFixed *out) {
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = add_Fixed(a[i], b[i]);
+    }
+}
+
+static void sub_(const iFixed *a, const iFixed *b, size_t count, iFixed *out) {
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = sub_Fixed(a[i], b[i]);
+    }
+}
+
+static void mul_(const iFixed *a, const iFixed *b, size_t count, iFixed *out) {
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = mul_Fixed(a[i], b[i]);
+    }
+}
+
+static void mix_(const iFixed *a, const iFixed *b, iFixed t, size_t count, iFixed *out) {
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = mix_Fixed(a[i], b[i], t);
+    }
+}
+
+#if defined (iFixedHaveAvx2)
+
+/* Bits 16...79 of the signed 128-bit product, like mul_Fixed(). The 64x64 multiply is
+   built from 32x32 partial products, and the high half is corrected for the signs. */
+iCpuTarget("avx2")
+iLocalDef __m256i mul4_(__m256i a, __m256i b) {
+    const __m256i low32 = _mm256_set1_epi64x(0xffffffff);
+    const __m256i aHigh = _mm256_srli_epi64(a, 32);
+    const __m256i bHigh = _mm256_srli_epi64(b, 32);
+    const __m256i p0    = _mm256_mul_epu32(a, b);
+    const __m256i p1    = _mm256_mul_epu32(a, bHigh);
+    const __m256i p2    = _mm256_mul_epu32(aHigh, b);
+    const __m256i p3    = _mm256_mul_epu32(aHigh, bHigh);
+    const __m256i mid   = _mm256_add_epi64(_mm256_add_epi64(_mm256_srli_epi64(p0, 32),
+                                                            _mm256_and_si256(p1, low32)),
+                                           _mm256_and_si256(p2, low32));
+    const __m256i lo    = _mm256_or_si256(_mm256_slli_epi64(mid, 32),
+                                          _mm256_and_si256(p0, low32));
+    __m256i hi = _mm256_add_epi64(_mm256_add_epi64(p3, _mm256_srli_epi64(p1, 32)),
+                                  _mm256_add_epi64(_mm256_srli_epi64(p2, 32),
+                                                   _mm256_srli_epi64(mid, 32)));
+    const __m256i zero = _mm256_setzero_si256();
+    hi = _mm256_sub_epi64(hi, _mm256_and_si256(_mm256_cmpgt_epi64(zero, a), b));
+    hi = _mm256_sub_epi64(hi, _mm256_and_si256(_mm256_cmpgt_epi64(zero, b), a));
+    return _mm256_or_si256(_mm256_srli_epi64(lo, iFixedFracBits),
+                           _mm256_slli_epi64(hi, 64 - iFixedFracBits));
+}
+
+/* Same as mul4_(a, a) with one partial product less. */
+iCpuTarget("avx2")
+iLocalDef __m256i sqr4_(__m256i a) {
+    const __m256i low32 = _mm256_set1_epi64x(0xffffffff);
+    const __m256i aHigh = _mm256_srli_epi64(a, 32);
+    const __m256i p0    = _mm256_mul_epu32(a, a);
+    const __m256i p1    = _mm256_mul_epu32(a, aHigh);
+    const __m256i p3    = _mm256_mul_epu32(aHigh, aHigh);
+    const __m256i mid   = _mm256_add_epi64(_mm256_srli_epi64(p0, 32),
+                                           _mm256_slli_epi64(_mm256_and_si256(p1, low32), 1));
+    const __m256i lo    = _mm256_or_si256(_mm256_slli_epi64(mid, 32),
+                                          _mm256_and_si256(p0, low32));
+    __m256i hi = _mm256_add_epi64(_mm256_add_epi64(p3, _mm256_srli_epi64(mid, 32)),
+                                  _mm256_slli_epi64(_mm256_srli_epi64(p1, 32), 1));
+    const __m256i neg = _mm256_and_si256(_mm256_cmpgt_epi64(_mm256_setzero_si256(), a), a);
+    hi = _mm256_sub_epi64(hi, _mm256_slli_epi64(neg, 1));
+    return _mm256_or_si256(_mm256_srli_epi64(lo, iFixedFracBits),
+                           _mm256_slli_epi64(hi, 64 - iFixedFracBits));
+}
+
+iCpuTarget("avx2")
+iLocalDef __m256i load4_(const iFixed *p) {
+    return _mm256_loadu_si256((const __m256i *) p);
+}
+
+iCpuTarget("avx2")
+iLocalDef void store4_(iFixed *p, __m256i v) {
+    _mm256_storeu_si256((__m256i *) p, v);
+}
+
+iCpuTarget("avx2")
+static size_t addAvx2_(const iFixed *a, const iFixed *b, size_t count, iFixed *out) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        store4_(out + i, _mm256_add_epi64(load4_(a + i), load4_(b + i)));
+    }
+    return i;
+}
+
+iCpuTarget("avx2")
+static size_t subAvx2_(const iFixed *a, const iFixed *b, size_t count, iFixed *out) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        store4_(out + i, _mm256_sub_epi64(load4_(a + i), load4_(b + i)));
+    }
+    return i;
+}
+
+iCpuTarget("avx2")
+static size_t mulAvx2_(const iFixed *a, const iFixed *b, size_t count, iFixed *out) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        store4_(out + i, mul4_(load4_(a + i), load4_(b + i)));
+    }
+    return i;
+}
+
+iCpuTarget("avx2")
+static size_t mixAvx2_(const iFixed *a, const iFixed *b, iFixed t, size_t count,
+                       iFixed *out) {
+    const __m256i tv = _mm256_set1_epi64x(t.v);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m256i av = load4_(a + i);
+        const __m256i dv = _mm256_sub_epi64(load4_(b + i), av);
+        store4_(out + i, _mm256_add_epi64(av, mul4_(dv, tv)));
+    }
+    return i;
+}
+
+/* Four consecutive iFixed3 values as separate x, y, and z vectors, and back. */
+iCpuTarget("avx2")
+static void load4X3_(const iFixed3 *p, __m256i *x, __m256i *y, __m256i *z) {
+    const __m256i r0 = load4_(&p[0].x); /* x0 y0 z0 x1 */
+    const __m256i r1 = load4_(&p[1].y); /* y1 z1 x2 y2 */
+    const __m256i r2 = load4_(&p[2].z); /* z2 x3 y3 z3 */
+    *x = _mm256_permute4x64_epi64(
+        _mm256_blend_epi32(_mm256_blend_epi32(r0, r1, 0x30), r2, 0x0c), 0x6c);
+    *y = _mm256_permute4x64_epi64(
+        _mm256_blend_epi32(_mm256_blend_epi32(r0, r1, 0xc3), r2, 0x30), 0xb1);
+    *z = _mm256_permute4x64_epi64(
+        _mm256_blend_epi32(_mm256_blend_epi32(r0, r1, 0x0c), r2, 0xc3), 0xc6);
+}
+
+iCpuTarget("avx2")
+static void store4X3_(iFixed3 *p, __m256i x, __m256i y, __m256i z) {
+    const __m256i xp = _mm256_permute4x64_epi64(x, 0x6c); /* x0 x3 x2 x1 */
+    const __m256i yp = _mm256_permute4x64_epi64(y, 0xb1); /* y1 y0 y3 y2 */
+    const __m256i zp = _mm256_permute4x64_epi64(z, 0xc6); /* z2 z1 z0 z3 */
+    store4_(&p[0].x, _mm256_blend_epi32(_mm256_blend_epi32(xp, yp, 0x0c), zp, 0x30));
+    store4_(&p[1].y, _mm256_blend_epi32(_mm256_blend_epi32(yp, zp, 0x0c), xp, 0x30));
+    store4_(&p[2].z, _mm256_blend_epi32(_mm256_blend_epi32(zp, xp, 0x0c), yp, 0x30));
+}
+
+/* Conversions between integers and doubles are exact below 2^51 in magnitude. */
+#define iFixedExactLimit (INT64_C(1) << 51)
+
+iCpuTarget("avx2")
+iLocalDef __m256d toDouble4_(__m256i v) {
+    const __m256d magic = _mm256_set1_pd(0x1.8p52);
+    return _mm256_sub_pd(_mm256_castsi256_pd(_mm256_add_epi64(v, _mm256_castpd_si256(magic))),
+                         magic);
+}
+
+iCpuTarget("avx2")
+iLocalDef __m256i toInt4_(__m256d integral) {
+    const __m256d magic = _mm256_set1_pd(0x1.8p52);
+    return _mm256_sub_epi64(_mm256_castpd_si256(_mm256_add_pd(integral, magic)),
+                            _mm256_castpd_si256(magic));
+}
+
+iCpuTarget("avx2")
+iLocalDef __m256i inRange4_(__m256i v, int64_t min, int64_t max) {
+    return _mm256_and_si256(_mm256_cmpgt_epi64(v, _mm256_set1_epi64x(min - 1)),
+                            _mm256_cmpgt_epi64(_mm256_set1_epi64x(max), v));
+}
+
+/* Like length_X3(): the squared length is rounded to float for the square root. Returns
+   false if the squared lengths are outside the range where the conversions are exact. */
+iCpuTarget("avx2")
+static iBool length4_(__m256i x, __m256i y, __m256i z, __m256i *len_out) {
+    const __m256i lenSq = _mm256_add_epi64(_mm256_add_epi64(sqr4_(x), sqr4_(y)), sqr4_(z));
+    if (_mm256_movemask_pd(_mm256_castsi256_pd(inRange4_(lenSq, 0, iFixedExactLimit - 1)))
+        != 0xf) {
+        return iFalse;
+    }
+    const __m256d lenSqUnits = _mm256_mul_pd(toDouble4_(lenSq), _mm256_set1_pd(1.0 / iFixedUnit));
+    const __m128  len = _mm_mul_ps(_mm_sqrt_ps(_mm256_cvtpd_ps(lenSqUnits)),
+                                   _mm_set1_ps((float) iFixedUnit));
+    *len_out = toInt4_(_mm256_round_pd(_mm256_cvtps_pd(len),
+                                       _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC));
+    return iTrue;
+}
+
+iCpuTarget("avx2")
+static size_t lengthAvx2_(const iFixed3 *vecs, size_t count, iFixed *out) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256i x, y, z, len;
+        load4X3_(vecs + i, &x, &y, &z);
+        if (length4_(x, y, z, &len)) {
+            store4_(out + i, len);
+        }
+        else {
+            for (size_t j = i; j < i + 4; ++j) {
+                out[j] = length_X3(vecs[j]);
+            }
+        }
+    }
+    return i;
+}
+
+/* Like div_Fixed(). The quotient of the doubles may be one too large in magnitude after
+   truncation, which the remainder reveals. */
+iCpuTarget("avx2")
+iLocalDef __m256i div4_(__m256i a, __m256d divisor) {
+    const __m256d num  = _mm256_mul_pd(toDouble4_(a), _mm256_set1_pd(iFixedUnit));
+    const __m256d quot = _mm256_round_pd(_mm256_div_pd(num, divisor),
+                                         _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+    const __m256d rem  = _mm256_sub_pd(num, _mm256_mul_pd(quot, divisor));
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d one  = _mm256_set1_pd(1.0);
+    const __m256d over = _mm256_and_pd(_mm256_cmp_pd(num, zero, _CMP_GE_OQ),
+                                       _mm256_cmp_pd(rem, zero, _CMP_LT_OQ));
+    const __m256d under = _mm256_and_pd(_mm256_cmp_pd(num, zero, _CMP_LT_OQ),
+                                        _mm256_cmp_pd(rem, zero, _CMP_GT_OQ));
+    return toInt4_(_mm256_add_pd(_mm256_sub_pd(quot, _mm256_and_pd(over, one)),
+                                 _mm256_and_pd(under, one)));
+}
+
+iCpuTarget("avx2")
+static size_t normalizeAvx2_(const iFixed3 *vecs, size_t count, iFixed3 *out) {
+    /* Numerators are the components shifted left, so they must stay below the limit. */
+    const int64_t compLimit = iFixedExactLimit >> iFixedFracBits;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256i x, y, z, len;
+        load4X3_(vecs + i, &x, &y, &z);
+        if (length4_(x, y, z, &len)) {
+            const __m256i valid = _mm256_and_si256(
+                _mm256_and_si256(inRange4_(len, 1, iFixedExactLimit - 1),
+                                 inRange4_(x, -compLimit + 1, compLimit)),
+                _mm256_and_si256(inRange4_(y, -compLimit + 1, compLimit),
+                                 inRange4_(z, -compLimit + 1, compLimit)));
+            if (_mm256_movemask_pd(_mm256_castsi256_pd(valid)) == 0xf) {
+                const __m256d divisor = toDouble4_(len);
+                store4X3_(out + i, div4_(x, divisor), div4_(y, divisor), div4_(z, divisor));
+                continue;
+            }
+        }
+        for (size_t j = i; j < i + 4; ++j) {
+            out[j] = normalize_X3(vecs[j]);
+        }
+    }
+    return i;
+}
+
+#endif /* iFixedHaveAvx2 */
+
+/*-------------------------------------------------------------------------------------*/
+
+iLocalDef iBool haveAvx2_(void) {
+#if defined (iFixedHaveAvx2)
+    return (features_Cpu() & avx2_CpuFeature) != 0;
+#else
+    return iFalse;
+#endif
+}
+
+/* The components of an iFixed3 array as a flat iFixed array. */
+#define iComps(vecs) (&(vecs)->x)
+
+void addArray_X3(const iFixed3 *a, const iFixed3 *b, size_t count, iFixed3 *out) {
+    const size_t n = 3 * count;
+    size_t done = 0;
+#if defined (iFixedHaveAvx2)
+    if (haveAvx2_()) {
+        done = addAvx2_(iComps(a), iComps(b), n, iComps(out));
+    }
+#endif
+    add_(iComps(a) + done, iComps(b) + done, n - done, iComps(out) + done);
+}
+
+void subArray_X3(const iFixed3 *a, const iFixed3 *b, size_t count, iFixed3 *out) {
+    const size_t n = 3 * count;
+    size_t done = 0;
+#if defined (iFixedHaveAvx2)
+    if (haveAvx2_()) {
+        done = subAvx2_(iComps(a), iComps(b), n, iComps(out));
+    }
+#endif
+    sub_(iComps(a) + done, iComps(b) + done, n - done, iComps(out) + done);
+}
+
+void mulArray_X3(const iFixed3 *a, const iFixed3 *b, size_t count, iFixed3 *out) {
+    const size_t n = 3 * count;
+    size_t done = 0;
+#if defined (iFixedHaveAvx2)
+    if (haveAvx2_()) {
+        done = mulAvx2_(iComps(a), iComps(b), n, iComps(out));
+    }
+#endif
+    mul_(iComps(a) + done, iComps(b) + done, n - done, iComps(out) + done);
+}
+
+void mixArray_X3(const iFixed3 *a, const iFixed3 *b, iFixed t, size_t count, iFixed3 *out) {
+    const size_t n = 3 * count;
+    size_t done = 0;
+#if defined (iFixedHaveAvx2)
+    if (haveAvx2_()) {
+        done = mixAvx2_(iComps(a), iComps(b), t, n, iComps(out));
+    }
+#endif
+    mix_(iComps(a) + done, iComps(b) + done, t, n - done, iComps(out) + done);
+}
+
+void lengthArray_X3(const iFixed3 *vecs, size_t count, iFixed *lengths_out) {
+    size_t done = 0;
+#if defined (iFixedHaveAvx2)
+    if (haveAvx2_()) {
+        done = lengthAvx2_(vecs, count, lengths_out);
+    }
+#endif
+    for (size_t i = done; i < count; ++i) {
+        lengths_out[i] = length_X3(vecs[i]);
+    }
+}
+
+void normalizeArray_X3(const iFixed3 *vecs, size_t count, iFixed3 *vecs_out) {
+    size_t done = 0;
+#if defined (iFixedHaveAvx2)
+    if (haveAvx2_()) {
+        done = normalizeAvx2_(vecs, count, vecs_out);
+    }
+#endif
+    for (size_t i = done; i < count; ++i) {
+        vecs_out[i] = normalize_X3(vecs[i]);
+    }
+}
@@ -28,6 +28,11 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
 #include "the_Foundation/intset.h"
 #include "the_Foundation/stream.h"
 
+#include <stdlib.h>
+
+void insertRadixN_SortedArray_(iSortedArray *, const void *values, size_t count,
+                               iBool isSigned); /* sortedarray.c */
+
 static int cmp_IntSet_(const void *a, const void *b) {
     return iCmp(*(const int *) a, *(const int *) b);
 }
@@ -40,6 +45,12 @@ iIntSet *newCmp_IntSet(iIntSetCompareFunc cmp) {
     return d;
 }
 
+iIntSet *newN_IntSet(const int *values, size_t count) {
+    iIntSet *d = new_IntSet();
+    insertN_IntSet(d, values, count);
+    return d;
+}
+
 void init_IntSet(iIntSet *d) {
     init_SortedArray(d, sizeof(int), cmp_IntSet_);
 }
@@ -68,6 +79,20 @@ iBool insert_IntSet(iIntSet *d, int value) {
     return insert_SortedArray(d, &value);
 }
 
+void insertN_IntSet(iIntSet *d, const int *values, size_t count) {
+    if (d->cmp == cmp_IntSet_) {
+        insertRadixN_SortedArray_(d, values, count, iTrue);
+    }
+    else {
+        insertN_SortedArray(d, values, count);
+    }
+}
+
+void merge_IntSet(iIntSet *d, const iIntSet *other) {
+    iAssert(d->cmp == other->cmp);
+    merge_SortedArray(d, constData_Array(&other->values), size_IntSet(other));
+}
+
 iBool remove_IntSet(iIntSet *d, int value) {
     iAssert(d);
     return remove_SortedArray(d, &value);
@@ -86,10 +111,26 @@ void serialize_IntSet(const iIntSet *d, iStream *outs) {
 
 void deserialize_IntSet(iIntSet *d, iStream *ins) {
     clear_IntSet(d);
+    /* The count comes from the stream, so it is not trusted for sizing an allocation.
+       The values are collected in an array that grows only as they are actually read,
+       and merged into the set in one pass. */
     uint32_t count = readU32_Stream(ins);
-    while (count--) {
-        insert_IntSet(d, read32_Stream(ins));
+    if (size_Stream(ins) > pos_Stream(ins)) {
+        count = (uint32_t) iMin(count, (size_Stream(ins) - pos_Stream(ins)) / 4);
+    }
+    iArray values;
+    init_Array(&values, sizeof(int));
+    reserve_Array(&values, iMin(count, 1024));
+    while (count-- > 0) {
+        const size_t pos   = pos_Stream(ins);
+        const int    value = read32_Stream(ins);
+        if (pos_Stream(ins) - pos < 4) {
+            break; /* truncated */
+        }
+        pushBack_Array(&values, &value);
     }
+    insertN_IntSet(d, constData_Array(&values), size_Array(&values));
+    deinit_Array(&values);
 }
 
 /*-------------------------------------------------------------------------------------*/
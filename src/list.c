@@ -131,50 +131,81 @@ iAny *remove_List(iList *d, iAny *node) {
     return node;
 }
 
-static iListNode *quicksortPartition_ListNode_(iListNode **low, iListNode **high,
-                                               iListCompareFunc cmp) {
-    iListNode *pivot = *high;
-    iListNode *prev;
-    for (iListNode *i = pivot->prev; i != *low; i = prev) {
-        prev = i->prev;
-        if (cmp(i, pivot) > 0) {
-            remove_ListNode_(i);
-            insertAfter_ListNode_(i, pivot);
-            if (*high == pivot) *high = i;
+iLocalDef int compare_ListSort_(const iListNode *a, const iListNode *b, iListCompareFunc cmp,
+                                iListCompareContextFunc cmpContext, void *context) {
+    return cmp ? cmp(a, b) : cmpContext(a, b, context);
+}
+
+/* Merges two NULL-terminated chains. Equal nodes are taken from `a` first. */
+static iListNode *merge_ListNode_(iListNode *a, iListNode *b, iListCompareFunc cmp,
+                                  iListCompareContextFunc cmpContext, void *context) {
+    iListNode head, *tail = &head;
+    while (a && b) {
+        if (compare_ListSort_(b, a, cmp, cmpContext, context) < 0) {
+            tail->next = b;
+            b = b->next;
         }
+        else {
+            tail->next = a;
+            a = a->next;
+        }
+        tail = tail->next;
     }
-    if (cmp(*low, pivot) > 0) {
-        iListNode *i = *low;
-        *low = i->next;
-        remove_ListNode_(i);
-        insertAfter_ListNode_(i, pivot);
-        if (*high == pivot) *high = i;
-    }
-    return pivot;
+    tail->next = (a ? a : b);
+    return head.next;
 }
 
-static void quicksort_ListNode_(iListNode **start, iListNode **end,
-                                iListCompareFunc cmp) {
-    if (*start != *end) {
-        iListNode *p = quicksortPartition_ListNode_(start, end, cmp);
-        /* Recurse to both halves. */
-        if (p != *start) {
-            iListNode *firstHalf = p->prev;
-            quicksort_ListNode_(start, &firstHalf, cmp);
+static void mergeSort_List_(iList *d, iListCompareFunc cmp, iListCompareContextFunc cmpContext,
+                            void *context) {
+    if (d->size < 2) {
+        return;
+    }
+    /* Bottom-up merge sort on a singly-linked chain. Already ordered runs are taken as
+       they are, so sorted input is handled in linear time. pending[i] holds a merged
+       sequence of about 2^i runs; the array is enough for any list that fits in memory. */
+    iListNode *pending[64] = { NULL };
+    int numLevels = 0;
+    d->root.prev->next = NULL;
+    for (iListNode *node = d->root.next; node; ) {
+        iListNode *run = node;
+        while (node->next && compare_ListSort_(node, node->next, cmp, cmpContext, context) <= 0) {
+            node = node->next;
         }
-        if (p != *end) {
-            iListNode *secondHalf = p->next;
-            quicksort_ListNode_(&secondHalf, end, cmp);
+        iListNode *next = node->next;
+        node->next = NULL;
+        int level;
+        for (level = 0; pending[level]; level++) {
+            run = merge_ListNode_(pending[level], run, cmp, cmpContext, context);
+            pending[level] = NULL;
         }
+        pending[level] = run;
+        numLevels = iMax(numLevels, level + 1);
+        node = next;
     }
+    iListNode *sorted = NULL;
+    for (int level = 0; level < numLevels; level++) {
+        if (pending[level]) {
+            sorted = (sorted ? merge_ListNode_(pending[level], sorted, cmp, cmpContext, context)
+                             : pending[level]);
+        }
+    }
+    /* Restore the backward links. */
+    iListNode *prev = &d->root;
+    for (iListNode *node = sorted; node; node = node->next) {
+        node->prev = prev;
+        prev->next = node;
+        prev = node;
+    }
+    prev->next = &d->root;
+    d->root.prev = prev;
 }
 
 void sort_List(iList *d, iListCompareFunc cmp) {
-    if (size_List(d) >= 2) {
-        iListNode *start = front_List(d);
-        iListNode *end   = back_List(d);
-        quicksort_ListNode_(&start, &end, cmp);
-    }
+    mergeSort_List_(d, cmp, NULL, NULL);
+}
+
+void sortContext_List(iList *d, iListCompareContextFunc cmp, void *context) {
+    mergeSort_List_(d, NULL, cmp, context);
 }
 
 /*-------------------------------------------------------------------------------------*/
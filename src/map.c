@@ -55,6 +55,11 @@ enum iRotation {
 #define isBlack_MapNode_(d)             (!(d) || (d)->flags == black_MapNodeFlag)
 #define isChildBlack_MapNode_(d, ch)    (!(d) || !(d)->child[ch] || (d)->child[ch]->flags == black_MapNodeFlag)
 #define isChildRed_MapNode_(d, ch)      (!isChildBlack_MapNode_(d, ch))
+#define count_MapNode_(d)               ((d) ? (d)->count : 0)
+
+static void updateCount_MapNode_(iMapNode *d) {
+    d->count = 1 + count_MapNode_(d->child[0]) + count_MapNode_(d->child[1]);
+}
 
 static iMapNode *sibling_MapNode_(iMapNode *d) {
     if (!d->parent) return NULL;
@@ -75,6 +80,7 @@ static int verify_MapNode_(iMapNode *d) {
     }
     iAssert(!d->child[0] || d->child[0]->parent == d);
     iAssert(!d->child[1] || d->child[1]->parent == d);
+    iAssert(d->count == 1 + count_MapNode_(d->child[0]) + count_MapNode_(d->child[1]));
     int bd0 = verify_MapNode_(d->child[0]);
     int bd1 = verify_MapNode_(d->child[1]);
     iAssert(bd0 == bd1);
@@ -116,6 +122,9 @@ static void rotate_MapNode_(iMapNode *d, enum iRotation dir) {
     newD->parent = d->parent;
     if (downLink) *downLink = newD;
     d->parent = newD;
+    /* The rotated subtree has the same nodes as before. */
+    newD->count = d->count;
+    updateCount_MapNode_(d);
 }
 
 static void replaceNode_Map_(iMap *d, iMapNode *node, iMapNode *replacement) {
@@ -130,10 +139,13 @@ static void swapNodes_Map_(iMap *d, iMapNode *node, iMapNode *other) {
     if (d->root == node) {
         d->root = other;
     }
-    /* Swap colors. */ {
+    /* Swap colors and subtree sizes, which belong to the positions in the tree. */ {
         int nf = node->flags;
         node->flags = other->flags;
         other->flags = nf;
+        size_t nc = node->count;
+        node->count = other->count;
+        other->count = nc;
     }
     iMapNode *npar = node->parent,  *nc0 = node ->child[0], *nc1 = node ->child[1];
     iMapNode *opar = other->parent, *oc0 = other->child[0], *oc1 = other->child[1];
@@ -265,6 +277,7 @@ static iMapNode *insertNode_Map_(iMap *d, iMapNode *insert) {
             setChild_MapNode_(insert, 0, root->child[0]);
             setChild_MapNode_(insert, 1, root->child[1]);
             insert->flags = root->flags;
+            insert->count = root->count;
             return root; // The old node.
         }
         const int side = (cmp < 0? 0 : 1);
@@ -279,12 +292,22 @@ static iMapNode *insertNode_Map_(iMap *d, iMapNode *insert) {
     insert->parent = root;
     insert->child[0] = insert->child[1] = NULL;
     insert->flags = red_MapNodeFlag;
+    insert->count = 1;
+    for (; root; root = root->parent) {
+        root->count++;
+    }
     return NULL; // New node added.
 }
 
 static void removeNodeWithZeroOrOneChild_Map_(iMap *d, iMapNode *node) {
     iAssert(!node->child[0] || !node->child[1]);
     iMapNode *child = node->child[node->child[0]? 0 : 1];
+    /* The node no longer counts in the subtree sizes, even while it remains attached
+       during the repairs. */
+    for (iMapNode *p = node->parent; p; p = p->parent) {
+        p->count--;
+    }
+    node->count = 0;
     if (node == d->root) {
         d->root = child;
         if (!child) return; // Tree became empty.
@@ -341,6 +364,81 @@ iMapNode *value_Map(const iMap *d, iMapKey key) {
     return node;
 }
 
+/* First node whose key is not less than `key`, or greater than `key` if `upper`. */
+static iMapNode *bound_Map_(const iMap *d, iMapKey key, iBool upper) {
+    iMapNode *node = d->root;
+    iMapNode *found = NULL;
+    while (node) {
+        const int cmp = d->cmp(node->key, key);
+        if (cmp > 0 || (cmp == 0 && !upper)) {
+            found = node;
+            node = node->child[0];
+        }
+        else {
+            node = node->child[1];
+        }
+    }
+    return found;
+}
+
+/* Last node whose key is less than `key`, or not greater than `key` if `upper`. */
+static iMapNode *boundBefore_Map_(const iMap *d, iMapKey key, iBool upper) {
+    iMapNode *node = d->root;
+    iMapNode *found = NULL;
+    while (node) {
+        const int cmp = d->cmp(node->key, key);
+        if (cmp < 0 || (cmp == 0 && upper)) {
+            found = node;
+            node = node->child[1];
+        }
+        else {
+            node = node->child[0];
+        }
+    }
+    return found;
+}
+
+iMapNode *floor_Map(const iMap *d, iMapKey key) {
+    return boundBefore_Map_(d, key, iTrue);
+}
+
+iMapNode *ceiling_Map(const iMap *d, iMapKey key) {
+    return bound_Map_(d, key, iFalse);
+}
+
+size_t rank_Map(const iMap *d, iMapKey key) {
+    size_t rank = 0;
+    const iMapNode *node = d->root;
+    while (node) {
+        if (d->cmp(key, node->key) <= 0) {
+            node = node->child[0];
+        }
+        else {
+            rank += count_MapNode_(node->child[0]) + 1;
+            node = node->child[1];
+        }
+    }
+    return rank;
+}
+
+iMapNode *at_Map(const iMap *d, size_t pos) {
+    iMapNode *node = d->root;
+    while (node) {
+        const size_t numLeft = count_MapNode_(node->child[0]);
+        if (pos < numLeft) {
+            node = node->child[0];
+        }
+        else if (pos == numLeft) {
+            return node;
+        }
+        else {
+            pos -= numLeft + 1;
+            node = node->child[1];
+        }
+    }
+    return NULL;
+}
+
 void clear_Map(iMap *d) {
     d->size = 0;
     d->root = NULL;
@@ -402,7 +500,7 @@ static const iMapNode *constNextInOrder_MapNode_(const iMapNode *d, int dir) {
     if (adj) return adj;
     /* Go back up until there's a forward node. */
     for (; d->parent; d = d->parent) {
-        if (isChild_MapNode_(d, dir ^ 1) && d->parent->child[dir]) {
+        if (isChild_MapNode_(d, dir ^ 1)) {
             return d->parent;
         }
     }
@@ -465,3 +563,49 @@ void init_MapReverseConstIterator(iMapReverseConstIterator *d, const iMap *map)
 void next_MapReverseConstIterator(iMapReverseConstIterator *d) {
     d->value = constNextInOrder_MapNode_(d->value, 0);
 }
+
+void initLowerBound_MapIterator(iMapIterator *d, iMap *map, iMapKey key) {
+    d->map = map;
+    d->value = bound_Map_(map, key, iFalse);
+    d->next = nextInOrder_MapNode_(d->value, 1);
+}
+
+void initUpperBound_MapIterator(iMapIterator *d, iMap *map, iMapKey key) {
+    d->map = map;
+    d->value = bound_Map_(map, key, iTrue);
+    d->next = nextInOrder_MapNode_(d->value, 1);
+}
+
+void initLowerBound_MapConstIterator(iMapConstIterator *d, const iMap *map, iMapKey key) {
+    d->map = map;
+    d->value = bound_Map_(map, key, iFalse);
+}
+
+void initUpperBound_MapConstIterator(iMapConstIterator *d, const iMap *map, iMapKey key) {
+    d->map = map;
+    d->value = bound_Map_(map, key, iTrue);
+}
+
+void initLowerBound_MapReverseIterator(iMapReverseIterator *d, iMap *map, iMapKey key) {
+    d->map = map;
+    d->value = boundBefore_Map_(map, key, iFalse);
+    d->next = nextInOrder_MapNode_(d->value, 0);
+}
+
+void initUpperBound_MapReverseIterator(iMapReverseIterator *d, iMap *map, iMapKey key) {
+    d->map = map;
+    d->value = boundBefore_Map_(map, key, iTrue);
+    d->next = nextInOrder_MapNode_(d->value, 0);
+}
+
+void initLowerBound_MapReverseConstIterator(iMapReverseConstIterator *d, const iMap *map,
+                                            iMapKey key) {
+    d->map = map;
+    d->value = boundBefore_Map_(map, key, iFalse);
+}
+
+void initUpperBound_MapReverseConstIterator(iMapReverseConstIterator *d, const iMap *map,
+                                            iMapKey key) {
+    d->map = map;
+    d->value = boundBefore_Map_(map, key, iTrue);
+}
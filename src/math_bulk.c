@@ -0,0 +1,615 @@
+/** @file math_bulk.c  Bulk operations over arrays of vectors.
+
+@authors Copyright (c) 2021 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+@par License
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+<small>THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
+*/
+
+#include "the_Foundation/math.h"
+#include "the_Foundation/cpu.h"
+
+#include <math.h>
+#if defined (iHaveCpuDispatch)
+#   include <immintrin.h>
+#endif
+
+/* All code paths evaluate the sums in the same order, left to right, and none of them
+   uses fused multiply-add. The results therefore do not depend on the CPU. Each vector
+   kernel returns the number of elements it processed; the rest are handed to the next
+   narrower kernel and finally to the scalar one. */
+
+static void mulPoints_Mat4_(const float *m, const iFloatVec3 *in, size_t count,
+                            iFloatVec3 *out) {
+    for (size_t i = 0; i < count; ++i) {
+        const float x = in[i].v[0], y = in[i].v[1], z = in[i].v[2];
+        const float w = m[3] * x + m[7] * y + m[11] * z + m[15];
+        out[i].v[0] = (m[0] * x + m[4] * y + m[8]  * z + m[12]) / w;
+        out[i].v[1] = (m[1] * x + m[5] * y + m[9]  * z + m[13]) / w;
+        out[i].v[2] = (m[2] * x + m[6] * y + m[10] * z + m[14]) / w;
+    }
+}
+
+static void mulVecs_Mat4_(const float *m, const iFloatVec4 *in, size_t count,
+                          iFloatVec4 *out) {
+    for (size_t i = 0; i < count; ++i) {
+        const float x = in[i].v[0], y = in[i].v[1], z = in[i].v[2], w = in[i].v[3];
+        for (int r = 0; r < 4; ++r) {
+            out[i].v[r] = m[r] * x + m[4 + r] * y + m[8 + r] * z + m[12 + r] * w;
+        }
+    }
+}
+
+static void mulSoaPoints_Mat4_(const float *m, const iFloat3Soa *in, size_t begin,
+                               size_t end, const iFloat3Soa *out) {
+    for (size_t i = begin; i < end; ++i) {
+        const float x = in->x[i], y = in->y[i], z = in->z[i];
+        const float w = m[3] * x + m[7] * y + m[11] * z + m[15];
+        out->x[i] = (m[0] * x + m[4] * y + m[8]  * z + m[12]) / w;
+        out->y[i] = (m[1] * x + m[5] * y + m[9]  * z + m[13]) / w;
+        out->z[i] = (m[2] * x + m[6] * y + m[10] * z + m[14]) / w;
+    }
+}
+
+static void dotSoa_(const iFloat3Soa *a, const iFloat3Soa *b, size_t begin, size_t end,
+                    float *out) {
+    for (size_t i = begin; i < end; ++i) {
+        out[i] = a->x[i] * b->x[i] + a->y[i] * b->y[i] + a->z[i] * b->z[i];
+    }
+}
+
+static void crossSoa_(const iFloat3Soa *a, const iFloat3Soa *b, size_t begin, size_t end,
+                      const iFloat3Soa *out) {
+    for (size_t i = begin; i < end; ++i) {
+        const float ax = a->x[i], ay = a->y[i], az = a->z[i];
+        const float bx = b->x[i], by = b->y[i], bz = b->z[i];
+        out->x[i] = ay * bz - az * by;
+        out->y[i] = az * bx - ax * bz;
+        out->z[i] = ax * by - ay * bx;
+    }
+}
+
+static void normalizeSoa_(const iFloat3Soa *in, size_t begin, size_t end,
+                          const iFloat3Soa *out) {
+    for (size_t i = begin; i < end; ++i) {
+        const float x = in->x[i], y = in->y[i], z = in->z[i];
+        const float inv = 1.f / sqrtf(x * x + y * y + z * z);
+        out->x[i] = x * inv;
+        out->y[i] = y * inv;
+        out->z[i] = z * inv;
+    }
+}
+
+static void boundsArray_(const iFloatVec3 *points, size_t count, float *min, float *max) {
+    for (size_t i = 0; i < count; ++i) {
+        for (int c = 0; c < 3; ++c) {
+            min[c] = iMin(min[c], points[i].v[c]);
+            max[c] = iMax(max[c], points[i].v[c]);
+        }
+    }
+}
+
+static void boundsSoa_(const iFloat3Soa *points, size_t begin, size_t end, float *min,
+                       float *max) {
+    const float *comps[3] = { points->x, points->y, points->z };
+    for (int c = 0; c < 3; ++c) {
+        for (size_t i = begin; i < end; ++i) {
+            min[c] = iMin(min[c], comps[c][i]);
+            max[c] = iMax(max[c], comps[c][i]);
+        }
+    }
+}
+
+/* Combines the lanes of bounds accumulated over consecutive packed points. Lane `k`
+   holds component `k % 3`. */
+static void foldPackedBounds_(const float *mins, const float *maxs, size_t numLanes,
+                              float *min, float *max) {
+    for (size_t k = 0; k < numLanes; ++k) {
+        min[k % 3] = iMin(min[k % 3], mins[k]);
+        max[k % 3] = iMax(max[k % 3], maxs[k]);
+    }
+}
+
+/*-------------------------------------------------------------------------------------*/
+
+#if defined (iHaveCpuDispatch)
+
+iCpuTarget("sse2")
+iLocalDef void store3_(float *p_out, __m128 v) {
+    _mm_storel_pi((__m64 *) p_out, v);
+    _mm_store_ss(p_out + 2, _mm_movehl_ps(v, v));
+}
+
+iCpuTarget("sse2")
+static size_t mulPointsSse_Mat4_(const float *m, const iFloatVec3 *in, size_t count,
+                                 iFloatVec3 *out) {
+    const __m128 c0 = _mm_loadu_ps(m), c1 = _mm_loadu_ps(m + 4), c2 = _mm_loadu_ps(m + 8),
+                 c3 = _mm_loadu_ps(m + 12);
+    for (size_t i = 0; i < count; ++i) {
+        __m128 r = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(in[i].v[0])),
+                                                    _mm_mul_ps(c1, _mm_set1_ps(in[i].v[1]))),
+                                         _mm_mul_ps(c2, _mm_set1_ps(in[i].v[2]))),
+                              c3);
+        r = _mm_div_ps(r, _mm_shuffle_ps(r, r, _MM_SHUFFLE(3, 3, 3, 3)));
+        store3_(out[i].v, r);
+    }
+    return count;
+}
+
+iCpuTarget("sse2")
+static size_t mulVecsSse_Mat4_(const float *m, const iFloatVec4 *in, size_t count,
+                               iFloatVec4 *out) {
+    const __m128 c0 = _mm_loadu_ps(m), c1 = _mm_loadu_ps(m + 4), c2 = _mm_loadu_ps(m + 8),
+                 c3 = _mm_loadu_ps(m + 12);
+    for (size_t i = 0; i < count; ++i) {
+        const __m128 r = _mm_add_ps(
+            _mm_add_ps(_mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(in[i].v[0])),
+                                  _mm_mul_ps(c1, _mm_set1_ps(in[i].v[1]))),
+                       _mm_mul_ps(c2, _mm_set1_ps(in[i].v[2]))),
+            _mm_mul_ps(c3, _mm_set1_ps(in[i].v[3])));
+        _mm_storeu_ps(out[i].v, r);
+    }
+    return count;
+}
+
+iCpuTarget("sse2")
+static size_t mulSoaPointsSse_Mat4_(const float *m, const iFloat3Soa *in, size_t begin,
+                                    size_t end, const iFloat3Soa *out) {
+    __m128 mm[16];
+    for (int k = 0; k < 16; ++k) {
+        mm[k] = _mm_set1_ps(m[k]);
+    }
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        const __m128 x = _mm_loadu_ps(in->x + i);
+        const __m128 y = _mm_loadu_ps(in->y + i);
+        const __m128 z = _mm_loadu_ps(in->z + i);
+        __m128 r[4];
+        for (int c = 0; c < 4; ++c) {
+            r[c] = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(mm[c], x), _mm_mul_ps(mm[4 + c], y)),
+                                         _mm_mul_ps(mm[8 + c], z)),
+                              mm[12 + c]);
+        }
+        _mm_storeu_ps(out->x + i, _mm_div_ps(r[0], r[3]));
+        _mm_storeu_ps(out->y + i, _mm_div_ps(r[1], r[3]));
+        _mm_storeu_ps(out->z + i, _mm_div_ps(r[2], r[3]));
+    }
+    return i;
+}
+
+iCpuTarget("sse2")
+static size_t dotSoaSse_(const iFloat3Soa *a, const iFloat3Soa *b, size_t begin, size_t end,
+                         float *out) {
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        const __m128 xx = _mm_mul_ps(_mm_loadu_ps(a->x + i), _mm_loadu_ps(b->x + i));
+        const __m128 yy = _mm_mul_ps(_mm_loadu_ps(a->y + i), _mm_loadu_ps(b->y + i));
+        const __m128 zz = _mm_mul_ps(_mm_loadu_ps(a->z + i), _mm_loadu_ps(b->z + i));
+        _mm_storeu_ps(out + i, _mm_add_ps(_mm_add_ps(xx, yy), zz));
+    }
+    return i;
+}
+
+iCpuTarget("sse2")
+static size_t crossSoaSse_(const iFloat3Soa *a, const iFloat3Soa *b, size_t begin, size_t end,
+                           const iFloat3Soa *out) {
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        const __m128 ax = _mm_loadu_ps(a->x + i), ay = _mm_loadu_ps(a->y + i),
+                     az = _mm_loadu_ps(a->z + i);
+        const __m128 bx = _mm_loadu_ps(b->x + i), by = _mm_loadu_ps(b->y + i),
+                     bz = _mm_loadu_ps(b->z + i);
+        _mm_storeu_ps(out->x + i, _mm_sub_ps(_mm_mul_ps(ay, bz), _mm_mul_ps(az, by)));
+        _mm_storeu_ps(out->y + i, _mm_sub_ps(_mm_mul_ps(az, bx), _mm_mul_ps(ax, bz)));
+        _mm_storeu_ps(out->z + i, _mm_sub_ps(_mm_mul_ps(ax, by), _mm_mul_ps(ay, bx)));
+    }
+    return i;
+}
+
+iCpuTarget("sse2")
+static size_t normalizeSoaSse_(const iFloat3Soa *in, size_t begin, size_t end,
+                               const iFloat3Soa *out) {
+    const __m128 one = _mm_set1_ps(1.f);
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        const __m128 x = _mm_loadu_ps(in->x + i), y = _mm_loadu_ps(in->y + i),
+                     z = _mm_loadu_ps(in->z + i);
+        const __m128 lenSq =
+            _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+        const __m128 inv = _mm_div_ps(one, _mm_sqrt_ps(lenSq));
+        _mm_storeu_ps(out->x + i, _mm_mul_ps(x, inv));
+        _mm_storeu_ps(out->y + i, _mm_mul_ps(y, inv));
+        _mm_storeu_ps(out->z + i, _mm_mul_ps(z, inv));
+    }
+    return i;
+}
+
+/* Four packed points are three registers of components. */
+iCpuTarget("sse2")
+static size_t boundsArraySse_(const iFloatVec3 *points, size_t count, float *min, float *max) {
+    const float *p = points[0].v;
+    __m128 lo[3], hi[3];
+    for (int k = 0; k < 3; ++k) {
+        lo[k] = _mm_set1_ps(INFINITY);
+        hi[k] = _mm_set1_ps(-INFINITY);
+    }
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4, p += 12) {
+        for (int k = 0; k < 3; ++k) {
+            const __m128 v = _mm_loadu_ps(p + 4 * k);
+            lo[k] = _mm_min_ps(lo[k], v);
+            hi[k] = _mm_max_ps(hi[k], v);
+        }
+    }
+    float mins[12], maxs[12];
+    for (int k = 0; k < 3; ++k) {
+        _mm_storeu_ps(mins + 4 * k, lo[k]);
+        _mm_storeu_ps(maxs + 4 * k, hi[k]);
+    }
+    foldPackedBounds_(mins, maxs, 12, min, max);
+    return i;
+}
+
+iCpuTarget("sse2")
+static size_t boundsSoaSse_(const iFloat3Soa *points, size_t begin, size_t end, float *min,
+                            float *max) {
+    const float *comps[3] = { points->x, points->y, points->z };
+    size_t i = begin;
+    for (int c = 0; c < 3; ++c) {
+        __m128 lo = _mm_set1_ps(INFINITY), hi = _mm_set1_ps(-INFINITY);
+        for (i = begin; i + 4 <= end; i += 4) {
+            const __m128 v = _mm_loadu_ps(comps[c] + i);
+            lo = _mm_min_ps(lo, v);
+            hi = _mm_max_ps(hi, v);
+        }
+        float lanes[8];
+        _mm_storeu_ps(lanes, lo);
+        _mm_storeu_ps(lanes + 4, hi);
+        for (int k = 0; k < 4; ++k) {
+            min[c] = iMin(min[c], lanes[k]);
+            max[c] = iMax(max[c], lanes[4 + k]);
+        }
+    }
+    return i;
+}
+
+#endif /* iHaveCpuDispatch */
+
+/*-------------------------------------------------------------------------------------*/
+
+#if defined (iHaveCpuDispatch)
+
+iCpuTarget("avx2")
+iLocalDef __m256 pair_(float a, float b) {
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(a)), _mm_set1_ps(b), 1);
+}
+
+/* Two packed points per register, one in each 128-bit lane. */
+iCpuTarget("avx2")
+static size_t mulPointsAvx2_Mat4_(const float *m, const iFloatVec3 *in, size_t count,
+                                  iFloatVec3 *out) {
+    const __m256 c0 = _mm256_broadcast_ps((const __m128 *) m);
+    const __m256 c1 = _mm256_broadcast_ps((const __m128 *) (m + 4));
+    const __m256 c2 = _mm256_broadcast_ps((const __m128 *) (m + 8));
+    const __m256 c3 = _mm256_broadcast_ps((const __m128 *) (m + 12));
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        const __m256 x = pair_(in[i].v[0], in[i + 1].v[0]);
+        const __m256 y = pair_(in[i].v[1], in[i + 1].v[1]);
+        const __m256 z = pair_(in[i].v[2], in[i + 1].v[2]);
+        __m256 r = _mm256_add_ps(
+            _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(c0, x), _mm256_mul_ps(c1, y)),
+                          _mm256_mul_ps(c2, z)),
+            c3);
+        r = _mm256_div_ps(r, _mm256_permute_ps(r, _MM_SHUFFLE(3, 3, 3, 3)));
+        const __m128 lo = _mm256_castps256_ps128(r);
+        const __m128 hi = _mm256_extractf128_ps(r, 1);
+        _mm_storel_pi((__m64 *) out[i].v, lo);
+        _mm_store_ss(out[i].v + 2, _mm_movehl_ps(lo, lo));
+        _mm_storel_pi((__m64 *) out[i + 1].v, hi);
+        _mm_store_ss(out[i + 1].v + 2, _mm_movehl_ps(hi, hi));
+    }
+    return i;
+}
+
+iCpuTarget("avx2")
+static size_t mulVecsAvx2_Mat4_(const float *m, const iFloatVec4 *in, size_t count,
+                                iFloatVec4 *out) {
+    const __m256 c0 = _mm256_broadcast_ps((const __m128 *) m);
+    const __m256 c1 = _mm256_broadcast_ps((const __m128 *) (m + 4));
+    const __m256 c2 = _mm256_broadcast_ps((const __m128 *) (m + 8));
+    const __m256 c3 = _mm256_broadcast_ps((const __m128 *) (m + 12));
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        const __m256 r = _mm256_add_ps(
+            _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(c0, pair_(in[i].v[0], in[i + 1].v[0])),
+                                        _mm256_mul_ps(c1, pair_(in[i].v[1], in[i + 1].v[1]))),
+                          _mm256_mul_ps(c2, pair_(in[i].v[2], in[i + 1].v[2]))),
+            _mm256_mul_ps(c3, pair_(in[i].v[3], in[i + 1].v[3])));
+        _mm256_storeu_ps(out[i].v, r);
+    }
+    return i;
+}
+
+iCpuTarget("avx2")
+static size_t mulSoaPointsAvx2_Mat4_(const float *m, const iFloat3Soa *in, size_t begin,
+                                     size_t end, const iFloat3Soa *out) {
+    __m256 mm[16];
+    for (int k = 0; k < 16; ++k) {
+        mm[k] = _mm256_set1_ps(m[k]);
+    }
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8) {
+        const __m256 x = _mm256_loadu_ps(in->x + i);
+        const __m256 y = _mm256_loadu_ps(in->y + i);
+        const __m256 z = _mm256_loadu_ps(in->z + i);
+        __m256 r[4];
+        for (int c = 0; c < 4; ++c) {
+            r[c] = _mm256_add_ps(
+                _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(mm[c], x), _mm256_mul_ps(mm[4 + c], y)),
+                              _mm256_mul_ps(mm[8 + c], z)),
+                mm[12 + c]);
+        }
+        _mm256_storeu_ps(out->x + i, _mm256_div_ps(r[0], r[3]));
+        _mm256_storeu_ps(out->y + i, _mm256_div_ps(r[1], r[3]));
+        _mm256_storeu_ps(out->z + i, _mm256_div_ps(r[2], r[3]));
+    }
+    return i;
+}
+
+iCpuTarget("avx2")
+static size_t dotSoaAvx2_(const iFloat3Soa *a, const iFloat3Soa *b, size_t begin, size_t end,
+                          float *out) {
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8) {
+        const __m256 xx = _mm256_mul_ps(_mm256_loadu_ps(a->x + i), _mm256_loadu_ps(b->x + i));
+        const __m256 yy = _mm256_mul_ps(_mm256_loadu_ps(a->y + i), _mm256_loadu_ps(b->y + i));
+        const __m256 zz = _mm256_mul_ps(_mm256_loadu_ps(a->z + i), _mm256_loadu_ps(b->z + i));
+        _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_add_ps(xx, yy), zz));
+    }
+    return i;
+}
+
+iCpuTarget("avx2")
+static size_t crossSoaAvx2_(const iFloat3Soa *a, const iFloat3Soa *b, size_t begin, size_t end,
+                            const iFloat3Soa *out) {
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8) {
+        const __m256 ax = _mm256_loadu_ps(a->x + i), ay = _mm256_loadu_ps(a->y + i),
+                     az = _mm256_loadu_ps(a->z + i);
+        const __m256 bx = _mm256_loadu_ps(b->x + i), by = _mm256_loadu_ps(b->y + i),
+                     bz = _mm256_loadu_ps(b->z + i);
+        _mm256_storeu_ps(out->x + i, _mm256_sub_ps(_mm256_mul_ps(ay, bz), _mm256_mul_ps(az, by)));
+        _mm256_storeu_ps(out->y + i, _mm256_sub_ps(_mm256_mul_ps(az, bx), _mm256_mul_ps(ax, bz)));
+        _mm256_storeu_ps(out->z + i, _mm256_sub_ps(_mm256_mul_ps(ax, by), _mm256_mul_ps(ay, bx)));
+    }
+    return i;
+}
+
+iCpuTarget("avx2")
+static size_t normalizeSoaAvx2_(const iFloat3Soa *in, size_t begin, size_t end,
+                                const iFloat3Soa *out) {
+    const __m256 one = _mm256_set1_ps(1.f);
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8) {
+        const __m256 x = _mm256_loadu_ps(in->x + i), y = _mm256_loadu_ps(in->y + i),
+                     z = _mm256_loadu_ps(in->z + i);
+        const __m256 lenSq = _mm256_add_ps(
+            _mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y)), _mm256_mul_ps(z, z));
+        const __m256 inv = _mm256_div_ps(one, _mm256_sqrt_ps(lenSq));
+        _mm256_storeu_ps(out->x + i, _mm256_mul_ps(x, inv));
+        _mm256_storeu_ps(out->y + i, _mm256_mul_ps(y, inv));
+        _mm256_storeu_ps(out->z + i, _mm256_mul_ps(z, inv));
+    }
+    return i;
+}
+
+/* Eight packed points are three registers of components. */
+iCpuTarget("avx2")
+static size_t boundsArrayAvx2_(const iFloatVec3 *points, size_t count, float *min, float *max) {
+    const float *p = points[0].v;
+    __m256 lo[3], hi[3];
+    for (int k = 0; k < 3; ++k) {
+        lo[k] = _mm256_set1_ps(INFINITY);
+        hi[k] = _mm256_set1_ps(-INFINITY);
+    }
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8, p += 24) {
+        for (int k = 0; k < 3; ++k) {
+            const __m256 v = _mm256_loadu_ps(p + 8 * k);
+            lo[k] = _mm256_min_ps(lo[k], v);
+            hi[k] = _mm256_max_ps(hi[k], v);
+        }
+    }
+    float mins[24], maxs[24];
+    for (int k = 0; k < 3; ++k) {
+        _mm256_storeu_ps(mins + 8 * k, lo[k]);
+        _mm256_storeu_ps(maxs + 8 * k, hi[k]);
+    }
+    foldPackedBounds_(mins, maxs, 24, min, max);
+    return i;
+}
+
+iCpuTarget("avx2")
+static size_t boundsSoaAvx2_(const iFloat3Soa *points, size_t begin, size_t end, float *min,
+                             float *max) {
+    const float *comps[3] = { points->x, points->y, points->z };
+    size_t i = begin;
+    for (int c = 0; c < 3; ++c) {
+        __m256 lo = _mm256_set1_ps(INFINITY), hi = _mm256_set1_ps(-INFINITY);
+        for (i = begin; i + 8 <= end; i += 8) {
+            const __m256 v = _mm256_loadu_ps(comps[c] + i);
+            lo = _mm256_min_ps(lo, v);
+            hi = _mm256_max_ps(hi, v);
+        }
+        float lanes[16];
+        _mm256_storeu_ps(lanes, lo);
+        _mm256_storeu_ps(lanes + 8, hi);
+        for (int k = 0; k < 8; ++k) {
+            min[c] = iMin(min[c], lanes[k]);
+            max[c] = iMax(max[c], lanes[8 + k]);
+        }
+    }
+    return i;
+}
+
+#endif /* iHaveCpuDispatch */
+
+/*-------------------------------------------------------------------------------------*/
+
+void mulArray_Mat4F3(const iMat4 *d, const iFloatVec3 *points, size_t count,
+                     iFloatVec3 *points_out) {
+    float m[16];
+    store_Mat4(d, m);
+    size_t done = 0;
+#if defined (iHaveCpuDispatch)
+    const int cpu = features_Cpu();
+    if (cpu & avx2_CpuFeature) {
+        done = mulPointsAvx2_Mat4_(m, points, count, points_out);
+    }
+    if (cpu & sse2_CpuFeature) {
+        done += mulPointsSse_Mat4_(m, points + done, count - done, points_out + done);
+    }
+#endif
+    mulPoints_Mat4_(m, points + done, count - done, points_out + done);
+}
+
+void mulArray_Mat4F4(const iMat4 *d, const iFloatVec4 *vecs, size_t count,
+                     iFloatVec4 *vecs_out) {
+    float m[16];
+    store_Mat4(d, m);
+    size_t done = 0;
+#if defined (iHaveCpuDispatch)
+    const int cpu = features_Cpu();
+    if (cpu & avx2_CpuFeature) {
+        done = mulVecsAvx2_Mat4_(m, vecs, count, vecs_out);
+    }
+    if (cpu & sse2_CpuFeature) {
+        done += mulVecsSse_Mat4_(m, vecs + done, count - done, vecs_out + done);
+    }
+#endif
+    mulVecs_Mat4_(m, vecs + done, count - done, vecs_out + done);
+}
+
+void mulSoa_Mat4F3(const iMat4 *d, const iFloat3Soa *points, size_t count,
+                   const iFloat3Soa *points_out) {
+    float m[16];
+    store_Mat4(d, m);
+    size_t done = 0;
+#if defined (iHaveCpuDispatch)
+    const int cpu = features_Cpu();
+    if (cpu & avx2_CpuFeature) {
+        done = mulSoaPointsAvx2_Mat4_(m, points, done, count, points_out);
+    }
+    if (cpu & sse2_CpuFeature) {
+        done = mulSoaPointsSse_Mat4_(m, points, done, count, points_out);
+    }
+#endif
+    mulSoaPoints_Mat4_(m, points, done, count, points_out);
+}
+
+void dotSoa_F3(const iFloat3Soa *a, const iFloat3Soa *b, size_t count, float *dots_out) {
+    size_t done = 0;
+#if defined (iHaveCpuDispatch)
+    const int cpu = features_Cpu();
+    if (cpu & avx2_CpuFeature) {
+        done = dotSoaAvx2_(a, b, done, count, dots_out);
+    }
+    if (cpu & sse2_CpuFeature) {
+        done = dotSoaSse_(a, b, done, count, dots_out);
+    }
+#endif
+    dotSoa_(a, b, done, count, dots_out);
+}
+
+void crossSoa_F3(const iFloat3Soa *a, const iFloat3Soa *b, size_t count,
+                 const iFloat3Soa *cross_out) {
+    size_t done = 0;
+#if defined (iHaveCpuDispatch)
+    const int cpu = features_Cpu();
+    if (cpu & avx2_CpuFeature) {
+        done = crossSoaAvx2_(a, b, done, count, cross_out);
+    }
+    if (cpu & sse2_CpuFeature) {
+        done = crossSoaSse_(a, b, done, count, cross_out);
+    }
+#endif
+    crossSoa_(a, b, done, count, cross_out);
+}
+
+void normalizeSoa_F3(const iFloat3Soa *vecs, size_t count, const iFloat3Soa *vecs_out) {
+    size_t done = 0;
+#if defined (iHaveCpuDispatch)
+    const int cpu = features_Cpu();
+    if (cpu & avx2_CpuFeature) {
+        done = normalizeSoaAvx2_(vecs, done, count, vecs_out);
+    }
+    if (cpu & sse2_CpuFeature) {
+        done = normalizeSoaSse_(vecs, done, count, vecs_out);
+    }
+#endif
+    normalizeSoa_(vecs, done, count, vecs_out);
+}
+
+static void storeBounds_(const float *min, const float *max, size_t count, iFloatVec3 *min_out,
+                         iFloatVec3 *max_out) {
+    for (int c = 0; c < 3; ++c) {
+        min_out->v[c] = count ? min[c] : 0.f;
+        max_out->v[c] = count ? max[c] : 0.f;
+    }
+}
+
+void boundsArray_F3(const iFloatVec3 *points, size_t count, iFloatVec3 *min_out,
+                    iFloatVec3 *max_out) {
+    float min[3] = { INFINITY, INFINITY, INFINITY };
+    float max[3] = { -INFINITY, -INFINITY, -INFINITY };
+    size_t done = 0;
+#if defined (iHaveCpuDispatch)
+    const int cpu = features_Cpu();
+    if (cpu & avx2_CpuFeature) {
+        done = boundsArrayAvx2_(points, count, min, max);
+    }
+    if (cpu & sse2_CpuFeature) {
+        done += boundsArraySse_(points + done, count - done, min, max);
+    }
+#endif
+    boundsArray_(points + done, count - done, min, max);
+    storeBounds_(min, max, count, min_out, max_out);
+}
+
+void boundsSoa_F3(const iFloat3Soa *points, size_t count, iFloatVec3 *min_out,
+                  iFloatVec3 *max_out) {
+    float min[3] = { INFINITY, INFINITY, INFINITY };
+    float max[3] = { -INFINITY, -INFINITY, -INFINITY };
+    size_t done = 0;
+#if defined (iHaveCpuDispatch)
+    const int cpu = features_Cpu();
+    if (cpu & avx2_CpuFeature) {
+        done = boundsSoaAvx2_(points, done, count, min, max);
+    }
+    if (cpu & sse2_CpuFeature) {
+        done = boundsSoaSse_(points, done, count, min, max);
+    }
+#endif
+    boundsSoa_(points, done, count, min, max);
+    storeBounds_(min, max, count, min_out, max_out);
+}
@@ -27,15 +27,7 @@ ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
 SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
 */
 
-#include "the_Foundation/defs.h"
-
-iDeclareType(Md5Context)
-
-struct Impl_Md5Context {
-    uint32_t state[4];
-    uint32_t count[2];
-    uint8_t  buffer[64];
-};
+#include "the_Foundation/digest.h"
 
 static const uint8_t padding_[64] = {0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
                                      0,    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
@@ -181,7 +173,16 @@ static void transform_(uint32_t *state, const uint8_t *block) {
     state[3] += d;
 }
 
-static void update_Md5Context_(iMd5Context *d, const uint8_t *input, size_t inputLen) {
+void init_Md5Context(iMd5Context *d) {
+    d->state[0] = 0x67452301;
+    d->state[1] = 0xefcdab89;
+    d->state[2] = 0x98badcfe;
+    d->state[3] = 0x10325476;
+    d->count[0] = d->count[1] = 0;
+}
+
+void update_Md5Context(iMd5Context *d, const void *data, size_t inputLen) {
+    const uint8_t *input = data;
     size_t i, index, partLen;
     /* Number of bytes mod 64. */
     index = (size_t) ((d->count[0] >> 3) & 0x3f);
@@ -189,7 +190,7 @@ static void update_Md5Context_(iMd5Context *d, const uint8_t *input, size_t inpu
     if ((d->count[0] += ((uint32_t) inputLen << 3)) < ((uint32_t) inputLen << 3)) {
         d->count[1]++;
     }
-    d->count[1] += ((uint32_t) inputLen >> 29);
+    d->count[1] += (uint32_t) ((uint64_t) inputLen >> 29);
     partLen = 64 - index;
     if (inputLen >= partLen) {
         memcpy(d->buffer + index, input, partLen);
@@ -206,18 +207,21 @@ static void update_Md5Context_(iMd5Context *d, const uint8_t *input, size_t inpu
     memcpy(d->buffer + index, input + i, inputLen - i);
 }
 
+void final_Md5Context(iMd5Context *d, uint8_t md5_out[16]) {
+    uint8_t bits[8];
+    size_t index, padLen;
+    encode_(bits, d->count, 8);
+    /* Pad out to 56 mod 64. */
+    index = (size_t) ((d->count[0] >> 3) & 0x3f);
+    padLen = (index < 56) ? (56 - index) : (120 - index);
+    update_Md5Context(d, padding_, padLen);
+    update_Md5Context(d, bits, 8); // length before padding
+    encode_(md5_out, d->state, 16);
+}
+
 void iMd5Hash(const void *data, size_t size, uint8_t md5_out[16]) {
-    iMd5Context ctx = { .state = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476 }};
-    update_Md5Context_(&ctx, data, size);
-    /* Finalize. */ {
-        uint8_t bits[8];
-        size_t index, padLen;
-        encode_(bits, ctx.count, 8);
-        /* Pad out to 56 mod 64. */
-        index = (size_t) ((ctx.count[0] >> 3) & 0x3f);
-        padLen = (index < 56) ? (56 - index) : (120 - index);
-        update_Md5Context_(&ctx, padding_, padLen);
-        update_Md5Context_(&ctx, bits, 8); // length before padding
-        encode_(md5_out, ctx.state, 16);
-    }
+    iMd5Context ctx;
+    init_Md5Context(&ctx);
+    update_Md5Context(&ctx, data, size);
+    final_Md5Context(&ctx, md5_out);
 }
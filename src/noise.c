@@ -1,28 +1,39 @@
 #include "the_Foundation/noise.h"
 #include "the_Foundation/array.h"
+#include "the_Foundation/cpu.h"
 #include "the_Foundation/math.h"
 #include "the_Foundation/geometry.h"
 #include "the_Foundation/stream.h"
+#include "the_Foundation/threadpool.h"
+
+#include <string.h>
+#if defined (iHaveCpuDispatch)
+#   include <immintrin.h>
+#endif
+
+/* Batches are evaluated in spans of this many points, using buffers on the stack. */
+#define iNoiseSpan  256
 
 struct Impl_Noise {
-    iInt2    size;
-    float    scale; // normalizing output values
-    iFloat3 *gradients;
+    iInt2  size;
+    float  scale; // normalizing output values
+    float *gradients; // (x, y) pairs; rows of adjacent corners can be loaded together
 };
 
 iDefineTypeConstructionArgs(Noise, (iInt2 size), size)
 
-iLocalDef iFloat3 *gradient_Noise_(const iNoise *d, const iInt2 pos) {
-    return d->gradients + (d->size.x * pos.y + pos.x);
+iLocalDef const float *gradient_Noise_(const iNoise *d, int x, int y) {
+    return d->gradients + 2 * (d->size.x * y + x);
 }
 
 void init_Noise(iNoise *d, iInt2 size) {
     d->size = add_I2(size, one_I2()); // gradients at cell corners
     d->scale = 1.45f;
-    d->gradients = malloc(sizeof(iFloat3) * (size_t) prod_I2(d->size));
+    d->gradients = malloc(sizeof(float) * 2 * (size_t) prod_I2(d->size));
     for (int i = 0; i < prod_I2(d->size); ++i) {
         const float angle = iRandomf() * iMathPif * 2.f;
-        d->gradients[i] = init_F3(cosf(angle), sinf(angle), 0.f);
+        d->gradients[2 * i]     = cosf(angle);
+        d->gradients[2 * i + 1] = sinf(angle);
     }
 }
 
@@ -34,23 +45,21 @@ void serialize_Noise(const iNoise *d, iStream *outs) {
     writeInt2_Stream(outs, d->size);
     writef_Stream(outs, d->scale);
     for (int i = 0; i < prod_I2(d->size); ++i) {
-        writeFloat3_Stream(outs, d->gradients[i]);
+        writeFloat3_Stream(outs, init_F3(d->gradients[2 * i], d->gradients[2 * i + 1], 0.f));
     }
 }
 
 void deserialize_Noise(iNoise *d, iStream *ins) {
     d->size = readInt2_Stream(ins);
     d->scale = readf_Stream(ins);
-    d->gradients = realloc(d->gradients, sizeof(iFloat3) * (size_t) prod_I2(d->size));
+    d->gradients = realloc(d->gradients, sizeof(float) * 2 * (size_t) prod_I2(d->size));
     for (int i = 0; i < prod_I2(d->size); ++i) {
-        d->gradients[i] = readFloat3_Stream(ins);
+        const iFloat3 grad = readFloat3_Stream(ins); /* z is always zero */
+        d->gradients[2 * i]     = x_F3(grad);
+        d->gradients[2 * i + 1] = y_F3(grad);
     }
 }
 
-iLocalDef float dotGradient_Noise_(const iNoise *d, const int x, int y, const iFloat3 b) {
-    return dot_F3(sub_F3(b, initi_F3(x, y, 0)), *gradient_Noise_(d, init_I2(x, y)));
-}
-
 iLocalDef float hermite_(float a, float b, float w) {
     w = iClamp(w, 0, 1);
     return a + (b - a) * (w * w * (3 - 2 * w));
@@ -68,12 +77,239 @@ float eval_Noise(const iNoise *d, float normX, float normY) {
     if (any_Boolv(less_I2(c0, zero_I2())) || any_Boolv(greaterEqual_I2(c1, d->size))) {
         return 0.f;
     }
-    const iFloat3 pos = init_F3(x, y, 0.f);
-    const float s0 = hermite_(
-        dotGradient_Noise_(d, c0.x, c0.y, pos), dotGradient_Noise_(d, c1.x, c0.y, pos), x - c0.x);
-    const float s1 = hermite_(
-        dotGradient_Noise_(d, c0.x, c1.y, pos), dotGradient_Noise_(d, c1.x, c1.y, pos), x - c0.x);
-    return hermite_(s0, s1, y - c0.y) * d->scale;
+    /* The operations are the same and in the same order as in the vector kernels, so all
+       the code paths produce identical results. */
+    const float  dx  = x - c0.x;
+    const float  dy  = y - c0.y;
+    const float  dx1 = dx - 1.f;
+    const float  dy1 = dy - 1.f;
+    const float *g00 = gradient_Noise_(d, c0.x, c0.y);
+    const float *g10 = gradient_Noise_(d, c1.x, c0.y);
+    const float *g01 = gradient_Noise_(d, c0.x, c1.y);
+    const float *g11 = gradient_Noise_(d, c1.x, c1.y);
+    const float s0 = hermite_(dx * g00[0] + dy * g00[1], dx1 * g10[0] + dy * g10[1], dx);
+    const float s1 = hermite_(dx * g01[0] + dy1 * g01[1], dx1 * g11[0] + dy1 * g11[1], dx);
+    return hermite_(s0, s1, dy) * d->scale;
+}
+
+#if defined (iHaveCpuDispatch)
+static const float zeroGradients_Noise_[4];
+
+iCpuTarget("sse4.1")
+iLocalDef __m128 hermite_Noise_(__m128 a, __m128 b, __m128 w) {
+    w = _mm_min_ps(_mm_max_ps(w, _mm_setzero_ps()), _mm_set1_ps(1.f));
+    const __m128 ww = _mm_mul_ps(_mm_mul_ps(w, w), _mm_sub_ps(_mm_set1_ps(3.f), _mm_add_ps(w, w)));
+    return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), ww));
+}
+
+/* Evaluates four points at a time. The gradients of two horizontally adjacent corners are
+   fetched with a single load per lane, and the lanes are then transposed so that each
+   register holds one gradient component of one corner for all four points. */
+iCpuTarget("sse4.1")
+static size_t evalSse41_Noise_(const iNoise *d, const float *normX, const float *normY,
+                               size_t count, float *values_out) {
+    const __m128  scaleX   = _mm_set1_ps((float) (d->size.x - 1));
+    const __m128  scaleY   = _mm_set1_ps((float) (d->size.y - 1));
+    const __m128  scale    = _mm_set1_ps(d->scale);
+    const __m128  one      = _mm_set1_ps(1.f);
+    const __m128i minCell  = _mm_set1_epi32(-1);
+    const __m128i maxCellX = _mm_set1_epi32(d->size.x - 1);
+    const __m128i maxCellY = _mm_set1_epi32(d->size.y - 1);
+    const __m128i stride   = _mm_set1_epi32(d->size.x);
+    const size_t  rowPitch = 2 * (size_t) d->size.x;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        const __m128  x  = _mm_mul_ps(_mm_loadu_ps(normX + i), scaleX);
+        const __m128  y  = _mm_mul_ps(_mm_loadu_ps(normY + i), scaleY);
+        const __m128i cx = _mm_cvttps_epi32(x);
+        const __m128i cy = _mm_cvttps_epi32(y);
+        const __m128i valid = _mm_and_si128(
+            _mm_and_si128(_mm_cmpgt_epi32(cx, minCell), _mm_cmpgt_epi32(cy, minCell)),
+            _mm_and_si128(_mm_cmplt_epi32(cx, maxCellX), _mm_cmplt_epi32(cy, maxCellY)));
+        const int mask = _mm_movemask_ps(_mm_castsi128_ps(valid));
+        if (!mask) {
+            _mm_storeu_ps(values_out + i, _mm_setzero_ps());
+            continue;
+        }
+        int cells[4];
+        _mm_storeu_si128((__m128i *) cells, _mm_add_epi32(_mm_mullo_epi32(cy, stride), cx));
+        __m128 top[4], bottom[4];
+        for (int k = 0; k < 4; ++k) {
+            if (mask & (1 << k)) {
+                const float *grad = d->gradients + 2 * (size_t) cells[k];
+                top[k]    = _mm_loadu_ps(grad);
+                bottom[k] = _mm_loadu_ps(grad + rowPitch);
+            }
+            else {
+                top[k] = bottom[k] = _mm_loadu_ps(zeroGradients_Noise_);
+            }
+        }
+        _MM_TRANSPOSE4_PS(top[0], top[1], top[2], top[3]);
+        _MM_TRANSPOSE4_PS(bottom[0], bottom[1], bottom[2], bottom[3]);
+        /* Offsets from the top left corner of the cell. */
+        const __m128 dx  = _mm_sub_ps(x, _mm_cvtepi32_ps(cx));
+        const __m128 dy  = _mm_sub_ps(y, _mm_cvtepi32_ps(cy));
+        const __m128 dx1 = _mm_sub_ps(dx, one);
+        const __m128 dy1 = _mm_sub_ps(dy, one);
+        const __m128 d00 = _mm_add_ps(_mm_mul_ps(dx, top[0]), _mm_mul_ps(dy, top[1]));
+        const __m128 d10 = _mm_add_ps(_mm_mul_ps(dx1, top[2]), _mm_mul_ps(dy, top[3]));
+        const __m128 d01 = _mm_add_ps(_mm_mul_ps(dx, bottom[0]), _mm_mul_ps(dy1, bottom[1]));
+        const __m128 d11 = _mm_add_ps(_mm_mul_ps(dx1, bottom[2]), _mm_mul_ps(dy1, bottom[3]));
+        const __m128 value = _mm_mul_ps(
+            hermite_Noise_(hermite_Noise_(d00, d10, dx), hermite_Noise_(d01, d11, dx), dy), scale);
+        _mm_storeu_ps(values_out + i, _mm_and_ps(value, _mm_castsi128_ps(valid)));
+    }
+    return i;
+}
+
+iCpuTarget("avx2")
+iLocalDef __m256 hermite256_Noise_(__m256 a, __m256 b, __m256 w) {
+    w = _mm256_min_ps(_mm256_max_ps(w, _mm256_setzero_ps()), _mm256_set1_ps(1.f));
+    const __m256 ww =
+        _mm256_mul_ps(_mm256_mul_ps(w, w), _mm256_sub_ps(_mm256_set1_ps(3.f), _mm256_add_ps(w, w)));
+    return _mm256_add_ps(a, _mm256_mul_ps(_mm256_sub_ps(b, a), ww));
+}
+
+iCpuTarget("avx2")
+iLocalDef __m256 join_Noise_(__m128 low, __m128 high) {
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(low), high, 1);
+}
+
+/* Same as the SSE 4.1 version, but with eight points at a time. Each half of the lanes is
+   transposed separately. */
+iCpuTarget("avx2")
+static size_t evalAvx2_Noise_(const iNoise *d, const float *normX, const float *normY,
+                              size_t count, float *values_out) {
+    const __m256  scaleX   = _mm256_set1_ps((float) (d->size.x - 1));
+    const __m256  scaleY   = _mm256_set1_ps((float) (d->size.y - 1));
+    const __m256  scale    = _mm256_set1_ps(d->scale);
+    const __m256  one      = _mm256_set1_ps(1.f);
+    const __m256i minCell  = _mm256_set1_epi32(-1);
+    const __m256i maxCellX = _mm256_set1_epi32(d->size.x - 1);
+    const __m256i maxCellY = _mm256_set1_epi32(d->size.y - 1);
+    const __m256i stride   = _mm256_set1_epi32(d->size.x);
+    const size_t  rowPitch = 2 * (size_t) d->size.x;
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256  x  = _mm256_mul_ps(_mm256_loadu_ps(normX + i), scaleX);
+        const __m256  y  = _mm256_mul_ps(_mm256_loadu_ps(normY + i), scaleY);
+        const __m256i cx = _mm256_cvttps_epi32(x);
+        const __m256i cy = _mm256_cvttps_epi32(y);
+        const __m256i valid = _mm256_and_si256(
+            _mm256_and_si256(_mm256_cmpgt_epi32(cx, minCell), _mm256_cmpgt_epi32(cy, minCell)),
+            _mm256_and_si256(_mm256_cmpgt_epi32(maxCellX, cx), _mm256_cmpgt_epi32(maxCellY, cy)));
+        const int mask = _mm256_movemask_ps(_mm256_castsi256_ps(valid));
+        if (!mask) {
+            _mm256_storeu_ps(values_out + i, _mm256_setzero_ps());
+            continue;
+        }
+        int cells[8];
+        _mm256_storeu_si256((__m256i *) cells,
+                            _mm256_add_epi32(_mm256_mullo_epi32(cy, stride), cx));
+        __m128 top[8], bottom[8];
+        for (int k = 0; k < 8; ++k) {
+            if (mask & (1 << k)) {
+                const float *grad = d->gradients + 2 * (size_t) cells[k];
+                top[k]    = _mm_loadu_ps(grad);
+                bottom[k] = _mm_loadu_ps(grad + rowPitch);
+            }
+            else {
+                top[k] = bottom[k] = _mm_loadu_ps(zeroGradients_Noise_);
+            }
+        }
+        _MM_TRANSPOSE4_PS(top[0], top[1], top[2], top[3]);
+        _MM_TRANSPOSE4_PS(top[4], top[5], top[6], top[7]);
+        _MM_TRANSPOSE4_PS(bottom[0], bottom[1], bottom[2], bottom[3]);
+        _MM_TRANSPOSE4_PS(bottom[4], bottom[5], bottom[6], bottom[7]);
+        const __m256 dx  = _mm256_sub_ps(x, _mm256_cvtepi32_ps(cx));
+        const __m256 dy  = _mm256_sub_ps(y, _mm256_cvtepi32_ps(cy));
+        const __m256 dx1 = _mm256_sub_ps(dx, one);
+        const __m256 dy1 = _mm256_sub_ps(dy, one);
+        const __m256 d00 = _mm256_add_ps(_mm256_mul_ps(dx, join_Noise_(top[0], top[4])),
+                                         _mm256_mul_ps(dy, join_Noise_(top[1], top[5])));
+        const __m256 d10 = _mm256_add_ps(_mm256_mul_ps(dx1, join_Noise_(top[2], top[6])),
+                                         _mm256_mul_ps(dy, join_Noise_(top[3], top[7])));
+        const __m256 d01 = _mm256_add_ps(_mm256_mul_ps(dx, join_Noise_(bottom[0], bottom[4])),
+                                         _mm256_mul_ps(dy1, join_Noise_(bottom[1], bottom[5])));
+        const __m256 d11 = _mm256_add_ps(_mm256_mul_ps(dx1, join_Noise_(bottom[2], bottom[6])),
+                                         _mm256_mul_ps(dy1, join_Noise_(bottom[3], bottom[7])));
+        const __m256 value = _mm256_mul_ps(hermite256_Noise_(hermite256_Noise_(d00, d10, dx),
+                                                             hermite256_Noise_(d01, d11, dx),
+                                                             dy),
+                                           scale);
+        _mm256_storeu_ps(values_out + i, _mm256_and_ps(value, _mm256_castsi256_ps(valid)));
+    }
+    return i;
+}
+#endif
+
+void evalArray_Noise(const iNoise *d, const float *normX, const float *normY, size_t count,
+                     float *values_out) {
+    size_t i = 0;
+#if defined (iHaveCpuDispatch)
+    const int cpu = features_Cpu();
+    if (cpu & avx2_CpuFeature) {
+        i = evalAvx2_Noise_(d, normX, normY, count, values_out);
+    }
+    if (cpu & sse41_CpuFeature) {
+        i += evalSse41_Noise_(d, normX + i, normY + i, count - i, values_out + i);
+    }
+#endif
+    for (; i < count; ++i) {
+        values_out[i] = eval_Noise(d, normX[i], normY[i]);
+    }
+}
+
+/*-----------------------------------------------------------------------------------------------*/
+
+iDeclareType(NoiseGrid)
+
+typedef void (*iNoiseGridEvalFunc)(const void *noise, const float *normX, const float *normY,
+                                   size_t count, float *values_out);
+
+struct Impl_NoiseGrid {
+    const void *noise;
+    iNoiseGridEvalFunc evalArray;
+    iInt2 size;
+    float *values;
+};
+
+static void evalRows_NoiseGrid_(void *context, size_t begin, size_t end) {
+    const iNoiseGrid *d = context;
+    float normX[iNoiseSpan], normY[iNoiseSpan];
+    for (size_t row = begin; row < end; ++row) {
+        const float y = (float) row / d->size.y;
+        for (int x0 = 0; x0 < d->size.x; x0 += iNoiseSpan) {
+            const int count = iMin(iNoiseSpan, d->size.x - x0);
+            for (int i = 0; i < count; ++i) {
+                normX[i] = (float) (x0 + i) / d->size.x;
+                normY[i] = y;
+            }
+            d->evalArray(d->noise, normX, normY, count, d->values + row * d->size.x + x0);
+        }
+    }
+}
+
+static void eval_NoiseGrid_(iNoiseGrid *d, iThreadPool *pool) {
+    if (d->size.x <= 0 || d->size.y <= 0) {
+        return;
+    }
+    if (pool) {
+        parallelFor_ThreadPool(pool, 0, d->size.y, 0, evalRows_NoiseGrid_, d);
+    }
+    else {
+        evalRows_NoiseGrid_(d, 0, d->size.y);
+    }
+}
+
+static void evalArrayNoise_NoiseGrid_(const void *noise, const float *normX, const float *normY,
+                                      size_t count, float *values_out) {
+    evalArray_Noise(noise, normX, normY, count, values_out);
+}
+
+void evalGrid_Noise(const iNoise *d, iInt2 gridSize, float *values_out, iThreadPool *pool) {
+    iNoiseGrid grid = { d, evalArrayNoise_NoiseGrid_, gridSize, values_out };
+    eval_NoiseGrid_(&grid, pool);
 }
 
 /*-----------------------------------------------------------------------------------------------*/
@@ -228,6 +464,40 @@ float eval_CombinedNoise(const iCombinedNoise *d, float normX, float normY) {
     return value + weightedOffset_CombinedNoise_(d, normX, normY);
 }
 
+void evalArray_CombinedNoise(const iCombinedNoise *d, const float *normX, const float *normY,
+                             size_t count, float *values_out) {
+    float partValues[iNoiseSpan];
+    for (size_t begin = 0; begin < count; begin += iNoiseSpan) {
+        const size_t span   = iMin(iNoiseSpan, count - begin);
+        float *      values = values_out + begin;
+        memset(values, 0, sizeof(float) * span);
+        iConstForEach(Array, i, &d->parts) {
+            const iCombinedNoisePart *part = i.value;
+            evalArray_Noise(&part->noise, normX + begin, normY + begin, span, partValues);
+            for (size_t k = 0; k < span; ++k) {
+                values[k] += part->weight * partValues[k] + part->offset;
+            }
+        }
+        if (!isEmpty_Array(&d->offsets)) {
+            for (size_t k = 0; k < span; ++k) {
+                values[k] += weightedOffset_CombinedNoise_(d, normX[begin + k], normY[begin + k]);
+            }
+        }
+    }
+}
+
+static void evalArrayCombinedNoise_NoiseGrid_(const void *noise, const float *normX,
+                                              const float *normY, size_t count,
+                                              float *values_out) {
+    evalArray_CombinedNoise(noise, normX, normY, count, values_out);
+}
+
+void evalGrid_CombinedNoise(const iCombinedNoise *d, iInt2 gridSize, float *values_out,
+                            iThreadPool *pool) {
+    iNoiseGrid grid = { d, evalArrayCombinedNoise_NoiseGrid_, gridSize, values_out };
+    eval_NoiseGrid_(&grid, pool);
+}
+
 iFloat3 randomCoord_CombinedNoise(const iCombinedNoise *d, iBool (*rangeCheck)(float)) {
     const int maxAttempts = 1000;
     for (int i = 0; i < maxAttempts; ++i) {
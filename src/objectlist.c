@@ -110,6 +110,22 @@ void popBack_ObjectList(iObjectList *d) {
     delete_ObjectListNode_(popBack_List(&d->list));
 }
 
+iDeclareType(ObjectListSort)
+
+struct Impl_ObjectListSort {
+    iObjectListCompareFunc cmp;
+};
+
+static int compareNodes_ObjectListSort_(const iAny *a, const iAny *b, void *context) {
+    const iObjectListSort *d = context;
+    return d->cmp(object_ObjectListNode(a), object_ObjectListNode(b));
+}
+
+void sort_ObjectList(iObjectList *d, iObjectListCompareFunc cmp) {
+    iObjectListSort sorter = { cmp };
+    sortContext_List(&d->list, compareNodes_ObjectListSort_, &sorter);
+}
+
 /*-------------------------------------------------------------------------------------*/
 
 void init_ObjectListIterator(iObjectListIterator *d, iObjectList *list) {
@@ -28,9 +28,13 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
 #include "the_Foundation/process.h"
 
 #include "the_Foundation/array.h"
+#include "the_Foundation/atomic.h"
 #include "the_Foundation/block.h"
+#include "the_Foundation/ptrset.h"
+#include "the_Foundation/stream.h"
 #include "the_Foundation/stringlist.h"
 #include "the_Foundation/path.h"
+#include "the_Foundation/thread.h"
 #include "pipe.h"
 
 #include <fcntl.h>
@@ -39,13 +43,15 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
 #else
 #include <spawn.h>
 #endif
+#include <errno.h>
 #include <poll.h>
+#include <pthread.h>
 #include <unistd.h>
 #include <signal.h>
 #include <sys/wait.h>
-#if defined (iPlatformOther)
-#   include <sys/select.h>
-#endif
+
+#define INPUT_CHUNK_SIZE    0x10000
+#define OUTPUT_CHUNK_SIZE   0x10000
 
 struct Impl_Process {
     iObject object;
@@ -56,10 +62,27 @@ struct Impl_Process {
     iPipe pin;
     iPipe pout;
     iPipe perr;
+    /* Asynchronous I/O: */
+    iMutex mutex;
+    iCondition finishedCond;
+    iBool isAsync;
+    iBool isFinished;
+    int exitStatus;
+    iStream *input;
+    iBlock *pendingInput;
+    size_t pendingPos;
+    iBlock *output; /* received data that no one was observing */
+    iBlock *error;
+    iAudience *outputReceived;
+    iAudience *errorReceived;
+    iAudience *finished;
 };
 
 iDefineObjectConstruction(Process)
 iDefineClass(Process)
+iDefineAudienceGetter(Process, outputReceived)
+iDefineAudienceGetter(Process, errorReceived)
+iDefineAudienceGetter(Process, finished)
 
 extern char **environ; /* The environment variables. */
 
@@ -71,6 +94,19 @@ void init_Process(iProcess *d) {
     init_Pipe(&d->pin);
     init_Pipe(&d->pout);
     init_Pipe(&d->perr);
+    init_Mutex(&d->mutex);
+    init_Condition(&d->finishedCond);
+    d->isAsync        = iFalse;
+    d->isFinished     = iFalse;
+    d->exitStatus     = -1;
+    d->input          = NULL;
+    d->pendingInput   = NULL;
+    d->pendingPos     = 0;
+    d->output         = new_Block(0);
+    d->error          = new_Block(0);
+    d->outputReceived = NULL;
+    d->errorReceived  = NULL;
+    d->finished       = NULL;
 }
 
 void deinit_Process(iProcess *d) {
@@ -85,6 +121,22 @@ void deinit_Process(iProcess *d) {
         int status = 0;
         waitpid(d->pid, &status, WNOHANG);
     }
+    iRelease(d->input);
+    delete_Block(d->pendingInput);
+    delete_Block(d->output);
+    delete_Block(d->error);
+    delete_Audience(d->outputReceived);
+    delete_Audience(d->errorReceived);
+    delete_Audience(d->finished);
+    deinit_Condition(&d->finishedCond);
+    deinit_Mutex(&d->mutex);
+}
+
+static void closeFd_Process_(int *fd) {
+    if (*fd >= 0) {
+        close(*fd);
+        *fd = -1;
+    }
 }
 
 void setArguments_Process(iProcess *d, const iStringList *args) {
@@ -116,6 +168,11 @@ iBool start_Process(iProcess *d) {
         argv[i] = cstr_String(at_StringList(d->args, i));
     }
     argv[argc] = NULL;
+    /* Other children started meanwhile must not inherit our ends of the pipes, or we
+       would not see the pipes closing. */
+    fcntl(input_Pipe(&d->pin), F_SETFD, FD_CLOEXEC);
+    fcntl(output_Pipe(&d->pout), F_SETFD, FD_CLOEXEC);
+    fcntl(output_Pipe(&d->perr), F_SETFD, FD_CLOEXEC);
 #if !defined (__sgi)
     posix_spawn_file_actions_t facts;
     /* Use pipes to redirect the child's stdout/stderr to us. */
@@ -166,9 +223,9 @@ iBool start_Process(iProcess *d) {
 #if !defined (__sgi)
     posix_spawn_file_actions_destroy(&facts);
 #endif
-    close(output_Pipe(&d->pin));
-    close(input_Pipe(&d->pout));
-    close(input_Pipe(&d->perr));
+    closeFd_Process_(&d->pin.fds[0]);
+    closeFd_Process_(&d->pout.fds[1]);
+    closeFd_Process_(&d->perr.fds[1]);
     return rc == 0;
 }
 
@@ -189,6 +246,15 @@ iBool isRunning_Process(const iProcess *d) {
 }
 
 void waitForFinished_Process(iProcess *d) {
+    if (d->isAsync) {
+        /* The I/O thread reaps the child. */
+        lock_Mutex(&d->mutex);
+        while (!d->isFinished) {
+            wait_Condition(&d->finishedCond, &d->mutex);
+        }
+        unlock_Mutex(&d->mutex);
+        return;
+    }
     if (!d->pid) return;
     waitpid(d->pid, NULL, 0);
     d->pid = 0;
@@ -205,7 +271,7 @@ size_t writeInput_Process(iProcess *d, const iBlock *data) {
         }
         else break;
     }
-    close(input_Pipe(&d->pin));
+    closeFd_Process_(&d->pin.fds[1]);
     return size_Block(data) - remain;
 }
 
@@ -225,11 +291,26 @@ static iBlock *readFromPipe_(int fd, iBlock *readChars) {
     return readChars;
 }
 
+static iBlock *takeReceived_Process_(iProcess *d, iBlock *received) {
+    iBlock *data;
+    lock_Mutex(&d->mutex);
+    data = copy_Block(received);
+    clear_Block(received);
+    unlock_Mutex(&d->mutex);
+    return data;
+}
+
 iBlock *readOutput_Process(iProcess *d) {
+    if (d->isAsync) {
+        return takeReceived_Process_(d, d->output);
+    }
     return readFromPipe_(output_Pipe(&d->pout), new_Block(0));
 }
 
 iBlock *readError_Process(iProcess *d) {
+    if (d->isAsync) {
+        return takeReceived_Process_(d, d->error);
+    }
     return readFromPipe_(output_Pipe(&d->perr), new_Block(0));
 }
 
@@ -240,22 +321,22 @@ void kill_Process(iProcess *d) {
 }
 
 iBlock *readOutputUntilClosed_Process(iProcess *d) {
+    if (d->isAsync) {
+        waitForFinished_Process(d);
+        return readOutput_Process(d);
+    }
     iBlock *output = new_Block(0);
     const int fd = output_Pipe(&d->pout);
     int flags = fcntl(fd, F_GETFL, 0);
     fcntl(fd, F_SETFL, flags | O_NONBLOCK);
     for (;;) {
-        fd_set reads, errs;
-        FD_ZERO(&reads);
-        FD_ZERO(&errs);
-        FD_SET(fd, &reads);
-        FD_SET(fd, &errs);
-        const int rc = select(fd + 1, &reads, NULL, &errs, NULL);
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        const int rc = poll(&pfd, 1, -1);
         if (rc > 0) {
-            if (FD_ISSET(fd, &errs)) {
+            if (pfd.revents & (POLLERR | POLLNVAL)) {
                 break;
             }
-            if (FD_ISSET(fd, &reads)) {
+            if (pfd.revents & (POLLIN | POLLHUP)) {
                 char buf[0x20000];
                 ssize_t len = 0;
                 do {
@@ -278,3 +359,283 @@ iBool exists_Process(iProcessId pid) {
     if (!pid) return iFalse;
     return kill(pid, 0) == 0;
 }
+
+/*-------------------------------------------------------------------------------------*/
+
+iDeclareClass(ProcessThread)
+
+/* A single thread performs the I/O of all asynchronously running processes. */
+struct Impl_ProcessThread {
+    iThread thread;
+    iMutex mutex;
+    iPipe wakeup;
+    iPtrSet processes; /* each holds a reference */
+    iAtomicInt isStopping;
+};
+
+iDeclareType(ProcessWatch)
+
+struct Impl_ProcessWatch {
+    iProcess *process;
+    int *fd;
+};
+
+static iProcessThread *processIO_ = NULL;
+static iMutex          processIOMutex_; /* guards the creation and deletion of `processIO_` */
+static once_flag       processIOMutexOnce_ = ONCE_FLAG_INIT;
+
+static void initProcessIOMutex_(void) {
+    init_Mutex(&processIOMutex_);
+}
+
+static iBool isOpen_Process_(const iProcess *d) {
+    return output_Pipe(&d->pout) >= 0 || output_Pipe(&d->perr) >= 0;
+}
+
+static iBool wantsInput_Process_(const iProcess *d) {
+    return d->input && input_Pipe(&d->pin) >= 0;
+}
+
+static void endInput_Process_(iProcess *d) {
+    closeFd_Process_(&d->pin.fds[1]);
+    iReleasePtr(&d->input);
+    delete_Block(d->pendingInput);
+    d->pendingInput = NULL;
+}
+
+static void feedInput_Process_(iProcess *d) {
+    if (!d->pendingInput) {
+        d->pendingInput = new_Block(0);
+    }
+    if (d->pendingPos == size_Block(d->pendingInput)) {
+        /* Only read more when the child is ready for it. */
+        d->pendingPos = 0;
+        if (readBlock_Stream(d->input, INPUT_CHUNK_SIZE, d->pendingInput) == 0) {
+            endInput_Process_(d);
+            return;
+        }
+    }
+    const ssize_t num = write(input_Pipe(&d->pin),
+                              constBegin_Block(d->pendingInput) + d->pendingPos,
+                              size_Block(d->pendingInput) - d->pendingPos);
+    if (num > 0) {
+        d->pendingPos += num;
+    }
+    else if (num < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        endInput_Process_(d); /* child is no longer reading */
+    }
+}
+
+static void receive_Process_(iProcess *d, int *fd) {
+    char buf[OUTPUT_CHUNK_SIZE];
+    const ssize_t num = read(*fd, buf, sizeof(buf));
+    if (num < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return;
+    }
+    if (num <= 0) {
+        closeFd_Process_(fd);
+        return;
+    }
+    const iBool isOutput = (fd == &d->pout.fds[0]);
+    iAudience *audience = isOutput ? d->outputReceived : d->errorReceived;
+    if (audience && !isEmpty_SortedArray(&audience->observers)) {
+        iBlock data;
+        initData_Block(&data, buf, num);
+        if (isOutput) {
+            iNotifyAudienceArgs(d, outputReceived, ProcessOutputReceived, &data);
+        }
+        else {
+            iNotifyAudienceArgs(d, errorReceived, ProcessErrorReceived, &data);
+        }
+        deinit_Block(&data);
+    }
+    else {
+        iGuardMutex(&d->mutex, appendData_Block(isOutput ? d->output : d->error, buf, num));
+    }
+}
+
+static iBool reap_Process_(iProcess *d) {
+    int status = 0;
+    const pid_t rc = waitpid(d->pid, &status, WNOHANG);
+    if (rc == 0) {
+        return iFalse; /* still running */
+    }
+    endInput_Process_(d);
+    iGuardMutex(&d->mutex, {
+        d->exitStatus = (rc == d->pid && WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+        d->pid = 0;
+    });
+    return iTrue;
+}
+
+static void finish_Process_(iProcess *d) {
+    iNotifyAudienceArgs(d, finished, ProcessFinished, d->exitStatus);
+    /* Waiters are released only after the observers have been notified. */
+    iGuardMutex(&d->mutex, {
+        d->isFinished = iTrue;
+        signalAll_Condition(&d->finishedCond);
+    });
+}
+
+static iThreadResult run_ProcessThread_(iThread *thread) {
+    iProcessThread *d = (iAny *) thread;
+    /* Writing to a pipe whose reader has exited fails with EPIPE instead of raising
+       SIGPIPE in this thread. */ {
+        sigset_t mask;
+        sigemptyset(&mask);
+        sigaddset(&mask, SIGPIPE);
+        pthread_sigmask(SIG_BLOCK, &mask, NULL);
+    }
+    iArray *fds     = new_Array(sizeof(struct pollfd));
+    iArray *watches = new_Array(sizeof(iProcessWatch));
+    iArray *done    = new_Array(sizeof(iProcess *));
+    while (!value_Atomic(&d->isStopping)) {
+        int timeout = -1;
+        clear_Array(fds);
+        clear_Array(watches);
+        pushBack_Array(fds, &(struct pollfd){ .fd = output_Pipe(&d->wakeup), .events = POLLIN });
+        pushBack_Array(watches, &(iProcessWatch){ NULL, NULL });
+        lock_Mutex(&d->mutex);
+        iForEach(PtrSet, i, &d->processes) {
+            iProcess *proc = *i.value;
+            if (output_Pipe(&proc->pout) >= 0) {
+                pushBack_Array(fds, &(struct pollfd){ .fd = output_Pipe(&proc->pout), .events = POLLIN });
+                pushBack_Array(watches, &(iProcessWatch){ proc, &proc->pout.fds[0] });
+            }
+            if (output_Pipe(&proc->perr) >= 0) {
+                pushBack_Array(fds, &(struct pollfd){ .fd = output_Pipe(&proc->perr), .events = POLLIN });
+                pushBack_Array(watches, &(iProcessWatch){ proc, &proc->perr.fds[0] });
+            }
+            if (wantsInput_Process_(proc)) {
+                pushBack_Array(fds, &(struct pollfd){ .fd = input_Pipe(&proc->pin), .events = POLLOUT });
+                pushBack_Array(watches, &(iProcessWatch){ proc, &proc->pin.fds[1] });
+            }
+            if (!isOpen_Process_(proc)) {
+                timeout = 10; /* output closed, waiting for the child to exit */
+            }
+        }
+        unlock_Mutex(&d->mutex);
+        if (poll(data_Array(fds), size_Array(fds), timeout) == -1) {
+            if (errno == EINTR) continue;
+            iWarning("[Process] error from poll(): %s\n", strerror(errno));
+            break;
+        }
+        const struct pollfd *pfd = constData_Array(fds);
+        if (pfd[0].revents & POLLIN) {
+            readByte_Pipe(&d->wakeup);
+        }
+        /* Only this thread touches the pipes of asynchronous processes. */
+        for (size_t i = 1; i < size_Array(fds); i++) {
+            const iProcessWatch *watch = constAt_Array(watches, i);
+            if (!pfd[i].revents) {
+                continue;
+            }
+            if (watch->fd == &watch->process->pin.fds[1]) {
+                if (pfd[i].revents & (POLLERR | POLLNVAL)) {
+                    endInput_Process_(watch->process);
+                }
+                else if (wantsInput_Process_(watch->process)) {
+                    feedInput_Process_(watch->process);
+                }
+            }
+            else if (pfd[i].revents & POLLNVAL) {
+                closeFd_Process_(watch->fd);
+            }
+            else {
+                receive_Process_(watch->process, watch->fd);
+            }
+        }
+        /* Finished processes are removed from the set. */
+        lock_Mutex(&d->mutex);
+        iForEach(PtrSet, j, &d->processes) {
+            iProcess *proc = *j.value;
+            if (!isOpen_Process_(proc) && reap_Process_(proc)) {
+                pushBack_Array(done, &proc);
+                remove_PtrSetIterator(&j);
+            }
+        }
+        unlock_Mutex(&d->mutex);
+        iConstForEach(Array, k, done) {
+            iProcess *proc = *(iProcess * const *) k.value;
+            finish_Process_(proc);
+            iRelease(proc);
+        }
+        clear_Array(done);
+    }
+    delete_Array(done);
+    delete_Array(watches);
+    delete_Array(fds);
+    return 0;
+}
+
+static void init_ProcessThread(iProcessThread *d) {
+    init_Thread(&d->thread, run_ProcessThread_);
+    setName_Thread(&d->thread, "ProcessThread");
+    init_Mutex(&d->mutex);
+    init_Pipe(&d->wakeup);
+    init_PtrSet(&d->processes);
+    set_Atomic(&d->isStopping, iFalse);
+}
+
+static void deinit_ProcessThread(iProcessThread *d) {
+    iForEach(PtrSet, i, &d->processes) {
+        iRelease(*i.value);
+    }
+    deinit_PtrSet(&d->processes);
+    deinit_Pipe(&d->wakeup);
+    deinit_Mutex(&d->mutex);
+}
+
+iDefineSubclass(ProcessThread, Thread)
+static iDefineObjectConstruction(ProcessThread)
+
+void deinit_ProcessThreads_(void) { /* called from deinit_Foundation */
+    call_once(&processIOMutexOnce_, initProcessIOMutex_);
+    lock_Mutex(&processIOMutex_);
+    if (processIO_) {
+        set_Atomic(&processIO_->isStopping, iTrue);
+        writeByte_Pipe(&processIO_->wakeup, 1);
+        join_Thread(&processIO_->thread);
+        iRelease(processIO_);
+        processIO_ = NULL;
+    }
+    unlock_Mutex(&processIOMutex_);
+}
+
+void setInput_Process(iProcess *d, iStream *input) {
+    iAssert(!d->isAsync);
+    iChangeRef(d->input, input);
+}
+
+iBool startAsync_Process(iProcess *d) {
+    iAssert(!d->isAsync);
+    if (!start_Process(d)) {
+        return iFalse;
+    }
+    d->isAsync = iTrue;
+    if (!d->input) {
+        endInput_Process_(d); /* nothing to feed; the child sees EOF on stdin */
+    }
+    const int fds[] = { input_Pipe(&d->pin), output_Pipe(&d->pout), output_Pipe(&d->perr) };
+    iForIndices(i, fds) {
+        if (fds[i] >= 0) {
+            fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL, 0) | O_NONBLOCK);
+        }
+    }
+    call_once(&processIOMutexOnce_, initProcessIOMutex_);
+    lock_Mutex(&processIOMutex_);
+    if (!processIO_) {
+        processIO_ = new_ProcessThread();
+        start_Thread(&processIO_->thread);
+    }
+    iGuardMutex(&processIO_->mutex, insert_PtrSet(&processIO_->processes, ref_Object(d)));
+    writeByte_Pipe(&processIO_->wakeup, 1); /* update the set of polled pipes */
+    unlock_Mutex(&processIOMutex_);
+    return iTrue;
+}
+
+int exitStatus_Process(const iProcess *d) {
+    int status;
+    iGuardMutex(&d->mutex, status = d->exitStatus);
+    return status;
+}
@@ -0,0 +1,658 @@
+/** @file posix/reactor.c  Event loop for file descriptors and timers.
+
+@authors Copyright (c) 2021 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+@par License
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+<small>THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
+*/
+
+#include "the_Foundation/reactor.h"
+#include "the_Foundation/array.h"
+#include "the_Foundation/hash.h"
+#include "the_Foundation/mutex.h"
+#include "the_Foundation/thread.h"
+#include "the_Foundation/time.h"
+#include "pipe.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#if defined (iPlatformLinux)
+#   define iReactorEpoll
+#   include <sys/epoll.h>
+#elif defined (iPlatformApple) || defined (__FreeBSD__) || defined (__NetBSD__) || \
+      defined (__OpenBSD__) || defined (__DragonFly__)
+#   define iReactorKqueue
+#   include <sys/event.h>
+#else
+#   include <poll.h>
+#endif
+
+iDeclareType(ReactorWatch)
+iDeclareType(ReactorFd)
+iDeclareType(ReactorReady)
+iDeclareType(ReactorCall)
+
+struct Impl_ReactorWatch {
+    iHashNode      node;      /* key is the ID */
+    iReactorFd *   rfd;       /* NULL for timers */
+    iReactorWatch *nextOnFd;
+    int            events;
+    int            immediate; /* events to report when the deadline passes, if not a timeout */
+    iTime          deadline;  /* invalid if there is no time limit */
+    size_t         timerPos;  /* position in the timer heap */
+    iReactorFunc   func;
+    void *         context;
+};
+
+/* All the waits for one descriptor. The kernel is told to watch for the union of their
+   events, and only when that changes. */
+struct Impl_ReactorFd {
+    iHashNode      node;   /* key is the descriptor */
+    uint32_t       serial; /* tells apart registrations of a reused descriptor; never zero */
+    int            polled; /* events registered with the kernel */
+    iReactorWatch *watches;
+};
+
+/* A descriptor reported by the kernel during the latest wait. */
+struct Impl_ReactorReady {
+    int      fd;
+    uint32_t serial;
+    int      events;
+};
+
+struct Impl_ReactorCall {
+    uint32_t     id;
+    iReactorFunc func; /* NULL if canceled before being called */
+    void *       context;
+    int          events;
+};
+
+struct Impl_Reactor {
+    iObject  object;
+    iMutex   mutex;
+    iPipe    wakeup;
+    iThread *thread;
+    iHash    watches;  /* iReactorWatch, by ID */
+    iHash    fds;      /* iReactorFd, by descriptor */
+    iArray   timers;   /* iReactorWatch *, a binary min-heap ordered by deadline */
+#if defined (iReactorEpoll) || defined (iReactorKqueue)
+    int      queue;    /* epoll or kqueue instance */
+#else
+    iArray   pollFds;  /* struct pollfd; rebuilt by the reactor thread when changed */
+    iArray   pollSerials;
+    iBool    isPollSetChanged;
+#endif
+    iArray   ready;    /* iReactorReady; only used in the reactor thread */
+    iArray   calls;    /* iReactorCall, fired during the current round */
+    size_t   nextCall; /* index of the next call to make; earlier ones are done */
+    uint32_t nextId;
+    uint32_t nextSerial;
+    iTime    wakeTime; /* when the ongoing wait ends at the latest; invalid if never */
+    iBool    isPolling;
+    iBool    isWakeupPending;
+    iBool    stop;
+};
+
+iDefineClass(Reactor)
+iDefineObjectConstruction(Reactor)
+
+/*----------------------------------------------------------------------------------------------*/
+
+static iReactorWatch *timerAt_Reactor_(const iReactor *d, size_t pos) {
+    return *(iReactorWatch * const *) constAt_Array(&d->timers, pos);
+}
+
+static iBool isEarlier_ReactorWatch_(const iReactorWatch *d, const iReactorWatch *other) {
+    return cmp_Time(&d->deadline, &other->deadline) < 0;
+}
+
+static void placeTimer_Reactor_(iReactor *d, size_t pos, iReactorWatch *watch) {
+    set_Array(&d->timers, pos, &watch);
+    watch->timerPos = pos;
+}
+
+static void siftUpTimer_Reactor_(iReactor *d, size_t pos) {
+    iReactorWatch *watch = timerAt_Reactor_(d, pos);
+    while (pos > 0) {
+        const size_t parent = (pos - 1) / 2;
+        iReactorWatch *up = timerAt_Reactor_(d, parent);
+        if (!isEarlier_ReactorWatch_(watch, up)) break;
+        placeTimer_Reactor_(d, pos, up);
+        pos = parent;
+    }
+    placeTimer_Reactor_(d, pos, watch);
+}
+
+static void siftDownTimer_Reactor_(iReactor *d, size_t pos) {
+    const size_t count = size_Array(&d->timers);
+    iReactorWatch *watch = timerAt_Reactor_(d, pos);
+    for (;;) {
+        size_t child = 2 * pos + 1;
+        if (child >= count) break;
+        if (child + 1 < count &&
+            isEarlier_ReactorWatch_(timerAt_Reactor_(d, child + 1), timerAt_Reactor_(d, child))) {
+            child++;
+        }
+        iReactorWatch *down = timerAt_Reactor_(d, child);
+        if (!isEarlier_ReactorWatch_(down, watch)) break;
+        placeTimer_Reactor_(d, pos, down);
+        pos = child;
+    }
+    placeTimer_Reactor_(d, pos, watch);
+}
+
+static void addTimer_Reactor_(iReactor *d, iReactorWatch *watch) {
+    pushBack_Array(&d->timers, &watch);
+    siftUpTimer_Reactor_(d, size_Array(&d->timers) - 1);
+}
+
+static void removeTimer_Reactor_(iReactor *d, iReactorWatch *watch) {
+    const size_t pos = watch->timerPos;
+    iReactorWatch *last = timerAt_Reactor_(d, size_Array(&d->timers) - 1);
+    popBack_Array(&d->timers);
+    watch->timerPos = iInvalidPos;
+    if (pos < size_Array(&d->timers)) {
+        placeTimer_Reactor_(d, pos, last);
+        siftDownTimer_Reactor_(d, pos);
+        siftUpTimer_Reactor_(d, last->timerPos);
+    }
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
+#if defined (iReactorEpoll)
+
+static void initQueue_Reactor_(iReactor *d) {
+    d->queue = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event ev = { .events = EPOLLIN, .data.u64 = (uint32_t) output_Pipe(&d->wakeup) };
+    epoll_ctl(d->queue, EPOLL_CTL_ADD, output_Pipe(&d->wakeup), &ev);
+}
+
+static void deinitQueue_Reactor_(iReactor *d) {
+    close(d->queue);
+}
+
+/* Returns zero, or the error that prevents watching the descriptor. */
+static int setPolled_Reactor_(iReactor *d, iReactorFd *rfd, int events) {
+    if (events == rfd->polled) {
+        return 0;
+    }
+    const int fd = (int) rfd->node.key;
+    struct epoll_event ev = {
+        .events   = (events & readable_ReactorEvent ? EPOLLIN : 0) |
+                    (events & writable_ReactorEvent ? EPOLLOUT : 0),
+        .data.u64 = (uint64_t) rfd->serial << 32 | (uint32_t) fd
+    };
+    int op = (!rfd->polled ? EPOLL_CTL_ADD : !events ? EPOLL_CTL_DEL : EPOLL_CTL_MOD);
+    int rc = epoll_ctl(d->queue, op, fd, &ev);
+    if (rc && op == EPOLL_CTL_MOD && errno == ENOENT) {
+        /* The descriptor was closed and reopened meanwhile. */
+        rc = epoll_ctl(d->queue, op = EPOLL_CTL_ADD, fd, &ev);
+    }
+    if (rc && op != EPOLL_CTL_DEL) {
+        return errno;
+    }
+    rfd->polled = events;
+    return 0;
+}
+
+/* Returns -1 on error, 1 if woken up, otherwise 0. */
+static int wait_Reactor_(iReactor *d, int timeoutMs) {
+    struct epoll_event evs[256];
+    int woken = 0;
+    clear_Array(&d->ready);
+    const int count = epoll_wait(d->queue, evs, iElemCount(evs), timeoutMs);
+    if (count < 0) {
+        return errno == EINTR ? 0 : -1;
+    }
+    for (int i = 0; i < count; i++) {
+        const uint32_t serial = (uint32_t) (evs[i].data.u64 >> 32);
+        if (serial == 0) {
+            char buf[64];
+            read_Pipe(&d->wakeup, sizeof(buf), buf);
+            woken = 1;
+            continue;
+        }
+        const uint32_t flags = evs[i].events;
+        pushBack_Array(&d->ready, &(iReactorReady){
+            .fd     = (int) (uint32_t) evs[i].data.u64,
+            .serial = serial,
+            .events = (flags & EPOLLIN ? readable_ReactorEvent : 0) |
+                      (flags & EPOLLOUT ? writable_ReactorEvent : 0) |
+                      (flags & (EPOLLHUP | EPOLLERR) ? hangup_ReactorEvent : 0) });
+    }
+    return woken;
+}
+
+#elif defined (iReactorKqueue)
+
+static void initQueue_Reactor_(iReactor *d) {
+    d->queue = kqueue();
+    fcntl(d->queue, F_SETFD, FD_CLOEXEC);
+    struct kevent ev;
+    EV_SET(&ev, output_Pipe(&d->wakeup), EVFILT_READ, EV_ADD, 0, 0, 0);
+    kevent(d->queue, &ev, 1, NULL, 0, NULL);
+}
+
+static void deinitQueue_Reactor_(iReactor *d) {
+    close(d->queue);
+}
+
+static int setPolled_Reactor_(iReactor *d, iReactorFd *rfd, int events) {
+    static const struct { int event; short filter; } filters_[] = {
+        { readable_ReactorEvent, EVFILT_READ },
+        { writable_ReactorEvent, EVFILT_WRITE },
+    };
+    struct kevent changes[2];
+    int numChanges = 0;
+    iForIndices(i, filters_) {
+        const iBool want = (events & filters_[i].event) != 0;
+        const iBool have = (rfd->polled & filters_[i].event) != 0;
+        if (want != have) {
+            EV_SET(&changes[numChanges++], rfd->node.key, filters_[i].filter,
+                   want ? EV_ADD : EV_DELETE, 0, 0, (void *) (intptr_t) rfd->serial);
+        }
+    }
+    if (numChanges && kevent(d->queue, changes, numChanges, NULL, 0, NULL) < 0 && events) {
+        return errno;
+    }
+    rfd->polled = events;
+    return 0;
+}
+
+static int wait_Reactor_(iReactor *d, int timeoutMs) {
+    struct kevent evs[256];
+    struct timespec timeout = { timeoutMs / 1000, (timeoutMs % 1000) * 1000000L };
+    int woken = 0;
+    clear_Array(&d->ready);
+    const int count = kevent(d->queue, NULL, 0, evs, iElemCount(evs),
+                             timeoutMs >= 0 ? &timeout : NULL);
+    if (count < 0) {
+        return errno == EINTR ? 0 : -1;
+    }
+    for (int i = 0; i < count; i++) {
+        const uint32_t serial = (uint32_t) (intptr_t) evs[i].udata;
+        if (serial == 0) {
+            char buf[64];
+            read_Pipe(&d->wakeup, sizeof(buf), buf);
+            woken = 1;
+            continue;
+        }
+        pushBack_Array(&d->ready, &(iReactorReady){
+            .fd     = (int) evs[i].ident,
+            .serial = serial,
+            .events = (evs[i].filter == EVFILT_READ ? readable_ReactorEvent
+                                                    : writable_ReactorEvent) |
+                      (evs[i].flags & (EV_EOF | EV_ERROR) ? hangup_ReactorEvent : 0) });
+    }
+    return woken;
+}
+
+#else /* poll() */
+
+static void initQueue_Reactor_(iReactor *d) {
+    init_Array(&d->pollFds, sizeof(struct pollfd));
+    init_Array(&d->pollSerials, sizeof(uint32_t));
+    d->isPollSetChanged = iTrue;
+}
+
+static void deinitQueue_Reactor_(iReactor *d) {
+    deinit_Array(&d->pollSerials);
+    deinit_Array(&d->pollFds);
+}
+
+static int setPolled_Reactor_(iReactor *d, iReactorFd *rfd, int events) {
+    if (events != rfd->polled) {
+        rfd->polled = events;
+        d->isPollSetChanged = iTrue;
+    }
+    return 0;
+}
+
+/* Called in the reactor thread before polling. poll() only reads the array, but it
+   must not change while the reactor is not holding the mutex. */
+static void preparePoll_Reactor_(iReactor *d) {
+    if (!d->isPollSetChanged) {
+        return;
+    }
+    clear_Array(&d->pollFds);
+    clear_Array(&d->pollSerials);
+    pushBack_Array(&d->pollFds, &(struct pollfd){ .fd = output_Pipe(&d->wakeup), .events = POLLIN });
+    iConstForEach(Hash, i, &d->fds) {
+        const iReactorFd *rfd = (const iReactorFd *) i.value;
+        pushBack_Array(&d->pollFds, &(struct pollfd){
+            .fd     = (int) rfd->node.key,
+            .events = (rfd->polled & readable_ReactorEvent ? POLLIN : 0) |
+                      (rfd->polled & writable_ReactorEvent ? POLLOUT : 0) });
+        pushBack_Array(&d->pollSerials, &rfd->serial);
+    }
+    d->isPollSetChanged = iFalse;
+}
+
+static int wait_Reactor_(iReactor *d, int timeoutMs) {
+    int woken = 0;
+    clear_Array(&d->ready);
+    const int count = poll(data_Array(&d->pollFds), size_Array(&d->pollFds), timeoutMs);
+    if (count < 0) {
+        return errno == EINTR ? 0 : -1;
+    }
+    const struct pollfd *polled = constData_Array(&d->pollFds);
+    if (count > 0 && polled[0].revents & POLLIN) {
+        char buf[64];
+        read_Pipe(&d->wakeup, sizeof(buf), buf);
+        woken = 1;
+    }
+    for (size_t i = 1; count > 0 && i < size_Array(&d->pollFds); i++) {
+        const short revents = polled[i].revents;
+        if (revents) {
+            pushBack_Array(&d->ready, &(iReactorReady){
+                .fd     = polled[i].fd,
+                .serial = *(const uint32_t *) constAt_Array(&d->pollSerials, i - 1),
+                .events = (revents & POLLIN ? readable_ReactorEvent : 0) |
+                          (revents & POLLOUT ? writable_ReactorEvent : 0) |
+                          (revents & (POLLHUP | POLLERR | POLLNVAL) ? hangup_ReactorEvent : 0) });
+        }
+    }
+    return woken;
+}
+
+#endif
+
+/*----------------------------------------------------------------------------------------------*/
+
+static void updateFd_Reactor_(iReactor *d, iReactorFd *rfd) {
+    int events = 0;
+    for (const iReactorWatch *w = rfd->watches; w; w = w->nextOnFd) {
+        events |= w->events;
+    }
+    setPolled_Reactor_(d, rfd, events);
+    if (!events) {
+        remove_Hash(&d->fds, rfd->node.key);
+        free(rfd);
+    }
+}
+
+/* Removes the watch from the timers and descriptors, and forgets its ID. */
+static void detach_Reactor_(iReactor *d, iReactorWatch *watch) {
+    remove_Hash(&d->watches, watch->node.key);
+    if (watch->timerPos != iInvalidPos) {
+        removeTimer_Reactor_(d, watch);
+    }
+    iReactorFd *rfd = watch->rfd;
+    if (rfd) {
+        for (iReactorWatch **w = &rfd->watches; *w; w = &(*w)->nextOnFd) {
+            if (*w == watch) {
+                *w = watch->nextOnFd;
+                break;
+            }
+        }
+        watch->rfd = NULL;
+        updateFd_Reactor_(d, rfd);
+    }
+}
+
+static void fire_Reactor_(iReactor *d, iReactorWatch *watch, int events) {
+    detach_Reactor_(d, watch);
+    pushBack_Array(&d->calls,
+                   &(iReactorCall){ watch->node.key, watch->func, watch->context, events });
+    free(watch);
+}
+
+static void fireFd_Reactor_(iReactor *d, iReactorFd *rfd, int events) {
+    for (iReactorWatch **w = &rfd->watches; *w; ) {
+        iReactorWatch *watch = *w;
+        int fired = events & watch->events;
+        if (events & hangup_ReactorEvent) {
+            /* Whatever was being waited for will now fail without blocking. */
+            fired |= hangup_ReactorEvent | watch->events;
+        }
+        if (fired) {
+            *w = watch->nextOnFd;
+            watch->rfd = NULL;
+            fire_Reactor_(d, watch, fired);
+        }
+        else {
+            w = &watch->nextOnFd;
+        }
+    }
+    updateFd_Reactor_(d, rfd);
+}
+
+static iThreadResult run_Reactor_(iThread *thread) {
+    iReactor *d = userData_Thread(thread);
+    /* Callbacks may write to sockets whose peer has gone away. That fails with EPIPE
+       instead of raising SIGPIPE in this thread. */ {
+        sigset_t mask;
+        sigemptyset(&mask);
+        sigaddset(&mask, SIGPIPE);
+        pthread_sigmask(SIG_BLOCK, &mask, NULL);
+    }
+    lock_Mutex(&d->mutex);
+    while (!d->stop) {
+        int timeout = -1;
+        iZap(d->wakeTime);
+        if (!isEmpty_Array(&d->timers)) {
+            const iTime now = now_Time();
+            d->wakeTime = timerAt_Reactor_(d, 0)->deadline;
+            const double remaining = secondsSince_Time(&d->wakeTime, &now);
+            timeout = (int) ceil(iClamp(remaining, 0.0, 86400.0) * 1000.0);
+        }
+#if !defined (iReactorEpoll) && !defined (iReactorKqueue)
+        preparePoll_Reactor_(d);
+#endif
+        d->isPolling = iTrue;
+        unlock_Mutex(&d->mutex);
+        const int rc = wait_Reactor_(d, timeout);
+        lock_Mutex(&d->mutex);
+        d->isPolling = iFalse;
+        if (rc < 0) {
+            iWarning("[Reactor] error while waiting for events: %s\n", strerror(errno));
+            break;
+        }
+        if (rc > 0) {
+            d->isWakeupPending = iFalse;
+        }
+        /* Waits may have been canceled while the reactor was not holding the mutex, and
+           their descriptors may have been reused for new waits. */
+        clear_Array(&d->calls);
+        iConstForEach(Array, i, &d->ready) {
+            const iReactorReady *ready = i.value;
+            iReactorFd *rfd = (iReactorFd *) value_Hash(&d->fds, (iHashKey) ready->fd);
+            if (rfd && rfd->serial == ready->serial) {
+                fireFd_Reactor_(d, rfd, ready->events);
+            }
+        }
+        const iTime now = now_Time();
+        while (!isEmpty_Array(&d->timers)) {
+            iReactorWatch *watch = timerAt_Reactor_(d, 0);
+            if (cmp_Time(&watch->deadline, &now) > 0) break;
+            fire_Reactor_(d, watch, watch->immediate ? watch->immediate : timeout_ReactorEvent);
+        }
+        /* A callback may cancel waits that have already fired in this round. */
+        for (d->nextCall = 0; d->nextCall < size_Array(&d->calls); ) {
+            const iReactorCall call = *(const iReactorCall *) constAt_Array(&d->calls,
+                                                                             d->nextCall++);
+            if (call.func) {
+                unlock_Mutex(&d->mutex);
+                call.func(call.context, call.events);
+                lock_Mutex(&d->mutex);
+            }
+        }
+        clear_Array(&d->calls);
+    }
+    unlock_Mutex(&d->mutex);
+    return 0;
+}
+
+static void wakeUp_Reactor_(iReactor *d) {
+    /* The reactor thread itself checks the timers before waiting again. */
+    if (d->isPolling && !d->isWakeupPending && current_Thread() != d->thread) {
+        writeByte_Pipe(&d->wakeup, 0);
+        d->isWakeupPending = iTrue;
+    }
+}
+
+void init_Reactor(iReactor *d) {
+    init_Mutex(&d->mutex);
+    init_Pipe(&d->wakeup);
+    init_Hash(&d->watches);
+    init_Hash(&d->fds);
+    init_Array(&d->timers, sizeof(iReactorWatch *));
+    init_Array(&d->ready, sizeof(iReactorReady));
+    init_Array(&d->calls, sizeof(iReactorCall));
+    initQueue_Reactor_(d);
+    iZap(d->wakeTime);
+    d->nextCall        = 0;
+    d->nextId          = 1;
+    d->nextSerial      = 1;
+    d->isPolling       = iFalse;
+    d->isWakeupPending = iFalse;
+    d->stop            = iFalse;
+    d->thread          = new_Thread(run_Reactor_);
+    setName_Thread(d->thread, "Reactor");
+    setUserData_Thread(d->thread, d);
+    start_Thread(d->thread);
+}
+
+void deinit_Reactor(iReactor *d) {
+    iGuardMutex(&d->mutex, {
+        d->stop = iTrue;
+        wakeUp_Reactor_(d);
+    });
+    join_Thread(d->thread);
+    iRelease(d->thread);
+    iForEach(Hash, i, &d->watches) {
+        free(remove_HashIterator(&i));
+    }
+    iForEach(Hash, j, &d->fds) {
+        free(remove_HashIterator(&j));
+    }
+    deinitQueue_Reactor_(d);
+    deinit_Array(&d->calls);
+    deinit_Array(&d->ready);
+    deinit_Array(&d->timers);
+    deinit_Hash(&d->fds);
+    deinit_Hash(&d->watches);
+    deinit_Pipe(&d->wakeup);
+    deinit_Mutex(&d->mutex);
+}
+
+static uint32_t add_Reactor_(iReactor *d, int fd, int events, double timeoutSeconds,
+                             iReactorFunc func, void *context) {
+    iReactorWatch *watch = calloc(1, sizeof(iReactorWatch));
+    watch->events   = events;
+    watch->timerPos = iInvalidPos;
+    watch->func     = func;
+    watch->context  = context;
+    if (timeoutSeconds > 0.0 || fd < 0) {
+        initTimeout_Time(&watch->deadline, iMax(timeoutSeconds, 0.0));
+    }
+    lock_Mutex(&d->mutex);
+    const uint32_t id = d->nextId++;
+    if (d->nextId == 0) {
+        d->nextId = 1;
+    }
+    watch->node.key = id;
+    insert_Hash(&d->watches, &watch->node);
+    if (fd >= 0) {
+        iReactorFd *rfd = (iReactorFd *) value_Hash(&d->fds, (iHashKey) fd);
+        if (!rfd) {
+            rfd = calloc(1, sizeof(iReactorFd));
+            rfd->node.key = (iHashKey) fd;
+            rfd->serial   = d->nextSerial++;
+            if (d->nextSerial == 0) {
+                d->nextSerial = 1;
+            }
+            insert_Hash(&d->fds, &rfd->node);
+        }
+        watch->rfd      = rfd;
+        watch->nextOnFd = rfd->watches;
+        rfd->watches    = watch;
+        const int err = setPolled_Reactor_(d, rfd, rfd->polled | events);
+        if (err) {
+            /* The wait ends right away. Regular files cannot be watched but never block;
+               other errors mean the descriptor is unusable. */
+            rfd->watches    = watch->nextOnFd;
+            watch->rfd      = NULL;
+            watch->immediate = events | (err == EPERM ? 0 : hangup_ReactorEvent);
+            initCurrent_Time(&watch->deadline);
+            updateFd_Reactor_(d, rfd);
+        }
+    }
+    if (isValid_Time(&watch->deadline)) {
+        addTimer_Reactor_(d, watch);
+        if (!isValid_Time(&d->wakeTime) || cmp_Time(&watch->deadline, &d->wakeTime) < 0) {
+            wakeUp_Reactor_(d);
+        }
+    }
+#if !defined (iReactorEpoll) && !defined (iReactorKqueue)
+    if (d->isPollSetChanged) {
+        wakeUp_Reactor_(d);
+    }
+#endif
+    unlock_Mutex(&d->mutex);
+    return id;
+}
+
+uint32_t watch_Reactor(iReactor *d, int fd, int events, double timeoutSeconds,
+                       iReactorFunc func, void *context) {
+    iAssert(fd >= 0);
+    return add_Reactor_(d, fd, events, timeoutSeconds, func, context);
+}
+
+uint32_t addTimer_Reactor(iReactor *d, double seconds, iReactorFunc func, void *context) {
+    return add_Reactor_(d, -1, 0, seconds, func, context);
+}
+
+iBool cancel_Reactor(iReactor *d, uint32_t id) {
+    iBool found = iFalse;
+    iGuardMutex(&d->mutex, {
+        iReactorWatch *watch = (iReactorWatch *) value_Hash(&d->watches, id);
+        if (watch) {
+            detach_Reactor_(d, watch);
+            free(watch);
+            found = iTrue;
+        }
+        else {
+            /* The wait may have ended in the ongoing round without being called yet. */
+            for (size_t i = d->nextCall; i < size_Array(&d->calls); i++) {
+                iReactorCall *call = at_Array(&d->calls, i);
+                if (call->id == id && call->func) {
+                    call->func = NULL;
+                    found = iTrue;
+                    break;
+                }
+            }
+        }
+    });
+    return found;
+}
+
+iBool isCurrentThread_Reactor(const iReactor *d) {
+    return isCurrent_Thread(d->thread);
+}
@@ -26,24 +26,47 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
 */
 
 #include "the_Foundation/service.h"
+#include "the_Foundation/atomic.h"
+#include "the_Foundation/objectlist.h"
 #include "the_Foundation/socket.h"
 #include "the_Foundation/string.h"
 #include "the_Foundation/thread.h"
+#include "the_Foundation/threadpool.h"
 #include "pipe.h"
+#if defined (iHaveTlsRequest)
+#include "../../tlsfilter.h"
+#endif
 
 #include <netdb.h>
 #include <unistd.h>
-#include <sys/select.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <errno.h>
 
+
+#define MAX_ACCEPT_BATCH    64
+#define FAST_OPEN_QUEUE     256
+
 struct Impl_Service {
     iObject object;
     uint16_t port;
-    int fd;
+    int flags;
+    int numListeners;
+    int backlog;
+    iThreadPool *pool;
+    iMutex jobMutex;
+    iCondition jobsDone;
+    int pendingJobs; /* AcceptedJobs still queued in the pool */
     iPipe stop;
-    iThread *listening;
+    iObjectList *listeners; /* ListenerThreads */
+    iAtomicInt numStoppedListeners; /* stopped by an error on the listening socket */
+#if defined (iHaveTlsRequest)
+    iTlsServerContext *tls;
+#endif
     iAudience *incomingAccepted;
 };
 
@@ -51,42 +74,226 @@ iDefineAudienceGetter(Service, incomingAccepted)
 
 iDefineObjectConstructionArgs(Service, (uint16_t port), port)
 
-static iThreadResult listen_Service_(iThread *thd) {
-    iService *d = userData_Thread(thd);
-    while (d->fd >= 0) {
+static iSocket *newAccepted_Service_(iService *d, int fd, const struct sockaddr_storage *addr,
+                                     socklen_t size) {
+#if defined (iHaveTlsRequest)
+    if (d->tls) {
+        return newExistingTls_Socket(fd, addr, size, new_TlsFilter(d->tls));
+    }
+#endif
+    return newExisting_Socket(fd, addr, size);
+}
+
+static void notifyAccepted_Service_(iService *d, int fd, const struct sockaddr_storage *addr,
+                                    socklen_t size) {
+    iSocket *socket = newAccepted_Service_(d, fd, addr, size);
+    iNotifyAudienceArgs(d, incomingAccepted, ServiceIncomingAccepted, socket);
+    iRelease(socket);
+}
+
+/*-------------------------------------------------------------------------------------*/
+
+iDeclareClass(AcceptedJob)
+
+/* The accepted connection is set up and announced in a pooled thread, so the
+   listening thread can go straight back to accepting. Jobs don't hold a reference
+   to the Service; instead, closing the Service waits until all of them are done. */
+struct Impl_AcceptedJob {
+    iThread thread;
+    iService *service;
+    int fd;
+    struct sockaddr_storage addr;
+    socklen_t addrSize;
+};
+
+static iThreadResult run_AcceptedJob_(iThread *thread) {
+    iAcceptedJob *d = (iAny *) thread;
+    notifyAccepted_Service_(d->service, d->fd, &d->addr, d->addrSize);
+    d->fd = -1;
+    return 0;
+}
+
+static void init_AcceptedJob(iAcceptedJob *d, iService *service, int fd,
+                             const struct sockaddr_storage *addr, socklen_t addrSize) {
+    init_Thread(&d->thread, run_AcceptedJob_);
+    d->service  = service;
+    d->fd       = fd;
+    d->addr     = *addr;
+    d->addrSize = addrSize;
+}
+
+static void deinit_AcceptedJob(iAcceptedJob *d) {
+    if (d->fd >= 0) {
+        close(d->fd); /* never ran */
+    }
+    iService *sv = d->service;
+    lock_Mutex(&sv->jobMutex);
+    if (--sv->pendingJobs == 0) {
+        signalAll_Condition(&sv->jobsDone);
+    }
+    unlock_Mutex(&sv->jobMutex);
+}
+
+iDefineSubclass(AcceptedJob, Thread)
+static iDefineObjectConstructionArgs(AcceptedJob,
+                                     (iService *service, int fd,
+                                      const struct sockaddr_storage *addr, socklen_t addrSize),
+                                     service, fd, addr, addrSize)
+
+/*-------------------------------------------------------------------------------------*/
+
+iDeclareClass(ListenerThread)
+
+struct Impl_ListenerThread {
+    iThread thread;
+    iService *service;
+    int fd;
+    iBool ownsFd; /* with SO_REUSEPORT each listener has its own socket */
+};
+
+static iBool isTransientAcceptError_(int err) {
+    switch (err) {
+        case EINTR:
+        case ECONNABORTED:
+        case EPROTO:
+        case EPERM:
+            return iTrue;
+        default:
+            return iFalse;
+    }
+}
+
+static iBool isResourceError_(int err) {
+    return err == EMFILE || err == ENFILE || err == ENOBUFS || err == ENOMEM;
+}
+
+static iBool isSocketError_(int err) {
+    /* The listening socket itself is unusable. */
+    return err == EBADF || err == ENOTSOCK || err == EINVAL || err == EOPNOTSUPP ||
+           err == EFAULT;
+}
+
+static iThreadResult stop_ListenerThread_(iListenerThread *d, int err) {
+    iWarning("[Service] stopped listening on port %u: %s\n", d->service->port,
+             err ? strerror(err) : "socket closed");
+    add_Atomic(&d->service->numStoppedListeners, 1);
+    return err;
+}
+
+static int accept_ListenerThread_(iListenerThread *d, struct sockaddr_storage *addr,
+                                  socklen_t *size) {
+    *size = sizeof(*addr);
+#if defined (iPlatformLinux)
+    return accept4(d->fd, (struct sockaddr *) addr, size, SOCK_CLOEXEC);
+#else
+    const int fd = accept(d->fd, (struct sockaddr *) addr, size);
+    if (fd >= 0) {
+        /* Accepted sockets may inherit O_NONBLOCK from the listening socket. */
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) & ~O_NONBLOCK);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    return fd;
+#endif
+}
+
+static iThreadResult run_ListenerThread_(iThread *thread) {
+    iListenerThread *d = (iAny *) thread;
+    iService *sv = d->service;
+    const int stopFd = output_Pipe(&sv->stop);
+    for (;;) {
         /* Wait for activity. */
-        fd_set fds;
-        FD_ZERO(&fds);
-        FD_SET(d->fd, &fds);
-        FD_SET(output_Pipe(&d->stop), &fds);
-        const int maxfds = iMax(d->fd, output_Pipe(&d->stop));
-        if (select(maxfds + 1, &fds, NULL, NULL, NULL) == -1) {
+        struct pollfd fds[2] = {
+            { .fd = stopFd, .events = POLLIN },
+            { .fd = d->fd,  .events = POLLIN },
+        };
+        if (poll(fds, iElemCount(fds), -1) == -1) {
+            if (errno == EINTR) continue;
             break;
         }
-        if (FD_ISSET(output_Pipe(&d->stop), &fds)) {
+        if (fds[0].revents & POLLIN) {
             break;
         }
-        if (FD_ISSET(d->fd, &fds)) {
+        if (!(fds[1].revents & POLLIN)) {
+            if (fds[1].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+                /* Nothing to accept, and poll would keep returning this right away. */
+                int err = EBADF;
+                socklen_t len = sizeof(err);
+                if (~fds[1].revents & POLLNVAL &&
+                    getsockopt(d->fd, SOL_SOCKET, SO_ERROR, &err, &len)) {
+                    err = errno;
+                }
+                return stop_ListenerThread_(d, err);
+            }
+            continue;
+        }
+        /* Accept all pending connections. The listening socket is non-blocking, so this
+           returns EAGAIN when the queue is empty or another listener got there first. */
+        for (int n = 0; n < MAX_ACCEPT_BATCH; n++) {
             struct sockaddr_storage addr;
-            socklen_t size = sizeof(addr);
-            int incoming = accept(d->fd, (struct sockaddr *) &addr, &size);
+            socklen_t size;
+            const int incoming = accept_ListenerThread_(d, &addr, &size);
             if (incoming < 0) {
-                iWarning("[Service] error on accept: %s\n", strerror(errno));
+                const int err = errno;
+                if (err == EAGAIN || err == EWOULDBLOCK || isTransientAcceptError_(err)) {
+                    break;
+                }
+                if (isSocketError_(err)) {
+                    return stop_ListenerThread_(d, err);
+                }
+                /* Keep listening; the error may concern just this connection. */
+                iWarning("[Service] error on accept: %s\n", strerror(err));
+                sleep_Thread(isResourceError_(err) ? 0.01  /* let some connections close first */
+                                                   : 0.1); /* don't flood the log */
                 break;
             }
-            iSocket *socket = newExisting_Socket(incoming, &addr, size);
-            iNotifyAudienceArgs(d, incomingAccepted, ServiceIncomingAccepted, socket);
-            iRelease(socket);
+            if (sv->pool) {
+                iGuardMutex(&sv->jobMutex, sv->pendingJobs++);
+                iRelease(run_ThreadPool(
+                    sv->pool, (iThread *) new_AcceptedJob(sv, incoming, &addr, size)));
+            }
+            else {
+                notifyAccepted_Service_(sv, incoming, &addr, size);
+            }
         }
     }
-    iReleasePtr(&d->listening);
     return 0;
 }
 
+static void init_ListenerThread(iListenerThread *d, iService *service, int fd, iBool ownsFd) {
+    init_Thread(&d->thread, run_ListenerThread_);
+    setName_Thread(&d->thread, "Service");
+    d->service = service;
+    d->fd      = fd;
+    d->ownsFd  = ownsFd;
+}
+
+static void deinit_ListenerThread(iListenerThread *d) {
+    if (d->ownsFd) {
+        close(d->fd);
+    }
+}
+
+iDefineSubclass(ListenerThread, Thread)
+static iDefineObjectConstructionArgs(ListenerThread,
+                                     (iService *service, int fd, iBool ownsFd),
+                                     service, fd, ownsFd)
+
+/*-------------------------------------------------------------------------------------*/
+
 void init_Service(iService *d, uint16_t port) {
     d->port = port;
-    d->fd = -1;
-    d->listening = NULL;
+    d->flags = 0;
+    d->numListeners = 1;
+    d->backlog = SOMAXCONN;
+    d->pool = NULL;
+    init_Mutex(&d->jobMutex);
+    init_Condition(&d->jobsDone);
+    d->pendingJobs = 0;
+    d->listeners = new_ObjectList();
+    set_Atomic(&d->numStoppedListeners, 0);
+#if defined (iHaveTlsRequest)
+    d->tls = NULL;
+#endif
     init_Pipe(&d->stop);
     d->incomingAccepted = new_Audience();
 }
@@ -94,69 +301,182 @@ void init_Service(iService *d, uint16_t port) {
 void deinit_Service(iService *d) {
     close_Service(d);
     deinit_Pipe(&d->stop);
-    iAssert(d->listening == NULL);
-    iAssert(d->fd < 0);
+    iRelease(d->listeners);
+    iRelease(d->pool);
+    deinit_Condition(&d->jobsDone);
+    deinit_Mutex(&d->jobMutex);
+#if defined (iHaveTlsRequest)
+    delete_TlsServerContext(d->tls);
+#endif
     delete_Audience(d->incomingAccepted);
 }
 
+iBool setCertificate_Service(iService *d, const iTlsCertificate *cert) {
+#if defined (iHaveTlsRequest)
+    iAssert(!isOpen_Service(d));
+    delete_TlsServerContext(d->tls);
+    d->tls = NULL;
+    if (cert) {
+        d->tls = new_TlsServerContext(cert);
+        if (!isValid_TlsServerContext(d->tls)) {
+            delete_TlsServerContext(d->tls);
+            d->tls = NULL;
+            return iFalse;
+        }
+    }
+    return iTrue;
+#else
+    iUnused(d);
+    if (cert) {
+        iWarning("[Service] TLS is not available\n");
+        return iFalse;
+    }
+    return iTrue;
+#endif
+}
+
+void setFlags_Service(iService *d, int flags) {
+    iAssert(!isOpen_Service(d));
+    d->flags = flags;
+}
+
+void setListenerCount_Service(iService *d, int count) {
+    iAssert(!isOpen_Service(d));
+    d->numListeners = iMax(1, count);
+}
+
+void setBacklog_Service(iService *d, int backlog) {
+    iAssert(!isOpen_Service(d));
+    d->backlog = backlog > 0 ? backlog : SOMAXCONN;
+}
+
+void setThreadPool_Service(iService *d, iThreadPool *pool) {
+    iAssert(!isOpen_Service(d));
+    iChangeRef(d->pool, pool);
+}
+
+int flags_Service(const iService *d) {
+    return d->flags;
+}
+
 iBool isOpen_Service(const iService *d) {
-    return d->fd >= 0;
+    return !isEmpty_ObjectList(d->listeners) &&
+           value_Atomic(&d->numStoppedListeners) < (int) size_ObjectList(d->listeners);
+}
+
+static void setOption_Service_(int fd, int level, int name, int value, const char *what) {
+    if (setsockopt(fd, level, name, &value, sizeof(value))) {
+        iWarning("[Service] failed to set %s: %s\n", what, strerror(errno));
+    }
+}
+
+static int openSocket_Service_(iService *d, const struct addrinfo *info) {
+    int fd = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
+    if (fd < 0) {
+        iWarning("[Service] failed to open socket: %s\n", strerror(errno));
+        return -1;
+    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    /* Don't let connections in TIME_WAIT prevent restarting the service. */
+    setOption_Service_(fd, SOL_SOCKET, SO_REUSEADDR, 1, "SO_REUSEADDR");
+#if defined (SO_REUSEPORT)
+    if (d->flags & reusePort_ServiceFlag) {
+        setOption_Service_(fd, SOL_SOCKET, SO_REUSEPORT, 1, "SO_REUSEPORT");
+    }
+#endif
+#if defined (TCP_DEFER_ACCEPT)
+    if (d->flags & deferAccept_ServiceFlag) {
+        setOption_Service_(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, 1, "TCP_DEFER_ACCEPT");
+    }
+#endif
+    if (bind(fd, info->ai_addr, info->ai_addrlen) < 0) {
+        iWarning("[Service] failed to bind address: %s\n", strerror(errno));
+        close(fd);
+        return -1;
+    }
+#if defined (TCP_FASTOPEN)
+    if (d->flags & fastOpen_ServiceFlag) {
+        setOption_Service_(fd, IPPROTO_TCP, TCP_FASTOPEN, FAST_OPEN_QUEUE, "TCP_FASTOPEN");
+    }
+#endif
+    if (listen(fd, d->backlog) < 0) {
+        iWarning("[Service] failed to listen: %s\n", strerror(errno));
+        close(fd);
+        return -1;
+    }
+    /* Accepting is done in batches until the queue is empty. */
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    return fd;
 }
 
 iBool open_Service(iService *d) {
     if (isOpen_Service(d)) return iFalse;
-    /* Set up the socket. */ {
-        struct addrinfo *info, hints = {
-            .ai_socktype = SOCK_STREAM,
+    close_Service(d); /* listeners stopped by errors */
+    struct addrinfo *info, hints = {
+        .ai_socktype = SOCK_STREAM,
 #if defined (iPlatformCygwin)
-            .ai_family   = AF_INET, // listen IPv4
+        .ai_family   = AF_INET, // listen IPv4
 #else
-            .ai_family   = AF_UNSPEC,
+        .ai_family   = AF_UNSPEC,
 #endif
-            .ai_flags    = AI_PASSIVE,
-        };
-        iString *port = new_String();
-        format_String(port, "%i", d->port);
-        int rc = getaddrinfo(NULL, cstr_String(port), &hints, &info);
-        delete_String(port);
-        if (rc) {
-            iWarning("[Service] failed to look up address: %s\n", gai_strerror(rc));
-            return iFalse;
-        }
-        d->fd = socket(info->ai_family, info->ai_socktype, info->ai_protocol);
-        if (d->fd < 0) {
-            iWarning("[Service] failed to open socket: %s\n", strerror(errno));
-            return iFalse;
-        }
-        rc = bind(d->fd, info->ai_addr, info->ai_addrlen);
-        if (rc < 0) {
-            close(d->fd);
-            d->fd = -1;
-            iWarning("[Service] failed to bind address: %s\n", strerror(errno));
-            return iFalse;
-        }
-        rc = listen(d->fd, 10);
-        if (rc < 0) {
-            close(d->fd);
-            d->fd = -1;
-            iWarning("[Service] failed to listen: %s\n", strerror(errno));
-            return iFalse;
+        .ai_flags    = AI_PASSIVE,
+    };
+    iString *port = new_String();
+    format_String(port, "%i", d->port);
+    int rc = getaddrinfo(NULL, cstr_String(port), &hints, &info);
+    delete_String(port);
+    if (rc) {
+        iWarning("[Service] failed to look up address: %s\n", gai_strerror(rc));
+        return iFalse;
+    }
+    /* Without SO_REUSEPORT, all the listening threads share a single socket. */
+    iBool isSharded = iFalse;
+#if defined (SO_REUSEPORT)
+    isSharded = (d->flags & reusePort_ServiceFlag) != 0;
+#endif
+    int sharedFd = -1;
+    for (int i = 0; i < d->numListeners; i++) {
+        int fd = sharedFd;
+        if (isSharded || i == 0) {
+            fd = openSocket_Service_(d, info);
+            if (fd < 0) {
+                break;
+            }
+            if (!isSharded) {
+                sharedFd = fd;
+            }
         }
+        iListenerThread *listener = new_ListenerThread(d, fd, isSharded || i == 0);
+        pushBack_ObjectList(d->listeners, listener);
+        iRelease(listener);
+    }
+    freeaddrinfo(info);
+    if (size_ObjectList(d->listeners) < (size_t) d->numListeners) {
+        clear_ObjectList(d->listeners);
+        return iFalse;
+    }
+    iForEach(ObjectList, i, d->listeners) {
+        start_Thread(i.object);
     }
-    d->listening = new_Thread(listen_Service_);
-    setUserData_Thread(d->listening, d);
-    start_Thread(d->listening);
     return iTrue;
 }
 
 void close_Service(iService *d) {
-    if (d->listening) {
-        /* Signal the listening thread to stop. */
+    if (!isEmpty_ObjectList(d->listeners)) {
+        /* Signal the listening threads to stop. */
         writeByte_Pipe(&d->stop, 1);
-        close(d->fd);
-        d->fd = -1;
-        join_Thread(d->listening);
-        iAssert(d->listening == NULL);
+        iForEach(ObjectList, i, d->listeners) {
+            join_Thread(i.object);
+        }
+        readByte_Pipe(&d->stop);
+        clear_ObjectList(d->listeners); /* closes the sockets */
+        set_Atomic(&d->numStoppedListeners, 0);
+        /* Connections may still be waiting for a pooled thread. */
+        lock_Mutex(&d->jobMutex);
+        while (d->pendingJobs > 0) {
+            wait_Condition(&d->jobsDone, &d->jobMutex);
+        }
+        unlock_Mutex(&d->jobMutex);
     }
 }
 
@@ -31,12 +31,17 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
 #include "the_Foundation/thread.h"
 #include "the_Foundation/atomic.h"
 #include "pipe.h"
+#if defined (iHaveTlsRequest)
+#include "../../tlsfilter.h"
+#endif
 
 #include <errno.h>
 #include <unistd.h>
 #include <fcntl.h>
-#include <sys/select.h>
+#include <poll.h>
 #include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #if defined (__sgi)
 #include <sys/time.h>
 #endif
@@ -51,6 +56,7 @@ int getSockAddr_Address(const iAddress *  d,
                         int               family,
                         int               indexInFamily);
 
+
 iDeclareType(SocketThread)
 
 struct Impl_Socket {
@@ -63,6 +69,9 @@ struct Impl_Socket {
     iPipe *stopConnect;
     iThread *connecting;
     iSocketThread *thread;
+#if defined (iHaveTlsRequest)
+    iTlsFilter *tls; /* server-side TLS; accessed only in the I/O thread while it runs */
+#endif
     iCondition allSent;
     iMutex mutex;
     /* Audiences: */
@@ -100,39 +109,62 @@ struct Impl_SocketThread {
     iAtomicInt mode; /* enum iSocketThreadMode */
 };
 
+static iBool isReadyToSend_Socket_(const iSocket *d) {
+#if defined (iHaveTlsRequest)
+    if (d->tls && !isHandshakeFinished_TlsFilter(d->tls)) {
+        return iFalse; /* output is held back until the handshake is complete */
+    }
+#endif
+    return bytesToSend_Socket(d) > 0;
+}
+
+static iBool sendAll_Socket_(iSocket *d, const void *data, size_t size) {
+    const char *ptr = data;
+    while (size > 0) {
+        ssize_t sent = send(d->fd, ptr, size, 0);
+        if (sent == -1) {
+            return iFalse;
+        }
+        size -= sent;
+        ptr += sent;
+    }
+    return iTrue;
+}
+
 static iThreadResult run_SocketThread_(iThread *thread) {
     iSocketThread *d = (iAny *) thread;
     iMutex *smx = &d->socket->mutex;
     iBlock *inbuf = collect_Block(new_Block(0x20000));
+#if defined (iHaveTlsRequest)
+    iBlock *decrypted = collect_Block(new_Block(0));
+    iBlock *encrypted = collect_Block(new_Block(0));
+#endif
     iGuardMutex(smx, {
         /* Connection has been formed. */
         delete_Pipe(d->socket->stopConnect);
         d->socket->stopConnect = NULL;
     });
     while (value_Atomic(&d->mode) == run_SocketThreadMode) {
-        if (bytesToSend_Socket(d->socket) > 0) {
-            /* Make sure we won't block on select() when there's still data to send. */
+        if (isReadyToSend_Socket_(d->socket)) {
+            /* Make sure we won't block on poll() when there's still data to send. */
             writeByte_Pipe(&d->wakeup, 0);
         }
-        /* Wait for activity. */
-        fd_set reads, errors; {
-            FD_ZERO(&reads);
-            FD_ZERO(&errors);
-            FD_SET(output_Pipe(&d->wakeup), &reads);
-            FD_SET(d->socket->fd, &reads);
-            FD_SET(d->socket->fd, &errors);
-            int maxfd = iMax(output_Pipe(&d->wakeup), d->socket->fd);
-            int ready = select(maxfd + 1, &reads, NULL, &errors, NULL);
-            if (ready == -1) {
-                iWarning("[Socket] error from select(): %s\n", strerror(errno));
-                return errno;
-            }
+        /* Wait for activity. Unlike select(), poll() is not limited to descriptors
+           below FD_SETSIZE, which a busy service can easily exceed. */
+        struct pollfd fds[2] = {
+            { .fd = output_Pipe(&d->wakeup), .events = POLLIN },
+            { .fd = d->socket->fd, .events = POLLIN },
+        };
+        if (poll(fds, iElemCount(fds), -1) == -1) {
+            if (errno == EINTR) continue;
+            iWarning("[Socket] error from poll(): %s\n", strerror(errno));
+            return errno;
         }
-        if (FD_ISSET(output_Pipe(&d->wakeup), &reads)) {
+        if (fds[0].revents & POLLIN) {
             readByte_Pipe(&d->wakeup);
         }
         /* Problem with the socket? */
-        if (FD_ISSET(d->socket->fd, &errors)) {
+        if (fds[1].revents & (POLLERR | POLLNVAL)) {
             if (status_Socket(d->socket) == connected_SocketStatus) {
                 iWarning("[Socket] error when receiving: %s\n", strerror(errno));
                 shutdown_Socket_(d->socket);
@@ -142,29 +174,36 @@ static iThreadResult run_SocketThread_(iThread *thread) {
         }
         /* Check for data to send. */ {
             iBlock *data = NULL;
-            size_t remaining = 0;
             iGuardMutex(smx, {
                 if (d->mode != stop_SocketThreadMode) {
-                    if (!isEmpty_Buffer(d->socket->output)) {
+                    if (isReadyToSend_Socket_(d->socket)) {
                         data = consumeBlock_Buffer(d->socket->output, 0x10000);
                     }
                 }
             });
             if (data) {
-                const char * ptr         = constData_Block(data);
-                const size_t totalToSend = remaining = size_Block(data);
-                while (remaining > 0) {
-                    ssize_t sent = send(d->socket->fd, ptr, remaining, 0);
-                    if (sent == -1) {
-                        /* Error! */
-                        delete_Block(data);
-                        shutdown_Socket_(d->socket);
-                        return errno;
-                    }
-                    remaining -= sent;
-                    ptr += sent;
+                const size_t totalToSend = size_Block(data);
+                iBool ok;
+#if defined (iHaveTlsRequest)
+                if (d->socket->tls) {
+                    clear_Block(encrypted);
+                    ok = encrypt_TlsFilter(d->socket->tls, constData_Block(data), totalToSend,
+                                           encrypted) &&
+                         sendAll_Socket_(d->socket, constData_Block(encrypted),
+                                         size_Block(encrypted));
+                }
+                else
+#endif
+                {
+                    ok = sendAll_Socket_(d->socket, constData_Block(data), totalToSend);
                 }
                 delete_Block(data);
+                if (!ok) {
+                    /* Error! */
+                    const int err = errno;
+                    shutdown_Socket_(d->socket);
+                    return err;
+                }
                 iNotifyAudienceArgs(d->socket, bytesWritten, SocketBytesWritten, totalToSend);
                 iGuardMutex(smx, {
                     if (isEmpty_Buffer(d->socket->output)) {
@@ -179,7 +218,7 @@ static iThreadResult run_SocketThread_(iThread *thread) {
             });
         }
         /* Check for incoming data. */
-        if (FD_ISSET(d->socket->fd, &reads)) {
+        if (fds[1].revents & (POLLIN | POLLHUP)) {
             ssize_t readSize = recv(d->socket->fd, data_Block(inbuf), size_Block(inbuf), 0);
             if (readSize == 0) {
                 iWarning("[Socket] peer closed the connection\n");
@@ -195,6 +234,32 @@ static iThreadResult run_SocketThread_(iThread *thread) {
                 /* This was expected. */
                 return 0;
             }
+#if defined (iHaveTlsRequest)
+            if (d->socket->tls) {
+                clear_Block(decrypted);
+                clear_Block(encrypted);
+                const enum iTlsFilterResult result = decrypt_TlsFilter(
+                    d->socket->tls, constData_Block(inbuf), readSize, decrypted, encrypted);
+                if (result == failed_TlsFilterResult ||
+                    !sendAll_Socket_(d->socket, constData_Block(encrypted), size_Block(encrypted))) {
+                    iWarning("[Socket] TLS error when receiving\n");
+                    shutdown_Socket_(d->socket);
+                    return 0;
+                }
+                if (!isEmpty_Block(decrypted)) {
+                    iGuardMutex(smx, {
+                        writeData_Buffer(d->socket->input, constData_Block(decrypted),
+                                         size_Block(decrypted));
+                    });
+                    iNotifyAudience(d->socket, readyRead, SocketReadyRead);
+                }
+                if (result == closed_TlsFilterResult) {
+                    shutdown_Socket_(d->socket);
+                    return 0;
+                }
+                continue;
+            }
+#endif
             iGuardMutex(smx, {
                 writeData_Buffer(d->socket->input, constData_Block(inbuf), readSize);
             });
@@ -224,7 +289,7 @@ static void deinit_SocketThread(iSocketThread *d) {
 
 static void exit_SocketThread_(iSocketThread *d) {
     set_Atomic(&d->mode, stop_SocketThreadMode);
-    writeByte_Pipe(&d->wakeup, 1); // select() will exit
+    writeByte_Pipe(&d->wakeup, 1); // poll() will exit
     join_Thread(&d->thread);
 }
 
@@ -259,9 +324,12 @@ static void init_Socket_(iSocket *d) {
     openEmpty_Buffer(d->input);
     d->fd = -1;
     d->address = NULL;
-    d->stopConnect = new_Pipe(); /* used for aborting select() on user action */
+    d->stopConnect = new_Pipe(); /* used for aborting poll() on user action */
     d->connecting = NULL;
     d->thread = NULL;
+#if defined (iHaveTlsRequest)
+    d->tls = NULL;
+#endif
     init_Condition(&d->allSent);
     init_Mutex(&d->mutex);
     d->connected = NULL;
@@ -281,6 +349,9 @@ void deinit_Socket(iSocket *d) {
     });
     waitForFinished_Address(d->address);
     iReleasePtr(&d->address);
+#if defined (iHaveTlsRequest)
+    delete_TlsFilter(d->tls);
+#endif
     deinit_Mutex(&d->mutex);
     delete_Pipe(d->stopConnect);
     deinit_Condition(&d->allSent);
@@ -391,19 +462,13 @@ static iThreadResult connectAsync_Socket_(iThread *thd) {
                 }
                 iAssert(d->stopConnect != NULL);
                 const int stopFd = output_Pipe(d->stopConnect);
-                fd_set stopSet;
-                fd_set connSet;
-                fd_set errSet;
-                FD_ZERO(&stopSet);
-                FD_ZERO(&connSet);
-                FD_ZERO(&errSet);
-                FD_SET(stopFd, &stopSet);
-                FD_SET(d->fd, &connSet);
-                FD_SET(d->fd, &errSet);
-                struct timeval timeout = { .tv_sec = connectionTimeoutSeconds_Socket_ };
-                rc = select(iMax(stopFd, d->fd) + 1, &stopSet, &connSet, &errSet, &timeout);
+                struct pollfd fds[2] = {
+                    { .fd = stopFd, .events = POLLIN },
+                    { .fd = d->fd,  .events = POLLOUT },
+                };
+                rc = poll(fds, iElemCount(fds), connectionTimeoutSeconds_Socket_ * 1000);
                 if (rc > 0) {
-                    if (FD_ISSET(stopFd, &stopSet)) {
+                    if (fds[0].revents & POLLIN) {
                         setError_Socket_(d, ECONNABORTED, "Connection aborted");
                         return ECONNABORTED;
                     }
@@ -511,6 +576,26 @@ iSocket *newExisting_Socket(int fd, const void *sockAddr, size_t sockAddrSize) {
     return d;
 }
 
+#if defined (iHaveTlsRequest)
+iSocket *newExistingTls_Socket(int fd, const void *sockAddr, size_t sockAddrSize,
+                               iTlsFilter *tls) {
+    /* Note: Takes ownership of `tls`. */
+    iSocket *d = iNew(Socket);
+    init_Socket_(d);
+    d->fd = fd;
+    d->address = newSockAddr_Address(sockAddr, sockAddrSize, tcp_SocketType);
+    d->tls = tls;
+    /* Handshake flights and records are already written in whole chunks. Without this,
+       Nagle's algorithm and delayed ACKs stall each exchange by tens of milliseconds. */ {
+        const int noDelay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+    }
+    setStatus_Socket_(d, connected_SocketStatus);
+    startThread_Socket_(d);
+    return d;
+}
+#endif
+
 void init_Socket(iSocket *d, const char *hostName, uint16_t port) {
     init_Socket_(d);
     d->address = new_Address();
@@ -543,6 +628,15 @@ void close_Socket(iSocket *d) {
         unlock_Mutex(&d->mutex);
     }
     stopThread_Socket_(d);
+#if defined (iHaveTlsRequest)
+    if (d->tls && status_Socket(d) == connected_SocketStatus) {
+        /* The I/O thread has stopped, so the close_notify can be sent from here. */
+        iBlock *closeNotify = new_Block(0);
+        shutdown_TlsFilter(d->tls, closeNotify);
+        sendAll_Socket_(d, constData_Block(closeNotify), size_Block(closeNotify));
+        delete_Block(closeNotify);
+    }
+#endif
     iGuardMutex(&d->mutex, {
         if (d->status == disconnected_SocketStatus ||
             d->status == disconnecting_SocketStatus) {
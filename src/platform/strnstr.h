@@ -37,7 +37,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
 #endif
 
 static char *strnstr(const char *haystack, const char *needle, size_t len) {
-    size_t needleLen = strnlen(needle, len);
+    size_t needleLen = strlen(needle); /* must fit entirely within `len` */
     if (needleLen == 0) {
         return iConstCast(char *, haystack);
     }
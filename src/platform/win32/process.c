@@ -43,12 +43,18 @@ struct Impl_Process {
     iStringList *args;
     iString workDir;
     PROCESS_INFORMATION procInfo;
+    iAudience *outputReceived;
+    iAudience *errorReceived;
+    iAudience *finished;
     // iPipe pout;
     // iPipe perr;
 };
 
 iDefineObjectConstruction(Process)
 iDefineClass(Process)
+iDefineAudienceGetter(Process, outputReceived)
+iDefineAudienceGetter(Process, errorReceived)
+iDefineAudienceGetter(Process, finished)
 
 extern char **environ; // The environment variables.
 
@@ -56,6 +62,9 @@ void init_Process(iProcess *d) {
     d->args = new_StringList();
     init_String(&d->workDir);
     iZap(d->procInfo);
+    d->outputReceived = NULL;
+    d->errorReceived = NULL;
+    d->finished = NULL;
     // init_Pipe(&d->pout);
     // init_Pipe(&d->perr);
 }
@@ -63,6 +72,9 @@ void init_Process(iProcess *d) {
 void deinit_Process(iProcess *d) {
     iRelease(d->args);
     deinit_String(&d->workDir);
+    delete_Audience(d->outputReceived);
+    delete_Audience(d->errorReceived);
+    delete_Audience(d->finished);
     // deinit_Pipe(&d->pout);
     // deinit_Pipe(&d->perr);
 }
@@ -172,3 +184,20 @@ void kill_Process(iProcess *d) {
     //     kill(d->pid, SIGTERM);
     // }
 }
+
+void setInput_Process(iProcess *d, iStream *input) {
+    iUnused(d, input);
+}
+
+iBool startAsync_Process(iProcess *d) {
+    iUnused(d);
+    return iFalse;
+}
+
+int exitStatus_Process(const iProcess *d) {
+    iUnused(d);
+    return -1;
+}
+
+void deinit_ProcessThreads_(void) {
+}
@@ -100,6 +100,32 @@ void deinit_Service(iService *d) {
     delete_Audience(d->incomingAccepted);
 }
 
+iBool setCertificate_Service(iService *d, const iTlsCertificate *cert) {
+    iUnused(d);
+    return cert == NULL; /* TLS is not supported */
+}
+
+void setFlags_Service(iService *d, int flags) {
+    iUnused(d, flags);
+}
+
+void setListenerCount_Service(iService *d, int count) {
+    iUnused(d, count);
+}
+
+void setBacklog_Service(iService *d, int backlog) {
+    iUnused(d, backlog);
+}
+
+void setThreadPool_Service(iService *d, iThreadPool *pool) {
+    iUnused(d, pool);
+}
+
+int flags_Service(const iService *d) {
+    iUnused(d);
+    return 0;
+}
+
 iBool isOpen_Service(const iService *d) {
     iUnused(d);
     // return d->fd >= 0;
@@ -0,0 +1,346 @@
+/** @file promise.c  Value-carrying promise with continuations.
+
+@authors Copyright (c) 2021 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+@par License
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+<small>THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
+*/
+
+#include "the_Foundation/promise.h"
+#include "the_Foundation/array.h"
+#include "the_Foundation/mutex.h"
+#include "the_Foundation/objectlist.h"
+#include "the_Foundation/threadpool.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+
+iDeclareType(PromiseContinuation)
+
+struct Impl_PromiseContinuation {
+    iPromiseSettledFunc settled;
+    void *context;
+};
+
+/* The state and value do not change after the promise has been settled, so continuations
+   can read them without locking. */
+struct Impl_Promise {
+    iObject object;
+    iMutex mutex;
+    iCondition settled;
+    enum iPromiseState state;
+    iAnyObject *value;
+    iArray continuations; /* iPromiseContinuation */
+};
+
+iDefineClass(Promise)
+iDefineObjectConstruction(Promise)
+
+static iBool settle_Promise_(iPromise *d, enum iPromiseState state, const iAnyObject *value) {
+    iArray conts;
+    lock_Mutex(&d->mutex);
+    if (d->state != pending_PromiseState) {
+        unlock_Mutex(&d->mutex);
+        return iFalse;
+    }
+    d->state = state;
+    d->value = ref_Object(value);
+    conts = d->continuations;
+    init_Array(&d->continuations, sizeof(iPromiseContinuation));
+    signalAll_Condition(&d->settled);
+    unlock_Mutex(&d->mutex);
+    iConstForEach(Array, i, &conts) {
+        const iPromiseContinuation *cont = i.value;
+        cont->settled(d, cont->context);
+    }
+    deinit_Array(&conts);
+    return iTrue;
+}
+
+void whenSettled_Promise(iPromise *d, iPromiseSettledFunc settled, void *context) {
+    const iPromiseContinuation cont = { settled, context };
+    lock_Mutex(&d->mutex);
+    if (d->state == pending_PromiseState) {
+        pushBack_Array(&d->continuations, &cont);
+        unlock_Mutex(&d->mutex);
+        return;
+    }
+    unlock_Mutex(&d->mutex);
+    settled(d, context);
+}
+
+void init_Promise(iPromise *d) {
+    init_Mutex(&d->mutex);
+    init_Condition(&d->settled);
+    d->state = pending_PromiseState;
+    d->value = NULL;
+    init_Array(&d->continuations, sizeof(iPromiseContinuation));
+}
+
+void deinit_Promise(iPromise *d) {
+    /* Nobody can fulfill the promise any more. */
+    cancel_Promise(d);
+    iRelease(d->value);
+    deinit_Array(&d->continuations);
+    deinit_Condition(&d->settled);
+    deinit_Mutex(&d->mutex);
+}
+
+enum iPromiseState state_Promise(const iPromise *d) {
+    enum iPromiseState state;
+    iGuardMutex(&d->mutex, state = d->state);
+    return state;
+}
+
+const iAnyObject *value_Promise(const iPromise *d) {
+    const iAnyObject *value;
+    iGuardMutex(&d->mutex, value = (d->state == fulfilled_PromiseState ? d->value : NULL));
+    return value;
+}
+
+iBool fulfill_Promise(iPromise *d, const iAnyObject *value) {
+    return settle_Promise_(d, fulfilled_PromiseState, value);
+}
+
+iBool cancel_Promise(iPromise *d) {
+    return settle_Promise_(d, canceled_PromiseState, NULL);
+}
+
+enum iPromiseState wait_Promise(const iPromise *d) {
+    iPromise *mut = iConstCast(iPromise *, d);
+    enum iPromiseState state;
+    lock_Mutex(&mut->mutex);
+    while (mut->state == pending_PromiseState) {
+        wait_Condition(&mut->settled, &mut->mutex);
+    }
+    state = mut->state;
+    unlock_Mutex(&mut->mutex);
+    return state;
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
+static void adopt_Promise_(iPromise *source, void *context) {
+    iPromise *d = context;
+    if (source->state == fulfilled_PromiseState) {
+        fulfill_Promise(d, source->value);
+    }
+    else {
+        cancel_Promise(d);
+    }
+    iRelease(d);
+}
+
+/* Settles the promise with a value returned by a callback. Returned promises are followed
+   so that asynchronous stages can be chained. */
+static void resolve_Promise_(iPromise *d, const iAnyObject *value) {
+    if (value && isInstance_Object(value, &Class_Promise)) {
+        whenSettled_Promise(iConstCast(iPromise *, value), adopt_Promise_, ref_Object(d));
+    }
+    else {
+        fulfill_Promise(d, value);
+    }
+}
+
+iDeclareType(PromiseRun)
+
+struct Impl_PromiseRun {
+    iPromise *promise;
+    iPromiseRunFunc func;
+    void *context;
+};
+
+static void run_PromiseRun_(void *context) {
+    iPromiseRun *d = context;
+    if (!isCanceled_Promise(d->promise)) {
+        iAnyObject *value = d->func(d->promise, d->context);
+        resolve_Promise_(d->promise, value);
+        iRelease(value);
+    }
+    iRelease(d->promise);
+    free(d);
+}
+
+iPromise *newRun_Promise(iThreadPool *pool, iPromiseRunFunc func, void *context) {
+    iPromise *d = new_Promise();
+    iPromiseRun *run = malloc(sizeof(iPromiseRun));
+    *run = (iPromiseRun){ ref_Object(d), func, context };
+    post_ThreadPool(pool, run_PromiseRun_, run);
+    return d;
+}
+
+iDeclareType(PromiseThen)
+
+struct Impl_PromiseThen {
+    iPromise *result;
+    iThreadPool *pool;
+    iPromiseThenFunc func;
+    void *context;
+    iAnyObject *value;
+};
+
+static void run_PromiseThen_(void *context) {
+    iPromiseThen *d = context;
+    if (!isCanceled_Promise(d->result)) {
+        iAnyObject *value = d->func(d->value, d->context);
+        resolve_Promise_(d->result, value);
+        iRelease(value);
+    }
+    iRelease(d->value);
+    iRelease(d->result);
+    free(d);
+}
+
+static void settled_PromiseThen_(iPromise *source, void *context) {
+    iPromiseThen *d = context;
+    if (source->state == canceled_PromiseState) {
+        cancel_Promise(d->result);
+        iRelease(d->result);
+        free(d);
+        return;
+    }
+    d->value = ref_Object(source->value);
+    if (d->pool) {
+        post_ThreadPool(d->pool, run_PromiseThen_, d);
+    }
+    else {
+        run_PromiseThen_(d);
+    }
+}
+
+iPromise *then_Promise(iPromise *d, iThreadPool *pool, iPromiseThenFunc func, void *context) {
+    iPromise *result = new_Promise();
+    iPromiseThen *then = malloc(sizeof(iPromiseThen));
+    *then = (iPromiseThen){ ref_Object(result), pool, func, context, NULL };
+    whenSettled_Promise(d, settled_PromiseThen_, then);
+    return result;
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
+iDeclareType(PromiseGroup)
+iDeclareType(PromiseGroupMember)
+
+/* Continuation context of one of the grouped promises. The member holds a reference to
+   its promise only after the promise has been fulfilled, so an abandoned pending promise
+   is still canceled when its producer releases it. */
+struct Impl_PromiseGroupMember {
+    iPromiseGroup *group;
+    iPromise *fulfilled;
+};
+
+/* Shared by the continuations of all the promises of newAll_Promise() or
+   newAny_Promise(). The last one to be called deletes the group. */
+struct Impl_PromiseGroup {
+    iPromise *result;
+    size_t count;
+    atomic_size_t numFulfilled;
+    atomic_size_t numCanceled;
+    atomic_size_t numSettled;
+    iPromiseGroupMember members[];
+};
+
+static iPromiseGroup *new_PromiseGroup_(iPromise *result, size_t count) {
+    iPromiseGroup *d = malloc(sizeof(iPromiseGroup) + sizeof(iPromiseGroupMember) * count);
+    d->result = ref_Object(result);
+    d->count  = count;
+    atomic_init(&d->numFulfilled, 0);
+    atomic_init(&d->numCanceled, 0);
+    atomic_init(&d->numSettled, 0);
+    for (size_t i = 0; i < count; i++) {
+        d->members[i] = (iPromiseGroupMember){ d, NULL };
+    }
+    return d;
+}
+
+static void finish_PromiseGroup_(iPromiseGroup *d) {
+    if (atomic_fetch_add(&d->numSettled, 1) + 1 == d->count) {
+        for (size_t i = 0; i < d->count; i++) {
+            iRelease(d->members[i].fulfilled);
+        }
+        iRelease(d->result);
+        free(d);
+    }
+}
+
+static void settledAll_PromiseGroup_(iPromise *source, void *context) {
+    iPromiseGroupMember *member = context;
+    iPromiseGroup *d = member->group;
+    if (source->state == fulfilled_PromiseState) {
+        member->fulfilled = ref_Object(source);
+        if (atomic_fetch_add(&d->numFulfilled, 1) + 1 == d->count) {
+            iObjectList *all = new_ObjectList();
+            for (size_t i = 0; i < d->count; i++) {
+                pushBack_ObjectList(all, d->members[i].fulfilled);
+            }
+            fulfill_Promise(d->result, all);
+            iRelease(all);
+        }
+    }
+    else {
+        cancel_Promise(d->result);
+    }
+    finish_PromiseGroup_(d);
+}
+
+static void settledAny_PromiseGroup_(iPromise *source, void *context) {
+    iPromiseGroup *d = ((iPromiseGroupMember *) context)->group;
+    if (source->state == fulfilled_PromiseState) {
+        fulfill_Promise(d->result, source->value);
+    }
+    else if (atomic_fetch_add(&d->numCanceled, 1) + 1 == d->count) {
+        cancel_Promise(d->result);
+    }
+    finish_PromiseGroup_(d);
+}
+
+static iPromise *newGroup_Promise_(iPromise * const *promises, size_t count,
+                                   iPromiseSettledFunc settled) {
+    iPromise *d = new_Promise();
+    iPromiseGroup *group = new_PromiseGroup_(d, count);
+    /* The group may be deleted by the last continuation, even during this loop. */
+    iPromiseGroupMember *members = group->members;
+    for (size_t i = 0; i < count; i++) {
+        whenSettled_Promise(promises[i], settled, &members[i]);
+    }
+    return d;
+}
+
+iPromise *newAll_Promise(iPromise * const *promises, size_t count) {
+    if (count == 0) {
+        iPromise *d = new_Promise();
+        iObjectList *none = new_ObjectList();
+        fulfill_Promise(d, none);
+        iRelease(none);
+        return d;
+    }
+    return newGroup_Promise_(promises, count, settledAll_PromiseGroup_);
+}
+
+iPromise *newAny_Promise(iPromise * const *promises, size_t count) {
+    if (count == 0) {
+        iPromise *d = new_Promise();
+        cancel_Promise(d);
+        return d;
+    }
+    return newGroup_Promise_(promises, count, settledAny_PromiseGroup_);
+}
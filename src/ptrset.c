@@ -28,6 +28,11 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
 #include "the_Foundation/ptrset.h"
 #include "the_Foundation/stream.h"
 
+#include <stdlib.h>
+
+void insertRadixN_SortedArray_(iSortedArray *, const void *values, size_t count,
+                               iBool isSigned); /* sortedarray.c */
+
 typedef void * iPtr;
 
 static int cmp_PtrSet_(const void *a, const void *b) {
@@ -70,6 +75,20 @@ iBool insert_PtrSet(iPtrSet *d, const void *ptr) {
     return insert_SortedArray(d, &ptr);
 }
 
+void insertN_PtrSet(iPtrSet *d, const void * const *ptrs, size_t count) {
+    if (d->cmp == cmp_PtrSet_) {
+        insertRadixN_SortedArray_(d, ptrs, count, iFalse);
+    }
+    else {
+        insertN_SortedArray(d, ptrs, count);
+    }
+}
+
+void merge_PtrSet(iPtrSet *d, const iPtrSet *other) {
+    iAssert(d->cmp == other->cmp);
+    merge_SortedArray(d, constData_Array(&other->values), size_PtrSet(other));
+}
+
 iBool remove_PtrSet(iPtrSet *d, const void *ptr) {
     iAssert(d);
     return remove_SortedArray(d, &ptr);
@@ -90,13 +109,30 @@ void serializeObjects_PtrSet(const iPtrSet *d, iStream *outs) {
     }
 }
 
+static void readObjects_PtrSet_(iPtrSet *d, iStream *ins, const iAnyClass *class,
+                                uint32_t count) {
+    /* The count comes from the stream and is not trusted for sizing an allocation. The
+       array grows as objects are read, and reading stops when the stream runs out. */
+    iArray objs;
+    init_Array(&objs, sizeof(iPtr));
+    reserve_Array(&objs, iMin(count, 1024));
+    while (count-- > 0) {
+        const size_t pos = pos_Stream(ins);
+        iAnyObject *obj = readObject_Stream(ins, class);
+        if (pos_Stream(ins) == pos && atEnd_Stream(ins)) {
+            iRelease(obj); /* truncated */
+            break;
+        }
+        pushBack_Array(&objs, &obj);
+    }
+    insertN_PtrSet(d, constData_Array(&objs), size_Array(&objs));
+    deinit_Array(&objs);
+}
+
 void deserializeObjects_PtrSet(iPtrSet *d, iStream *ins, const iAnyClass *class) {
     iAssert(d);
     iAssert(isEmpty_PtrSet(d));
-    uint32_t count = readU32_Stream(ins);
-    while (count--) {
-        insert_PtrSet(d, readObject_Stream(ins, class));
-    }
+    readObjects_PtrSet_(d, ins, class, readU32_Stream(ins));
 }
 
 iPtrSet *newStreamObjects_PtrSet(iStream *ins, const iAnyClass *class) {
@@ -104,9 +140,7 @@ iPtrSet *newStreamObjects_PtrSet(iStream *ins, const iAnyClass *class) {
     uint32_t count = readU32_Stream(ins);
     if (count) {
         d = new_PtrSet();
-        while (count--) {
-            insert_PtrSet(d, readObject_Stream(ins, class));
-        }
+        readObjects_PtrSet_(d, ins, class, count);
     }
     return d;
 }
@@ -26,58 +26,318 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
 */
 
 #include "the_Foundation/random.h"
+#include "the_Foundation/cpu.h"
+#include "the_Foundation/mutex.h"
 #include "the_Foundation/time.h"
-#include "the_Foundation/atomic.h"
 
 #include <stdlib.h>
+#include <string.h>
 
-#define iRandMax (1u << 24)
+#if defined (iHaveCpuDispatch) && defined (__GNUC__)
+#   define iRandomHaveAvx2
+#   include <immintrin.h>
+#endif
 
-static uint32_t rand24_(void) {
-    /* For reference, see: https://en.wikipedia.org/wiki/Linear_congruential_generator */
-    static atomic_uint seed;
-    static iBool inited = iFalse;
-    const uint32_t multiplier = 1103515245;
-    const uint32_t increment = 12345;
-    const uint32_t modulus = 0x7fffffff;
-    if (!inited) {
-        inited = iTrue;
-        const iTime now = now_Time();
-        const uint32_t val = (uint32_t) (nanoSeconds_Time(&now) ^ (integralSeconds_Time(&now) % 1000));
-        iDebug("[the_Foundation] random seed: %ld\n", val);
-        set_Atomic(&seed, val & modulus);
+/* For reference, see: https://prng.di.unimi.it/ */
+
+iLocalDef uint64_t rotl_(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+static uint64_t splitMix64_(uint64_t *state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+static void stepLane_RandomEngine_(iRandomEngine *d, unsigned lane) {
+    uint64_t *s0 = &d->state[0][lane], *s1 = &d->state[1][lane];
+    uint64_t *s2 = &d->state[2][lane], *s3 = &d->state[3][lane];
+    const uint64_t t = *s1 << 17;
+    *s2 ^= *s0;
+    *s3 ^= *s1;
+    *s1 ^= *s2;
+    *s0 ^= *s3;
+    *s2 ^= t;
+    *s3 = rotl_(*s3, 45);
+}
+
+static void jumpLane_RandomEngine_(iRandomEngine *d, unsigned lane, const uint64_t *poly) {
+    uint64_t s[4] = { 0, 0, 0, 0 };
+    for (int i = 0; i < 4; i++) {
+        for (int b = 0; b < 64; b++) {
+            if (poly[i] & (UINT64_C(1) << b)) {
+                for (int w = 0; w < 4; w++) {
+                    s[w] ^= d->state[w][lane];
+                }
+            }
+            stepLane_RandomEngine_(d, lane);
+        }
+    }
+    for (int w = 0; w < 4; w++) {
+        d->state[w][lane] = s[w];
     }
-    return (exchange_Atomic(&seed, (multiplier * value_Atomic(&seed) + increment) & modulus) >> 6) &
-           (iRandMax - 1);
 }
 
-float iRandomf(void) {
-    return (float) rand24_() / (float) iRandMax;
+static const uint64_t jump128_[4] = {
+    0x180ec6d33cfd0aba, 0xd5a61266f0c9392c, 0xa9582618e03fc9aa, 0x39abdc4529b1661c
+};
+static const uint64_t jump192_[4] = {
+    0x76e15d3efefdcbbf, 0xc5004e441c522fb3, 0x77710069854ee241, 0x39109bb02acbe635
+};
+
+void init_RandomEngine(iRandomEngine *d, uint64_t seed) {
+    seed_RandomEngine(d, seed);
 }
 
-int iRandom(int start, int end) {
+void deinit_RandomEngine(iRandomEngine *d) {
+    iUnused(d);
+}
+
+iDefineTypeConstructionArgs(RandomEngine, (uint64_t seed), seed)
+
+void seed_RandomEngine(iRandomEngine *d, uint64_t seed) {
+    for (int w = 0; w < 4; w++) {
+        d->state[w][0] = splitMix64_(&seed);
+    }
+    /* Each lane continues 2^128 steps further along the same sequence. */
+    for (unsigned lane = 1; lane < 4; lane++) {
+        for (int w = 0; w < 4; w++) {
+            d->state[w][lane] = d->state[w][lane - 1];
+        }
+        jumpLane_RandomEngine_(d, lane, jump128_);
+    }
+    d->lane = 0;
+}
+
+uint64_t next_RandomEngine(iRandomEngine *d) {
+    const unsigned lane = d->lane;
+    const uint64_t result = rotl_(d->state[1][lane] * 5, 7) * 9;
+    stepLane_RandomEngine_(d, lane);
+    d->lane = (lane + 1) & 3;
+    return result;
+}
+
+uint32_t nextU32_RandomEngine(iRandomEngine *d) {
+    return (uint32_t) (next_RandomEngine(d) >> 32);
+}
+
+iLocalDef float toFloat_(uint64_t x) {
+    return (float) (x >> 40) * 0x1.0p-24f;
+}
+
+float nextf_RandomEngine(iRandomEngine *d) {
+    return toFloat_(next_RandomEngine(d));
+}
+
+double nextd_RandomEngine(iRandomEngine *d) {
+    return (double) (next_RandomEngine(d) >> 11) * 0x1.0p-53;
+}
+
+static uint64_t boundedWide_RandomEngine_(iRandomEngine *d, uint64_t bound) {
+    /* Rejection sampling on a bit mask that covers the bound. */
+    uint64_t mask = bound - 1;
+    mask |= mask >> 1;
+    mask |= mask >> 2;
+    mask |= mask >> 4;
+    mask |= mask >> 8;
+    mask |= mask >> 16;
+    mask |= mask >> 32;
+    uint64_t x;
+    do {
+        x = next_RandomEngine(d) & mask;
+    } while (x >= bound);
+    return x;
+}
+
+/* Multiply-and-shift reduction of a 32-bit value to the range [0, bound). Returns false
+   if the value falls in the biased part of the range and must be drawn again.
+   See: Lemire, "Fast Random Integer Generation in an Interval" (2019). */
+iLocalDef iBool reduce32_(uint32_t x, uint32_t bound, uint32_t *result_out) {
+    const uint64_t m = (uint64_t) x * bound;
+    const uint32_t low = (uint32_t) m;
+    if (low < bound && low < (uint32_t) -bound % bound) {
+        return iFalse;
+    }
+    *result_out = (uint32_t) (m >> 32);
+    return iTrue;
+}
+
+uint64_t bounded_RandomEngine(iRandomEngine *d, uint64_t bound) {
+    if (bound <= 1) {
+        return 0;
+    }
+    if (bound > UINT32_MAX) {
+        return boundedWide_RandomEngine_(d, bound);
+    }
+    uint32_t result;
+    while (!reduce32_(nextU32_RandomEngine(d), (uint32_t) bound, &result)) {}
+    return result;
+}
+
+int range_RandomEngine(iRandomEngine *d, int start, int end) {
     if (end <= start) return start;
-    const unsigned range = end - start;
-    if (range >= iRandMax) {
-        return (int) (start + iRandomf() * range);
+    return (int) (start + (int64_t) bounded_RandomEngine(d, (uint64_t) ((int64_t) end - start)));
+}
+
+void jump_RandomEngine(iRandomEngine *d) {
+    for (unsigned lane = 0; lane < 4; lane++) {
+        jumpLane_RandomEngine_(d, lane, jump192_);
+    }
+}
+
+void split_RandomEngine(iRandomEngine *d, iRandomEngine *split_out) {
+    *split_out = *d;
+    jump_RandomEngine(d);
+}
+
+#if defined (iRandomHaveAvx2)
+iCpuTarget("avx2")
+static size_t fillAvx2_RandomEngine_(iRandomEngine *d, uint64_t *values, size_t count) {
+    __m256i s0 = _mm256_loadu_si256((const __m256i *) d->state[0]);
+    __m256i s1 = _mm256_loadu_si256((const __m256i *) d->state[1]);
+    __m256i s2 = _mm256_loadu_si256((const __m256i *) d->state[2]);
+    __m256i s3 = _mm256_loadu_si256((const __m256i *) d->state[3]);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        /* x*5 and x*9 with shifts, as there is no 64-bit multiply in AVX2. */
+        const __m256i m5 = _mm256_add_epi64(_mm256_slli_epi64(s1, 2), s1);
+        const __m256i r  = _mm256_or_si256(_mm256_slli_epi64(m5, 7), _mm256_srli_epi64(m5, 57));
+        const __m256i m9 = _mm256_add_epi64(_mm256_slli_epi64(r, 3), r);
+        _mm256_storeu_si256((__m256i *) (values + i), m9);
+        const __m256i t = _mm256_slli_epi64(s1, 17);
+        s2 = _mm256_xor_si256(s2, s0);
+        s3 = _mm256_xor_si256(s3, s1);
+        s1 = _mm256_xor_si256(s1, s2);
+        s0 = _mm256_xor_si256(s0, s3);
+        s2 = _mm256_xor_si256(s2, t);
+        s3 = _mm256_or_si256(_mm256_slli_epi64(s3, 45), _mm256_srli_epi64(s3, 19));
+    }
+    _mm256_storeu_si256((__m256i *) d->state[0], s0);
+    _mm256_storeu_si256((__m256i *) d->state[1], s1);
+    _mm256_storeu_si256((__m256i *) d->state[2], s2);
+    _mm256_storeu_si256((__m256i *) d->state[3], s3);
+    return i;
+}
+#endif
+
+void fill_RandomEngine(iRandomEngine *d, uint64_t *values, size_t count) {
+    size_t i = 0;
+    /* The vector kernel advances all lanes at once, so it starts from the first lane. */
+    while (i < count && d->lane != 0) {
+        values[i++] = next_RandomEngine(d);
+    }
+#if defined (iRandomHaveAvx2)
+    if (features_Cpu() & avx2_CpuFeature) {
+        i += fillAvx2_RandomEngine_(d, values + i, count - i);
+    }
+#endif
+    while (i < count) {
+        values[i++] = next_RandomEngine(d);
+    }
+}
+
+#define iRandomChunk 256
+
+void fillf_RandomEngine(iRandomEngine *d, float *values, size_t count) {
+    uint64_t buf[iRandomChunk];
+    while (count) {
+        const size_t n = iMin(count, (size_t) iRandomChunk);
+        fill_RandomEngine(d, buf, n);
+        for (size_t i = 0; i < n; i++) {
+            values[i] = toFloat_(buf[i]);
+        }
+        values += n;
+        count -= n;
+    }
+}
+
+void fillRange_RandomEngine(iRandomEngine *d, int *values, size_t count, int start, int end) {
+    if (end <= start) {
+        for (size_t i = 0; i < count; i++) {
+            values[i] = start;
+        }
+        return;
+    }
+    const uint64_t bound = (uint64_t) ((int64_t) end - start);
+    if (bound > UINT32_MAX) {
+        for (size_t i = 0; i < count; i++) {
+            values[i] = range_RandomEngine(d, start, end);
+        }
+        return;
     }
-    return start + rand24_() % range;
+    /* Rejected draws take the next buffered value, which keeps the output identical to
+       calling range_RandomEngine() for each element. */
+    uint64_t buf[iRandomChunk];
+    size_t avail = 0, pos = 0;
+    for (size_t i = 0; i < count; ) {
+        if (pos == avail) {
+            /* Don't draw more than needed when no values get rejected. */
+            avail = iMin(count - i, (size_t) iRandomChunk);
+            fill_RandomEngine(d, buf, avail);
+            pos = 0;
+        }
+        uint32_t result;
+        if (reduce32_((uint32_t) (buf[pos++] >> 32), (uint32_t) bound, &result)) {
+            values[i++] = (int) (start + (int64_t) result);
+        }
+    }
+}
+
+/*-------------------------------------------------------------------------------------*/
+
+static tss_t     threadLocal_RandomEngine_;
+static iMutex    mainMutex_RandomEngine_; /* guards `main_RandomEngine_` */
+static iRandomEngine main_RandomEngine_;  /* thread engines are split off this one */
+static once_flag initOnce_RandomEngine_ = ONCE_FLAG_INIT;
+
+static void initShared_RandomEngine_(void) {
+    tss_create(&threadLocal_RandomEngine_, (tss_dtor_t) delete_RandomEngine);
+    init_Mutex(&mainMutex_RandomEngine_);
+    const iTime now = now_Time();
+    const uint64_t seed = ((uint64_t) integralSeconds_Time(&now) << 32) ^
+                          (uint64_t) nanoSeconds_Time(&now);
+    iDebug("[the_Foundation] random seed: %llu\n", (unsigned long long) seed);
+    init_RandomEngine(&main_RandomEngine_, seed);
+}
+
+iRandomEngine *current_RandomEngine(void) {
+    call_once(&initOnce_RandomEngine_, initShared_RandomEngine_);
+    iRandomEngine *d = tss_get(threadLocal_RandomEngine_);
+    if (!d) {
+        d = iMalloc(RandomEngine);
+        lock_Mutex(&mainMutex_RandomEngine_);
+        split_RandomEngine(&main_RandomEngine_, d);
+        unlock_Mutex(&mainMutex_RandomEngine_);
+        tss_set(threadLocal_RandomEngine_, d);
+    }
+    return d;
+}
+
+void deinitForThread_Random_(void) {
+    call_once(&initOnce_RandomEngine_, initShared_RandomEngine_);
+    iRandomEngine *d = tss_get(threadLocal_RandomEngine_);
+    if (d) {
+        delete_RandomEngine(d);
+        tss_set(threadLocal_RandomEngine_, NULL);
+    }
+}
+
+float iRandomf(void) {
+    return nextf_RandomEngine(current_RandomEngine());
+}
+
+int iRandom(int start, int end) {
+    return range_RandomEngine(current_RandomEngine(), start, end);
 }
 
 unsigned iRandomu(unsigned start, unsigned end) {
     if (end <= start) return start;
-    const unsigned range = end - start;
-    if (range >= iRandMax) {
-        return (unsigned) (start + iRandomf() * range);
-    }
-    return start + rand24_() % range;
+    return start + (unsigned) bounded_RandomEngine(current_RandomEngine(), end - start);
 }
 
 size_t iRandoms(size_t start, size_t end) {
     if (end <= start) return start;
-    const size_t range = end - start;
-    if (range >= iRandMax) {
-        return (size_t) (start + iRandomf() * range);
-    }
-    return start + rand24_() % range;
+    return start + (size_t) bounded_RandomEngine(current_RandomEngine(), end - start);
 }
@@ -0,0 +1,322 @@
+/** @file ring.c  Bounded lock-free ring buffer.
+
+@authors Copyright (c) 2021 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+@par License
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+<small>THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
+*/
+
+#include "the_Foundation/ring.h"
+#include "the_Foundation/mutex.h"
+#include "the_Foundation/time.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define iRingCacheLine  64
+
+/* The producer and consumer counters live on separate cache lines so that the two sides
+   do not keep invalidating each other's cached copies. Positions increase monotonically;
+   they are masked only when accessing the buffer. */
+struct Impl_Ring {
+    size_t          elementSize;
+    size_t          mask;
+    enum iRingMode  mode;
+    char *          data;
+    atomic_size_t * ready; /* multi-producer: position + 1 of the element written to a slot */
+    iMutex          mutex;
+    iCondition      notEmpty;
+    iCondition      notFull;
+    atomic_int      waitingConsumers;
+    atomic_int      waitingProducers;
+    char            pad0_[iRingCacheLine];
+    atomic_size_t   tail; /* next position to write */
+    size_t          cachedHead; /* single producer's last seen consumer position */
+    char            pad1_[iRingCacheLine];
+    atomic_size_t   head; /* next position to read */
+    size_t          cachedTail; /* consumer's last seen producer position */
+    char            pad2_[iRingCacheLine];
+};
+
+void init_Ring(iRing *d, size_t elementSize, size_t capacity, enum iRingMode mode) {
+    iAssert(elementSize > 0);
+    size_t cap = 1;
+    while (cap < capacity) {
+        cap <<= 1;
+    }
+    d->elementSize = elementSize;
+    d->mask        = cap - 1;
+    d->mode        = mode;
+    d->data        = malloc(cap * elementSize);
+    d->ready       = NULL;
+    if (mode == multiProducer_RingMode) {
+        d->ready = malloc(sizeof(atomic_size_t) * cap);
+        for (size_t i = 0; i < cap; i++) {
+            atomic_init(&d->ready[i], 0);
+        }
+    }
+    init_Mutex(&d->mutex);
+    init_Condition(&d->notEmpty);
+    init_Condition(&d->notFull);
+    atomic_init(&d->waitingConsumers, 0);
+    atomic_init(&d->waitingProducers, 0);
+    atomic_init(&d->tail, 0);
+    atomic_init(&d->head, 0);
+    d->cachedHead = 0;
+    d->cachedTail = 0;
+}
+
+void deinit_Ring(iRing *d) {
+    deinit_Condition(&d->notFull);
+    deinit_Condition(&d->notEmpty);
+    deinit_Mutex(&d->mutex);
+    free(d->ready);
+    free(d->data);
+}
+
+iDefineTypeConstructionArgs(Ring,
+                            (size_t elementSize, size_t capacity, enum iRingMode mode),
+                            elementSize, capacity, mode)
+
+size_t elementSize_Ring(const iRing *d) {
+    return d->elementSize;
+}
+
+size_t capacity_Ring(const iRing *d) {
+    return d->mask + 1;
+}
+
+size_t size_Ring(const iRing *d) {
+    const size_t head = atomic_load(&iConstCast(iRing *, d)->head);
+    const size_t tail = atomic_load(&iConstCast(iRing *, d)->tail);
+    return tail - head;
+}
+
+static void copyIn_Ring_(iRing *d, size_t pos, const void *elements, size_t count) {
+    const size_t index = pos & d->mask;
+    const size_t first = iMin(count, d->mask + 1 - index);
+    memcpy(d->data + index * d->elementSize, elements, first * d->elementSize);
+    if (first < count) {
+        memcpy(d->data,
+               (const char *) elements + first * d->elementSize,
+               (count - first) * d->elementSize);
+    }
+}
+
+static void copyOut_Ring_(const iRing *d, size_t pos, void *elements, size_t count) {
+    const size_t index = pos & d->mask;
+    const size_t first = iMin(count, d->mask + 1 - index);
+    memcpy(elements, d->data + index * d->elementSize, first * d->elementSize);
+    if (first < count) {
+        memcpy((char *) elements + first * d->elementSize,
+               d->data,
+               (count - first) * d->elementSize);
+    }
+}
+
+static void wake_Ring_(iRing *d, iCondition *cond, atomic_int *waiting) {
+    /* Pairs with the increment of the waiter count in wait_Ring_(): either the waiter sees
+       the new state when it checks, or we see the waiter here. */
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(waiting, memory_order_relaxed) > 0) {
+        iGuardMutex(&d->mutex, signalAll_Condition(cond));
+    }
+}
+
+static iBool hasRoom_Ring_(const iRing *d) {
+    return size_Ring(d) <= d->mask;
+}
+
+static iBool hasElements_Ring_(const iRing *d) {
+    const size_t head = atomic_load_explicit(&d->head, memory_order_relaxed);
+    if (d->mode == multiProducer_RingMode) {
+        return atomic_load(&d->ready[head & d->mask]) == head + 1;
+    }
+    return atomic_load(&d->tail) != head;
+}
+
+static iBool wait_Ring_(iRing *d, iCondition *cond, atomic_int *waiting,
+                        iBool (*isReady)(const iRing *), const iTime *until) {
+    iBool ready;
+    lock_Mutex(&d->mutex);
+    atomic_fetch_add(waiting, 1);
+    while (!(ready = isReady(d))) {
+        if (!until) {
+            wait_Condition(cond, &d->mutex);
+        }
+        else if (waitTimeout_Condition(cond, &d->mutex, until) == thrd_timedout) {
+            ready = isReady(d);
+            break;
+        }
+    }
+    atomic_fetch_sub(waiting, 1);
+    unlock_Mutex(&d->mutex);
+    return ready;
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
+size_t tryPushN_Ring(iRing *d, const void *elements, size_t count) {
+    if (count == 0) {
+        return 0;
+    }
+    const size_t cap = d->mask + 1;
+    size_t pos, avail;
+    if (d->mode == singleProducer_RingMode) {
+        pos   = atomic_load_explicit(&d->tail, memory_order_relaxed);
+        avail = cap - (pos - d->cachedHead);
+        if (avail < count) {
+            d->cachedHead = atomic_load_explicit(&d->head, memory_order_acquire);
+            avail = cap - (pos - d->cachedHead);
+        }
+        avail = iMin(avail, count);
+        if (avail == 0) {
+            return 0;
+        }
+        copyIn_Ring_(d, pos, elements, avail);
+        atomic_store_explicit(&d->tail, pos + avail, memory_order_release);
+    }
+    else {
+        /* Reserve a range of positions, then mark each slot ready once it is written.
+           The consumer frees slots in order, so all reserved slots are free. */
+        pos = atomic_load_explicit(&d->tail, memory_order_relaxed);
+        for (;;) {
+            const size_t head = atomic_load_explicit(&d->head, memory_order_acquire);
+            if (pos - head >= cap) {
+                /* Full, or `pos` is out of date and the CAS would fail anyway. */
+                if (pos - head == cap) {
+                    return 0;
+                }
+                pos = atomic_load_explicit(&d->tail, memory_order_relaxed);
+                continue;
+            }
+            avail = iMin(cap - (pos - head), count);
+            if (atomic_compare_exchange_weak_explicit(&d->tail, &pos, pos + avail,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                break;
+            }
+        }
+        copyIn_Ring_(d, pos, elements, avail);
+        for (size_t i = 0; i < avail; i++) {
+            atomic_store_explicit(&d->ready[(pos + i) & d->mask], pos + i + 1,
+                                  memory_order_release);
+        }
+    }
+    wake_Ring_(d, &d->notEmpty, &d->waitingConsumers);
+    return avail;
+}
+
+iBool tryPush_Ring(iRing *d, const void *element) {
+    return tryPushN_Ring(d, element, 1) == 1;
+}
+
+void push_Ring(iRing *d, const void *element) {
+    while (!tryPush_Ring(d, element)) {
+        wait_Ring_(d, &d->notFull, &d->waitingProducers, hasRoom_Ring_, NULL);
+    }
+}
+
+iBool pushTimeout_Ring(iRing *d, const void *element, double timeoutSeconds) {
+    iTime until;
+    initTimeout_Time(&until, timeoutSeconds);
+    while (!tryPush_Ring(d, element)) {
+        if (!wait_Ring_(d, &d->notFull, &d->waitingProducers, hasRoom_Ring_, &until)) {
+            return iFalse;
+        }
+    }
+    return iTrue;
+}
+
+void pushN_Ring(iRing *d, const void *elements, size_t count) {
+    while (count > 0) {
+        const size_t pushed = tryPushN_Ring(d, elements, count);
+        if (pushed == 0) {
+            wait_Ring_(d, &d->notFull, &d->waitingProducers, hasRoom_Ring_, NULL);
+            continue;
+        }
+        elements = (const char *) elements + pushed * d->elementSize;
+        count -= pushed;
+    }
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
+size_t tryPopN_Ring(iRing *d, void *elements_out, size_t maxCount) {
+    const size_t head = atomic_load_explicit(&d->head, memory_order_relaxed);
+    size_t avail;
+    if (d->mode == singleProducer_RingMode) {
+        avail = d->cachedTail - head;
+        if (avail < maxCount) {
+            d->cachedTail = atomic_load_explicit(&d->tail, memory_order_acquire);
+            avail = d->cachedTail - head;
+        }
+        avail = iMin(avail, maxCount);
+    }
+    else {
+        /* Producers may finish writing out of order; stop at the first unwritten slot. */
+        for (avail = 0; avail < maxCount; avail++) {
+            const size_t pos = head + avail;
+            if (atomic_load_explicit(&d->ready[pos & d->mask], memory_order_acquire) != pos + 1) {
+                break;
+            }
+        }
+    }
+    if (avail == 0) {
+        return 0;
+    }
+    copyOut_Ring_(d, head, elements_out, avail);
+    atomic_store_explicit(&d->head, head + avail, memory_order_release);
+    wake_Ring_(d, &d->notFull, &d->waitingProducers);
+    return avail;
+}
+
+iBool tryPop_Ring(iRing *d, void *element_out) {
+    return tryPopN_Ring(d, element_out, 1) == 1;
+}
+
+void pop_Ring(iRing *d, void *element_out) {
+    popN_Ring(d, element_out, 1);
+}
+
+iBool popTimeout_Ring(iRing *d, void *element_out, double timeoutSeconds) {
+    iTime until;
+    initTimeout_Time(&until, timeoutSeconds);
+    while (!tryPop_Ring(d, element_out)) {
+        if (!wait_Ring_(d, &d->notEmpty, &d->waitingConsumers, hasElements_Ring_, &until)) {
+            return iFalse;
+        }
+    }
+    return iTrue;
+}
+
+size_t popN_Ring(iRing *d, void *elements_out, size_t maxCount) {
+    if (maxCount == 0) {
+        return 0;
+    }
+    size_t count;
+    while ((count = tryPopN_Ring(d, elements_out, maxCount)) == 0) {
+        wait_Ring_(d, &d->notEmpty, &d->waitingConsumers, hasElements_Ring_, NULL);
+    }
+    return count;
+}
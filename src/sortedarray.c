@@ -28,6 +28,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
 #include "the_Foundation/sortedarray.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 iDefineTypeConstructionArgs(SortedArray,
                             (size_t elementSize, iSortedArrayCompareElemFunc cmp),
@@ -78,6 +79,49 @@ iBool locate_SortedArray(const iSortedArray *d, const void *value, size_t *pos_o
     return iFalse;
 }
 
+/* Position of the first element not less than `value`, or greater than it if `upper`. */
+static size_t bound_SortedArray_(const iSortedArray *d, const void *value,
+                                 iSortedArrayCompareElemFunc cmp, iBool upper) {
+    iRanges span = { 0, size_SortedArray(d) };
+    while (!isEmpty_Range(&span)) {
+        const size_t mid = (span.start + span.end) / 2;
+        const int c = cmp(constAt_SortedArray(d, mid), value);
+        if (c > 0 || (c == 0 && !upper)) {
+            span.end = mid;
+        }
+        else {
+            span.start = mid + 1;
+        }
+    }
+    return span.start;
+}
+
+size_t lowerBound_SortedArray(const iSortedArray *d, const void *value) {
+    return bound_SortedArray_(d, value, d->cmp, iFalse);
+}
+
+size_t upperBound_SortedArray(const iSortedArray *d, const void *value) {
+    return bound_SortedArray_(d, value, d->cmp, iTrue);
+}
+
+iBool floor_SortedArray(const iSortedArray *d, const void *value, size_t *pos_out) {
+    const size_t pos = upperBound_SortedArray(d, value);
+    if (pos == 0) {
+        return iFalse;
+    }
+    if (pos_out) *pos_out = pos - 1;
+    return iTrue;
+}
+
+iBool ceiling_SortedArray(const iSortedArray *d, const void *value, size_t *pos_out) {
+    const size_t pos = lowerBound_SortedArray(d, value);
+    if (pos == size_SortedArray(d)) {
+        return iFalse;
+    }
+    if (pos_out) *pos_out = pos;
+    return iTrue;
+}
+
 iRanges locateRange_SortedArray(const iSortedArray *d, const void *value,
                                 iSortedArrayCompareElemFunc relaxed) {
     const iSortedArrayCompareElemFunc cmpFunc = (relaxed ? relaxed : d->cmp);
@@ -88,34 +132,8 @@ iRanges locateRange_SortedArray(const iSortedArray *d, const void *value,
     if (cmpFunc(value, constBack_SortedArray(d)) > 0) {
         return (iRanges){ size_SortedArray(d), size_SortedArray(d) };
     }
-    iRanges range;
-    /* Find the beginning of the range. */ {
-        iRanges span = { 0, size_SortedArray(d) };
-        while (!isEmpty_Range(&span)) {
-            const size_t mid = (span.start + span.end) / 2;
-            if (cmpFunc(constAt_SortedArray(d, mid), value) >= 0) {
-                span.end = mid;
-            }
-            else {
-                span.start = mid + 1;
-            }
-        }
-        range.start = span.end;
-    }
-    /* Find the end of the range. */ {
-        iRanges span = { 0, size_SortedArray(d) };
-        while (!isEmpty_Range(&span)) {
-            const size_t mid = (span.start + span.end) / 2;
-            if (cmpFunc(constAt_SortedArray(d, mid), value) > 0) {
-                span.end = mid;
-            }
-            else {
-                span.start = mid + 1;
-            }
-        }
-        range.end = span.start;
-    }
-    return range;
+    return (iRanges){ bound_SortedArray_(d, value, cmpFunc, iFalse),
+                      bound_SortedArray_(d, value, cmpFunc, iTrue) };
 }
 
 void clear_SortedArray(iSortedArray *d) {
@@ -147,3 +165,152 @@ iBool remove_SortedArray(iSortedArray *d, const void *value) {
     }
     return iFalse;
 }
+
+/* Removes adjacent equal elements from sorted values, keeping the last of each run.
+   Returns the remaining number of elements. */
+static size_t unique_SortedArray_(const iSortedArray *d, char *values, size_t count) {
+    const size_t es = d->values.elementSize;
+    if (count < 2) {
+        return count;
+    }
+    size_t out = 0;
+    for (size_t i = 1; i < count; i++) {
+        if (d->cmp(values + out * es, values + i * es)) {
+            out++;
+        }
+        if (out != i) {
+            memcpy(values + out * es, values + i * es, es);
+        }
+    }
+    return out + 1;
+}
+
+void merge_SortedArray(iSortedArray *d, const void *sortedValues, size_t count) {
+    const size_t es = d->values.elementSize;
+    const size_t oldCount = size_SortedArray(d);
+    const char *b = sortedValues;
+    if (count == 0) {
+        return;
+    }
+    /* Nothing to interleave if the batch goes after the existing elements. */
+    if (oldCount == 0 || d->cmp(constBack_SortedArray(d), b) < 0) {
+        pushBackN_Array(&d->values, b, count);
+        return;
+    }
+    iArray merged;
+    init_Array(&merged, es);
+    resize_Array(&merged, oldCount + count);
+    const char *a = constData_Array(&d->values);
+    const char *aEnd = a + oldCount * es;
+    const char *bEnd = b + count * es;
+    char *out = data_Array(&merged);
+    while (a != aEnd && b != bEnd) {
+        const int cmp = d->cmp(a, b);
+        if (cmp < 0) {
+            memcpy(out, a, es);
+            a += es;
+        }
+        else {
+            /* An equal new value replaces the old one. */
+            memcpy(out, b, es);
+            b += es;
+            if (cmp == 0) a += es;
+        }
+        out += es;
+    }
+    memcpy(out, a, aEnd - a);
+    out += aEnd - a;
+    memcpy(out, b, bEnd - b);
+    out += bEnd - b;
+    resize_Array(&merged, (out - (char *) data_Array(&merged)) / es);
+    deinit_Array(&d->values);
+    d->values = merged;
+}
+
+void insertN_SortedArray(iSortedArray *d, const void *values, size_t count) {
+    if (count == 0) {
+        return;
+    }
+    iArray batch;
+    init_Array(&batch, d->values.elementSize);
+    pushBackN_Array(&batch, values, count);
+    sort_Array(&batch, d->cmp); /* stable, so the last of equal values is the latest */
+    merge_SortedArray(d, data_Array(&batch), unique_SortedArray_(d, data_Array(&batch), count));
+    deinit_Array(&batch);
+}
+
+/*-------------------------------------------------------------------------------------*/
+
+#define iSortedArrayRadixSortMin    256 /* fewer values are merge sorted */
+
+/* LSD radix sort of unsigned keys, one byte at a time. Returns the buffer that has the
+   sorted keys. Passes where all keys have the same byte value are skipped. */
+#define iDefineRadixSort_(bits) \
+    static uint##bits##_t *radixSort_U##bits##_(uint##bits##_t *keys, uint##bits##_t *tmp, \
+                                                size_t count) { \
+        size_t hist[bits / 8][256]; \
+        memset(hist, 0, sizeof(hist)); \
+        for (size_t i = 0; i < count; i++) { \
+            for (int b = 0; b < bits / 8; b++) { \
+                hist[b][(keys[i] >> (8 * b)) & 0xff]++; \
+            } \
+        } \
+        uint##bits##_t *src = keys, *dst = tmp; \
+        for (int b = 0; b < bits / 8; b++) { \
+            const unsigned shift = 8 * b; \
+            if (hist[b][(src[0] >> shift) & 0xff] == count) { \
+                continue; \
+            } \
+            size_t offset[256]; \
+            size_t sum = 0; \
+            for (int v = 0; v < 256; v++) { \
+                offset[v] = sum; \
+                sum += hist[b][v]; \
+            } \
+            for (size_t i = 0; i < count; i++) { \
+                dst[offset[(src[i] >> shift) & 0xff]++] = src[i]; \
+            } \
+            uint##bits##_t *swap = src; src = dst; dst = swap; \
+        } \
+        return src; \
+    }
+
+iDefineRadixSort_(32)
+iDefineRadixSort_(64)
+
+#define iDefineRadixInsert_(bits) \
+    static void radixInsert_U##bits##_(iSortedArray *d, const uint##bits##_t *values, \
+                                       size_t count, uint##bits##_t flip) { \
+        uint##bits##_t *buf = malloc(sizeof(uint##bits##_t) * count * 2); \
+        for (size_t i = 0; i < count; i++) { \
+            buf[i] = values[i] ^ flip; \
+        } \
+        uint##bits##_t *keys = radixSort_U##bits##_(buf, buf + count, count); \
+        size_t n = 0; \
+        for (size_t i = 0; i < count; i++) { \
+            if (n == 0 || keys[n - 1] != (keys[i] ^ flip)) { \
+                keys[n++] = keys[i] ^ flip; \
+            } \
+        } \
+        merge_SortedArray(d, keys, n); \
+        free(buf); \
+    }
+
+iDefineRadixInsert_(32)
+iDefineRadixInsert_(64)
+
+/* Bulk insert of integer-like values that are ordered by their numeric value: IntSet and
+   PtrSet use this when they have their default comparison function. */
+void insertRadixN_SortedArray_(iSortedArray *d, const void *values, size_t count,
+                               iBool isSigned) {
+    const size_t es = d->values.elementSize;
+    if (count < iSortedArrayRadixSortMin || (es != 4 && es != 8)) {
+        insertN_SortedArray(d, values, count);
+    }
+    else if (es == 4) {
+        radixInsert_U32_(d, values, count, isSigned ? UINT32_C(0x80000000) : 0);
+    }
+    else {
+        radixInsert_U64_(d, values, count, isSigned ? UINT64_C(1) << 63 : 0);
+    }
+}
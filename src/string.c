@@ -29,6 +29,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
 #include "the_Foundation/stringlist.h"
 #include "the_Foundation/range.h"
 #include "the_Foundation/stdthreads.h"
+#include "the_Foundation/cpu.h"
 
 #include <stdlib.h>
 #include <stdarg.h>
@@ -44,6 +45,12 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
 #if !defined (iHaveStrnstr)
 #   include "platform/strnstr.h"
 #endif
+#if defined (iHaveCpuDispatch)
+#   include <immintrin.h>
+#endif
+#if defined (iHaveCpuDispatch) && defined (__GNUC__)
+#   define iStringHaveSimdSearch
+#endif
 
 static char localeCharSet_[64];
 
@@ -387,11 +394,51 @@ const char *cstr_String(const iString *d) {
     return constData_Block(&d->chars);
 }
 
+#if defined (iHaveCpuDispatch)
+iCpuTarget("sse2")
+static size_t asciiPrefixSse2_(const char *chars, size_t size) {
+    size_t n = 0;
+    for (; n + 16 <= size; n += 16) {
+        if (_mm_movemask_epi8(_mm_loadu_si128((const __m128i *) (chars + n)))) break;
+    }
+    return n;
+}
+
+iCpuTarget("avx2")
+static size_t asciiPrefixAvx2_(const char *chars, size_t size) {
+    size_t n = 0;
+    for (; n + 32 <= size; n += 32) {
+        if (_mm256_movemask_epi8(_mm256_loadu_si256((const __m256i *) (chars + n)))) break;
+    }
+    return n;
+}
+#endif
+
+/* Returns the number of leading bytes that are known to be ASCII. Whole vector registers
+   are checked, so more ASCII may follow. An ASCII byte is never part of a multibyte
+   sequence, so the rest of the string can be decoded separately. */
+static size_t asciiPrefix_(const char *chars, size_t size) {
+    size_t n = 0;
+#if defined (iHaveCpuDispatch)
+    const int cpu = features_Cpu();
+    if (cpu & avx2_CpuFeature) {
+        n = asciiPrefixAvx2_(chars, size);
+    }
+    if (cpu & sse2_CpuFeature) {
+        n += asciiPrefixSse2_(chars + n, size - n);
+    }
+#else
+    iUnused(chars, size);
+#endif
+    return n;
+}
+
 size_t length_String(const iString *d) {
-    return u8_mbsnlen((const uint8_t *) cstr_String(d), size_String(d));
+    return length_Rangecc(range_String(d));
 }
 
 iBool isUtf8_Rangecc(iRangecc d) {
+    d.start += asciiPrefix_(d.start, size_Range(&d));
     return u8_check((const uint8_t *) d.start, size_Range(&d)) == NULL;
 }
 
@@ -406,7 +453,8 @@ size_t length_Rangecc(const iRangecc d) {
         n++;
     }
     return n;*/
-    return u8_mbsnlen((const uint8_t *) d.start, size_Range(&d));
+    const size_t ascii = asciiPrefix_(d.start, size_Range(&d));
+    return ascii + u8_mbsnlen((const uint8_t *) d.start + ascii, size_Range(&d) - ascii);
 }
 
 size_t size_String(const iString *d) {
@@ -1156,6 +1204,72 @@ char *iDupStr(const char *a) {
     return strdup(a);
 }
 
+#if defined (iStringHaveSimdSearch)
+/* The vector searches compare the first and last bytes of the needle at every position of
+   a register's worth of the haystack, and check the full needle only where both match.
+   They return the first match, or the position where less than a full register of
+   candidates remains. */
+iCpuTarget("sse2")
+static const char *findSse2_(const char *pos, const char *end, const char *needle,
+                             size_t needleLen) {
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last  = _mm_set1_epi8(needle[needleLen - 1]);
+    for (; (size_t) (end - pos) >= needleLen - 1 + 16; pos += 16) {
+        unsigned mask = (unsigned) _mm_movemask_epi8(_mm_and_si128(
+            _mm_cmpeq_epi8(first, _mm_loadu_si128((const __m128i *) pos)),
+            _mm_cmpeq_epi8(last, _mm_loadu_si128((const __m128i *) (pos + needleLen - 1)))));
+        for (; mask; mask &= mask - 1) {
+            const char *candidate = pos + __builtin_ctz(mask);
+            if (!memcmp(candidate, needle, needleLen)) {
+                return candidate;
+            }
+        }
+    }
+    return pos;
+}
+
+iCpuTarget("avx2")
+static const char *findAvx2_(const char *pos, const char *end, const char *needle,
+                             size_t needleLen) {
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last  = _mm256_set1_epi8(needle[needleLen - 1]);
+    for (; (size_t) (end - pos) >= needleLen - 1 + 32; pos += 32) {
+        unsigned mask = (unsigned) _mm256_movemask_epi8(_mm256_and_si256(
+            _mm256_cmpeq_epi8(first, _mm256_loadu_si256((const __m256i *) pos)),
+            _mm256_cmpeq_epi8(last,
+                              _mm256_loadu_si256((const __m256i *) (pos + needleLen - 1)))));
+        for (; mask; mask &= mask - 1) {
+            const char *candidate = pos + __builtin_ctz(mask);
+            if (!memcmp(candidate, needle, needleLen)) {
+                return candidate;
+            }
+        }
+    }
+    return pos;
+}
+#endif
+
 char *iStrStrN(const char *a, const char *b, size_t n) {
+#if defined (iStringHaveSimdSearch)
+    const int cpu = features_Cpu();
+    if (cpu & sse2_CpuFeature) {
+        const size_t needleLen = strlen(b);
+        if (needleLen == 0) {
+            return iConstCast(char *, a);
+        }
+        const char *end = a + strnlen(a, n);
+        const char *pos = a;
+        if (cpu & avx2_CpuFeature) {
+            pos = findAvx2_(pos, end, b, needleLen);
+        }
+        pos = findSse2_(pos, end, b, needleLen);
+        for (; (size_t) (end - pos) >= needleLen; pos++) {
+            if (*pos == *b && !memcmp(pos, b, needleLen)) {
+                return iConstCast(char *, pos);
+            }
+        }
+        return NULL;
+    }
+#endif
     return strnstr(a, b, n);
 }
@@ -275,6 +275,37 @@ iString *take_StringList(iStringList *d, size_t pos) {
     return str;
 }
 
+iDeclareType(StringListSort)
+
+struct Impl_StringListSort {
+    iStringListCompareFunc cmp;
+};
+
+static int compare_StringListSort_(const void *a, const void *b, void *context) {
+    const iStringListSort *d = context;
+    return d->cmp ? d->cmp(a, b) : cmpString_String((const iString *) a, (const iString *) b);
+}
+
+void sort_StringList(iStringList *d, iStringListCompareFunc cmp) {
+    /* The strings are sorted as one array, and then moved back to the nodes. */
+    iArray *strings = new_Array(sizeof(iString));
+    reserve_Array(strings, d->size);
+    iConstForEach(List, i, &d->list) {
+        const iStringListNode *node = (const iStringListNode *) i.value;
+        pushBackN_Array(strings, constData_Array(&node->strings.strings),
+                        size_StringArray(&node->strings));
+    }
+    sortContext_Array(strings, compare_StringListSort_, &(iStringListSort){ cmp });
+    size_t pos = 0;
+    iForEach(List, j, &d->list) {
+        iStringListNode *node = (iStringListNode *) j.value;
+        const size_t count = size_StringArray(&node->strings);
+        setN_Array(&node->strings.strings, 0, constAt_Array(strings, pos), count);
+        pos += count;
+    }
+    delete_Array(strings);
+}
+
 iString *joinCStr_StringList(const iStringList *d, const char *delim) {
     iString *joined = new_String();
     iConstForEach(StringList, i, d) {
@@ -26,6 +26,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
 */
 
 #include "the_Foundation/stringset.h"
+#include "the_Foundation/stringlist.h"
+
+#include <stdlib.h>
+#include <string.h>
 
 iDefineObjectConstruction(StringSet)
 
@@ -101,6 +105,166 @@ iBool insertIf_StringSet(iStringSet *d, const iString *value, iStringSetCompareF
     return insertIf_SortedArray(&d->strings, value, (iSortedArrayCompareElemFunc) pred);
 }
 
+/*----------------------------------------------------------------------------------------------*/
+
+iDeclareType(StringSetKey)
+
+struct Impl_StringSetKey {
+    const uint8_t *chars;
+    const iString *str;
+};
+
+iLocalDef void swap_StringSetKey_(iStringSetKey *a, iStringSetKey *b) {
+    const iStringSetKey tmp = *a;
+    *a = *b;
+    *b = tmp;
+}
+
+/* Multikey quicksort (Bentley & Sedgewick): a three-way partition on the character at
+   `depth`, so each string is scanned roughly once instead of being compared from the
+   beginning again at every level. */
+static void multikeySort_StringSetKey_(iStringSetKey *keys, size_t n, size_t depth) {
+    while (n > 1) {
+        if (n < 16) {
+            for (size_t i = 1; i < n; i++) {
+                for (size_t j = i; j > 0 && iCmpStr((const char *) keys[j - 1].chars + depth,
+                                                    (const char *) keys[j].chars + depth) > 0; j--) {
+                    swap_StringSetKey_(&keys[j - 1], &keys[j]);
+                }
+            }
+            return;
+        }
+        /* Median of three as the pivot character. */
+        int v;
+        {
+            const int a = keys[0].chars[depth];
+            const int b = keys[n / 2].chars[depth];
+            const int c = keys[n - 1].chars[depth];
+            v = (a < b ? (b < c ? b : a < c ? c : a) : (a < c ? a : b < c ? c : b));
+        }
+        size_t lt = 0, i = 0, gt = n;
+        while (i < gt) {
+            const int ch = keys[i].chars[depth];
+            if (ch < v) {
+                swap_StringSetKey_(&keys[lt++], &keys[i++]);
+            }
+            else if (ch > v) {
+                swap_StringSetKey_(&keys[i], &keys[--gt]);
+            }
+            else {
+                i++;
+            }
+        }
+        multikeySort_StringSetKey_(keys, lt, depth);
+        multikeySort_StringSetKey_(keys + gt, n - gt, depth);
+        if (v == 0) {
+            return; /* the middle strings have all ended */
+        }
+        keys += lt;
+        n = gt - lt;
+        depth++;
+    }
+}
+
+static int cmp_StringSetKey_(const void *a, const void *b, void *context) {
+    const iSortedArrayCompareElemFunc cmp = *(const iSortedArrayCompareElemFunc *) context;
+    return cmp(((const iStringSetKey *) a)->str, ((const iStringSetKey *) b)->str);
+}
+
+/* Merges sorted and unique new strings with the existing ones. Existing strings are moved
+   to the new array as-is, new strings are copied. */
+static void merge_StringSet_(iStringSet *d, const iStringSetKey *keys, size_t count) {
+    const iSortedArrayCompareElemFunc cmp = d->strings.cmp;
+    const size_t oldCount = size_StringSet(d);
+    iArray merged;
+    init_Array(&merged, sizeof(iString));
+    resize_Array(&merged, oldCount + count);
+    iString *out = data_Array(&merged);
+    size_t a = 0, b = 0;
+    while (a < oldCount || b < count) {
+        const iString *old = a < oldCount ? constAt_StringSet(d, a) : NULL;
+        const int order = (!old ? 1 : b == count ? -1 : cmp(old, keys[b].str));
+        if (order <= 0) {
+            memcpy(out++, old, sizeof(iString));
+            a++;
+            if (order == 0) b++;
+        }
+        else {
+            initCopy_String(out++, keys[b++].str);
+        }
+    }
+    resize_Array(&merged, out - (iString *) data_Array(&merged));
+    deinit_Array(&d->strings.values);
+    d->strings.values = merged;
+}
+
+void insertN_StringSet(iStringSet *d, const iString * const *strings, size_t count) {
+    if (count == 0) {
+        return;
+    }
+    const iBool isDefaultCmp = (d->strings.cmp == (iSortedArrayCompareElemFunc) cmp_StringSet_);
+    iArray keys;
+    init_Array(&keys, sizeof(iStringSetKey));
+    resize_Array(&keys, count);
+    iStringSetKey *key = data_Array(&keys);
+    for (size_t i = 0; i < count; i++) {
+        key[i].chars = constData_Block(&strings[i]->chars);
+        key[i].str   = strings[i];
+    }
+    if (isDefaultCmp) {
+        multikeySort_StringSetKey_(key, count, 0);
+    }
+    else {
+        sortContext_Array(&keys, cmp_StringSetKey_, &d->strings.cmp);
+    }
+    /* Drop duplicates. */
+    size_t n = 1;
+    for (size_t i = 1; i < count; i++) {
+        const iBool isDup = isDefaultCmp
+                                ? !iCmpStr((const char *) key[n - 1].chars, (const char *) key[i].chars)
+                                : !d->strings.cmp(key[n - 1].str, key[i].str);
+        if (!isDup) {
+            key[n++] = key[i];
+        }
+    }
+    merge_StringSet_(d, key, n);
+    deinit_Array(&keys);
+}
+
+void insertStringList_StringSet(iStringSet *d, const iStringList *strings) {
+    const iString **ptrs = malloc(sizeof(iString *) * size_StringList(strings));
+    size_t count = 0;
+    iConstForEach(StringList, i, strings) {
+        ptrs[count++] = i.value;
+    }
+    insertN_StringSet(d, ptrs, count);
+    free(ptrs);
+}
+
+void merge_StringSet(iStringSet *d, const iStringSet *other) {
+    iAssert(d->strings.cmp == other->strings.cmp);
+    const size_t count = size_StringSet(other);
+    iStringSetKey *keys = malloc(sizeof(iStringSetKey) * iMax(count, 1));
+    for (size_t i = 0; i < count; i++) {
+        keys[i].chars = NULL;
+        keys[i].str   = constAt_StringSet(other, i);
+    }
+    merge_StringSet_(d, keys, count);
+    free(keys);
+}
+
+iStringSet *newN_StringSet(const iString * const *strings, size_t count) {
+    iStringSet *d = new_StringSet();
+    insertN_StringSet(d, strings, count);
+    return d;
+}
+
+iStringSet *newStringList_StringSet(const iStringList *strings) {
+    iStringSet *d = new_StringSet();
+    insertStringList_StringSet(d, strings);
+    return d;
+}
+
 iString *joinCStr_StringSet(const iStringSet *d, const char *sep) {
     iString *joined = new_String();
     iConstForEach(StringSet, i, d) {
@@ -0,0 +1,320 @@
+/** @file task.c  Stackless tasks multiplexed on a thread pool.
+
+@authors Copyright (c) 2021 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+@par License
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+<small>THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
+*/
+
+#include "the_Foundation/task.h"
+#include "the_Foundation/array.h"
+#include "the_Foundation/mutex.h"
+#include "the_Foundation/threadpool.h"
+
+#include <stdlib.h>
+
+struct Impl_Scheduler {
+    iObject      object;
+    iThreadPool *pool;
+    iBool        ownsPool;
+    iReactor *   reactor;
+    iMutex       mutex;
+    iCondition   idle;
+    size_t       numTasks;
+    iTask *      suspended; /* tasks waiting for the Reactor or a Promise */
+    iBool        isCanceled;
+};
+
+/* States of iTask.promiseWait. A continuation of the awaited Promise cannot be removed,
+   so when a task waiting for a Promise is canceled, the continuation deletes the task. */
+enum iTaskPromiseWait {
+    none_TaskPromiseWait,
+    waiting_TaskPromiseWait,
+    canceled_TaskPromiseWait,
+};
+
+iDefineClass(Scheduler)
+iDefineObjectConstructionArgs(Scheduler, (iThreadPool *pool), pool)
+
+void init_Scheduler(iScheduler *d, iThreadPool *pool) {
+    d->ownsPool   = (pool == NULL);
+    d->pool       = pool ? pool : new_ThreadPool();
+    d->reactor    = new_Reactor();
+    d->numTasks   = 0;
+    d->suspended  = NULL;
+    d->isCanceled = iFalse;
+    init_Mutex(&d->mutex);
+    init_Condition(&d->idle);
+}
+
+void deinit_Scheduler(iScheduler *d) {
+    cancel_Scheduler(d);
+    wait_Scheduler(d);
+    iRelease(d->reactor);
+    if (d->ownsPool) {
+        iRelease(d->pool);
+    }
+    deinit_Condition(&d->idle);
+    deinit_Mutex(&d->mutex);
+}
+
+iReactor *reactor_Scheduler(const iScheduler *d) {
+    return d->reactor;
+}
+
+size_t numTasks_Scheduler(const iScheduler *d) {
+    size_t num;
+    iGuardMutex(&d->mutex, num = d->numTasks);
+    return num;
+}
+
+/* Settles the promise of a task that has ended, and removes the task from the scheduler. */
+static void ended_Scheduler_(iScheduler *d, iPromise *finished, iAnyObject *result,
+                             iBool isFinished) {
+    if (isFinished) {
+        fulfill_Promise(finished, result);
+    }
+    else {
+        cancel_Promise(finished);
+    }
+    iRelease(result);
+    iRelease(finished);
+    iGuardMutex(&d->mutex, {
+        if (--d->numTasks == 0) {
+            signalAll_Condition(&d->idle);
+        }
+    });
+}
+
+static void end_Task_(iTask *d, iBool isFinished) {
+    iScheduler *sched  = d->scheduler;
+    iPromise *finished = d->finished;
+    iAnyObject *result = d->result;
+    free(d);
+    ended_Scheduler_(sched, finished, result, isFinished);
+}
+
+/* Runs the task until it suspends itself or finishes. A suspended task may already be
+   continuing in another thread, so it must not be touched afterwards. */
+static void step_Task_(void *context) {
+    iTask *d = context;
+    if (d->func(d) == finished_TaskStep) {
+        end_Task_(d, iTrue);
+    }
+}
+
+static void cancel_Task_(void *context) {
+    end_Task_(context, iFalse);
+}
+
+static void resume_Task_(iTask *d, int events) {
+    d->events = events;
+    post_ThreadPool(d->scheduler->pool, step_Task_, d);
+}
+
+/* Called with the scheduler's mutex locked. */
+static void linkSuspended_Task_(iTask *d) {
+    iScheduler *sched = d->scheduler;
+    d->prevSuspended = NULL;
+    d->nextSuspended = sched->suspended;
+    if (sched->suspended) {
+        sched->suspended->prevSuspended = d;
+    }
+    sched->suspended = d;
+}
+
+/* Called with the scheduler's mutex locked. */
+static void unlinkSuspended_Task_(iTask *d) {
+    iScheduler *sched = d->scheduler;
+    if (d->prevSuspended) {
+        d->prevSuspended->nextSuspended = d->nextSuspended;
+    }
+    else {
+        sched->suspended = d->nextSuspended;
+    }
+    if (d->nextSuspended) {
+        d->nextSuspended->prevSuspended = d->prevSuspended;
+    }
+    d->prevSuspended = d->nextSuspended = NULL;
+}
+
+static void reactorEvent_Task_(void *context, int events) {
+    iTask *d = context;
+    iGuardMutex(&d->scheduler->mutex, {
+        unlinkSuspended_Task_(d);
+        d->wait = 0;
+    });
+    resume_Task_(d, events);
+}
+
+static void promiseSettled_Task_(iPromise *promise, void *context) {
+    iUnused(promise);
+    iTask *d = context;
+    if (exchange_Atomic(&d->promiseWait, none_TaskPromiseWait) == canceled_TaskPromiseWait) {
+        free(d); /* the scheduler may already be gone */
+        return;
+    }
+    iGuardMutex(&d->scheduler->mutex, unlinkSuspended_Task_(d));
+    resume_Task_(d, 0);
+}
+
+iPromise *spawn_Scheduler(iScheduler *d, iTaskFunc func, void *context) {
+    iTask *task = calloc(1, sizeof(iTask));
+    task->scheduler = d;
+    task->func      = func;
+    task->context   = context;
+    task->finished  = new_Promise();
+    set_Atomic(&task->promiseWait, none_TaskPromiseWait);
+    iGuardMutex(&d->mutex, d->numTasks++);
+    iPromise *finished = ref_Object(task->finished);
+    post_ThreadPool(d->pool, step_Task_, task);
+    return finished;
+}
+
+void wait_Scheduler(iScheduler *d) {
+    lock_Mutex(&d->mutex);
+    while (d->numTasks > 0) {
+        wait_Condition(&d->idle, &d->mutex);
+    }
+    unlock_Mutex(&d->mutex);
+}
+
+iDeclareType(CanceledTask)
+
+struct Impl_CanceledTask {
+    iTask *     task; /* NULL if the task is deleted by a Promise continuation */
+    iPromise *  finished;
+    iAnyObject *result;
+};
+
+void cancel_Scheduler(iScheduler *d) {
+    iArray canceled;
+    init_Array(&canceled, sizeof(iCanceledTask));
+    lock_Mutex(&d->mutex);
+    d->isCanceled = iTrue;
+    for (iTask *task = d->suspended, *next; task; task = next) {
+        next = task->nextSuspended;
+        if (task->wait) {
+            /* If the wait has already ended, the task is about to continue. It will be
+               canceled at its next await. */
+            if (cancel_Reactor(d->reactor, task->wait)) {
+                unlinkSuspended_Task_(task);
+                task->wait = 0;
+                pushBack_Array(&canceled, &(iCanceledTask){ task, NULL, NULL });
+            }
+        }
+        else {
+            /* Once the state has changed, the Promise continuation may delete the task at
+               any time. */
+            const iCanceledTask ended = { NULL, task->finished, task->result };
+            int expected = waiting_TaskPromiseWait;
+            unlinkSuspended_Task_(task);
+            if (atomic_compare_exchange_strong(&task->promiseWait, &expected,
+                                               canceled_TaskPromiseWait)) {
+                pushBack_Array(&canceled, &ended);
+            }
+            else {
+                linkSuspended_Task_(task); /* the continuation is resuming it */
+            }
+        }
+    }
+    unlock_Mutex(&d->mutex);
+    /* The tasks' promises are canceled without holding the mutex, since that calls
+       their continuations. */
+    iConstForEach(Array, i, &canceled) {
+        const iCanceledTask *ended = i.value;
+        if (ended->task) {
+            end_Task_(ended->task, iFalse);
+        }
+        else {
+            ended_Scheduler_(d, ended->finished, ended->result, iFalse);
+        }
+    }
+    deinit_Array(&canceled);
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
+void setResult_Task(iTask *d, const iAnyObject *result) {
+    iRelease(d->result);
+    d->result = ref_Object(result);
+}
+
+/* The task is suspended for a Reactor wait, unless the scheduler has been canceled. */
+static void suspendReactor_Task_(iTask *d, int fd, int events, double timeoutSeconds) {
+    iScheduler *sched = d->scheduler;
+    iGuardMutex(&sched->mutex, {
+        if (sched->isCanceled) {
+            post_ThreadPool(sched->pool, cancel_Task_, d);
+        }
+        else {
+            /* The wait may end right away, but its callback needs the mutex. */
+            linkSuspended_Task_(d);
+            d->wait = (fd >= 0 ? watch_Reactor(sched->reactor, fd, events, timeoutSeconds,
+                                               reactorEvent_Task_, d)
+                               : addTimer_Reactor(sched->reactor, timeoutSeconds,
+                                                  reactorEvent_Task_, d));
+        }
+    });
+}
+
+void suspendReadable_Task(iTask *d, int fd, double timeoutSeconds) {
+    suspendReactor_Task_(d, fd, readable_ReactorEvent, timeoutSeconds);
+}
+
+void suspendWritable_Task(iTask *d, int fd, double timeoutSeconds) {
+    suspendReactor_Task_(d, fd, writable_ReactorEvent, timeoutSeconds);
+}
+
+void suspendTimeout_Task(iTask *d, double seconds) {
+    suspendReactor_Task_(d, -1, 0, seconds);
+}
+
+void suspendPromise_Task(iTask *d, iPromise *promise) {
+    iScheduler *sched = d->scheduler;
+    iBool isCanceled;
+    iGuardMutex(&sched->mutex, {
+        isCanceled = sched->isCanceled;
+        if (isCanceled) {
+            post_ThreadPool(sched->pool, cancel_Task_, d);
+        }
+        else {
+            linkSuspended_Task_(d);
+            set_Atomic(&d->promiseWait, waiting_TaskPromiseWait);
+        }
+    });
+    if (!isCanceled) {
+        whenSettled_Promise(promise, promiseSettled_Task_, d);
+    }
+}
+
+void suspendYield_Task(iTask *d) {
+    iScheduler *sched = d->scheduler;
+    iBool isCanceled;
+    iGuardMutex(&sched->mutex, isCanceled = sched->isCanceled);
+    if (isCanceled) {
+        post_ThreadPool(sched->pool, cancel_Task_, d);
+    }
+    else {
+        resume_Task_(d, 0);
+    }
+}
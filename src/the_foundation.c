@@ -38,7 +38,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
 static iBool hasBeenInitialized_ = iFalse;
 
 void deinitForThread_Garbage_(void); /* garbage.c */
+void deinitForThread_Random_(void);  /* random.c */
 void deinit_DatagramThreads_(void);  /* datagram.c */
+void deinit_ProcessThreads_(void);   /* process.c */
 void deinit_Address_(void);          /* address.c */
 void deinit_Threads_(void);          /* thread.c */
 void init_DatagramThreads_(void);    /* datagram.c */
@@ -63,7 +65,9 @@ void deinit_Foundation(void) {
     if (isInitialized_Foundation()) {
         hasBeenInitialized_ = iFalse;
         deinit_DatagramThreads_();
+        deinit_ProcessThreads_();
         deinit_Address_();
+        deinitForThread_Random_();
         deinitForThread_Garbage_();
         deinit_Threads_();
     }
@@ -38,15 +38,20 @@ iDefinePlainKeyBlockHash(ThreadHash, ThreadId, Thread)
 
 iDefineLockableObject(ThreadHash)
 
-static iLockableThreadHash *runningThreads_;
+static iLockableThreadHash *runningThreads_; /* for enumerating the threads */
+static tss_t currentThread_;                 /* each thread's own iThread */
 
 void deinit_Threads_(void) {
+    if (runningThreads_) {
+        tss_delete(currentThread_);
+    }
     delete_LockableThreadHash(runningThreads_);
     runningThreads_ = NULL;
 }
 
 static iLockableThreadHash *init_Threads_(void) {
     if (!runningThreads_) {
+        tss_create(&currentThread_, NULL);
         runningThreads_ = new_LockableThreadHash();
     }
     return runningThreads_;
@@ -68,6 +73,7 @@ void finish_Thread_(iThread *d) { /* called from threadpool.c as well */
 static int run_Threads_(void *arg) {
     iThread *d = (iThread *) arg;
     ref_Object(d);
+    tss_set(currentThread_, d);
     if (!isEmpty_String(&d->name)) {
 #if defined (iPlatformApple)
         pthread_setname_np(cstr_String(&d->name));
@@ -84,6 +90,7 @@ static int run_Threads_(void *arg) {
     d->result = d->run(d);
     /* Deregister the thread since it's stopping. */
     iGuard(runningThreads_, remove_ThreadHash(runningThreads_->value, &d->id));
+    tss_set(currentThread_, NULL);
     /* Notify observers that the thread is done. */
     finish_Thread_(d);
     deref_Object(d);
@@ -198,11 +205,10 @@ void sleep_Thread(double seconds) {
 }
 
 iThread *current_Thread(void) {
-    iThread *d = NULL;
-    const iThreadId cur = thrd_current();
-    const iLockableThreadHash *threads = init_Threads_();
-    iGuard(threads, d = value_ThreadHash(threads->value, &cur));
-    return d;
+    if (!runningThreads_) {
+        return NULL; /* no threads have been started */
+    }
+    return tss_get(currentThread_);
 }
 
 iBool isCurrent_Thread(const iThread *d) {
@@ -26,9 +26,21 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
 */
 
 #include "the_Foundation/threadpool.h"
+#include "the_Foundation/time.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
 
 void finish_Thread_(iThread *); // thread.c
 
+iDeclareType(ThreadPoolJob)
+
+struct Impl_ThreadPoolJob {
+    iThreadPoolJobFunc func;
+    void *context;
+};
+
 iDeclareClass(PooledThread)
 
 struct Impl_PooledThread {
@@ -95,6 +107,8 @@ void init_ThreadPool(iThreadPool *d) {
 
 void initLimits_ThreadPool(iThreadPool *d, int minThreads, int reservedCores) {
     init_Queue(&d->queue);
+    init_Array(&d->jobs, sizeof(iThreadPoolJob));
+    d->jobsHead = 0;
     d->threads = new_ObjectList();
     startThreads_ThreadPool_(d, minThreads, reservedCores);
 }
@@ -102,6 +116,7 @@ void initLimits_ThreadPool(iThreadPool *d, int minThreads, int reservedCores) {
 void deinit_ThreadPool(iThreadPool *d) {
     stopThreads_ThreadPool_(d);
     iRelease(d->threads);
+    deinit_Array(&d->jobs);
     deinit_Queue(&d->queue);
 }
 
@@ -112,13 +127,66 @@ iThread *run_ThreadPool(iThreadPool *d, iThread *thread) {
     return thread;
 }
 
+size_t numThreads_ThreadPool(const iThreadPool *d) {
+    return size_ObjectList(d->threads);
+}
+
+void post_ThreadPool(iThreadPool *d, iThreadPoolJobFunc func, void *context) {
+    const iThreadPoolJob job = { func, context };
+    iGuardMutex(&d->queue.mutex, {
+        pushBack_Array(&d->jobs, &job);
+        signal_Condition(&d->queue.cond);
+    });
+}
+
+static iBool takeJob_ThreadPool_(iThreadPool *d, iThreadPoolJob *job_out) {
+    /* Taking a job only advances the head index. The taken jobs are dropped all at once
+       when the queue runs empty or when they make up most of the array, so a busy queue
+       isn't moved around in memory on every pop. */
+    if (d->jobsHead == size_Array(&d->jobs)) {
+        return iFalse;
+    }
+    *job_out = *(const iThreadPoolJob *) constAt_Array(&d->jobs, d->jobsHead++);
+    if (d->jobsHead == size_Array(&d->jobs)) {
+        clear_Array(&d->jobs);
+        d->jobsHead = 0;
+    }
+    else if (d->jobsHead >= 64 && d->jobsHead >= size_Array(&d->jobs) / 2) {
+        removeN_Array(&d->jobs, 0, d->jobsHead);
+        d->jobsHead = 0;
+    }
+    return iTrue;
+}
+
 iBool yield_ThreadPool(iThreadPool *d, double timeoutSeconds) {
+    iThreadPoolJob func = { NULL, NULL };
     iThread *job = NULL;
-    if (timeoutSeconds <= 0.0) {
-        job = (iAny *) take_Queue(&d->queue);
+    iTime until;
+    if (timeoutSeconds > 0.0) {
+        initTimeout_Time(&until, timeoutSeconds);
+    }
+    /* Plain function jobs go first, as someone is usually waiting for them to finish. */
+    lock_Mutex(&d->queue.mutex);
+    for (;;) {
+        if (takeJob_ThreadPool_(d, &func)) {
+            break;
+        }
+        job = (iAny *) takeFront_ObjectList(&d->queue.items);
+        if (job) {
+            break;
+        }
+        if (timeoutSeconds <= 0.0) {
+            wait_Condition(&d->queue.cond, &d->queue.mutex);
+        }
+        else if (waitTimeout_Condition(&d->queue.cond, &d->queue.mutex, &until) ==
+                 thrd_timedout) {
+            break;
+        }
     }
-    else {
-        job = (iAny *) takeTimeout_Queue(&d->queue, timeoutSeconds);
+    unlock_Mutex(&d->queue.mutex);
+    if (func.func) {
+        func.func(func.context);
+        return iTrue;
     }
     if (job == NULL || job == (void *) d) {
         /* Terminated. */
@@ -132,3 +200,171 @@ iBool yield_ThreadPool(iThreadPool *d, double timeoutSeconds) {
     iRelease(job);
     return iTrue;
 }
+
+/*-------------------------------------------------------------------------------------*/
+
+iDeclareType(ThreadPoolBatch)
+
+/* A set of items processed by the calling thread and helper jobs. Each participant
+   claims the next unprocessed item until none are left. */
+struct Impl_ThreadPoolBatch {
+    iThreadPool *pool;
+    size_t count;
+    atomic_size_t next;
+    void (*runItem)(iThreadPoolBatch *, size_t index);
+    iThreadPoolJobFunc func;
+    char *contexts;
+    size_t contextSize;
+    void *context;
+    size_t begin;
+    size_t end;
+    size_t grain;
+    iParallelForFunc forFunc;
+    iParallelReduceFunc reduce;
+    const void *identity;
+    char *partials;
+    size_t resultSize;
+    int numHelpers; /* helper jobs that may still access the batch */
+    iMutex mutex;
+    iCondition finished;
+};
+
+static void runItems_ThreadPoolBatch_(iThreadPoolBatch *d) {
+    for (;;) {
+        const size_t index = atomic_fetch_add_explicit(&d->next, 1, memory_order_relaxed);
+        if (index >= d->count) break;
+        d->runItem(d, index);
+    }
+}
+
+static void help_ThreadPoolBatch_(void *context) {
+    iThreadPoolBatch *d = context;
+    runItems_ThreadPoolBatch_(d);
+    iGuardMutex(&d->mutex, {
+        if (--d->numHelpers == 0) {
+            signal_Condition(&d->finished);
+        }
+    });
+}
+
+static void run_ThreadPoolBatch_(iThreadPoolBatch *d) {
+    if (d->count == 0) {
+        return;
+    }
+    iThreadPool *pool = d->pool;
+    const size_t numThreads = pool ? numThreads_ThreadPool(pool) : 0;
+    d->numHelpers = (int) iMin(numThreads, d->count - 1);
+    atomic_init(&d->next, 0);
+    if (d->numHelpers == 0) {
+        runItems_ThreadPoolBatch_(d);
+        return;
+    }
+    init_Mutex(&d->mutex);
+    init_Condition(&d->finished);
+    const iThreadPoolJob helper = { help_ThreadPoolBatch_, d };
+    iGuardMutex(&pool->queue.mutex, {
+        for (int i = 0; i < d->numHelpers; i++) {
+            pushBack_Array(&pool->jobs, &helper);
+        }
+        signalAll_Condition(&pool->queue.cond);
+    });
+    runItems_ThreadPoolBatch_(d);
+    /* All items have been claimed. Helpers that have not started yet are not needed. */
+    int numCanceled = 0;
+    iGuardMutex(&pool->queue.mutex, {
+        for (size_t i = size_Array(&pool->jobs); i-- > pool->jobsHead; ) {
+            const iThreadPoolJob *job = constAt_Array(&pool->jobs, i);
+            if (job->context == d && job->func == help_ThreadPoolBatch_) {
+                remove_Array(&pool->jobs, i);
+                numCanceled++;
+            }
+        }
+    });
+    lock_Mutex(&d->mutex);
+    d->numHelpers -= numCanceled;
+    while (d->numHelpers > 0) {
+        wait_Condition(&d->finished, &d->mutex);
+    }
+    unlock_Mutex(&d->mutex);
+    deinit_Condition(&d->finished);
+    deinit_Mutex(&d->mutex);
+}
+
+static void runContext_ThreadPoolBatch_(iThreadPoolBatch *d, size_t index) {
+    d->func(d->contexts + index * d->contextSize);
+}
+
+static void runRange_ThreadPoolBatch_(iThreadPoolBatch *d, size_t index) {
+    const size_t begin = d->begin + index * d->grain;
+    d->forFunc(d->context, begin, iMin(begin + d->grain, d->end));
+}
+
+static void runReduce_ThreadPoolBatch_(iThreadPoolBatch *d, size_t index) {
+    const size_t begin = d->begin + index * d->grain;
+    void *partial = d->partials + index * d->resultSize;
+    memcpy(partial, d->identity, d->resultSize);
+    d->reduce(d->context, begin, iMin(begin + d->grain, d->end), partial);
+}
+
+static size_t grain_ThreadPool_(const iThreadPool *d, size_t count, size_t grain) {
+    if (grain == 0) {
+        /* A few chunks per thread evens out differences in the cost of the chunks. */
+        const size_t numChunks = 4 * ((d ? numThreads_ThreadPool(d) : 0) + 1);
+        grain = (count + numChunks - 1) / numChunks;
+    }
+    return iMax(grain, 1u);
+}
+
+void runBatch_ThreadPool(iThreadPool *d, iThreadPoolJobFunc func, void *contexts,
+                         size_t contextSize, size_t count) {
+    iThreadPoolBatch batch = { .pool        = d,
+                               .count       = count,
+                               .runItem     = runContext_ThreadPoolBatch_,
+                               .func        = func,
+                               .contexts    = contexts,
+                               .contextSize = contextSize };
+    run_ThreadPoolBatch_(&batch);
+}
+
+void parallelFor_ThreadPool(iThreadPool *d, size_t begin, size_t end, size_t grain,
+                            iParallelForFunc func, void *context) {
+    if (end <= begin) {
+        return;
+    }
+    grain = grain_ThreadPool_(d, end - begin, grain);
+    iThreadPoolBatch batch = { .pool    = d,
+                               .count   = (end - begin + grain - 1) / grain,
+                               .runItem = runRange_ThreadPoolBatch_,
+                               .context = context,
+                               .begin   = begin,
+                               .end     = end,
+                               .grain   = grain,
+                               .forFunc = func };
+    run_ThreadPoolBatch_(&batch);
+}
+
+void parallelReduce_ThreadPool(iThreadPool *d, size_t begin, size_t end, size_t grain,
+                               size_t resultSize, void *result,
+                               iParallelReduceFunc reduce, iParallelCombineFunc combine,
+                               void *context) {
+    if (end <= begin) {
+        return;
+    }
+    grain = grain_ThreadPool_(d, end - begin, grain);
+    iThreadPoolBatch batch = { .pool       = d,
+                               .count      = (end - begin + grain - 1) / grain,
+                               .runItem    = runReduce_ThreadPoolBatch_,
+                               .context    = context,
+                               .begin      = begin,
+                               .end        = end,
+                               .grain      = grain,
+                               .reduce     = reduce,
+                               .identity   = result,
+                               .resultSize = resultSize };
+    batch.partials = malloc(batch.count * resultSize);
+    run_ThreadPoolBatch_(&batch);
+    for (size_t i = 0; i < batch.count; i++) {
+        combine(context, result, batch.partials + i * resultSize);
+    }
+    free(batch.partials);
+}
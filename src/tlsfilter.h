@@ -0,0 +1,63 @@
+#pragma once
+
+/** @file tlsfilter.h  Server-side TLS filter for accepted sockets (private).
+
+@authors Copyright (c) 2021 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+@par License
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+<small>THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
+*/
+
+#include "the_Foundation/socket.h"
+#include "the_Foundation/tlsrequest.h"
+
+iBeginPublic
+
+/* Implemented in tlsrequest.c. */
+
+iDeclareType(TlsServerContext)
+iDeclareTypeConstructionArgs(TlsServerContext, const iTlsCertificate *cert)
+
+iBool   isValid_TlsServerContext    (const iTlsServerContext *);
+
+iDeclareType(TlsFilter)
+iDeclareTypeConstructionArgs(TlsFilter, const iTlsServerContext *context)
+
+enum iTlsFilterResult {
+    ok_TlsFilterResult,
+    closed_TlsFilterResult,
+    failed_TlsFilterResult,
+};
+
+iBool                   isHandshakeFinished_TlsFilter   (const iTlsFilter *);
+enum iTlsFilterResult   decrypt_TlsFilter               (iTlsFilter *, const void *data, size_t size,
+                                                         iBlock *decrypted_out, iBlock *encrypted_out);
+iBool                   encrypt_TlsFilter               (iTlsFilter *, const void *data, size_t size,
+                                                         iBlock *encrypted_out);
+void                    shutdown_TlsFilter              (iTlsFilter *, iBlock *encrypted_out);
+
+/* Implemented in the POSIX socket.c. Takes ownership of `tls`. */
+
+iSocket *   newExistingTls_Socket   (int fd, const void *sockAddr, size_t sockAddrSize,
+                                     iTlsFilter *tls);
+
+iEndPublic
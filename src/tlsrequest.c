@@ -26,10 +26,12 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
 */
 
 #include "the_Foundation/tlsrequest.h"
-#include "the_Foundation/buffer.h"
+#include "the_Foundation/atomic.h"
 #include "the_Foundation/socket.h"
+#include "the_Foundation/stringhash.h"
 #include "the_Foundation/thread.h"
 #include "the_Foundation/time.h"
+#include "tlsfilter.h"
 
 #include <openssl/bn.h>
 #include <openssl/bio.h>
@@ -40,11 +42,24 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
 #include <openssl/sha.h>
 #include <openssl/ssl.h>
 #include <openssl/x509v3.h>
+#include <limits.h>
 #include <time.h>
+#if !defined (iPlatformWindows)
+#  include "the_Foundation/reactor.h"
+#  include <errno.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#  include <sys/socket.h>
+#  include <netinet/in.h>
+#  include <netinet/tcp.h>
+#endif
 
 iDeclareType(Context)
 
 #define DEFAULT_BUF_SIZE 8192
+#define MAX_RECORD_SIZE 16384 /* plaintext in one TLS record */
+#define MAX_CACHED_SESSIONS 256
+#define MAX_REACTORS 8 /* threads driving the client requests */
 
 static iContext *context_;
 static iBool isPrngSeeded_;
@@ -52,12 +67,52 @@ static iBool isPrngSeeded_;
 static void initContext_(void);
 static iTlsCertificate *newX509Chain_TlsCertificate_(X509 *cert, STACK_OF(X509) *chain);
 static void certificateVerifyFailed_TlsRequest_(iTlsRequest *, const iTlsCertificate *cert);
+static void cacheSession_TlsRequest_(iTlsRequest *, SSL_SESSION *session);
+static iBool isPinned_TlsRequest_(const iTlsRequest *);
+static iBool matchPinned_TlsRequest_(iTlsRequest *, X509 *cert);
+
+/*----------------------------------------------------------------------------------------------*/
+
+iDeclareClass(TlsSession)
+
+/* Cached client session: a session ID or a TLS 1.3 ticket. */
+struct Impl_TlsSession {
+    iObject      object;
+    SSL_SESSION *session;
+    uint32_t     serial; /* order of insertion into the cache */
+};
+
+static void init_TlsSession(iTlsSession *d, SSL_SESSION *session) {
+    d->session = session; /* takes ownership of the reference */
+    d->serial  = 0;
+}
+
+static void deinit_TlsSession(iTlsSession *d) {
+    SSL_SESSION_free(d->session);
+}
+
+iDefineClass(TlsSession)
+static iDefineObjectConstructionArgs(TlsSession, (SSL_SESSION *session), session)
+
+/*----------------------------------------------------------------------------------------------*/
 
 struct Impl_Context {
     SSL_CTX *             ctx;
     X509_STORE *          certStore;
     iTlsRequestVerifyFunc userVerifyFunc;
     tss_t                 tssKeyCurrentRequest;
+    iMutex                sessionMtx;
+    iStringHash *         sessions; /* session key => TlsSession */
+    uint32_t              sessionSerial;
+    iBool                 isSessionCacheEnabled; /* guarded by sessionMtx */
+    iAtomicInt            numFullHandshakes;
+    iAtomicInt            numResumedHandshakes;
+#if !defined (iPlatformWindows)
+    iMutex                reactorMtx;
+    iReactor *            reactors[MAX_REACTORS]; /* created when needed */
+    int                   numReactors;
+    unsigned int          nextReactor;
+#endif
 };
 
 static iTlsRequest *currentRequestForThread_Context_(iContext *d) {
@@ -102,6 +157,47 @@ static int verifyCallback_Context_(int preverifyOk, X509_STORE_CTX *storeCtx) {
     return result;
 }
 
+static iTlsRequest *request_SSL_(const SSL *ssl) {
+    return ssl ? SSL_get_app_data(ssl) : NULL;
+}
+
+static int certVerifyCallback_Context_(X509_STORE_CTX *storeCtx, void *arg) {
+    iUnused(arg);
+    iTlsRequest *request =
+        request_SSL_(X509_STORE_CTX_get_ex_data(storeCtx, SSL_get_ex_data_X509_STORE_CTX_idx()));
+    if (request && isPinned_TlsRequest_(request)) {
+        /* The caller knows which key to expect, so building and verifying the chain
+           against the CA store would be wasted effort. */
+        if (matchPinned_TlsRequest_(request, X509_STORE_CTX_get0_cert(storeCtx))) {
+            X509_STORE_CTX_set_error(storeCtx, X509_V_OK);
+            return 1;
+        }
+        X509_STORE_CTX_set_error(storeCtx, X509_V_ERR_CERT_REJECTED);
+        return 0;
+    }
+    return X509_verify_cert(storeCtx);
+}
+
+static iBool isSessionCacheEnabled_Context_(iContext *d) {
+    iBool enabled;
+    iGuardMutex(&d->sessionMtx, enabled = d->isSessionCacheEnabled);
+    return enabled;
+}
+
+static int newSession_Context_(SSL *ssl, SSL_SESSION *session) {
+    /* Called during the handshake, or afterwards when a TLS 1.3 ticket arrives. */
+    iTlsRequest *request = request_SSL_(ssl);
+    if (request && isSessionCacheEnabled_Context_(context_)) {
+        /* OpenSSL marks the session non-resumable if the connection is not shut down
+           with a close_notify from both ends, so the cache keeps a copy of its own. */
+        SSL_SESSION *copy = SSL_SESSION_dup(session);
+        if (copy) {
+            cacheSession_TlsRequest_(request, copy);
+        }
+    }
+    return 0;
+}
+
 void init_Context(iContext *d) {
     d->tssKeyCurrentRequest = 0;
     tss_create(&d->tssKeyCurrentRequest, NULL);
@@ -124,11 +220,43 @@ void init_Context(iContext *d) {
     d->userVerifyFunc = NULL;
     SSL_CTX_set_verify(d->ctx, SSL_VERIFY_PEER, verifyCallback_Context_);
     /* Bug workarounds: https://www.openssl.org/docs/manmaster/man3/SSL_CTX_set_options.html */
-    SSL_CTX_set_options(d->ctx, SSL_OP_ALL);
+    SSL_CTX_set_options(d->ctx, SSL_OP_ALL | SSL_OP_NO_COMPRESSION);
+    /* Idle connections don't need to hold on to their read/write buffers. */
+    SSL_CTX_set_mode(d->ctx, SSL_MODE_RELEASE_BUFFERS);
+#if defined (SSL_OP_IGNORE_UNEXPECTED_EOF)
+    /* Many servers just close the connection without a close_notify when they are done. */
+    SSL_CTX_set_options(d->ctx, SSL_OP_IGNORE_UNEXPECTED_EOF);
+#endif
+    SSL_CTX_set_cert_verify_callback(d->ctx, certVerifyCallback_Context_, NULL);
+    /* Client sessions are cached by us, keyed by host and port, because OpenSSL's
+       internal cache is only used by servers. */
+    SSL_CTX_set_session_cache_mode(d->ctx,
+                                   SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(d->ctx, newSession_Context_);
     d->certStore = NULL;
+    init_Mutex(&d->sessionMtx);
+    d->sessions = new_StringHash();
+    d->sessionSerial = 0;
+    d->isSessionCacheEnabled = iTrue;
+    set_Atomic(&d->numFullHandshakes, 0);
+    set_Atomic(&d->numResumedHandshakes, 0);
+#if !defined (iPlatformWindows)
+    init_Mutex(&d->reactorMtx);
+    iZap(d->reactors);
+    d->numReactors = iClamp(idealConcurrentCount_Thread(), 1, MAX_REACTORS);
+    d->nextReactor = 0;
+#endif
 }
 
 void deinit_Context(iContext *d) {
+#if !defined (iPlatformWindows)
+    iForIndices(i, d->reactors) {
+        iRelease(d->reactors[i]);
+    }
+    deinit_Mutex(&d->reactorMtx);
+#endif
+    iRelease(d->sessions);
+    deinit_Mutex(&d->sessionMtx);
     SSL_CTX_free(d->ctx);
     tss_delete(d->tssKeyCurrentRequest);
 }
@@ -137,6 +265,31 @@ iBool isValid_Context(iContext *d) {
     return d->ctx != NULL;
 }
 
+#if !defined (iPlatformWindows)
+static iReactor *reactor_Context_(iContext *d) {
+    /* Requests are spread over a few reactor threads, so the handshakes and notifications
+       of unrelated requests run in parallel. A request submitted in a notification callback
+       stays in the caller's reactor thread, where it can be canceled without waiting. */
+    iReactor *reactor = NULL;
+    iGuardMutex(&d->reactorMtx, {
+        for (int i = 0; i < d->numReactors && d->reactors[i]; i++) {
+            if (isCurrentThread_Reactor(d->reactors[i])) {
+                reactor = d->reactors[i];
+                break;
+            }
+        }
+        if (!reactor) {
+            const int index = (int) (d->nextReactor++ % (unsigned int) d->numReactors);
+            if (!d->reactors[index]) {
+                d->reactors[index] = new_Reactor();
+            }
+            reactor = d->reactors[index];
+        }
+    });
+    return reactor;
+}
+#endif
+
 void setCACertificates_TlsRequest(const iString *caFile, const iString *caPath) {
     initContext_();
     iContext *d = context_;
@@ -157,6 +310,127 @@ void setVerifyFunc_TlsRequest(iTlsRequestVerifyFunc verifyFunc) {
     d->userVerifyFunc = verifyFunc;
 }
 
+static void sessionKey_Context_(const iContext *d, const iString *hostName, uint16_t port,
+                                const iBlock *pinnedKey, const iTlsCertificate *clientCert,
+                                iString *key_out) {
+    /* A resumed handshake skips the verification of the server certificate, and the
+       server may remember the client certificate. Therefore, sessions are shared only by
+       requests that have the same pinned key and present the same client certificate. */
+    iUnused(d);
+    format_String(key_out, "%s:%u", cstr_String(hostName), port);
+    if (!isEmpty_Block(pinnedKey)) {
+        iString *hex = hexEncode_Block(pinnedKey);
+        appendFormat_String(key_out, " pin:%s", cstr_String(hex));
+        delete_String(hex);
+    }
+    if (clientCert) {
+        iBlock *fp = fingerprint_TlsCertificate(clientCert);
+        iString *hex = hexEncode_Block(fp);
+        appendFormat_String(key_out, " cert:%s", cstr_String(hex));
+        delete_String(hex);
+        delete_Block(fp);
+    }
+}
+
+static SSL_SESSION *takeSession_Context_(iContext *d, const iString *key) {
+    SSL_SESSION *sess = NULL;
+    lock_Mutex(&d->sessionMtx);
+    iTlsSession *cached = d->isSessionCacheEnabled ? value_StringHash(d->sessions, key) : NULL;
+    if (cached) {
+        if (SSL_SESSION_is_resumable(cached->session)) {
+            sess = cached->session;
+            SSL_SESSION_up_ref(sess);
+#if defined (TLS1_3_VERSION)
+            /* TLS 1.3 tickets are meant to be used only once. The resumed handshake
+               will provide new ones. */
+            if (SSL_SESSION_get_protocol_version(sess) == TLS1_3_VERSION) {
+                remove_StringHash(d->sessions, key);
+            }
+#endif
+        }
+        else {
+            remove_StringHash(d->sessions, key);
+        }
+    }
+    unlock_Mutex(&d->sessionMtx);
+    return sess;
+}
+
+static void removeSession_Context_(iContext *d, const iString *key) {
+    iGuardMutex(&d->sessionMtx, remove_StringHash(d->sessions, key));
+}
+
+static void evictOldestSession_Context_(iContext *d) {
+    /* Note: The session mutex must be locked. */
+    iString *oldestKey = NULL;
+    uint32_t oldestAge = 0;
+    iConstForEach(StringHash, i, d->sessions) {
+        const iTlsSession *cached = i.value->object;
+        const uint32_t age = d->sessionSerial - cached->serial; /* wraps around */
+        if (!oldestKey || age > oldestAge) {
+            delete_String(oldestKey);
+            oldestKey = copy_String(key_StringHashConstIterator(&i));
+            oldestAge = age;
+        }
+    }
+    if (oldestKey) {
+        remove_StringHash(d->sessions, oldestKey);
+        delete_String(oldestKey);
+    }
+}
+
+static void insertSession_Context_(iContext *d, const iString *key, SSL_SESSION *session) {
+    iTlsSession *cached = new_TlsSession(session);
+    lock_Mutex(&d->sessionMtx);
+    if (!d->isSessionCacheEnabled) {
+        /* Disabled after the session was received. */
+        unlock_Mutex(&d->sessionMtx);
+        iRelease(cached);
+        return;
+    }
+    if (size_StringHash(d->sessions) >= MAX_CACHED_SESSIONS && !contains_StringHash(d->sessions, key)) {
+        evictOldestSession_Context_(d);
+    }
+    cached->serial = d->sessionSerial++;
+    insert_StringHash(d->sessions, key, cached);
+    unlock_Mutex(&d->sessionMtx);
+    iRelease(cached);
+}
+
+void setSessionCacheEnabled_TlsRequest(iBool enable) {
+    initContext_();
+    iContext *d = context_;
+    iGuardMutex(&d->sessionMtx, {
+        d->isSessionCacheEnabled = enable;
+        if (!enable) {
+            clear_StringHash(d->sessions);
+        }
+    });
+}
+
+void clearSessionCache_TlsRequest(void) {
+    if (context_) {
+        iGuardMutex(&context_->sessionMtx, clear_StringHash(context_->sessions));
+    }
+}
+
+void handshakeStats_TlsRequest(iTlsHandshakeStats *stats_out) {
+    if (context_) {
+        stats_out->numFull    = value_Atomic(&context_->numFullHandshakes);
+        stats_out->numResumed = value_Atomic(&context_->numResumedHandshakes);
+    }
+    else {
+        iZap(*stats_out);
+    }
+}
+
+void resetHandshakeStats_TlsRequest(void) {
+    if (context_) {
+        set_Atomic(&context_->numFullHandshakes, 0);
+        set_Atomic(&context_->numResumedHandshakes, 0);
+    }
+}
+
 iDefineTypeConstruction(Context)
 
 static void globalCleanup_TlsRequest_(void) {
@@ -564,31 +838,48 @@ struct Impl_TlsRequest {
     /* Connection. */
     iString *        hostName;
     uint16_t         port;
+#if defined (iPlatformWindows)
     iSocket *        socket;
+#else
+    iAddress *       address;
+    int              fd;
+    int              addrIndex; /* next resolved address to try */
+    iReactor *       reactor;   /* drives the request; chosen when submitted */
+    uint32_t         wait;      /* pending Reactor wait */
+    iBool            isActive;  /* the reactor may still access the request */
+    iBool            isHalted;
+#endif
     const iTlsCertificate *clientCert;
+    iBlock           pinnedKey; /* SHA-256 of the expected public key */
+    iString *        sessionKey;
     /* Payload and result. */
     iBlock           content;
-    iBuffer *        result;
+    iBlock           received;
     iTlsCertificate *cert; /* server certificate */
     iBool            certVerifyFailed;
+    iBool            isResumed;
     /* Internal state. */
     volatile enum iTlsRequestStatus status;
     iString *        errorMsg;
-    iThread *        thread;
     iBool            notifyReady;
     size_t           totalBytesToSend;
     size_t           totalBytesSent;
+#if defined (iPlatformWindows)
+    iThread *        thread;
     iBlock  *        incoming;
     iCondition       gotIncoming;
     iMutex           incomingMtx;
+#endif
     iCondition       requestDone;
     iAudience *      readyRead;
     iAudience *      sent;
     iAudience *      finished;
     /* OpenSSL state. */
     SSL *            ssl;
+#if defined (iPlatformWindows)
     BIO *            rbio; /* we insert incoming encrypted bytes here for SSL to read */
     BIO *            wbio; /* SSL sends encrypted bytes to socket */
+#endif
     iBlock           sending;
 };
 
@@ -627,64 +918,17 @@ static void setStatus_TlsRequest_(iTlsRequest *d, enum iTlsRequestStatus st) {
             signalAll_Condition(&d->requestDone);
         }
         unlock_Mutex(&d->mtx);
+#if defined (iPlatformWindows)
         lock_Mutex(&d->incomingMtx);
         signal_Condition(&d->gotIncoming); /* wake up if sleeping */
         unlock_Mutex(&d->incomingMtx);
+#endif
     }
     else {
         unlock_Mutex(&d->mtx);
     }
 }
 
-static void flushToSocket_TlsRequest_(iTlsRequest *d) {
-    char buf[DEFAULT_BUF_SIZE];
-    int n;
-    do {
-        n = BIO_read(d->wbio, buf, sizeof(buf));
-        if (n > 0) {
-            d->totalBytesToSend += n;
-            writeData_Socket(d->socket, buf, n);
-        }
-        else if (!BIO_should_retry(d->wbio)) {
-            iDebug("[TlsRequest] output error (BIO_read)\n");
-            setStatus_TlsRequest_(d, error_TlsRequestStatus);
-            return;
-        }
-    } while (n > 0);
-}
-
-static enum iSSLResult doHandshake_TlsRequest_(iTlsRequest *d) {
-    int n = SSL_do_handshake(d->ssl);
-    enum iSSLResult result = sslResult_TlsRequest_(d, n);
-    if (result == wantIO_SSLResult) {
-        flushToSocket_TlsRequest_(d);
-    }
-    return result;
-}
-
-static iBool encrypt_TlsRequest_(iTlsRequest *d) {
-    if (!SSL_is_init_finished(d->ssl)) {
-        return iFalse;
-    }
-    while (!isEmpty_Block(&d->sending)) {
-        int n = SSL_write(d->ssl, constData_Block(&d->sending), size_Block(&d->sending));
-        enum iSSLResult status = sslResult_TlsRequest_(d, n);
-        if (n > 0) {
-            remove_Block(&d->sending, 0, n);
-            flushToSocket_TlsRequest_(d);
-        }
-        if (status == fail_SSLResult) {
-            iDebug("[TlsRequest] failure to encrypt (SSL_write)\n");
-            setError_TlsRequest_(d, "failure to encrypt data");
-            return iTrue;
-        }
-        if (n == 0) {
-            break;
-        }
-    }
-    return iTrue;
-}
-
 void setCiphers_TlsRequest(const char *cipherList) {
     initContext_();
     SSL_CTX_set_cipher_list(context_->ctx, cipherList);
@@ -695,56 +939,85 @@ void init_TlsRequest(iTlsRequest *d) {
     init_Mutex(&d->mtx);
     d->hostName = new_String();
     d->port = 0;
+#if defined (iPlatformWindows)
     d->socket = NULL;
+#else
+    d->address = NULL;
+    d->fd = -1;
+    d->addrIndex = 0;
+    d->reactor = NULL;
+    d->wait = 0;
+    d->isActive = iFalse;
+    d->isHalted = iFalse;
+#endif
     d->clientCert = NULL;
+    init_Block(&d->pinnedKey, 0);
+    d->sessionKey = new_String();
     init_Block(&d->content, 0);
-    d->result = new_Buffer();
-    openEmpty_Buffer(d->result);
+    init_Block(&d->received, 0);
     d->cert = NULL;
+    d->certVerifyFailed = iFalse;
+    d->isResumed = iFalse;
     d->errorMsg = new_String();
     d->status = initialized_TlsRequestStatus;
-    d->thread = NULL;
     d->notifyReady = iFalse;
     d->totalBytesToSend = 0;
     d->totalBytesSent = 0;
+#if defined (iPlatformWindows)
+    d->thread = NULL;
     d->incoming = new_Block(0);
     init_Mutex(&d->incomingMtx);
     init_Condition(&d->gotIncoming);
+#endif
     init_Condition(&d->requestDone);
     d->readyRead = NULL;
     d->sent = NULL;
     d->finished = NULL;
-    d->ssl = SSL_new(context_->ctx);
-    /* We could also try BIO_s_socket() but all BSD socket related code should be encapsulated
-       into the Socket class. */
-    d->rbio = BIO_new(BIO_s_mem());
-    d->wbio = BIO_new(BIO_s_mem());
-    SSL_set_connect_state(d->ssl);
-    SSL_set_bio(d->ssl, d->rbio, d->wbio);
+    d->ssl = NULL; /* created when submitted */
     init_Block(&d->sending, 0);
 }
 
+#if !defined (iPlatformWindows)
+static void addressLookedUp_TlsRequest_(iAny *any, const iAddress *address);
+#endif
+
 void deinit_TlsRequest(iTlsRequest *d) {
+#if defined (iPlatformWindows)
     iGuardMutex(&d->incomingMtx, signal_Condition(&d->gotIncoming));
     iGuardMutex(&d->mtx, d->status = finished_TlsRequestStatus);
     if (d->thread) {
         join_Thread(d->thread);
         iRelease(d->thread);
     }
+#else
+    if (d->address) {
+        iDisconnect(Address, d->address, lookupFinished, d, addressLookedUp_TlsRequest_);
+    }
+    cancel_TlsRequest(d);
+    iRelease(d->address);
+#endif
     deinit_Block(&d->sending);
-    SSL_free(d->ssl);
+    if (d->ssl) {
+        SSL_free(d->ssl);
+    }
     deinit_Condition(&d->requestDone);
+#if defined (iPlatformWindows)
     deinit_Condition(&d->gotIncoming);
     deinit_Mutex(&d->incomingMtx);
     delete_Block(d->incoming);
+#endif
     delete_Audience(d->finished);
     delete_Audience(d->sent);
     delete_Audience(d->readyRead);
     delete_String(d->errorMsg);
     delete_TlsCertificate(d->cert);
-    iRelease(d->result);
+    deinit_Block(&d->received);
     deinit_Block(&d->content);
+#if defined (iPlatformWindows)
     iRelease(d->socket);
+#endif
+    delete_String(d->sessionKey);
+    deinit_Block(&d->pinnedKey);
     delete_String(d->hostName);
     deinit_Mutex(&d->mtx);
 }
@@ -762,10 +1035,183 @@ void setCertificate_TlsRequest(iTlsRequest *d, const iTlsCertificate *cert) {
     d->clientCert = cert;
 }
 
+void setPinnedPublicKey_TlsRequest(iTlsRequest *d, const iBlock *publicKeyFingerprint) {
+    if (publicKeyFingerprint) {
+        set_Block(&d->pinnedKey, publicKeyFingerprint);
+    }
+    else {
+        clear_Block(&d->pinnedKey);
+    }
+}
+
+static iBool isPinned_TlsRequest_(const iTlsRequest *d) {
+    return !isEmpty_Block(&d->pinnedKey);
+}
+
+static iBool matchPinned_TlsRequest_(iTlsRequest *d, X509 *cert) {
+    if (!cert) {
+        return iFalse;
+    }
+    X509_up_ref(cert);
+    iTlsCertificate *tlsCert = newX509Chain_TlsCertificate_(cert, NULL);
+    iBlock *fp = publicKeyFingerprint_TlsCertificate(tlsCert);
+    const iBool isMatch = cmp_Block(fp, &d->pinnedKey) == 0;
+    if (!isMatch) {
+        certificateVerifyFailed_TlsRequest_(d, tlsCert);
+    }
+    delete_Block(fp);
+    delete_TlsCertificate(tlsCert);
+    return isMatch;
+}
+
+static void cacheSession_TlsRequest_(iTlsRequest *d, SSL_SESSION *session) {
+    insertSession_Context_(context_, d->sessionKey, session);
+}
+
+static iBool handshakeFinished_TlsRequest_(iTlsRequest *d) {
+    /* Returns iFalse if the connection must not be used. */
+    if (!d->cert) {
+        d->isResumed = SSL_session_reused(d->ssl) != 0;
+        if (d->isResumed && isPinned_TlsRequest_(d)) {
+            /* The certificate verify callback is not called when resuming, so the pin
+               is checked here. */
+            X509 *peer = SSL_get_peer_certificate(d->ssl);
+            const iBool isMatch = matchPinned_TlsRequest_(d, peer);
+            X509_free(peer);
+            if (!isMatch) {
+                return iFalse;
+            }
+        }
+        /* A resumed session may not have the peer's chain available. */
+        const STACK_OF(X509) *chain = SSL_get_peer_cert_chain(d->ssl);
+        d->cert = newX509Chain_TlsCertificate_(SSL_get_peer_certificate(d->ssl),
+                                               chain ? sk_X509_dup(chain) : NULL);
+        add_Atomic(d->isResumed ? &context_->numResumedHandshakes : &context_->numFullHandshakes, 1);
+    }
+    return iTrue;
+}
+
+static void checkReadyRead_TlsRequest_(iTlsRequest *d) {
+    /* All notifications are done from the I/O thread. */
+    if (d->notifyReady) {
+        d->notifyReady = iFalse;
+        iNotifyAudience(d, readyRead, TlsRequestReadyRead);
+    }
+}
+
+static void setError_TlsRequest_(iTlsRequest *d, const char *msg) {
+    setCStr_String(d->errorMsg, msg);
+    removeSession_Context_(context_, d->sessionKey); /* don't resume a failed session */
+    setStatus_TlsRequest_(d, error_TlsRequestStatus);
+}
+
+static void resetSSL_TlsRequest_(iTlsRequest *d) {
+    /* Each submission is a new connection with its own SSL state. */
+    if (d->ssl) {
+        SSL_free(d->ssl);
+    }
+    d->ssl = SSL_new(context_->ctx);
+    SSL_set_app_data(d->ssl, d);
+    SSL_set_connect_state(d->ssl);
+#if defined (iPlatformWindows)
+    /* The socket's I/O is done by the Socket class. */
+    d->rbio = BIO_new(BIO_s_mem());
+    d->wbio = BIO_new(BIO_s_mem());
+    SSL_set_bio(d->ssl, d->rbio, d->wbio);
+#endif
+}
+
+static void prepare_TlsRequest_(iTlsRequest *d) {
+    clear_Block(&d->received);
+    clear_String(d->errorMsg);
+    set_Block(&d->sending, &d->content);
+    d->notifyReady = iFalse;
+    d->totalBytesToSend = 0;
+    d->totalBytesSent = 0;
+    d->certVerifyFailed = iFalse;
+    d->isResumed = iFalse;
+    if (d->cert) {
+        delete_TlsCertificate(d->cert);
+        d->cert = NULL;
+    }
+    resetSSL_TlsRequest_(d);
+    sessionKey_Context_(context_, d->hostName, d->port, &d->pinnedKey, d->clientCert,
+                        d->sessionKey);
+    SSL_SESSION *sess = takeSession_Context_(context_, d->sessionKey); /* NULL if disabled */
+    if (sess) {
+        SSL_set_session(d->ssl, sess);
+        SSL_SESSION_free(sess);
+    }
+    SSL_set1_host(d->ssl, cstr_String(d->hostName));
+    /* Server Name Indication for the handshake. */
+    if (!contains_String(d->hostName, ':')) { /* Domain names only (not literal IPv6 addresses). */
+        SSL_set_tlsext_host_name(d->ssl, cstr_String(d->hostName));
+    }
+    /* The client certificate. */
+    if (d->clientCert) {
+        SSL_use_certificate(d->ssl, d->clientCert->cert);
+        SSL_use_PrivateKey(d->ssl, d->clientCert->pkey);
+    }
+}
+
+#if defined (iPlatformWindows)
+/*----------------------------------------------------------------------------------------------*/
+/* Windows: the encrypted bytes pass through a Socket and memory BIOs, and each request
+   runs a thread of its own for the SSL state machine. */
+
+static void flushToSocket_TlsRequest_(iTlsRequest *d) {
+    char buf[DEFAULT_BUF_SIZE];
+    int n;
+    do {
+        n = BIO_read(d->wbio, buf, sizeof(buf));
+        if (n > 0) {
+            d->totalBytesToSend += n;
+            writeData_Socket(d->socket, buf, n);
+        }
+        else if (!BIO_should_retry(d->wbio)) {
+            iDebug("[TlsRequest] output error (BIO_read)\n");
+            setStatus_TlsRequest_(d, error_TlsRequestStatus);
+            return;
+        }
+    } while (n > 0);
+}
+
+static enum iSSLResult doHandshake_TlsRequest_(iTlsRequest *d) {
+    int n = SSL_do_handshake(d->ssl);
+    enum iSSLResult result = sslResult_TlsRequest_(d, n);
+    if (result == wantIO_SSLResult) {
+        flushToSocket_TlsRequest_(d);
+    }
+    return result;
+}
+
+static iBool encrypt_TlsRequest_(iTlsRequest *d) {
+    if (!SSL_is_init_finished(d->ssl)) {
+        return iFalse;
+    }
+    while (!isEmpty_Block(&d->sending)) {
+        int n = SSL_write(d->ssl, constData_Block(&d->sending), size_Block(&d->sending));
+        enum iSSLResult status = sslResult_TlsRequest_(d, n);
+        if (n > 0) {
+            remove_Block(&d->sending, 0, n);
+            flushToSocket_TlsRequest_(d);
+        }
+        if (status == fail_SSLResult) {
+            iDebug("[TlsRequest] failure to encrypt (SSL_write)\n");
+            setError_TlsRequest_(d, "failure to encrypt data");
+            return iTrue;
+        }
+        if (n == 0) {
+            break;
+        }
+    }
+    return iTrue;
+}
+
 static void appendReceived_TlsRequest_(iTlsRequest *d, const char *buf, size_t len) {
     if (len > 0) {
         iGuardMutex(&d->mtx, {
-            writeData_Buffer(d->result, buf, len);
+            appendData_Block(&d->received, buf, len);
         });
         d->notifyReady = iTrue;
     }
@@ -795,10 +1241,9 @@ static int processIncoming_TlsRequest_(iTlsRequest *d, const char *src, size_t l
                 return 0; /* continue later */
             }
         }
-        if (!d->cert) {
-            const STACK_OF(X509) *chain = SSL_get_peer_cert_chain(d->ssl);
-            d->cert = newX509Chain_TlsCertificate_(SSL_get_peer_certificate(d->ssl),
-                                                   sk_X509_dup(chain));
+        if (!handshakeFinished_TlsRequest_(d)) {
+            setError_TlsRequest_(d, "server public key does not match the pinned key");
+            return -1;
         }
         /* The encrypted data is now in the input bio so now we can perform actual
            read of unencrypted data. */
@@ -826,14 +1271,6 @@ static int processIncoming_TlsRequest_(iTlsRequest *d, const char *src, size_t l
     return 0;
 }
 
-static void checkReadyRead_TlsRequest_(iTlsRequest *d) {
-    /* All notifications are done from the TlsRequest thread. */
-    if (d->notifyReady) {
-        d->notifyReady = iFalse;
-        iNotifyAudience(d, readyRead, TlsRequestReadyRead);
-    }
-}
-
 static void gotIncoming_TlsRequest_(iTlsRequest *d, iSocket *socket) {
     iUnused(socket);
     iBlock *data = readAll_Socket(socket);
@@ -904,15 +1341,11 @@ static void disconnected_TlsRequest_(iTlsRequest *d, iSocket *sock) {
 }
 
 static void bytesWritten_TlsRequest_(iTlsRequest *d, iSocket *sock, size_t num) {
+    iUnused(sock);
     d->totalBytesSent += num;
     iNotifyAudienceArgs(d, sent, TlsRequestSent, d->totalBytesSent, d->totalBytesToSend);
 }
 
-static void setError_TlsRequest_(iTlsRequest *d, const char *msg) {
-    setCStr_String(d->errorMsg, msg);
-    setStatus_TlsRequest_(d, error_TlsRequestStatus);
-}
-
 static void handleError_TlsRequest_(iTlsRequest *d, iSocket *sock, int error, const char *msg) {
     iUnused(sock, error);
     setError_TlsRequest_(d, msg);
@@ -926,21 +1359,12 @@ void submit_TlsRequest(iTlsRequest *d) {
         iDebug("[TlsRequest] request already ongoing\n");
         return;
     }
-    clear_Buffer(d->result);
-    clear_String(d->errorMsg);
-    set_Block(&d->sending, &d->content);
-    iRelease(d->socket);
-    d->certVerifyFailed = iFalse;
-    SSL_set1_host(d->ssl, cstr_String(d->hostName));
-    /* Server Name Indication for the handshake. */
-    if (!contains_String(d->hostName, ':')) { /* Domain names only (not literal IPv6 addresses). */
-        SSL_set_tlsext_host_name(d->ssl, cstr_String(d->hostName));
-    }
-    /* The client certificate. */
-    if (d->clientCert) {
-        SSL_use_certificate(d->ssl, d->clientCert->cert);
-        SSL_use_PrivateKey(d->ssl, d->clientCert->pkey);
+    if (d->thread) {
+        join_Thread(d->thread);
+        iReleasePtr(&d->thread);
     }
+    prepare_TlsRequest_(d);
+    iRelease(d->socket);
     d->socket = new_Socket(cstr_String(d->hostName), d->port);
     iConnect(Socket, d->socket, connected, d, connected_TlsRequest_);
     iConnect(Socket, d->socket, disconnected, d, disconnected_TlsRequest_);
@@ -968,16 +1392,321 @@ void cancel_TlsRequest(iTlsRequest *d) {
     iReleasePtr(&d->thread);
 }
 
-void waitForFinished_TlsRequest(iTlsRequest *d) {
+const iAddress *address_TlsRequest(const iTlsRequest *d) {
+    return d->socket ? address_Socket(d->socket) : NULL;
+}
+
+#else /* POSIX */
+/*----------------------------------------------------------------------------------------------*/
+/* The connection is a non-blocking socket owned by the request, and each request is
+   driven by one of a few shared Reactors. Whenever the socket is ready, the SSL state
+   machine runs in that reactor's thread for as long as it can progress without blocking,
+   reading and writing the socket directly. There are no per-request threads or
+   intermediate copies of the data. */
+
+int getSockAddr_Address(const iAddress *  d,
+                        struct sockaddr **addr_out,
+                        socklen_t *       addrSize_out,
+                        int               family,
+                        int               indexInFamily); /* address.c */
+
+static const double connectionTimeoutSeconds_TlsRequest_ = 6.0;
+
+static void process_TlsRequest_(iTlsRequest *d);
+static void tryConnect_TlsRequest_(iTlsRequest *d, int error);
+
+static iReactor *reactor_TlsRequest_(const iTlsRequest *d) {
+    return d->reactor;
+}
+
+static void setWait_TlsRequest_(iTlsRequest *d, uint32_t wait) {
+    iGuardMutex(&d->mtx, d->wait = wait);
+}
+
+static void socketReady_TlsRequest_(void *context, int events) {
+    iTlsRequest *d = context;
+    iUnused(events); /* SSL will find out what happened */
+    setWait_TlsRequest_(d, 0);
+    process_TlsRequest_(d);
+}
+
+static void waitForSocket_TlsRequest_(iTlsRequest *d, int sslError) {
+    const int events =
+        (sslError == SSL_ERROR_WANT_WRITE ? writable_ReactorEvent : readable_ReactorEvent);
+    lock_Mutex(&d->mtx);
+    d->wait = watch_Reactor(reactor_TlsRequest_(d), d->fd, events, 0.0, socketReady_TlsRequest_, d);
+    unlock_Mutex(&d->mtx);
+}
+
+static void closeSocket_TlsRequest_(iTlsRequest *d) {
+    if (d->fd >= 0) {
+        close(d->fd);
+        d->fd = -1;
+    }
+}
+
+static void finish_TlsRequest_(iTlsRequest *d) {
+    /* Runs in the reactor thread after the final status has been set. */
+    closeSocket_TlsRequest_(d);
+    checkReadyRead_TlsRequest_(d);
+    iNotifyAudience(d, finished, TlsRequestFinished);
+    iDebug("[TlsRequest] finished\n");
+    /* After this, the request may be deleted at any time. */
+    iGuardMutex(&d->mtx, {
+        d->isActive = iFalse;
+        signalAll_Condition(&d->requestDone);
+    });
+}
+
+static void startConnecting_TlsRequest_(void *context, int events) {
+    iTlsRequest *d = context;
+    iUnused(events);
+    setWait_TlsRequest_(d, 0);
+    tryConnect_TlsRequest_(d, 0);
+}
+
+static void addressLookedUp_TlsRequest_(iAny *any, const iAddress *address) {
+    /* Runs in the address lookup thread; everything else happens in the reactor. */
+    iTlsRequest *d = any;
+    iUnused(address);
+    lock_Mutex(&d->mtx);
+    if (d->status == submitted_TlsRequestStatus) {
+        d->wait = addTimer_Reactor(reactor_TlsRequest_(d), 0.0, startConnecting_TlsRequest_, d);
+    }
+    unlock_Mutex(&d->mtx);
+}
+
+static void connected_TlsRequest_(void *context, int events) {
+    iTlsRequest *d = context;
+    setWait_TlsRequest_(d, 0);
+    int error = ETIMEDOUT;
+    if (~events & timeout_ReactorEvent) {
+        socklen_t argLen = sizeof(error);
+        if (getsockopt(d->fd, SOL_SOCKET, SO_ERROR, &error, &argLen)) {
+            error = errno;
+        }
+    }
+    if (error) {
+        closeSocket_TlsRequest_(d);
+        tryConnect_TlsRequest_(d, error); /* next address */
+        return;
+    }
+    SSL_set_fd(d->ssl, d->fd);
+    process_TlsRequest_(d);
+}
+
+static void tryConnect_TlsRequest_(iTlsRequest *d, int error) {
+    /* Tries each resolved address in turn until one of them accepts the connection. */
+    while (d->addrIndex < count_Address(d->address)) {
+        const int index = d->addrIndex++;
+        struct sockaddr *addr;
+        socklen_t addrSize;
+        getSockAddr_Address(d->address, &addr, &addrSize, AF_UNSPEC, index);
+        if (!addrSize) {
+            break;
+        }
+        const iSocketParameters sp = socketParametersIndex_Address(d->address, index);
+        d->fd = socket(sp.family, sp.type, sp.protocol);
+        if (d->fd < 0) {
+            error = errno;
+            continue;
+        }
+        fcntl(d->fd, F_SETFL, fcntl(d->fd, F_GETFL, 0) | O_NONBLOCK);
+        /* Handshake flights and records are written in whole chunks. Without this,
+           Nagle's algorithm and delayed ACKs stall each exchange. */ {
+            const int noDelay = 1;
+            setsockopt(d->fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+        }
+#if defined (SO_NOSIGPIPE)
+        /* The reactor thread blocks SIGPIPE, but not all platforms deliver it that way. */ {
+            const int noSigPipe = 1;
+            setsockopt(d->fd, SOL_SOCKET, SO_NOSIGPIPE, &noSigPipe, sizeof(noSigPipe));
+        }
+#endif
+        if (connect(d->fd, addr, addrSize) == 0 || errno == EINPROGRESS) {
+            lock_Mutex(&d->mtx);
+            d->wait = watch_Reactor(reactor_TlsRequest_(d), d->fd, writable_ReactorEvent,
+                                    connectionTimeoutSeconds_TlsRequest_,
+                                    connected_TlsRequest_, d);
+            unlock_Mutex(&d->mtx);
+            return;
+        }
+        error = errno;
+        closeSocket_TlsRequest_(d);
+    }
+    setError_TlsRequest_(d, !isHostFound_Address(d->address) ? "Failed to look up hostname"
+                            : error ? strerror(error) : "Failed to connect");
+    finish_TlsRequest_(d);
+}
+
+static void process_TlsRequest_(iTlsRequest *d) {
+    /* Runs in the reactor thread. Progresses as far as possible without blocking, and
+       then waits until the socket is ready for more. */
+    int n;
+    setCurrentRequestForThread_Context_(context_, d); /* for the verify callback */
+    if (!SSL_is_init_finished(d->ssl)) {
+        n = SSL_do_handshake(d->ssl);
+        const enum iSSLResult result = sslResult_TlsRequest_(d, n);
+        if (result == wantIO_SSLResult) {
+            waitForSocket_TlsRequest_(d, SSL_get_error(d->ssl, n));
+            return;
+        }
+        if (result != ok_SSLResult) {
+            iDebug("[TlsRequest] handshake failure\n");
+            setError_TlsRequest_(d, "TLS/SSL handshake failed");
+            finish_TlsRequest_(d);
+            return;
+        }
+    }
+    if (!handshakeFinished_TlsRequest_(d)) {
+        setError_TlsRequest_(d, "server public key does not match the pinned key");
+        finish_TlsRequest_(d);
+        return;
+    }
+    /* Records are encrypted directly into the socket. */
+    while (!isEmpty_Block(&d->sending)) {
+        n = SSL_write(d->ssl,
+                      constData_Block(&d->sending),
+                      (int) iMin(size_Block(&d->sending), INT_MAX));
+        if (n <= 0) {
+            if (sslResult_TlsRequest_(d, n) == wantIO_SSLResult) {
+                waitForSocket_TlsRequest_(d, SSL_get_error(d->ssl, n));
+                return;
+            }
+            iDebug("[TlsRequest] failure to encrypt (SSL_write)\n");
+            setError_TlsRequest_(d, "failure to encrypt data");
+            finish_TlsRequest_(d);
+            return;
+        }
+        remove_Block(&d->sending, 0, n);
+        d->totalBytesSent += n;
+        iNotifyAudienceArgs(d, sent, TlsRequestSent, d->totalBytesSent, d->totalBytesToSend);
+    }
+    /* Incoming records are decrypted directly into the received data. */
+    do {
+        lock_Mutex(&d->mtx);
+        const size_t pos = size_Block(&d->received);
+        resize_Block(&d->received, pos + MAX_RECORD_SIZE);
+        n = SSL_read(d->ssl, (char *) data_Block(&d->received) + pos, MAX_RECORD_SIZE);
+        truncate_Block(&d->received, pos + iMax(n, 0));
+        unlock_Mutex(&d->mtx);
+        if (n > 0) {
+            d->notifyReady = iTrue;
+        }
+    } while (n > 0);
+    checkReadyRead_TlsRequest_(d);
+    const int sslError = SSL_get_error(d->ssl, n);
+    if (sslError == SSL_ERROR_WANT_READ || sslError == SSL_ERROR_WANT_WRITE) {
+        waitForSocket_TlsRequest_(d, sslError);
+        return;
+    }
+    if (sslError == SSL_ERROR_ZERO_RETURN ||
+        (sslError == SSL_ERROR_SYSCALL && ERR_peek_error() == 0 && n == 0)) {
+        /* The server closed the connection, with or without a close_notify. */
+        setStatus_TlsRequest_(d, finished_TlsRequestStatus);
+    }
+    else {
+        sslResult_TlsRequest_(d, n); /* print the errors */
+        setError_TlsRequest_(d, "error while decrypting incoming data");
+    }
+    finish_TlsRequest_(d);
+}
+
+static void halt_TlsRequest_(iTlsRequest *d) {
+    /* Runs in the reactor thread, so none of the request's callbacks is running. */
+    lock_Mutex(&d->mtx);
+    const iBool isActive = d->isActive;
+    const uint32_t wait = d->wait;
+    d->wait = 0;
+    if (isActive && d->status == submitted_TlsRequestStatus) {
+        d->status = error_TlsRequestStatus; /* also prevents connecting after the lookup */
+        signalAll_Condition(&d->requestDone);
+    }
+    unlock_Mutex(&d->mtx);
+    if (wait) {
+        cancel_Reactor(reactor_TlsRequest_(d), wait);
+    }
+    if (isActive) {
+        finish_TlsRequest_(d);
+    }
+}
+
+static void haltRequested_TlsRequest_(void *context, int events) {
+    iTlsRequest *d = context;
+    iUnused(events);
+    halt_TlsRequest_(d);
+    iGuardMutex(&d->mtx, {
+        d->isHalted = iTrue;
+        signalAll_Condition(&d->requestDone);
+    });
+}
+
+void submit_TlsRequest(iTlsRequest *d) {
     lock_Mutex(&d->mtx);
     if (d->status == submitted_TlsRequestStatus) {
+        unlock_Mutex(&d->mtx);
+        iDebug("[TlsRequest] request already ongoing\n");
+        return;
+    }
+    if (d->isActive && isCurrentThread_Reactor(reactor_TlsRequest_(d))) {
+        unlock_Mutex(&d->mtx);
+        iDebug("[TlsRequest] cannot resubmit while the previous request is finishing\n");
+        return;
+    }
+    while (d->isActive) {
+        wait_Condition(&d->requestDone, &d->mtx); /* previous request is finishing */
+    }
+    unlock_Mutex(&d->mtx);
+    prepare_TlsRequest_(d);
+    if (d->address) {
+        iDisconnect(Address, d->address, lookupFinished, d, addressLookedUp_TlsRequest_);
+        iRelease(d->address);
+    }
+    d->address = new_Address();
+    d->addrIndex = 0;
+    d->totalBytesToSend = size_Block(&d->content); /* progress is reported for the payload */
+    iGuardMutex(&d->mtx, {
+        d->reactor = reactor_Context_(context_);
+        d->status = submitted_TlsRequestStatus;
+        d->isActive = iTrue;
+    });
+    iConnect(Address, d->address, lookupFinished, d, addressLookedUp_TlsRequest_);
+    lookupTcp_Address(d->address, d->hostName, d->port);
+}
+
+void cancel_TlsRequest(iTlsRequest *d) {
+    lock_Mutex(&d->mtx);
+    if (!d->isActive) {
+        unlock_Mutex(&d->mtx);
+        return;
+    }
+    iReactor *reactor = reactor_TlsRequest_(d);
+    if (isCurrentThread_Reactor(reactor)) {
+        /* Another request's callback; this one is not running. */
+        unlock_Mutex(&d->mtx);
+        halt_TlsRequest_(d);
+        return;
+    }
+    /* The reactor thread owns the request's state, so the halting is done there. */
+    d->isHalted = iFalse;
+    addTimer_Reactor(reactor, 0.0, haltRequested_TlsRequest_, d);
+    while (!d->isHalted) {
         wait_Condition(&d->requestDone, &d->mtx);
     }
     unlock_Mutex(&d->mtx);
 }
 
 const iAddress *address_TlsRequest(const iTlsRequest *d) {
-    return d->socket ? address_Socket(d->socket) : NULL;
+    return d->address;
+}
+#endif
+
+void waitForFinished_TlsRequest(iTlsRequest *d) {
+    lock_Mutex(&d->mtx);
+    while (d->status == submitted_TlsRequestStatus) {
+        wait_Condition(&d->requestDone, &d->mtx);
+    }
+    unlock_Mutex(&d->mtx);
 }
 
 enum iTlsRequestStatus status_TlsRequest(const iTlsRequest *d) {
@@ -998,20 +1727,227 @@ iBool isVerified_TlsRequest(const iTlsRequest *d) {
     return !d->certVerifyFailed;
 }
 
+iBool isResumed_TlsRequest(const iTlsRequest *d) {
+    return d->isResumed;
+}
+
 const iTlsCertificate *serverCertificate_TlsRequest(const iTlsRequest *d) {
     return d->cert;
 }
 
 iBlock *readAll_TlsRequest(iTlsRequest *d) {
     iBlock *rd;
-    iGuardMutex(&d->mtx, rd = consumeAll_Buffer(d->result));
+    iGuardMutex(&d->mtx, {
+        rd = copy_Block(&d->received); /* shares the data */
+        clear_Block(&d->received);
+    });
     return rd;
 }
 
 size_t receivedBytes_TlsRequest(const iTlsRequest *d) {
     size_t len;
-    iGuardMutex(&d->mtx, len = size_Buffer(d->result));
+    iGuardMutex(&d->mtx, len = size_Block(&d->received));
     return len;
 }
 
 iDefineClass(TlsRequest)
+
+/*----------------------------------------------------------------------------------------------*/
+/* Server side: TLS on sockets accepted by Service. The handshake and the encryption
+   are driven by the socket's I/O thread via memory BIOs, so nothing here blocks. */
+
+struct Impl_TlsServerContext {
+    SSL_CTX *ctx;
+};
+
+void init_TlsServerContext(iTlsServerContext *d, const iTlsCertificate *cert) {
+    initContext_(); /* library initialization */
+    d->ctx = NULL;
+    if (!cert->cert || !cert->pkey) {
+        iWarning("[TlsRequest] server certificate and private key are required\n");
+        return;
+    }
+    SSL_CTX *ctx = SSL_CTX_new(TLS_server_method());
+    if (!ctx) {
+        iWarning("[TlsRequest] failed to create server context\n");
+        return;
+    }
+    SSL_CTX_set_options(ctx, SSL_OP_ALL | SSL_OP_NO_COMPRESSION |
+                             SSL_OP_CIPHER_SERVER_PREFERENCE);
+    SSL_CTX_set_mode(ctx, SSL_MODE_RELEASE_BUFFERS);
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+    if (SSL_CTX_use_certificate(ctx, cert->cert) != 1 ||
+        SSL_CTX_use_PrivateKey(ctx, cert->pkey) != 1 ||
+        SSL_CTX_check_private_key(ctx) != 1) {
+        iWarning("[TlsRequest] server certificate or private key rejected\n");
+        SSL_CTX_free(ctx);
+        return;
+    }
+    if (cert->chain) {
+        /* Intermediate certificates to send to clients. */
+        for (int i = 0; i < sk_X509_num(cert->chain); i++) {
+            X509 *x = sk_X509_value(cert->chain, i);
+            if (X509_cmp(x, cert->cert)) {
+                SSL_CTX_add1_chain_cert(ctx, x);
+            }
+        }
+    }
+    d->ctx = ctx;
+}
+
+void deinit_TlsServerContext(iTlsServerContext *d) {
+    SSL_CTX_free(d->ctx); /* each accepted connection holds its own reference */
+}
+
+iDefineTypeConstructionArgs(TlsServerContext, (const iTlsCertificate *cert), cert)
+
+iBool isValid_TlsServerContext(const iTlsServerContext *d) {
+    return d->ctx != NULL;
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
+struct Impl_TlsFilter {
+    SSL *ssl;
+    BIO *rbio; /* encrypted bytes received from the peer */
+    BIO *wbio; /* encrypted bytes to send to the peer */
+    iBlock pending; /* plaintext not yet accepted by SSL_write */
+};
+
+void init_TlsFilter(iTlsFilter *d, const iTlsServerContext *context) {
+    d->ssl  = SSL_new(context->ctx);
+    d->rbio = BIO_new(BIO_s_mem());
+    d->wbio = BIO_new(BIO_s_mem());
+    SSL_set_accept_state(d->ssl);
+    SSL_set_bio(d->ssl, d->rbio, d->wbio);
+    init_Block(&d->pending, 0);
+}
+
+void deinit_TlsFilter(iTlsFilter *d) {
+    SSL_free(d->ssl); /* frees the BIOs, too */
+    deinit_Block(&d->pending);
+}
+
+iDefineTypeConstructionArgs(TlsFilter, (const iTlsServerContext *context), context)
+
+iBool isHandshakeFinished_TlsFilter(const iTlsFilter *d) {
+    return SSL_is_init_finished(d->ssl) != 0;
+}
+
+static void drainOutput_TlsFilter_(iTlsFilter *d, iBlock *encrypted_out) {
+    char buf[DEFAULT_BUF_SIZE];
+    int n;
+    while ((n = BIO_read(d->wbio, buf, sizeof(buf))) > 0) {
+        appendData_Block(encrypted_out, buf, n);
+    }
+}
+
+static enum iTlsFilterResult result_TlsFilter_(const iTlsFilter *d, int code) {
+    switch (SSL_get_error(d->ssl, code)) {
+        case SSL_ERROR_NONE:
+        case SSL_ERROR_WANT_READ:
+        case SSL_ERROR_WANT_WRITE:
+            return ok_TlsFilterResult;
+        case SSL_ERROR_ZERO_RETURN:
+            return closed_TlsFilterResult;
+        default:
+            ERR_clear_error();
+            return failed_TlsFilterResult;
+    }
+}
+
+/* Encrypts as much of the plaintext as SSL_write accepts. It may need more input from
+   the peer first, so the number of bytes actually consumed is returned in `written_out`. */
+static enum iTlsFilterResult write_TlsFilter_(iTlsFilter *d, const char *src, size_t size,
+                                              iBlock *encrypted_out, size_t *written_out) {
+    enum iTlsFilterResult result = ok_TlsFilterResult;
+    size_t written = 0;
+    while (written < size) {
+        const int n = SSL_write(d->ssl, src + written, (int) iMin(size - written, INT_MAX));
+        if (n <= 0) {
+            result = result_TlsFilter_(d, n);
+            break;
+        }
+        written += n;
+    }
+    drainOutput_TlsFilter_(d, encrypted_out);
+    *written_out = written;
+    return result;
+}
+
+static enum iTlsFilterResult flushPending_TlsFilter_(iTlsFilter *d, iBlock *encrypted_out) {
+    size_t written;
+    const enum iTlsFilterResult result = write_TlsFilter_(
+        d, constBegin_Block(&d->pending), size_Block(&d->pending), encrypted_out, &written);
+    remove_Block(&d->pending, 0, written);
+    return result;
+}
+
+/**
+ * Processes encrypted bytes received from the peer.
+ *
+ * @param decrypted_out  Decrypted application data is appended here.
+ * @param encrypted_out  Bytes that must be sent to the peer (e.g., handshake messages)
+ *                       are appended here.
+ */
+enum iTlsFilterResult decrypt_TlsFilter(iTlsFilter *d, const void *data, size_t size,
+                                        iBlock *decrypted_out, iBlock *encrypted_out) {
+    enum iTlsFilterResult result = ok_TlsFilterResult;
+    const char *src = data;
+    while (size > 0 && result == ok_TlsFilterResult) {
+        const int n = BIO_write(d->rbio, src, (int) iMin(size, INT_MAX));
+        if (n <= 0) {
+            return failed_TlsFilterResult;
+        }
+        src += n;
+        size -= n;
+        if (!SSL_is_init_finished(d->ssl)) {
+            result = result_TlsFilter_(d, SSL_do_handshake(d->ssl));
+            drainOutput_TlsFilter_(d, encrypted_out);
+            if (!SSL_is_init_finished(d->ssl)) {
+                continue;
+            }
+        }
+        char buf[DEFAULT_BUF_SIZE];
+        int rd;
+        while ((rd = SSL_read(d->ssl, buf, sizeof(buf))) > 0) {
+            appendData_Block(decrypted_out, buf, rd);
+        }
+        result = result_TlsFilter_(d, rd);
+        drainOutput_TlsFilter_(d, encrypted_out); /* e.g., key updates */
+        if (result == ok_TlsFilterResult && !isEmpty_Block(&d->pending)) {
+            result = flushPending_TlsFilter_(d, encrypted_out);
+        }
+    }
+    return result;
+}
+
+/**
+ * Encrypts application data for sending to the peer. All of the data is accepted: if
+ * SSL_write cannot take it all right away (e.g., the peer must be heard from first),
+ * the remainder is kept and encrypted by a later call to decrypt_TlsFilter().
+ *
+ * @param encrypted_out  Bytes to send to the peer are appended here.
+ *
+ * @return @c iFalse if the connection has failed.
+ */
+iBool encrypt_TlsFilter(iTlsFilter *d, const void *data, size_t size, iBlock *encrypted_out) {
+    iAssert(isHandshakeFinished_TlsFilter(d));
+    if (!isEmpty_Block(&d->pending)) {
+        appendData_Block(&d->pending, data, size); /* must stay after the earlier leftovers */
+        return flushPending_TlsFilter_(d, encrypted_out) != failed_TlsFilterResult;
+    }
+    size_t written;
+    if (write_TlsFilter_(d, data, size, encrypted_out, &written) == failed_TlsFilterResult) {
+        return iFalse;
+    }
+    appendData_Block(&d->pending, (const char *) data + written, size - written);
+    return iTrue;
+}
+
+void shutdown_TlsFilter(iTlsFilter *d, iBlock *encrypted_out) {
+    if (isHandshakeFinished_TlsFilter(d)) {
+        SSL_shutdown(d->ssl); /* close_notify */
+        drainOutput_TlsFilter_(d, encrypted_out);
+    }
+}
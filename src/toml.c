@@ -27,181 +27,265 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
 
 #include "the_Foundation/toml.h"
 
+#include <stdlib.h>
+#include <string.h>
+
 struct Impl_TomlParser {
-    iTomlTableFunc    tableFunc;
-    iTomlKeyValueFunc keyValueFunc;
-    void *            context;
+    iTomlTableFunc          tableFunc;
+    iTomlKeyValueFunc       keyValueFunc;
+    iTomlTableRangeFunc     tableRangeFunc;
+    iTomlKeyValueRangeFunc  keyValueRangeFunc;
+    void *                  context;
+    /* Reused for the String handlers and unescaping, so their memory is allocated once. */
+    iString table;
+    iString key;
+    iString text;
 };
 
 iDefineTypeConstruction(TomlParser)
 
-static void trimComment_(iString *line) {
-    iBool isQuoted = iFalse;
-    iBool isEscape = iFalse;
-    iConstForEach(String, i, line) {
-        const iChar ch = i.value;
-        if (isQuoted) {
-            if (isEscape) {
-                isEscape = iFalse;
-            }
-            else if (ch == '\\') {
-                isEscape = iTrue;
+void init_TomlParser(iTomlParser *d) {
+    d->tableFunc = NULL;
+    d->keyValueFunc = NULL;
+    d->tableRangeFunc = NULL;
+    d->keyValueRangeFunc = NULL;
+    d->context = NULL;
+    init_String(&d->table);
+    init_String(&d->key);
+    init_String(&d->text);
+}
+
+void deinit_TomlParser(iTomlParser *d) {
+    deinit_String(&d->text);
+    deinit_String(&d->key);
+    deinit_String(&d->table);
+}
+
+void setHandlers_TomlParser(iTomlParser *d, iTomlTableFunc table, iTomlKeyValueFunc kv,
+                            void *context) {
+    d->tableFunc = table;
+    d->keyValueFunc = kv;
+    d->context = context;
+}
+
+void setRangeHandlers_TomlParser(iTomlParser *d, iTomlTableRangeFunc table,
+                                 iTomlKeyValueRangeFunc kv, void *context) {
+    d->tableRangeFunc = table;
+    d->keyValueRangeFunc = kv;
+    d->context = context;
+}
+
+iLocalDef iBool isSpace_Toml_(char ch) {
+    return ch == ' ' || ch == '\t' || ch == '\r';
+}
+
+static const char *skipSpace_Toml_(const char *pos, const char *end) {
+    while (pos < end && isSpace_Toml_(*pos)) pos++;
+    return pos;
+}
+
+static const char *trimEnd_Toml_(const char *start, const char *end) {
+    while (end > start && isSpace_Toml_(end[-1])) end--;
+    return end;
+}
+
+/* Finds the first `ch` that is not inside a quoted key or string. */
+static const char *findUnquoted_Toml_(const char *pos, const char *end, char ch) {
+    const char *found = memchr(pos, ch, end - pos);
+    if (!found) {
+        return end;
+    }
+    if (!memchr(pos, '"', found - pos) && !memchr(pos, '\'', found - pos)) {
+        return found; /* nothing quoted before it */
+    }
+    char quote = 0;
+    for (; pos < end; pos++) {
+        if (quote) {
+            if (*pos == '\\' && quote == '"') {
+                if (++pos == end) break;
             }
-            else if (ch == '"') {
-                isQuoted = iFalse;
+            else if (*pos == quote) {
+                quote = 0;
             }
         }
-        else {
-            if (ch == '"') {
-                isQuoted = iTrue;
-            }
-            else if (ch == '#') {
-                truncate_Block(&line->chars, i.pos - cstr_String(line));
-                trim_String(line);
-                return;
-            }
+        else if (*pos == '"' || *pos == '\'') {
+            quote = *pos;
+        }
+        else if (*pos == ch) {
+            return pos;
         }
     }
+    return end;
 }
 
-static iBool parseNumber_(iRangecc value, int base, iTomlValue *tv_out) {
-    iString str;
-    initRange_String(&str, value);
+static const char *findComment_Toml_(const char *pos, const char *end) {
+    return findUnquoted_Toml_(pos, end, '#');
+}
+
+/* Numbers are converted directly from the source: the character following the value
+   (whitespace, '#', newline, or the terminating NUL) always stops the conversion. */
+static iBool parseNumber_Toml_(iRangecc value, iTomlValue *tv_out) {
+    const iBool isHex = size_Range(&value) >= 3 && value.start[0] == '0' && value.start[1] == 'x';
     char *endp = NULL;
-    tv_out->value.int64 = strtoll(cstr_String(&str), &endp, base);
     tv_out->type = int64_TomlType;
-    iBool ok = !*endp;
-    if (!ok && (*endp == '.' || *endp == ',')) {
-        tv_out->value.float64 = strtod(cstr_String(&str), &endp);
-        if (!*endp) {
-            tv_out->type = float64_TomlType;
-            ok = iTrue;
-        }
+    tv_out->value.int64 = strtoll(value.start, &endp, isHex ? 16 : 10);
+    if (endp == value.end) {
+        return iTrue;
     }
-    deinit_String(&str);
-    return ok;
+    if (!isHex && endp < value.end && (*endp == '.' || *endp == 'e' || *endp == 'E')) {
+        tv_out->type = float64_TomlType;
+        tv_out->value.float64 = strtod(value.start, &endp);
+        return endp == value.end;
+    }
+    return iFalse;
 }
 
-void init_TomlParser(iTomlParser *d) {
-    d->tableFunc = NULL;
-    d->keyValueFunc = NULL;
-    d->context = NULL;
+static void notifyTable_TomlParser_(iTomlParser *d, iRangecc table, iBool isStart) {
+    if (isEmpty_Range(&table)) {
+        return;
+    }
+    if (d->tableRangeFunc) {
+        d->tableRangeFunc(d->context, table, isStart);
+    }
+    if (d->tableFunc) {
+        d->tableFunc(d->context, &d->table, isStart);
+    }
 }
 
-void deinit_TomlParser(iTomlParser *d) {
-    iUnused(d);
+static void notifyKeyValue_TomlParser_(iTomlParser *d, iRangecc table, iRangecc key,
+                                       iTomlValue *value, iRangecc text) {
+    if (d->keyValueRangeFunc) {
+        if (value->type == string_TomlType) {
+            value->value.range = text;
+        }
+        d->keyValueRangeFunc(d->context, table, key, value);
+    }
+    if (d->keyValueFunc) {
+        setRange_String(&d->key, key);
+        if (value->type == string_TomlType) {
+            if (text.start != constBegin_String(&d->text)) {
+                setRange_String(&d->text, text);
+            }
+            value->value.string = &d->text;
+        }
+        d->keyValueFunc(d->context, &d->table, &d->key, value);
+    }
 }
 
-void setHandlers_TomlParser(iTomlParser *d, iTomlTableFunc table, iTomlKeyValueFunc kv,
-                            void *context) {
-    d->tableFunc = table;
-    d->keyValueFunc = kv;
-    d->context = context;
+/* Parses a quoted string beginning at `pos`. Only strings with escape sequences need to be
+   copied; others are returned as a range of the source. */
+static const char *parseString_TomlParser_(iTomlParser *d, const char *pos, const char *end,
+                                           iRangecc *text_out) {
+    iBool isEscaped = iFalse;
+    const char *start = ++pos;
+    for (; pos < end; pos++) {
+        if (*pos == '\\') {
+            isEscaped = iTrue;
+            if (++pos == end) break;
+        }
+        else if (*pos == '"') {
+            break;
+        }
+    }
+    if (pos >= end) {
+        return NULL; /* not terminated */
+    }
+    *text_out = (iRangecc){ start, pos };
+    if (isEscaped) {
+        setRange_String(&d->text, *text_out);
+        iString *unquoted = unquote_String(&d->text);
+        set_String(&d->text, unquoted);
+        delete_String(unquoted);
+        *text_out = range_String(&d->text);
+    }
+    return pos + 1;
 }
 
-static void notifyTable_TomlParser_(const iTomlParser *d, const iString *table, iBool isStart) {
-    if (!isEmpty_String(table) && d->tableFunc) {
-        d->tableFunc(d->context, table, isStart);
-    }    
+static iBool parseKeyValue_TomlParser_(iTomlParser *d, iRangecc table, const char *pos,
+                                       const char *end) {
+    /* The key is followed by '='. */
+    const char *eql = findUnquoted_Toml_(pos, end, '=');
+    if (eql == end || findComment_Toml_(pos, eql) != eql) {
+        return iFalse;
+    }
+    const iRangecc key = { pos, trimEnd_Toml_(pos, eql) };
+    const char *valueStart = skipSpace_Toml_(eql + 1, end);
+    if (isEmpty_Range(&key) || valueStart == end) {
+        return iFalse;
+    }
+    iTomlValue tv;
+    iRangecc text = iNullRange;
+    if (*valueStart == '"') {
+        const char *rest = parseString_TomlParser_(d, valueStart, end, &text);
+        if (!rest) {
+            return iFalse;
+        }
+        rest = skipSpace_Toml_(rest, end);
+        if (rest != end && *rest != '#') {
+            return iFalse;
+        }
+        tv.type = string_TomlType;
+    }
+    else {
+        const iRangecc value = { valueStart,
+                                 trimEnd_Toml_(valueStart, findComment_Toml_(valueStart, end)) };
+        if (isEmpty_Range(&value)) {
+            return iFalse;
+        }
+        if (equal_Rangecc(value, "true") || equal_Rangecc(value, "false")) {
+            tv.type = boolean_TomlType;
+            tv.value.boolean = (*value.start == 't');
+        }
+        else if ((*value.start >= '0' && *value.start <= '9') || *value.start == '-' ||
+                 *value.start == '+') {
+            if (!parseNumber_Toml_(value, &tv)) {
+                return iFalse;
+            }
+        }
+        else {
+            return iFalse;
+        }
+    }
+    notifyKeyValue_TomlParser_(d, table, key, &tv, text);
+    return iTrue;
 }
 
 iBool parse_TomlParser(iTomlParser *d, const iString *toml) {
+    /* The source is scanned once, line by line, without copying anything. */
     iBool allOk = iTrue;
-    iString line;
-    iString table;
-    iString key;
-    init_String(&line);
-    init_String(&table);
-    init_String(&key);
-    iRangecc srcLine = iNullRange;
-    while (nextSplit_Rangecc(range_String(toml), "\n", &srcLine)) {
-        setRange_String(&line, srcLine);
-        trim_String(&line);
-        if (isEmpty_String(&line) || *cstr_String(&line) == '#') {
-            continue; /* skip empty/comment lines without futher ado */
-        }
-        trimComment_(&line);
-        iRangecc rgLine = range_String(&line);
-        if (startsWith_String(&line, "[") && endsWith_String(&line, "]")) {
-            notifyTable_TomlParser_(d, &table, iFalse);
-            setRange_String(&table, (iRangecc){ rgLine.start + 1, rgLine.end - 1 });
-            trim_String(&table);
-            notifyTable_TomlParser_(d, &table, iTrue);
-            continue;
-        }
-        const size_t eqlPos = indexOfCStr_String(&line, "=");
-        if (eqlPos == iInvalidPos) {
-            allOk = iFalse;
-            continue;
+    iRangecc table = iNullRange;
+    clear_String(&d->table);
+    const char *pos = constBegin_String(toml);
+    const char *end = constEnd_String(toml);
+    while (pos < end) {
+        const char *lineEnd = memchr(pos, '\n', end - pos);
+        if (!lineEnd) {
+            lineEnd = end;
         }
-        iRangecc rgKey = { rgLine.start, rgLine.start + eqlPos };
-        iRangecc rgValue = { rgLine.start + eqlPos + 1, rgLine.end };
-        trim_Rangecc(&rgKey);
-        trim_Rangecc(&rgValue);
-        if (isEmpty_Range(&rgKey) || isEmpty_Range(&rgValue)) {
-            allOk = iFalse;
-            continue;
-        }
-        setRange_String(&key, rgKey);        
-        /* String value. */
-        if (*rgValue.start == '"' && rgValue.end[-1] == '"') {
-            rgValue.start++;
-            rgValue.end--;
-            iString quot;
-            initRange_String(&quot, rgValue);
-            iString *value = unquote_String(&quot);
-            deinit_String(&quot);
-            if (d->keyValueFunc) {
-                d->keyValueFunc(
-                    d->context,
-                    &table,
-                    &key,
-                    &(iTomlValue){ .type = string_TomlType, .value = { .string = value } });
-            }
-            delete_String(value);
-        }
-        /* Boolean. */
-        else if (equal_Rangecc(rgValue, "true") || equal_Rangecc(rgValue, "false")) {
-            if (d->keyValueFunc) {
-                d->keyValueFunc(
-                    d->context,
-                    &table,
-                    &key,
-                    &(iTomlValue){ .type  = boolean_TomlType,
-                                   .value = { .boolean = equal_Rangecc(rgValue, "true") } });
-            }
+        pos = skipSpace_Toml_(pos, lineEnd);
+        if (pos == lineEnd || *pos == '#') {
+            /* Skip empty/comment lines without further ado. */
         }
-        /* Hexadecimal value. */
-        else if (size_Range(&rgValue) >= 3 && rgValue.start[0] == '0' && rgValue.start[1] == 'x') {
-            iTomlValue tv;
-            if (parseNumber_(rgValue, 16, &tv)) {
-                if (d->keyValueFunc) {
-                    d->keyValueFunc(d->context, &table, &key, &tv);
+        else if (*pos == '[') {
+            const char *close = trimEnd_Toml_(pos, findComment_Toml_(pos, lineEnd));
+            if (close[-1] == ']' && close - pos >= 2) {
+                notifyTable_TomlParser_(d, table, iFalse);
+                table.start = skipSpace_Toml_(pos + 1, close - 1);
+                table.end   = trimEnd_Toml_(table.start, close - 1);
+                if (d->tableFunc || d->keyValueFunc) {
+                    setRange_String(&d->table, table);
                 }
+                notifyTable_TomlParser_(d, table, iTrue);
             }
             else {
                 allOk = iFalse;
             }
         }
-        /* Decimal value. */
-        else if (isNumeric_Char(*rgValue.start) || *rgValue.start == '-' || *rgValue.start == '+') {
-            iTomlValue tv;
-            if (parseNumber_(rgValue, 10, &tv)) {
-                if (d->keyValueFunc) {
-                    d->keyValueFunc(d->context, &table, &key, &tv);
-                }
-            }
-            else {
-                allOk = iFalse;
-            }            
-        }
-        else {
+        else if (!parseKeyValue_TomlParser_(d, table, pos, lineEnd)) {
             allOk = iFalse;
         }
+        pos = lineEnd + 1;
     }
-    notifyTable_TomlParser_(d, &table, iFalse);
-    deinit_String(&key);
-    deinit_String(&table);
-    deinit_String(&line);
+    notifyTable_TomlParser_(d, table, iFalse);
     return allOk;
 }
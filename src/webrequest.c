@@ -29,26 +29,55 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
 #include "the_Foundation/stringarray.h"
 #include "the_Foundation/buffer.h"
 #include "the_Foundation/mutex.h"
+#include "the_Foundation/ptrarray.h"
+#include "the_Foundation/thread.h"
 
 #include <curl/curl.h>
 
 #define iWebRequestProgressMinSize 0x10000
 
+static const long defaultTimeoutMs_WebRequest_ = 10000;
+
 struct Impl_WebRequest {
     iObject object;
     iMutex mutex;
     CURL *curl;
+    iWebSession *session;
+    long timeoutMs;
     iBlock postData;
     iString postContentType;
+    struct curl_slist *httpHeaders;
     iBuffer *result;
     size_t receivedSize;
     size_t contentLength;
     size_t lastNotifySize;
+    enum iWebRequestStatus status;
+    char errorBuf[CURL_ERROR_SIZE];
     iString errorMessage;
     iStringArray *headers;
+    iCondition finishedCond;
     /* Audiences: */
     iAudience *progress;
     iAudience *readyRead;
+    iAudience *finished;
+};
+
+struct Impl_WebSession {
+    iObject object;
+    iMutex mutex;
+    CURLSH *share;
+    iMutex shareLocks[CURL_LOCK_DATA_LAST];
+    CURLM *multi;
+    iThread *thread;
+    iBool isThreadIdle;  /* thread has exited its loop and must be joined before reuse */
+    iPtrArray pending;   /* submitted but not yet added to the multi handle */
+    iPtrArray ongoing;   /* being performed by the multi handle */
+    iPtrArray cancelled;
+    size_t maxTotalConnections;
+    size_t maxHostConnections;
+    iBool optionsChanged;
+    iCondition idle;
+    iAudience *finished;
 };
 
 static size_t headerCallback_WebRequest_(char *ptr, size_t size, size_t nmemb, void *userdata) {
@@ -82,9 +111,14 @@ static size_t dataCallback_WebRequest_(char *ptr, size_t size, size_t nmemb, voi
     return len;
 }
 
-void configure_WebRequest_(iWebRequest *d) {
+static void configure_WebRequest_(iWebRequest *d) {
     curl_easy_setopt(d->curl, CURLOPT_FOLLOWLOCATION, 1L);
-    curl_easy_setopt(d->curl, CURLOPT_TIMEOUT, 10);
+    curl_easy_setopt(d->curl, CURLOPT_TIMEOUT_MS, d->timeoutMs);
+    curl_easy_setopt(d->curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(d->curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(d->curl, CURLOPT_ERRORBUFFER, d->errorBuf);
+    curl_easy_setopt(d->curl, CURLOPT_PRIVATE, d);
+    curl_easy_setopt(d->curl, CURLOPT_SHARE, d->session ? d->session->share : NULL);
     curl_easy_setopt(d->curl, CURLOPT_HEADERFUNCTION, headerCallback_WebRequest_);
     curl_easy_setopt(d->curl, CURLOPT_HEADERDATA, d);
     curl_easy_setopt(d->curl, CURLOPT_WRITEFUNCTION, dataCallback_WebRequest_);
@@ -95,20 +129,36 @@ void init_WebRequest(iWebRequest *d) {
     iAssertIsObject(d);
     init_Mutex(&d->mutex);
     d->curl = curl_easy_init();
+    d->session = NULL;
+    d->timeoutMs = defaultTimeoutMs_WebRequest_;
     init_Block(&d->postData, 0);
     init_String(&d->postContentType);
+    d->httpHeaders = NULL;
     d->result = new_Buffer();
     openEmpty_Buffer(d->result);
+    d->receivedSize = 0;
+    d->contentLength = 0;
+    d->lastNotifySize = 0;
+    d->status = initialized_WebRequestStatus;
+    d->errorBuf[0] = 0;
     init_String(&d->errorMessage);
     d->headers = new_StringArray();
+    init_Condition(&d->finishedCond);
     d->progress = NULL;
     d->readyRead = NULL;
+    d->finished = NULL;
     configure_WebRequest_(d);
 }
 
 void deinit_WebRequest(iWebRequest *d) {
+    iAssert(d->status != submitted_WebRequestStatus);
     curl_easy_cleanup(d->curl);
+    curl_slist_free_all(d->httpHeaders);
+    iRelease(d->session);
+    delete_Audience(d->finished);
+    delete_Audience(d->readyRead);
     delete_Audience(d->progress);
+    deinit_Condition(&d->finishedCond);
     iRelease(d->headers);
     deinit_String(&d->errorMessage);
     iRelease(d->result);
@@ -121,6 +171,7 @@ void clear_WebRequest(iWebRequest *d) {
     curl_easy_reset(d->curl);
     configure_WebRequest_(d);
     clear_Block(&d->postData);
+    clear_String(&d->postContentType);
     clear_Buffer(d->result);
     clear_String(&d->errorMessage);
     clear_StringArray(d->headers);
@@ -139,35 +190,96 @@ void setPostData_WebRequest(iWebRequest *d, const char *contentType, const iBloc
     format_String(&d->postContentType, "Content-Type: %s", contentType);
 }
 
-static iBool execute_WebRequest_(iWebRequest *d) {
-    char errorMsg[CURL_ERROR_SIZE];
-    d->contentLength = 0;
-    d->receivedSize = 0;
-    d->lastNotifySize = 0;
-    clear_String(&d->errorMessage);
-    clear_Buffer(d->result);
-    clear_StringArray(d->headers);
-    curl_easy_setopt(d->curl, CURLOPT_ERRORBUFFER, errorMsg);
-    const iBool ok = (curl_easy_perform(d->curl) == CURLE_OK);
+void setTimeout_WebRequest(iWebRequest *d, double seconds) {
+    d->timeoutMs = (long) (iMax(0.0, seconds) * 1000.0);
+    curl_easy_setopt(d->curl, CURLOPT_TIMEOUT_MS, d->timeoutMs);
+}
+
+void setSession_WebRequest(iWebRequest *d, iWebSession *session) {
+    iAssert(d->status != submitted_WebRequestStatus);
+    if (d->session != session) {
+        iChangeRef(d->session, session);
+        curl_easy_setopt(d->curl, CURLOPT_SHARE, session ? session->share : NULL);
+    }
+}
+
+static iBool isPost_WebRequest_(const iWebRequest *d) {
+    return !isEmpty_String(&d->postContentType);
+}
+
+static iBool prepare_WebRequest_(iWebRequest *d, iBool isPost) {
+    iBool ok = iTrue;
+    iGuardMutex(&d->mutex, {
+        if (d->status == submitted_WebRequestStatus) {
+            iWarning("[WebRequest] request already ongoing\n");
+            ok = iFalse;
+        }
+        else {
+            d->status = submitted_WebRequestStatus;
+            d->contentLength = 0;
+            d->receivedSize = 0;
+            d->lastNotifySize = 0;
+            d->errorBuf[0] = 0;
+            clear_String(&d->errorMessage);
+            clear_Buffer(d->result);
+            clear_StringArray(d->headers);
+        }
+    });
     if (!ok) {
-        setCStr_String(&d->errorMessage, errorMsg);
-        iWarning("[WebRequest] %s\n", errorMsg);
+        return iFalse;
+    }
+    curl_slist_free_all(d->httpHeaders);
+    d->httpHeaders = NULL;
+    if (isPost) {
+        d->httpHeaders = curl_slist_append(NULL, cstr_String(&d->postContentType));
+        curl_easy_setopt(d->curl, CURLOPT_HTTPHEADER, d->httpHeaders);
+        curl_easy_setopt(d->curl, CURLOPT_POSTFIELDS, data_Block(&d->postData));
+        curl_easy_setopt(d->curl, CURLOPT_POSTFIELDSIZE, (long) size_Block(&d->postData));
     }
-    return ok;
+    else {
+        curl_easy_setopt(d->curl, CURLOPT_HTTPHEADER, NULL);
+        curl_easy_setopt(d->curl, CURLOPT_HTTPGET, 1L);
+    }
+    return iTrue;
+}
+
+static void finish_WebRequest_(iWebRequest *d, CURLcode code) {
+    const iBool ok = (code == CURLE_OK);
+    iGuardMutex(&d->mutex, {
+        if (!ok) {
+            setCStr_String(&d->errorMessage,
+                           d->errorBuf[0] ? d->errorBuf : curl_easy_strerror(code));
+            iWarning("[WebRequest] %s\n", cstr_String(&d->errorMessage));
+        }
+        d->status = ok ? finished_WebRequestStatus : error_WebRequestStatus;
+        signalAll_Condition(&d->finishedCond);
+    });
+    iNotifyAudience(d, finished, WebRequestFinished);
+}
+
+static iBool execute_WebRequest_(iWebRequest *d, iBool isPost) {
+    if (!prepare_WebRequest_(d, isPost)) {
+        return iFalse;
+    }
+    const CURLcode code = curl_easy_perform(d->curl);
+    finish_WebRequest_(d, code);
+    return code == CURLE_OK;
 }
 
 iBool get_WebRequest(iWebRequest *d) {
-    return execute_WebRequest_(d);
+    return execute_WebRequest_(d, iFalse);
 }
 
 iBool post_WebRequest(iWebRequest *d) {
-    struct curl_slist *headers = curl_slist_append(NULL, cstr_String(&d->postContentType));
-    curl_easy_setopt(d->curl, CURLOPT_HTTPHEADER, headers);
-    curl_easy_setopt(d->curl, CURLOPT_POSTFIELDS, data_Block(&d->postData));
-    curl_easy_setopt(d->curl, CURLOPT_POSTFIELDSIZE, size_Block(&d->postData));
-    const iBool ok = execute_WebRequest_(d);
-    curl_slist_free_all(headers);
-    return ok;
+    return execute_WebRequest_(d, iTrue);
+}
+
+void waitForFinished_WebRequest(iWebRequest *d) {
+    iGuardMutex(&d->mutex, {
+        while (d->status == submitted_WebRequestStatus) {
+            wait_Condition(&d->finishedCond, &d->mutex);
+        }
+    });
 }
 
 const iBlock *result_WebRequest(const iWebRequest *d) {
@@ -186,6 +298,16 @@ const iString *errorMessage_WebRequest(const iWebRequest *d) {
     return &d->errorMessage;
 }
 
+enum iWebRequestStatus status_WebRequest(const iWebRequest *d) {
+    enum iWebRequestStatus status;
+    iGuardMutex(&d->mutex, status = d->status);
+    return status;
+}
+
+iWebSession *session_WebRequest(const iWebRequest *d) {
+    return d->session;
+}
+
 iBool headerValue_WebRequest(const iWebRequest *d, const char *header, iString *value_out) {
     iBool found = iFalse;
     iConstForEach(StringArray, i, d->headers) {
@@ -212,3 +334,258 @@ iDefineClass(WebRequest)
 iDefineObjectConstruction(WebRequest)
 iDefineAudienceGetter(WebRequest, progress)
 iDefineAudienceGetter(WebRequest, readyRead)
+iDefineAudienceGetter(WebRequest, finished)
+
+/*----------------------------------------------------------------------------------------------*/
+
+static void lockShare_WebSession_(CURL *handle, curl_lock_data data, curl_lock_access access,
+                                  void *userptr) {
+    iUnused(handle, access);
+    iWebSession *d = userptr;
+    lock_Mutex(&d->shareLocks[data]);
+}
+
+static void unlockShare_WebSession_(CURL *handle, curl_lock_data data, void *userptr) {
+    iUnused(handle);
+    iWebSession *d = userptr;
+    unlock_Mutex(&d->shareLocks[data]);
+}
+
+static void wakeUp_WebSession_(iWebSession *d) {
+#if LIBCURL_VERSION_NUM >= 0x074400 /* 7.68.0 */
+    curl_multi_wakeup(d->multi);
+#else
+    iUnused(d); /* the thread polls with a short timeout */
+#endif
+}
+
+static void applyOptions_WebSession_(iWebSession *d) {
+    curl_multi_setopt(d->multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, (long) d->maxTotalConnections);
+    curl_multi_setopt(d->multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long) d->maxHostConnections);
+    d->optionsChanged = iFalse;
+}
+
+static void poll_WebSession_(iWebSession *d, int timeoutMs) {
+#if LIBCURL_VERSION_NUM >= 0x074200 /* 7.66.0 */
+    curl_multi_poll(d->multi, NULL, 0, timeoutMs, NULL);
+#else
+    curl_multi_wait(d->multi, NULL, 0, iMin(timeoutMs, 100), NULL);
+#endif
+}
+
+static void signalIfIdle_WebSession_(iWebSession *d) {
+    /* Note: Called with the mutex locked. */
+    if (isEmpty_PtrArray(&d->pending) && isEmpty_PtrArray(&d->ongoing)) {
+        signalAll_Condition(&d->idle);
+    }
+}
+
+static void completed_WebSession_(iWebSession *d, iWebRequest *req, CURLcode code) {
+    /* Note: Called in the session thread. */
+    curl_multi_remove_handle(d->multi, req->curl);
+    finish_WebRequest_(req, code);
+    iNotifyAudienceArgs(d, finished, WebSessionFinished, req);
+    iGuardMutex(&d->mutex, {
+        removeOne_PtrArray(&d->ongoing, req);
+        removeOne_PtrArray(&d->cancelled, req);
+        signalIfIdle_WebSession_(d);
+    });
+    iRelease(req);
+}
+
+static iThreadResult run_WebSession_(iThread *thread) {
+    iWebSession *d = userData_Thread(thread);
+    iBool lingering = iFalse;
+    for (;;) {
+        iPtrArray cancelled;
+        init_PtrArray(&cancelled);
+        /* Take new requests into use. */
+        lock_Mutex(&d->mutex);
+        if (d->optionsChanged) {
+            applyOptions_WebSession_(d);
+        }
+        iForEach(PtrArray, i, &d->pending) {
+            iWebRequest *req = i.ptr;
+            curl_multi_add_handle(d->multi, req->curl);
+            pushBack_PtrArray(&d->ongoing, req);
+        }
+        clear_PtrArray(&d->pending);
+        setCopy_PtrArray(&cancelled, &d->cancelled);
+        clear_PtrArray(&d->cancelled);
+        if (isEmpty_PtrArray(&d->ongoing)) {
+            signalAll_Condition(&d->idle);
+            if (lingering) {
+                /* Nothing more to do, so the thread can exit. A new one gets started when
+                   needed; the connection cache remains in the multi handle. */
+                d->isThreadIdle = iTrue;
+                unlock_Mutex(&d->mutex);
+                deinit_PtrArray(&cancelled);
+                break;
+            }
+            lingering = iTrue;
+        }
+        else {
+            lingering = iFalse;
+        }
+        unlock_Mutex(&d->mutex);
+        iConstForEach(PtrArray, c, &cancelled) {
+            completed_WebSession_(d, c.ptr, CURLE_ABORTED_BY_CALLBACK);
+        }
+        deinit_PtrArray(&cancelled);
+        /* Transfer data. */
+        int running = 0;
+        curl_multi_perform(d->multi, &running);
+        CURLMsg *msg;
+        int msgsLeft = 0;
+        while ((msg = curl_multi_info_read(d->multi, &msgsLeft)) != NULL) {
+            if (msg->msg == CURLMSG_DONE) {
+                iWebRequest *req = NULL;
+                curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **) &req);
+                iAssert(req);
+                completed_WebSession_(d, req, msg->data.result);
+            }
+        }
+        poll_WebSession_(d, lingering ? 1000 : 250);
+    }
+    /* The thread's reference to the session. */
+    iRelease(d);
+    return 0;
+}
+
+void init_WebSession(iWebSession *d) {
+    init_Mutex(&d->mutex);
+    for (size_t i = 0; i < iElemCount(d->shareLocks); i++) {
+        init_Mutex(&d->shareLocks[i]);
+    }
+    d->share = curl_share_init();
+    curl_share_setopt(d->share, CURLSHOPT_LOCKFUNC, lockShare_WebSession_);
+    curl_share_setopt(d->share, CURLSHOPT_UNLOCKFUNC, unlockShare_WebSession_);
+    curl_share_setopt(d->share, CURLSHOPT_USERDATA, d);
+    curl_share_setopt(d->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(d->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+#if LIBCURL_VERSION_NUM >= 0x073900 /* 7.57.0 */
+    curl_share_setopt(d->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
+    d->multi = curl_multi_init();
+    d->thread = NULL;
+    d->isThreadIdle = iFalse;
+    init_PtrArray(&d->pending);
+    init_PtrArray(&d->ongoing);
+    init_PtrArray(&d->cancelled);
+    d->maxTotalConnections = 0; /* unlimited */
+    d->maxHostConnections = 6;
+    applyOptions_WebSession_(d);
+    init_Condition(&d->idle);
+    d->finished = NULL;
+}
+
+void deinit_WebSession(iWebSession *d) {
+    /* The session thread and all joined requests hold a reference to the session. */
+    if (d->thread) {
+        iAssert(d->isThreadIdle);
+        if (isCurrent_Thread(d->thread)) {
+            /* The exiting session thread released the last reference. */
+            thrd_detach(thrd_current());
+        }
+        else {
+            join_Thread(d->thread);
+        }
+        iReleasePtr(&d->thread);
+    }
+    iAssert(isEmpty_PtrArray(&d->pending));
+    iAssert(isEmpty_PtrArray(&d->ongoing));
+    delete_Audience(d->finished);
+    deinit_Condition(&d->idle);
+    deinit_PtrArray(&d->cancelled);
+    deinit_PtrArray(&d->ongoing);
+    deinit_PtrArray(&d->pending);
+    curl_multi_cleanup(d->multi);
+    curl_share_cleanup(d->share);
+    for (size_t i = 0; i < iElemCount(d->shareLocks); i++) {
+        deinit_Mutex(&d->shareLocks[i]);
+    }
+    deinit_Mutex(&d->mutex);
+}
+
+void setMaxConnections_WebSession(iWebSession *d, size_t maxTotal, size_t maxPerHost) {
+    iGuardMutex(&d->mutex, {
+        d->maxTotalConnections = maxTotal;
+        d->maxHostConnections = maxPerHost;
+        if (d->thread && !d->isThreadIdle) {
+            d->optionsChanged = iTrue;
+            wakeUp_WebSession_(d);
+        }
+        else {
+            applyOptions_WebSession_(d);
+        }
+    });
+}
+
+iBool submit_WebSession(iWebSession *d, iWebRequest *request) {
+    setSession_WebRequest(request, d);
+    if (!prepare_WebRequest_(request, isPost_WebRequest_(request))) {
+        return iFalse;
+    }
+    iGuardMutex(&d->mutex, {
+        pushBack_PtrArray(&d->pending, ref_Object(request));
+        if (d->thread && d->isThreadIdle) {
+            /* The previous thread is exiting without touching the session any more. */
+            join_Thread(d->thread);
+            iReleasePtr(&d->thread);
+            d->isThreadIdle = iFalse;
+        }
+        if (!d->thread) {
+            d->thread = new_Thread(run_WebSession_);
+            setName_Thread(d->thread, "WebSession");
+            setUserData_Thread(d->thread, ref_Object(d));
+            start_Thread(d->thread);
+        }
+        else {
+            wakeUp_WebSession_(d);
+        }
+    });
+    return iTrue;
+}
+
+void cancel_WebSession(iWebSession *d, iWebRequest *request) {
+    iBool wasPending = iFalse;
+    iBool inSessionThread = iFalse;
+    iGuardMutex(&d->mutex, {
+        inSessionThread = (d->thread && isCurrent_Thread(d->thread));
+        if (removeOne_PtrArray(&d->pending, request)) {
+            wasPending = iTrue;
+            signalIfIdle_WebSession_(d);
+        }
+        else if (indexOf_PtrArray(&d->ongoing, request) != iInvalidPos &&
+                 indexOf_PtrArray(&d->cancelled, request) == iInvalidPos) {
+            pushBack_PtrArray(&d->cancelled, request);
+            wakeUp_WebSession_(d);
+        }
+    });
+    if (wasPending) {
+        finish_WebRequest_(request, CURLE_ABORTED_BY_CALLBACK);
+        iNotifyAudienceArgs(d, finished, WebSessionFinished, request);
+        iRelease(request);
+    }
+    else if (!inSessionThread) {
+        waitForFinished_WebRequest(request);
+    }
+}
+
+void waitForIdle_WebSession(iWebSession *d) {
+    iGuardMutex(&d->mutex, {
+        while (!isEmpty_PtrArray(&d->pending) || !isEmpty_PtrArray(&d->ongoing)) {
+            wait_Condition(&d->idle, &d->mutex);
+        }
+    });
+}
+
+size_t numOngoing_WebSession(const iWebSession *d) {
+    size_t num;
+    iGuardMutex(&d->mutex, num = size_PtrArray(&d->pending) + size_PtrArray(&d->ongoing));
+    return num;
+}
+
+iDefineClass(WebSession)
+iDefineObjectConstruction(WebSession)
+iDefineAudienceGetter(WebSession, finished)
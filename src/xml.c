@@ -26,6 +26,54 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
 */
 
 #include "the_Foundation/xml.h"
+#include "the_Foundation/cpu.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined (iHaveCpuDispatch) && defined (__GNUC__)
+#   include <immintrin.h>
+#   define iXmlHaveSimdScan
+#endif
+
+/* Bump allocator for the elements and attributes of a document. Nothing is freed
+   individually; all chunks are released together. */
+
+struct Impl_XmlArena {
+    iXmlArena *prev;
+    size_t size;
+    size_t used;
+    max_align_t data[]; /* followed by the chunk's memory */
+};
+
+#define iXmlArenaMinChunkSize   0x4000
+
+static void *alloc_XmlArena_(iXmlArena **d, size_t size) {
+    size = (size + sizeof(max_align_t) - 1) & ~(sizeof(max_align_t) - 1);
+    iXmlArena *chunk = *d;
+    if (!chunk || chunk->used + size > chunk->size) {
+        /* Chunks grow with the document, so there are only a few of them. */
+        const size_t chunkSize = iMax(size, iMax(iXmlArenaMinChunkSize, chunk ? chunk->size * 2 : 0));
+        chunk = malloc(sizeof(iXmlArena) + chunkSize);
+        chunk->prev = *d;
+        chunk->size = chunkSize;
+        chunk->used = 0;
+        *d = chunk;
+    }
+    void *ptr = (char *) chunk->data + chunk->used;
+    chunk->used += size;
+    return ptr;
+}
+
+static void free_XmlArena_(iXmlArena **d) {
+    while (*d) {
+        iXmlArena *prev = (*d)->prev;
+        free(*d);
+        *d = prev;
+    }
+}
+
+/*----------------------------------------------------------------------------------------------*/
 
 iDeclareType(XmlParser)
 
@@ -60,6 +108,7 @@ static const char *tokenTypeStr_[] = {
 
 struct Impl_XmlParser {
     iXmlDocument *doc;
+    iArray attribs; /* attributes of the current tag */
     const iString *src;
     iRangecc token;
     iBool inTag;
@@ -69,6 +118,7 @@ struct Impl_XmlParser {
 
 static void init_XmlParser_(iXmlParser *d, iXmlDocument *doc, const iString *source) {
     d->doc = doc;
+    init_Array(&d->attribs, sizeof(iXmlAttribute));
     d->src = source;
     d->token = iNullRange;
     d->inTag = iFalse;
@@ -230,6 +280,15 @@ static iBool expect_XmlParser_(iXmlParser *d, enum iXmlToken type) {
     return iTrue;
 }
 
+static void deinit_XmlParser_(iXmlParser *d) {
+    deinit_Array(&d->attribs);
+}
+
+static void init_XmlElement_(iXmlElement *d, const iXmlDocument *doc) {
+    iZap(*d);
+    d->doc = doc;
+}
+
 static iBool parseTree_XmlParser_(iXmlParser *d, iXmlElement *elem) {
     /* Iterator is assumed to be at the opening token of the element. */
     if (!expect_XmlParser_(d, open_XmlToken)) return iFalse;
@@ -239,6 +298,7 @@ static iBool parseTree_XmlParser_(iXmlParser *d, iXmlElement *elem) {
     elem->name = d->token;
     nextToken_XmlParser_(d);
     /* Parse the attributes. */
+    clear_Array(&d->attribs);
     while (d->tokenType != close_XmlToken && d->tokenType != closeSlash_XmlToken) {
         if (d->tokenType != name_XmlToken) {
             return iFalse;
@@ -247,11 +307,18 @@ static iBool parseTree_XmlParser_(iXmlParser *d, iXmlElement *elem) {
         nextToken_XmlParser_(d);
         if (!expect_XmlParser_(d, assignment_XmlToken)) return iFalse;
         attr.value = d->token;
-        pushBack_Array(&elem->attribs, &attr);
+        pushBack_Array(&d->attribs, &attr);
         //printf("%s.%s = %s\n", cstr_Rangecc(elem->name), cstr_Rangecc(attr.name),
         //       cstr_Rangecc(attr.value)); fflush(stdout);
         nextToken_XmlParser_(d);
     }
+    if (!isEmpty_Array(&d->attribs)) {
+        const size_t size = sizeof(iXmlAttribute) * size_Array(&d->attribs);
+        iXmlAttribute *attribs = alloc_XmlArena_(&d->doc->arena, size);
+        memcpy(attribs, constData_Array(&d->attribs), size);
+        elem->attribs    = attribs;
+        elem->numAttribs = size_Array(&d->attribs);
+    }
     if (d->tokenType == closeSlash_XmlToken) {
         nextToken_XmlParser_(d);
         return iTrue; /* no children */
@@ -260,14 +327,16 @@ static iBool parseTree_XmlParser_(iXmlParser *d, iXmlElement *elem) {
     elem->content.start = elem->content.end = d->token.end;
     /* Parse all child elements. */
     nextToken_XmlParser_(d);
+    const iXmlElement **nextChild = &elem->firstChild;
     while (d->tokenType != none_XmlToken) {
         if (d->tokenType == open_XmlToken) {
-            iXmlElement *child = new_XmlElement();
+            iXmlElement *child = alloc_XmlArena_(&d->doc->arena, sizeof(iXmlElement));
+            init_XmlElement_(child, d->doc);
             if (!parseTree_XmlParser_(d, child)) {
-                delete_XmlElement(child);
                 return iFalse;
             }
-            pushBack_PtrArray(&elem->children, child);
+            *nextChild = child;
+            nextChild = &child->nextSibling;
         }
         else if (d->tokenType == openSlash_XmlToken) {
             elem->content.end = d->token.start;
@@ -289,27 +358,224 @@ static iBool parseTree_XmlParser_(iXmlParser *d, iXmlElement *elem) {
 
 /*----------------------------------------------------------------------------------------------*/
 
+/* The index has two open addressing tables, both allocated from the document's arena.
+   Names are interned so that each distinct name gets a slot number, and (element, name)
+   pairs then map to the first child or attribute with that name. */
+
+iDeclareType(XmlIndexName)
+iDeclareType(XmlIndexEntry)
+
+struct Impl_XmlIndexName {
+    iRangecc name; /* null if the slot is unused */
+    uint32_t hash;
+};
+
+struct Impl_XmlIndexEntry {
+    const iXmlElement *owner; /* NULL if the slot is unused */
+    size_t key;               /* interned name; lowest bit set for attributes */
+    const void *target;
+};
+
+struct Impl_XmlIndex {
+    iXmlArena **arena;
+    iXmlIndexName *names;
+    size_t nameMask;
+    size_t numNames;
+    iXmlIndexEntry *entries;
+    size_t entryMask;
+};
+
+static uint32_t hashName_Xml_(const char *pos, const char *end) {
+    uint32_t hash = 2166136261u; /* FNV-1a */
+    for (; pos != end; pos++) {
+        hash = (hash ^ (uint8_t) *pos) * 16777619u;
+    }
+    return hash;
+}
+
+iLocalDef size_t hashEntry_Xml_(const iXmlElement *owner, size_t key) {
+    const uint64_t x = ((uint64_t) (uintptr_t) owner ^ (key * 0x9e3779b97f4a7c15ull)) *
+                       0xff51afd7ed558ccdull;
+    return (size_t) (x ^ (x >> 32));
+}
+
+static iXmlIndexName *allocNames_XmlIndex_(iXmlIndex *d, size_t capacity) {
+    iXmlIndexName *names = alloc_XmlArena_(d->arena, sizeof(iXmlIndexName) * capacity);
+    memset(names, 0, sizeof(iXmlIndexName) * capacity);
+    return names;
+}
+
+static void growNames_XmlIndex_(iXmlIndex *d) {
+    /* Interned names are slot numbers, so this must happen before any entries exist. */
+    const iXmlIndexName *old = d->names;
+    const size_t oldCapacity = d->nameMask + 1;
+    d->names = allocNames_XmlIndex_(d, oldCapacity * 2);
+    d->nameMask = oldCapacity * 2 - 1;
+    for (size_t i = 0; i < oldCapacity; i++) {
+        if (old[i].name.start) {
+            size_t pos = old[i].hash & d->nameMask;
+            while (d->names[pos].name.start) {
+                pos = (pos + 1) & d->nameMask;
+            }
+            d->names[pos] = old[i];
+        }
+    }
+}
+
+static size_t intern_XmlIndex_(iXmlIndex *d, iRangecc name) {
+    const uint32_t hash = hashName_Xml_(name.start, name.end);
+    for (size_t i = hash & d->nameMask; ; i = (i + 1) & d->nameMask) {
+        iXmlIndexName *slot = &d->names[i];
+        if (!slot->name.start) {
+            if ((d->numNames + 1) * 2 > d->nameMask + 1) {
+                growNames_XmlIndex_(d);
+                return intern_XmlIndex_(d, name);
+            }
+            slot->name = name;
+            slot->hash = hash;
+            d->numNames++;
+            return i;
+        }
+        if (slot->hash == hash && equalRange_Rangecc(slot->name, name)) {
+            return i;
+        }
+    }
+}
+
+static size_t find_XmlIndex_(const iXmlIndex *d, const char *name) {
+    const char *end = name + strlen(name);
+    const uint32_t hash = hashName_Xml_(name, end);
+    for (size_t i = hash & d->nameMask; ; i = (i + 1) & d->nameMask) {
+        const iXmlIndexName *slot = &d->names[i];
+        if (!slot->name.start) {
+            return iInvalidPos;
+        }
+        if (slot->hash == hash && equalRange_Rangecc(slot->name, (iRangecc){ name, end })) {
+            return i;
+        }
+    }
+}
+
+static void insert_XmlIndex_(iXmlIndex *d, const iXmlElement *owner, size_t key,
+                             const void *target) {
+    for (size_t i = hashEntry_Xml_(owner, key) & d->entryMask; ; i = (i + 1) & d->entryMask) {
+        iXmlIndexEntry *slot = &d->entries[i];
+        if (!slot->owner) {
+            *slot = (iXmlIndexEntry){ owner, key, target };
+            return;
+        }
+        if (slot->owner == owner && slot->key == key) {
+            return; /* the first one with the name is found, as when scanning */
+        }
+    }
+}
+
+static const void *lookup_XmlIndex_(const iXmlIndex *d, const iXmlElement *owner,
+                                    const char *name, size_t kind) {
+    const size_t id = find_XmlIndex_(d, name);
+    if (id == iInvalidPos) {
+        return NULL;
+    }
+    const size_t key = id * 2 + kind;
+    for (size_t i = hashEntry_Xml_(owner, key) & d->entryMask; ; i = (i + 1) & d->entryMask) {
+        const iXmlIndexEntry *slot = &d->entries[i];
+        if (!slot->owner) {
+            return NULL;
+        }
+        if (slot->owner == owner && slot->key == key) {
+            return slot->target;
+        }
+    }
+}
+
+static const iXmlElement *lookupChild_XmlIndex_(const iXmlIndex *d, const iXmlElement *owner,
+                                                const char *name) {
+    return lookup_XmlIndex_(d, owner, name, 0);
+}
+
+static const iXmlAttribute *lookupAttribute_XmlIndex_(const iXmlIndex *d,
+                                                      const iXmlElement *owner,
+                                                      const char *name) {
+    return lookup_XmlIndex_(d, owner, name, 1);
+}
+
+static size_t addNames_XmlIndex_(iXmlIndex *d, const iXmlElement *elem) {
+    size_t count = 1 + elem->numAttribs;
+    for (size_t i = 0; i < elem->numAttribs; i++) {
+        intern_XmlIndex_(d, elem->attribs[i].name);
+    }
+    intern_XmlIndex_(d, elem->name);
+    for (const iXmlElement *child = elem->firstChild; child; child = child->nextSibling) {
+        count += addNames_XmlIndex_(d, child);
+    }
+    return count;
+}
+
+static void addEntries_XmlIndex_(iXmlIndex *d, const iXmlElement *elem) {
+    for (size_t i = 0; i < elem->numAttribs; i++) {
+        const iXmlAttribute *attr = &elem->attribs[i];
+        insert_XmlIndex_(d, elem, intern_XmlIndex_(d, attr->name) * 2 + 1, attr);
+    }
+    for (const iXmlElement *child = elem->firstChild; child; child = child->nextSibling) {
+        insert_XmlIndex_(d, elem, intern_XmlIndex_(d, child->name) * 2, child);
+        addEntries_XmlIndex_(d, child);
+    }
+}
+
+void buildIndex_XmlDocument(iXmlDocument *d) {
+    if (d->index) {
+        return;
+    }
+    iXmlIndex *index = alloc_XmlArena_(&d->arena, sizeof(iXmlIndex));
+    index->arena    = &d->arena;
+    index->numNames = 0;
+    index->nameMask = 63;
+    index->names    = allocNames_XmlIndex_(index, index->nameMask + 1);
+    /* Each child and attribute needs one entry. */
+    const size_t count = addNames_XmlIndex_(index, &d->root);
+    size_t capacity = 16;
+    while (capacity < 2 * count) {
+        capacity *= 2;
+    }
+    index->entries   = alloc_XmlArena_(&d->arena, sizeof(iXmlIndexEntry) * capacity);
+    index->entryMask = capacity - 1;
+    memset(index->entries, 0, sizeof(iXmlIndexEntry) * capacity);
+    addEntries_XmlIndex_(index, &d->root);
+    d->index = index;
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
 iDefineTypeConstruction(XmlElement)
 iDefineTypeConstruction(XmlDocument)
 
 void init_XmlElement(iXmlElement *d) {
-    d->name    = iNullRange;
-    d->content = iNullRange;
-    init_Array(&d->attribs, sizeof(iXmlAttribute));
-    init_PtrArray(&d->children);
+    init_XmlElement_(d, NULL);
 }
 
 void deinit_XmlElement(iXmlElement *d) {
-    deinit_Array(&d->attribs);
-    iForEach(PtrArray, i, &d->children) {
-        delete_XmlElement(i.ptr);
+    iUnused(d); /* the document owns everything */
+}
+
+iPtrArray *children_XmlElement(const iXmlElement *d) {
+    iPtrArray *children = new_PtrArray();
+    for (const iXmlElement *child = d->firstChild; child; child = child->nextSibling) {
+        pushBack_PtrArray(children, child);
     }
-    deinit_PtrArray(&d->children);
+    return children;
+}
+
+iArray *attributes_XmlElement(const iXmlElement *d) {
+    iArray *attribs = new_Array(sizeof(iXmlAttribute));
+    pushBackN_Array(attribs, d->attribs, d->numAttribs);
+    return attribs;
 }
 
 const iXmlElement *child_XmlElement(const iXmlElement *d, const char *name) {
-    iConstForEach(PtrArray, i, &d->children) {
-        const iXmlElement *child = i.ptr;
+    if (d->firstChild && d->doc->index) {
+        return lookupChild_XmlIndex_(d->doc->index, d, name);
+    }
+    for (const iXmlElement *child = d->firstChild; child; child = child->nextSibling) {
         if (equal_Rangecc(child->name, name)) {
             return child;
         }
@@ -318,21 +584,23 @@ const iXmlElement *child_XmlElement(const iXmlElement *d, const char *name) {
 }
 
 iRangecc attribute_XmlElement(const iXmlElement *d, const char *name) {
-    iConstForEach(Array, i, &d->attribs) {
-        const iXmlAttribute *attr = i.value;
-        if (equal_Rangecc(attr->name, name)) {
-            return attr->value;
+    if (d->numAttribs && d->doc->index) {
+        const iXmlAttribute *attr = lookupAttribute_XmlIndex_(d->doc->index, d, name);
+        return attr ? attr->value : iNullRange;
+    }
+    for (size_t i = 0; i < d->numAttribs; i++) {
+        if (equal_Rangecc(d->attribs[i].name, name)) {
+            return d->attribs[i].value;
         }
     }
     return iNullRange;
 }
 
-iString *decodedContent_XmlElement(const iXmlElement *d) {
+static iString *decode_Xml_(iRangecc text) {
     iString *str = new_String();
-    if (!d) return str;
     iBool isCData = iFalse;
     iBool wasSpace = iFalse;
-    for (const char *pos = d->content.start; pos < d->content.end; ) {
+    for (const char *pos = text.start; pos < text.end; ) {
         if (!isCData && *pos == '&') {
             if (!iCmpStrN(pos, "&quot;", 6)) {
                 appendChar_String(str, '"');
@@ -385,7 +653,7 @@ iString *decodedContent_XmlElement(const iXmlElement *d) {
         }
         else if (!isCData && !iCmpStrN(pos, "<!--", 4)) {
             pos += 4;
-            while (pos <= d->content.end - 3 && iCmpStrN(pos, "-->", 3)) {
+            while (pos <= text.end - 3 && iCmpStrN(pos, "-->", 3)) {
                 pos++;
             }
             pos += 3;
@@ -401,7 +669,7 @@ iString *decodedContent_XmlElement(const iXmlElement *d) {
                 continue;
             }
             iChar ch = 0;
-            int n = decodeBytes_MultibyteChar(pos, d->content.end, &ch);
+            int n = decodeBytes_MultibyteChar(pos, text.end, &ch);
             if (n <= 0) {
                 return str;
             }
@@ -419,59 +687,624 @@ iString *decodedContent_XmlElement(const iXmlElement *d) {
     return str;
 }
 
+iString *decodedContent_XmlElement(const iXmlElement *d) {
+    return d ? decode_Xml_(d->content) : new_String();
+}
+
 /*----------------------------------------------------------------------------------------------*/
 
 void init_XmlDocument(iXmlDocument *d) {
     init_String(&d->source);
-    init_XmlElement(&d->root);
+    d->arena = NULL;
+    d->index = NULL;
+    init_XmlElement_(&d->root, d);
 }
 
 void deinit_XmlDocument(iXmlDocument *d) {
-    deinit_XmlElement(&d->root);
+    free_XmlArena_(&d->arena); /* all elements, attributes, and the index */
     deinit_String(&d->source);
 }
 
-iBool parse_XmlDocument(iXmlDocument *d, const iString *source) {
-    iXmlParser par;
-    init_XmlParser_(&par, d, source);
+static iBool parseDocument_XmlParser_(iXmlParser *d) {
     /* Must begin with the header. */
-    nextToken_XmlParser_(&par);
-    if (par.tokenType != headerOpen_XmlToken) {
+    nextToken_XmlParser_(d);
+    if (d->tokenType != headerOpen_XmlToken) {
         return iFalse;
     }
-    nextToken_XmlParser_(&par);
-    if (par.tokenType != name_XmlToken || !equal_Rangecc(par.token, "xml")) {
+    nextToken_XmlParser_(d);
+    if (d->tokenType != name_XmlToken || !equal_Rangecc(d->token, "xml")) {
         return iFalse;
     }
-    while (par.tokenType != headerClose_XmlToken) {
+    while (d->tokenType != headerClose_XmlToken) {
         /* Header must say version 1.0 and UTF-8. */
-        nextToken_XmlParser_(&par);
-        if (par.tokenType == name_XmlToken) {
-            if (equal_Rangecc(par.token, "version")) {
-                nextToken_XmlParser_(&par);
-                if (!expect_XmlParser_(&par, assignment_XmlToken)) {
+        nextToken_XmlParser_(d);
+        if (d->tokenType == name_XmlToken) {
+            if (equal_Rangecc(d->token, "version")) {
+                nextToken_XmlParser_(d);
+                if (!expect_XmlParser_(d, assignment_XmlToken)) {
                     return iFalse;
                 }
-                if (par.tokenType != stringLiteral_XmlToken || !equal_Rangecc(par.token, "1.0")) {
+                if (d->tokenType != stringLiteral_XmlToken || !equal_Rangecc(d->token, "1.0")) {
                     return iFalse;
                 }
             }
-            else if (equal_Rangecc(par.token, "encoding")) {
-                nextToken_XmlParser_(&par);
-                if (!expect_XmlParser_(&par, assignment_XmlToken)) {
+            else if (equal_Rangecc(d->token, "encoding")) {
+                nextToken_XmlParser_(d);
+                if (!expect_XmlParser_(d, assignment_XmlToken)) {
                     return iFalse;
                 }
-                if (par.tokenType != stringLiteral_XmlToken ||
-                    !equalCase_Rangecc(par.token, "UTF-8")) {
+                if (d->tokenType != stringLiteral_XmlToken ||
+                    !equalCase_Rangecc(d->token, "UTF-8")) {
                     return iFalse;
                 }
             }
         }
     }
-    nextToken_XmlParser_(&par);
+    nextToken_XmlParser_(d);
     /* This should now be the root element. */
-    if (!parseTree_XmlParser_(&par, &d->root)) {
+    if (!parseTree_XmlParser_(d, &d->doc->root)) {
+        return iFalse;
+    }
+    return d->tokenType == none_XmlToken;
+}
+
+iBool parse_XmlDocument(iXmlDocument *d, const iString *source) {
+    free_XmlArena_(&d->arena);
+    d->index = NULL;
+    init_XmlElement_(&d->root, d);
+    iXmlParser par;
+    init_XmlParser_(&par, d, source);
+    const iBool ok = parseDocument_XmlParser_(&par);
+    deinit_XmlParser_(&par);
+    return ok;
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
+#define iXmlReaderChunkSize     0x10000
+#define iXmlReaderMaxTokenSize  0x100000
+
+struct Impl_XmlReader {
+    iStream *input;
+    iBlock buf;
+    size_t pos;         /* start of unconsumed data in `buf` */
+    size_t end;         /* end of valid data in `buf` */
+    size_t next;        /* where the next event begins */
+    size_t maxTokenSize;
+    iBool atEnd;
+    iBool hasRoot;
+    iBool isEmptyElement; /* end event follows immediately */
+    iBool inCData;      /* a CDATA section continues in the next event */
+    enum iXmlReaderEvent event;
+    iRangecc name;
+    iRangecc text;
+    iArray attribs;
+    iBlock openNames;   /* names of open elements, each NUL-terminated */
+    iArray openOffsets; /* size_t offsets to `openNames` */
+    const char *error;
+};
+
+iDefineTypeConstructionArgs(XmlReader, (iStream *input), input)
+
+void init_XmlReader(iXmlReader *d, iStream *input) {
+    d->input = input;
+    init_Block(&d->buf, iXmlReaderChunkSize);
+    d->pos = d->end = d->next = 0;
+    d->maxTokenSize = iXmlReaderMaxTokenSize;
+    d->atEnd = iFalse;
+    d->hasRoot = iFalse;
+    d->isEmptyElement = iFalse;
+    d->inCData = iFalse;
+    d->event = end_XmlReaderEvent;
+    d->name = iNullRange;
+    d->text = iNullRange;
+    init_Array(&d->attribs, sizeof(iXmlAttribute));
+    init_Block(&d->openNames, 0);
+    init_Array(&d->openOffsets, sizeof(size_t));
+    d->error = NULL;
+}
+
+void deinit_XmlReader(iXmlReader *d) {
+    deinit_Array(&d->openOffsets);
+    deinit_Block(&d->openNames);
+    deinit_Array(&d->attribs);
+    deinit_Block(&d->buf);
+}
+
+void setMaxTokenSize_XmlReader(iXmlReader *d, size_t maxSize) {
+    d->maxTokenSize = iMax(maxSize, 16);
+}
+
+iLocalDef const char *base_XmlReader_(const iXmlReader *d) {
+    return constData_Block(&d->buf);
+}
+
+/* Discards the consumed data and reads more input after the unconsumed data. Offsets
+   relative to `pos` stay valid, but all pointers to the buffer are invalidated. */
+static iBool fill_XmlReader_(iXmlReader *d) {
+    if (d->atEnd || d->error) {
+        return iFalse;
+    }
+    char *base = data_Block(&d->buf);
+    if (d->pos > 0) {
+        memmove(base, base + d->pos, d->end - d->pos);
+        d->end -= d->pos;
+        d->pos = 0;
+    }
+    if (d->end + iXmlReaderChunkSize > size_Block(&d->buf)) {
+        if (d->end >= d->maxTokenSize) {
+            d->error = "token is too large";
+            return iFalse;
+        }
+        resize_Block(&d->buf, d->end + iXmlReaderChunkSize);
+        base = data_Block(&d->buf);
+    }
+    const size_t num = readData_Stream(d->input, size_Block(&d->buf) - d->end, base + d->end);
+    if (num == 0) {
+        d->atEnd = iTrue;
+        return iFalse;
+    }
+    d->end += num;
+    return iTrue;
+}
+
+#if defined (iXmlHaveSimdScan)
+iCpuTarget("sse2")
+static const char *findAnySse2_Xml_(const char *pos, const char *end, char a, char b, char c) {
+    const __m128i va = _mm_set1_epi8(a);
+    const __m128i vb = _mm_set1_epi8(b);
+    const __m128i vc = _mm_set1_epi8(c);
+    for (; end - pos >= 16; pos += 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i *) pos);
+        const int mask = _mm_movemask_epi8(_mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb)), _mm_cmpeq_epi8(v, vc)));
+        if (mask) {
+            return pos + __builtin_ctz(mask);
+        }
+    }
+    return pos;
+}
+
+iCpuTarget("avx2")
+static const char *findAnyAvx2_Xml_(const char *pos, const char *end, char a, char b, char c) {
+    const __m256i va = _mm256_set1_epi8(a);
+    const __m256i vb = _mm256_set1_epi8(b);
+    const __m256i vc = _mm256_set1_epi8(c);
+    for (; end - pos >= 32; pos += 32) {
+        const __m256i v = _mm256_loadu_si256((const __m256i *) pos);
+        const unsigned mask = (unsigned) _mm256_movemask_epi8(_mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, va), _mm256_cmpeq_epi8(v, vb)),
+            _mm256_cmpeq_epi8(v, vc)));
+        if (mask) {
+            return pos + __builtin_ctz(mask);
+        }
+    }
+    return pos;
+}
+#endif
+
+/* Finds the first occurrence of any of the three characters. Markup is ASCII, so the
+   bytes can be compared without decoding UTF-8. The vector scans stop at a match or
+   when less than a full register of input remains. */
+static const char *findAny_Xml_(const char *pos, const char *end, char a, char b, char c) {
+#if defined (iXmlHaveSimdScan)
+    const int cpu = features_Cpu();
+    if (cpu & avx2_CpuFeature) {
+        pos = findAnyAvx2_Xml_(pos, end, a, b, c);
+    }
+    if (cpu & sse2_CpuFeature) {
+        pos = findAnySse2_Xml_(pos, end, a, b, c);
+    }
+#endif
+    for (; pos < end; pos++) {
+        if (*pos == a || *pos == b || *pos == c) {
+            return pos;
+        }
+    }
+    return NULL;
+}
+
+static const char *findSeq_Xml_(const char *pos, const char *end, const char *seq, size_t len) {
+    while ((pos = memchr(pos, seq[0], end - pos)) != NULL) {
+        if ((size_t) (end - pos) < len) {
+            return NULL;
+        }
+        if (!memcmp(pos, seq, len)) {
+            return pos;
+        }
+        pos++;
+    }
+    return NULL;
+}
+
+iLocalDef iBool isSpace_Xml_(char c) {
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r';
+}
+
+iLocalDef iBool isNameChar_Xml_(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+           c == '_' || c == ':' || c == '-' || c == '.' || (unsigned char) c >= 0x80;
+}
+
+static const char *skipSpace_Xml_(const char *pos, const char *end) {
+    while (pos < end && isSpace_Xml_(*pos)) pos++;
+    return pos;
+}
+
+static enum iXmlReaderEvent fail_XmlReader_(iXmlReader *d, const char *msg) {
+    if (!d->error) {
+        d->error = msg;
+    }
+    d->name = iNullRange;
+    d->text = iNullRange;
+    return d->event = error_XmlReaderEvent;
+}
+
+/* Makes sure at least `size` bytes are available after `pos`, if the input has them. */
+static iBool require_XmlReader_(iXmlReader *d, size_t size) {
+    while (d->end - d->pos < size) {
+        if (!fill_XmlReader_(d)) {
+            return iFalse;
+        }
+    }
+    return iTrue;
+}
+
+/* Returns the offset of the '>' that ends the tag beginning at `pos`, skipping over quoted
+   attribute values. */
+static size_t findTagEnd_XmlReader_(iXmlReader *d) {
+    size_t scanned = 1;
+    char quote = 0;
+    for (;;) {
+        const char *base = base_XmlReader_(d);
+        const char *pos  = base + d->pos + scanned;
+        const char *end  = base + d->end;
+        while (pos < end) {
+            const char *found = quote ? memchr(pos, quote, end - pos)
+                                      : findAny_Xml_(pos, end, '>', '"', '\'');
+            if (!found) {
+                break;
+            }
+            if (quote) {
+                quote = 0;
+            }
+            else if (*found == '>') {
+                return found - base;
+            }
+            else {
+                quote = *found;
+            }
+            pos = found + 1;
+        }
+        scanned = d->end - d->pos;
+        if (!fill_XmlReader_(d)) {
+            return iInvalidPos;
+        }
+    }
+}
+
+/* Skips until `seq` has been passed, discarding data as it goes. */
+static iBool skipPast_XmlReader_(iXmlReader *d, size_t offset, const char *seq) {
+    const size_t len = strlen(seq);
+    for (;;) {
+        const char *base  = base_XmlReader_(d);
+        const char *found = findSeq_Xml_(base + d->pos + offset, base + d->end, seq, len);
+        if (found) {
+            d->pos = found + len - base;
+            return iTrue;
+        }
+        /* Keep what may be the beginning of the sequence. */
+        d->pos = iMax(d->pos + offset, d->end - iMin(d->end, len - 1));
+        offset = 0;
+        if (!fill_XmlReader_(d)) {
+            return iFalse;
+        }
+    }
+}
+
+static iBool skipDoctype_XmlReader_(iXmlReader *d) {
+    int brackets = 0;
+    char quote = 0;
+    for (;;) {
+        const char *base = base_XmlReader_(d);
+        for (const char *pos = base + d->pos; pos < base + d->end; pos++) {
+            const char c = *pos;
+            if (quote) {
+                if (c == quote) quote = 0;
+            }
+            else if (c == '"' || c == '\'') {
+                quote = c;
+            }
+            else if (c == '[') {
+                brackets++;
+            }
+            else if (c == ']') {
+                brackets--;
+            }
+            else if (c == '>' && brackets <= 0) {
+                d->pos = pos + 1 - base;
+                return iTrue;
+            }
+        }
+        d->pos = d->end;
+        if (!fill_XmlReader_(d)) {
+            return iFalse;
+        }
+    }
+}
+
+static void pushName_XmlReader_(iXmlReader *d, iRangecc name) {
+    const size_t offset = size_Block(&d->openNames);
+    pushBack_Array(&d->openOffsets, &offset);
+    appendData_Block(&d->openNames, name.start, size_Range(&name));
+    appendData_Block(&d->openNames, "", 1);
+}
+
+static iBool popName_XmlReader_(iXmlReader *d, iRangecc name) {
+    if (isEmpty_Array(&d->openOffsets)) {
         return iFalse;
     }
-    return par.tokenType == none_XmlToken;
+    const size_t offset = *(const size_t *) back_Array(&d->openOffsets);
+    if (!equal_Rangecc(name, cstr_Block(&d->openNames) + offset)) {
+        return iFalse;
+    }
+    popBack_Array(&d->openOffsets);
+    truncate_Block(&d->openNames, offset);
+    return iTrue;
+}
+
+/* Character data up to the next markup. Data that does not fit in a chunk is split, but
+   never in the middle of an entity reference or a UTF-8 sequence. */
+static enum iXmlReaderEvent readText_XmlReader_(iXmlReader *d) {
+    size_t scanned = 0;
+    for (;;) {
+        const char *base  = base_XmlReader_(d);
+        const char *start = base + d->pos;
+        const char *found = memchr(start + scanned, '<', d->end - d->pos - scanned);
+        if (found) {
+            d->text = (iRangecc){ start, found };
+            break;
+        }
+        scanned = d->end - d->pos;
+        if (scanned >= iXmlReaderChunkSize || !fill_XmlReader_(d)) {
+            if (d->error) {
+                return fail_XmlReader_(d, d->error);
+            }
+            base  = base_XmlReader_(d);
+            start = base + d->pos;
+            const char *cut = base + d->end;
+            if (!d->atEnd) {
+                const char *amp = cut - iMin(scanned, 12);
+                while ((amp = memchr(amp, '&', cut - amp)) != NULL &&
+                       memchr(amp, ';', cut - amp)) {
+                    amp++;
+                }
+                if (amp) {
+                    cut = amp;
+                }
+                while (cut > start && ((unsigned char) cut[-1] & 0xc0) == 0x80) cut--;
+                if (cut > start && (unsigned char) cut[-1] >= 0xc0) cut--;
+                if (cut == start) {
+                    cut = base + d->end;
+                }
+            }
+            d->text = (iRangecc){ start, cut };
+            break;
+        }
+    }
+    d->next = d->text.end - base_XmlReader_(d);
+    return d->event = text_XmlReaderEvent;
+}
+
+static enum iXmlReaderEvent readCData_XmlReader_(iXmlReader *d) {
+    size_t scanned = 0;
+    for (;;) {
+        const char *base  = base_XmlReader_(d);
+        const char *start = base + d->pos;
+        const char *found = findSeq_Xml_(start + scanned, base + d->end, "]]>", 3);
+        if (found) {
+            d->text    = (iRangecc){ start, found };
+            d->next    = found + 3 - base;
+            d->inCData = iFalse;
+            break;
+        }
+        scanned = d->end - d->pos;
+        scanned -= iMin(scanned, 2);
+        if (d->end - d->pos >= iXmlReaderChunkSize || !fill_XmlReader_(d)) {
+            if (d->atEnd || d->error) {
+                return fail_XmlReader_(d, "unterminated CDATA section");
+            }
+            base = base_XmlReader_(d);
+            d->text    = (iRangecc){ base + d->pos, base + d->pos + scanned };
+            d->next    = d->pos + scanned;
+            d->inCData = iTrue;
+            break;
+        }
+    }
+    return d->event = cdata_XmlReaderEvent;
+}
+
+static enum iXmlReaderEvent readTag_XmlReader_(iXmlReader *d) {
+    const size_t tagEnd = findTagEnd_XmlReader_(d);
+    if (tagEnd == iInvalidPos) {
+        return fail_XmlReader_(d, "unterminated tag");
+    }
+    const char *base = base_XmlReader_(d);
+    const char *pos  = base + d->pos + 1;
+    const char *end  = base + tagEnd;
+    d->next = tagEnd + 1;
+    if (*pos == '?') {
+        if (end[-1] != '?' || end - pos < 2) {
+            return fail_XmlReader_(d, "malformed processing instruction");
+        }
+        d->name.start = ++pos;
+        while (pos < end - 1 && !isSpace_Xml_(*pos)) pos++;
+        d->name.end = pos;
+        d->text = (iRangecc){ skipSpace_Xml_(pos, end - 1), end - 1 };
+        return d->event = instruction_XmlReaderEvent;
+    }
+    const iBool isEndTag = (*pos == '/');
+    if (isEndTag) {
+        pos++;
+    }
+    else if (end[-1] == '/') {
+        d->isEmptyElement = iTrue;
+        end--;
+    }
+    d->name.start = pos;
+    while (pos < end && isNameChar_Xml_(*pos)) pos++;
+    d->name.end = pos;
+    if (isEmpty_Range(&d->name)) {
+        return fail_XmlReader_(d, "missing element name");
+    }
+    if (isEndTag) {
+        if (skipSpace_Xml_(pos, end) != end || !popName_XmlReader_(d, d->name)) {
+            return fail_XmlReader_(d, "mismatched end tag");
+        }
+        return d->event = endElement_XmlReaderEvent;
+    }
+    for (;;) {
+        const char *next = skipSpace_Xml_(pos, end);
+        if (next == end) {
+            break;
+        }
+        if (next == pos) {
+            return fail_XmlReader_(d, "malformed attribute");
+        }
+        iXmlAttribute attr = { .name = { next, next } };
+        for (pos = next; pos < end && isNameChar_Xml_(*pos); pos++) {}
+        attr.name.end = pos;
+        pos = skipSpace_Xml_(pos, end);
+        if (isEmpty_Range(&attr.name) || pos == end || *pos != '=') {
+            return fail_XmlReader_(d, "malformed attribute");
+        }
+        pos = skipSpace_Xml_(pos + 1, end);
+        if (pos == end || (*pos != '"' && *pos != '\'')) {
+            return fail_XmlReader_(d, "malformed attribute");
+        }
+        const char *closing = memchr(pos + 1, *pos, end - pos - 1);
+        if (!closing) {
+            return fail_XmlReader_(d, "malformed attribute");
+        }
+        attr.value = (iRangecc){ pos + 1, closing };
+        pushBack_Array(&d->attribs, &attr);
+        pos = closing + 1;
+    }
+    if (isEmpty_Array(&d->openOffsets)) {
+        if (d->hasRoot) {
+            return fail_XmlReader_(d, "more than one root element");
+        }
+        d->hasRoot = iTrue;
+    }
+    pushName_XmlReader_(d, d->name);
+    return d->event = startElement_XmlReaderEvent;
+}
+
+enum iXmlReaderEvent next_XmlReader(iXmlReader *d) {
+    if (d->event == error_XmlReaderEvent) {
+        return d->event;
+    }
+    d->pos = d->next;
+    clear_Array(&d->attribs);
+    d->text = iNullRange;
+    if (d->isEmptyElement) {
+        /* The name of the empty element is still in the buffer. */
+        d->isEmptyElement = iFalse;
+        popName_XmlReader_(d, d->name);
+        return d->event = endElement_XmlReaderEvent;
+    }
+    d->name = iNullRange;
+    if (d->inCData) {
+        return readCData_XmlReader_(d);
+    }
+    for (;;) {
+        if (!require_XmlReader_(d, 1)) {
+            if (d->error) {
+                return fail_XmlReader_(d, d->error);
+            }
+            if (!isEmpty_Array(&d->openOffsets)) {
+                return fail_XmlReader_(d, "unexpected end of input");
+            }
+            if (!d->hasRoot) {
+                return fail_XmlReader_(d, "missing root element");
+            }
+            return d->event = end_XmlReaderEvent;
+        }
+        if (base_XmlReader_(d)[d->pos] != '<') {
+            readText_XmlReader_(d);
+            if (d->event == text_XmlReaderEvent && isEmpty_Array(&d->openOffsets)) {
+                /* Only whitespace is allowed outside the root element, and it is skipped. */
+                if (skipSpace_Xml_(d->text.start, d->text.end) != d->text.end) {
+                    return fail_XmlReader_(d, "text outside the root element");
+                }
+                d->pos = d->next;
+                continue;
+            }
+            return d->event;
+        }
+        require_XmlReader_(d, 9);
+        const char *pos = base_XmlReader_(d) + d->pos;
+        const size_t avail = d->end - d->pos;
+        if (avail >= 4 && !memcmp(pos, "<!--", 4)) {
+            if (!skipPast_XmlReader_(d, 4, "-->")) {
+                return fail_XmlReader_(d, "unterminated comment");
+            }
+            continue;
+        }
+        if (avail >= 9 && !memcmp(pos, "<![CDATA[", 9)) {
+            if (isEmpty_Array(&d->openOffsets)) {
+                return fail_XmlReader_(d, "CDATA section outside the root element");
+            }
+            d->pos += 9;
+            return readCData_XmlReader_(d);
+        }
+        if (avail >= 2 && pos[1] == '!') {
+            if (!skipDoctype_XmlReader_(d)) {
+                return fail_XmlReader_(d, "unterminated declaration");
+            }
+            continue;
+        }
+        return readTag_XmlReader_(d);
+    }
+}
+
+enum iXmlReaderEvent event_XmlReader(const iXmlReader *d) {
+    return d->event;
+}
+
+iRangecc name_XmlReader(const iXmlReader *d) {
+    return d->name;
+}
+
+iRangecc text_XmlReader(const iXmlReader *d) {
+    return d->text;
+}
+
+const iArray *attributes_XmlReader(const iXmlReader *d) {
+    return &d->attribs;
+}
+
+iRangecc attribute_XmlReader(const iXmlReader *d, const char *name) {
+    iConstForEach(Array, i, &d->attribs) {
+        const iXmlAttribute *attr = i.value;
+        if (equal_Rangecc(attr->name, name)) {
+            return attr->value;
+        }
+    }
+    return iNullRange;
+}
+
+size_t depth_XmlReader(const iXmlReader *d) {
+    return size_Array(&d->openOffsets);
+}
+
+const char *errorMessage_XmlReader(const iXmlReader *d) {
+    return d->error ? d->error : "";
+}
+
+iString *decodedText_XmlReader(const iXmlReader *d) {
+    if (d->event == cdata_XmlReaderEvent) {
+        return newRange_String(d->text);
+    }
+    return decode_Xml_(d->text);
 }
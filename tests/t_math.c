@@ -25,9 +25,14 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
 */
 
 #include <the_Foundation/defs.h>
+#include <the_Foundation/cpu.h>
 #include <the_Foundation/math.h>
 #include <the_Foundation/time.h>
 #include <the_Foundation/fixed2.h>
+#include <the_Foundation/fixed3.h>
+#include <the_Foundation/noise.h>
+#include <the_Foundation/random.h>
+#include <the_Foundation/threadpool.h>
 
 static void printNum(float n) {
     if (n == 0.f) {
@@ -193,6 +198,81 @@ int main(int argc, char **argv) {
         printf("  length (float): %f\n", lengthf_X2(v));
         print_("random", mix_X2(initi_X2(-1, 100), initi_X2(1, -100), random_Fixed()));
     }
+    /* Bulk fixed-point operations. */ {
+        const size_t count = 100003;
+        iFixed3 *a   = malloc(sizeof(iFixed3) * count);
+        iFixed3 *b   = malloc(sizeof(iFixed3) * count);
+        iFixed3 *out = malloc(sizeof(iFixed3) * count);
+        iFixed3 *ref = malloc(sizeof(iFixed3) * count);
+        iFixed *lens = malloc(sizeof(iFixed) * count);
+        iFixed *refLens = malloc(sizeof(iFixed) * count);
+        iRandomEngine *rnd = new_RandomEngine(49);
+        const iFixed t = initd_Fixed(0.3);
+        /* Products of arbitrary 64-bit values test the sign corrections. */
+        fill_RandomEngine(rnd, (uint64_t *) a, 3 * count);
+        fill_RandomEngine(rnd, (uint64_t *) b, 3 * count);
+        mulArray_X3(a, b, count, out);
+        size_t mismatches = 0;
+        for (size_t i = 0; i < count; ++i) {
+            mismatches += !isEqual_X3(out[i], mul_X3(a[i], b[i]));
+        }
+        /* Entities spread over +-30000 units, and some far away or very small. */
+        for (size_t i = 0; i < count; ++i) {
+            const int scale = (i % 97 == 0 ? 1 << 24 : i % 89 == 0 ? 1 : 30000);
+            for (int c = 0; c < 3; ++c) {
+                (&a[i].x)[c] = initd_Fixed((2 * nextd_RandomEngine(rnd) - 1) * scale);
+                (&b[i].x)[c] = initd_Fixed((2 * nextd_RandomEngine(rnd) - 1) * scale);
+            }
+            a[i].x = add_Fixed(abs_Fixed(a[i].x), one_Fixed()); /* never a zero vector */
+        }
+        iTime start = now_Time();
+        for (size_t i = 0; i < count; ++i) {
+            ref[i] = mix_X3(a[i], b[i], t);
+        }
+        const double mixTime = elapsedSeconds_Time(&start);
+        start = now_Time();
+        mixArray_X3(a, b, t, count, out);
+        const double mixArrayTime = elapsedSeconds_Time(&start);
+        mismatches += memcmp(out, ref, sizeof(iFixed3) * count) != 0;
+        addArray_X3(a, b, count, out);
+        subArray_X3(out, b, count, out);
+        mismatches += memcmp(out, a, sizeof(iFixed3) * count) != 0;
+        start = now_Time();
+        for (size_t i = 0; i < count; ++i) {
+            refLens[i] = length_X3(a[i]);
+        }
+        const double lengthTime = elapsedSeconds_Time(&start);
+        start = now_Time();
+        lengthArray_X3(a, count, lens);
+        const double lengthArrayTime = elapsedSeconds_Time(&start);
+        mismatches += memcmp(lens, refLens, sizeof(iFixed) * count) != 0;
+        start = now_Time();
+        for (size_t i = 0; i < count; ++i) {
+            ref[i] = normalize_X3(a[i]);
+        }
+        const double normTime = elapsedSeconds_Time(&start);
+        start = now_Time();
+        normalizeArray_X3(a, count, out);
+        const double normArrayTime = elapsedSeconds_Time(&start);
+        mismatches += memcmp(out, ref, sizeof(iFixed3) * count) != 0;
+        normalizeArray_X3(a, count, a); /* in place */
+        mismatches += memcmp(a, ref, sizeof(iFixed3) * count) != 0;
+        printf("Bulk fixed-point: %zu mismatches\n", mismatches);
+        iAssert(mismatches == 0);
+        printf("Bulk fixed-point (%s): mix %.1f / %.1f, length %.1f / %.1f, "
+               "normalize %.1f / %.1f Mvec/s (per-vector / array)\n",
+               kernelPath_Cpu(),
+               count / mixTime / 1.0e6, count / mixArrayTime / 1.0e6,
+               count / lengthTime / 1.0e6, count / lengthArrayTime / 1.0e6,
+               count / normTime / 1.0e6, count / normArrayTime / 1.0e6);
+        delete_RandomEngine(rnd);
+        free(refLens);
+        free(lens);
+        free(ref);
+        free(out);
+        free(b);
+        free(a);
+    }
     /* Matrices. */ {
         printf("--------------------------------------------------------\n");
         printf("dot3: %f\n", dot_F3(init_F3(1, 2, 3), init_F3(3, 4, 2)));
@@ -257,6 +337,212 @@ int main(int argc, char **argv) {
         printf("Rotation: elapsed %lf seconds\n", elapsedSeconds_Time(&start));
         free(res);
     }
+    /* Bulk vector operations. */ {
+        const size_t count = 1000003; /* not a multiple of the SIMD width */
+        iFloatVec3 *points = malloc(sizeof(iFloatVec3) * count);
+        iFloatVec3 *result = malloc(sizeof(iFloatVec3) * count);
+        iFloatVec3 *check  = malloc(sizeof(iFloatVec3) * count);
+        float *comps = malloc(sizeof(float) * count * 10);
+        const iFloat3Soa soa = { comps, comps + count, comps + 2 * count };
+        const iFloat3Soa out = { comps + 3 * count, comps + 4 * count, comps + 5 * count };
+        float *dots = comps + 6 * count;
+        const iFloat3Soa checkSoa = { comps + 7 * count, comps + 8 * count, comps + 9 * count };
+        for (size_t i = 0; i < count; ++i) {
+            for (int c = 0; c < 3; ++c) {
+                points[i].v[c] = iRandomf() * 200.f - 100.f;
+            }
+            soa.x[i] = points[i].v[0];
+            soa.y[i] = points[i].v[1];
+            soa.z[i] = points[i].v[2];
+        }
+        iMat4 mat;
+        perspective_Mat4(&mat, 90.f, 1.5f, 0.1f, 1000.f);
+        rotate_Mat4(&mat, init_F3(1, 1, 0), 30.f);
+        translate_Mat4(&mat, init_F3(1, 2, -300));
+        float m[16];
+        store_Mat4(&mat, m);
+        iTime start = now_Time();
+        for (size_t i = 0; i < count; ++i) {
+            store_F3(mulF3_Mat4(&mat, initv_F3(points[i].v)), result[i].v);
+        }
+        const double perVecTime = elapsedSeconds_Time(&start);
+        start = now_Time();
+        mulArray_Mat4F3(&mat, points, count, result);
+        const double arrayTime = elapsedSeconds_Time(&start);
+        start = now_Time();
+        mulSoa_Mat4F3(&mat, &soa, count, &out);
+        const double soaTime = elapsedSeconds_Time(&start);
+        size_t mismatches = 0;
+        for (size_t i = 0; i < count; ++i) {
+            /* Same evaluation order as the bulk kernels. */
+            const float x = points[i].v[0], y = points[i].v[1], z = points[i].v[2];
+            const float w = m[3] * x + m[7] * y + m[11] * z + m[15];
+            const float ref[3] = { (m[0] * x + m[4] * y + m[8]  * z + m[12]) / w,
+                                   (m[1] * x + m[5] * y + m[9]  * z + m[13]) / w,
+                                   (m[2] * x + m[6] * y + m[10] * z + m[14]) / w };
+            if (memcmp(ref, result[i].v, sizeof(ref)) ||
+                ref[0] != out.x[i] || ref[1] != out.y[i] || ref[2] != out.z[i]) {
+                mismatches++;
+            }
+        }
+        printf("Bulk transform: %zu mismatches\n", mismatches);
+        iAssert(mismatches == 0);
+        printf("Bulk transform (%s): per-vector %.1f, array %.1f, SoA %.1f Mvec/s\n",
+               kernelPath_Cpu(),
+               count / perVecTime / 1.0e6,
+               count / arrayTime / 1.0e6,
+               count / soaTime / 1.0e6);
+        /* The narrower code paths give identical results. */
+        const int narrower[] = { sse41_CpuFeature | sse2_CpuFeature, 0 };
+        iForIndices(n, narrower) {
+            setEnabledFeatures_Cpu(narrower[n]);
+            start = now_Time();
+            mulArray_Mat4F3(&mat, points, count, check);
+            mulSoa_Mat4F3(&mat, &soa, count, &checkSoa);
+            printf("Bulk transform (%s): array+SoA %.1f Mvec/s\n",
+                   kernelPath_Cpu(), count / elapsedSeconds_Time(&start) / 1.0e6);
+            iAssert(!memcmp(check, result, sizeof(iFloatVec3) * count));
+            iAssert(!memcmp(checkSoa.x, out.x, sizeof(float) * count * 3));
+        }
+        setEnabledFeatures_Cpu(all_CpuFeature);
+        start = now_Time();
+        dotSoa_F3(&soa, &out, count, dots);
+        crossSoa_F3(&soa, &out, count, &out);
+        normalizeSoa_F3(&out, count, &out);
+        iFloatVec3 bmin, bmax, smin, smax;
+        boundsArray_F3(points, count, &bmin, &bmax);
+        boundsSoa_F3(&soa, count, &smin, &smax);
+        printf("Bulk dot+cross+normalize+bounds: %.1f Mvec/s\n",
+               count / elapsedSeconds_Time(&start) / 1.0e6);
+        iAssert(!memcmp(&bmin, &smin, sizeof(bmin)) && !memcmp(&bmax, &smax, sizeof(bmax)));
+        for (size_t i = 0; i < count; i += 99991) {
+            const iFloat3 a = initv_F3(points[i].v);
+            const iFloat3 n = normalize_F3(cross_F3(a, mulF3_Mat4(&mat, a)));
+            printf("  %7zu: dot %12.3f  normal (%+.4f %+.4f %+.4f)  expected (%+.4f %+.4f %+.4f)\n",
+                   i, dots[i], out.x[i], out.y[i], out.z[i], x_F3(n), y_F3(n), z_F3(n));
+        }
+        printf("  bounds: (%.3f %.3f %.3f) - (%.3f %.3f %.3f)\n",
+               bmin.v[0], bmin.v[1], bmin.v[2], bmax.v[0], bmax.v[1], bmax.v[2]);
+        free(comps);
+        free(check);
+        free(result);
+        free(points);
+    }
+    /* Batched noise. */ {
+        const iNoiseComponent comps[] = {
+            { init_I2(64, 64), 1.f, 0.f }, { init_I2(16, 16), .5f, .25f }
+        };
+        iCombinedNoise *noise = new_CombinedNoise(comps, iElemCount(comps));
+        setPointOffset_CombinedNoise(noise, .5f, .5f, 1.f);
+        const iInt2  size  = init_I2(1024, 1024);
+        const size_t count = (size_t) prod_I2(size);
+        float *xs     = malloc(sizeof(float) * count);
+        float *ys     = malloc(sizeof(float) * count);
+        float *scalar = malloc(sizeof(float) * count);
+        float *batch  = malloc(sizeof(float) * count);
+        for (int y = 0; y < size.y; ++y) {
+            for (int x = 0; x < size.x; ++x) {
+                xs[y * size.x + x] = (float) x / size.x;
+                ys[y * size.x + x] = (float) y / size.y;
+            }
+        }
+        iTime start = now_Time();
+        for (size_t i = 0; i < count; ++i) {
+            scalar[i] = eval_CombinedNoise(noise, xs[i], ys[i]);
+        }
+        const double scalarTime = elapsedSeconds_Time(&start);
+        start = now_Time();
+        evalArray_CombinedNoise(noise, xs, ys, count, batch);
+        const double batchTime = elapsedSeconds_Time(&start);
+        /* All code paths give identical results. */
+        int mismatches = memcmp(batch, scalar, sizeof(float) * count) != 0;
+        const int narrower[] = { sse41_CpuFeature | sse2_CpuFeature, 0 };
+        iForIndices(n, narrower) {
+            setEnabledFeatures_Cpu(narrower[n]);
+            memset(batch, 0, sizeof(float) * count);
+            evalArray_CombinedNoise(noise, xs, ys, count, batch);
+            mismatches += memcmp(batch, scalar, sizeof(float) * count) != 0;
+        }
+        setEnabledFeatures_Cpu(all_CpuFeature);
+        iThreadPool *pool = new_ThreadPool();
+        memset(batch, 0, sizeof(float) * count);
+        start = now_Time();
+        evalGrid_CombinedNoise(noise, size, batch, pool);
+        const double gridTime = elapsedSeconds_Time(&start);
+        mismatches += memcmp(batch, scalar, sizeof(float) * count) != 0;
+        printf("Noise: %d mismatching code paths\n", mismatches);
+        iAssert(mismatches == 0);
+        printf("Noise (%s): scalar %.1f, batch %.1f, threaded grid %.1f Msamples/s\n",
+               kernelPath_Cpu(),
+               count / scalarTime / 1.0e6,
+               count / batchTime / 1.0e6,
+               count / gridTime / 1.0e6);
+        iRelease(pool);
+        free(batch);
+        free(scalar);
+        free(ys);
+        free(xs);
+        delete_CombinedNoise(noise);
+    }
+    /* Random number engine. */ {
+        const size_t count = 1000003;
+        uint64_t *values = malloc(sizeof(uint64_t) * count);
+        uint64_t *check  = malloc(sizeof(uint64_t) * count);
+        int *ints = malloc(sizeof(int) * count);
+        iRandomEngine *rnd = new_RandomEngine(12345);
+        iRandomEngine *ref = new_RandomEngine(12345);
+        next_RandomEngine(rnd); /* fill starts from the second lane */
+        next_RandomEngine(ref);
+        iTime start = now_Time();
+        for (size_t i = 0; i < count; ++i) {
+            values[i] = next_RandomEngine(ref);
+        }
+        const double nextTime = elapsedSeconds_Time(&start);
+        start = now_Time();
+        fill_RandomEngine(rnd, check, count);
+        const double fillTime = elapsedSeconds_Time(&start);
+        iAssert(!memcmp(values, check, sizeof(uint64_t) * count));
+        setEnabledFeatures_Cpu(0);
+        seed_RandomEngine(rnd, 12345);
+        next_RandomEngine(rnd);
+        fill_RandomEngine(rnd, check, count);
+        setEnabledFeatures_Cpu(all_CpuFeature);
+        iAssert(!memcmp(values, check, sizeof(uint64_t) * count));
+        printf("Random engine (%s): next %.1f, fill %.1f M values/s\n",
+               kernelPath_Cpu(), count / nextTime / 1.0e6, count / fillTime / 1.0e6);
+        /* Bulk ranges match the single draws, including rejections. */
+        int hist[7] = { 0 };
+        fillRange_RandomEngine(rnd, ints, count, -3, 4);
+        for (size_t i = 0; i < count; ++i) {
+            iAssert(ints[i] >= -3 && ints[i] < 4);
+            iAssert(ints[i] == range_RandomEngine(ref, -3, 4));
+            hist[ints[i] + 3]++;
+        }
+        printf("Random range histogram:");
+        iForIndices(i, hist) {
+            printf(" %.4f", (double) hist[i] / count);
+        }
+        printf("\n");
+        iAssert(bounded_RandomEngine(rnd, UINT64_C(1) << 40) < UINT64_C(1) << 40);
+        iAssert(range_RandomEngine(rnd, INT32_MIN, INT32_MAX) < INT32_MAX);
+        /* Split streams. */
+        iRandomEngine part;
+        split_RandomEngine(rnd, &part);
+        iAssert(next_RandomEngine(rnd) != next_RandomEngine(&part));
+        double sum = 0;
+        fillf_RandomEngine(&part, (float *) ints, count);
+        for (size_t i = 0; i < count; ++i) {
+            const float f = ((const float *) ints)[i];
+            iAssert(f >= 0.f && f < 1.f);
+            sum += f;
+        }
+        printf("Random floats: mean %.4f\n", sum / count);
+        delete_RandomEngine(ref);
+        delete_RandomEngine(rnd);
+        free(ints);
+        free(check);
+        free(values);
+    }
     /* Inversion. */ {
         iMat4 matrix;
         const float rowMajorValues[16] = {
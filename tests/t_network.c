@@ -35,9 +35,16 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
 #if defined (iHaveWebRequest)
 #  include <the_Foundation/webrequest.h>
 #endif
+#include <the_Foundation/threadpool.h>
 #if defined (iHaveTlsRequest)
 #  include <the_Foundation/tlsrequest.h>
 #endif
+#if !defined (iPlatformWindows)
+#  include <arpa/inet.h>
+#  include <netinet/in.h>
+#  include <sys/socket.h>
+#  include <unistd.h>
+#endif
 
 static void logConnected_(iAny *d, iSocket *sock) {
     iUnused(d);
@@ -142,6 +149,266 @@ static bool connectTo_(const char *address) {
     return true;
 }
 
+#if !defined (iPlatformWindows)
+/* Connection rate of Service. Clients use plain BSD sockets to keep their overhead low. */
+
+static iAtomicInt acceptCount_;
+static iAtomicInt connectFailures_;
+static uint16_t   benchPort_;
+
+static void countAccepted_(iAny *d, iService *sv, iSocket *sock) {
+    iUnused(d, sv, sock);
+    add_Atomic(&acceptCount_, 1);
+}
+
+static iThreadResult connectStorm_(iThread *thd) {
+    const int count = (int) (intptr_t) userData_Thread(thd);
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(benchPort_) };
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    for (int i = 0; i < count; i++) {
+        const int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) || write(fd, "x", 1) != 1) {
+            add_Atomic(&connectFailures_, 1);
+        }
+        close(fd);
+    }
+    return 0;
+}
+
+static void benchmarkService_(int count, uint16_t port) {
+    static const struct {
+        const char *label;
+        int backlog;
+        int listeners;
+        int flags;
+        iBool pool;
+    } configs_[] = {
+        { "1 listener", 0, 1, 0, iFalse },
+        { "1 listener + pool", 0, 1, 0, iTrue },
+        { "4 listeners + pool", 0, 4, reusePort_ServiceFlag, iTrue },
+        { "4 listeners + pool + defer/TFO", 0, 4,
+          reusePort_ServiceFlag | deferAccept_ServiceFlag | fastOpen_ServiceFlag, iTrue },
+    };
+    const int numClients = 16;
+    benchPort_ = port;
+    for (size_t c = 0; c < iElemCount(configs_); c++) {
+        iService *sv = new_Service(port);
+        iThreadPool *pool = configs_[c].pool ? new_ThreadPool() : NULL;
+        setBacklog_Service(sv, configs_[c].backlog);
+        setListenerCount_Service(sv, configs_[c].listeners);
+        setFlags_Service(sv, configs_[c].flags);
+        setThreadPool_Service(sv, pool);
+        iConnect(Service, sv, incomingAccepted, sv, countAccepted_);
+        if (!open_Service(sv)) {
+            puts("Failed to start the service");
+            iRelease(pool);
+            iRelease(sv);
+            return;
+        }
+        set_Atomic(&acceptCount_, 0);
+        set_Atomic(&connectFailures_, 0);
+        const iTime start = now_Time();
+        iObjectList *clients = new_ObjectList();
+        for (int i = 0; i < numClients; i++) {
+            iThread *client = new_Thread(connectStorm_);
+            setUserData_Thread(client, (void *) (intptr_t) (count / numClients));
+            pushBack_ObjectList(clients, client);
+            start_Thread(client);
+            iRelease(client);
+        }
+        const int total = count / numClients * numClients;
+        while (value_Atomic(&acceptCount_) + value_Atomic(&connectFailures_) < total &&
+               elapsedSeconds_Time(&start) < 30.0) {
+            sleep_Thread(0.001);
+        }
+        const double elapsed = elapsedSeconds_Time(&start);
+        iForEach(ObjectList, i, clients) {
+            join_Thread(i.object);
+        }
+        iRelease(clients);
+        printf("%-32s %d/%d accepted in %.3f s (%.0f conn/s)\n", configs_[c].label,
+               value_Atomic(&acceptCount_), total, elapsed,
+               value_Atomic(&acceptCount_) / elapsed);
+        close_Service(sv);
+        iRelease(sv);
+        iRelease(pool);
+    }
+}
+#endif
+
+#if defined (iHaveWebRequest)
+/* A minimal keep-alive HTTP server for exercising WebRequest without a network. */
+
+static iAtomicInt benchConnections_;
+static iMutex     benchMutex_;
+
+static void respondHttp_(iAny *d, iSocket *sock) {
+    iUnused(d);
+    static const char *response_ = "HTTP/1.1 200 OK\r\n"
+                                   "Content-Length: 5\r\n"
+                                   "Connection: keep-alive\r\n"
+                                   "\r\n"
+                                   "hello";
+    iBlock *pending = userData_Object(sock);
+    iBlock *data = readAll_Socket(sock);
+    iGuardMutex(&benchMutex_, {
+        append_Block(pending, data);
+        for (;;) {
+            const char *end = strstr(cstr_Block(pending), "\r\n\r\n");
+            if (!end) break;
+            remove_Block(pending, 0, end + 4 - cstr_Block(pending));
+            writeData_Socket(sock, response_, strlen(response_));
+        }
+    });
+    delete_Block(data);
+}
+
+static void closeHttp_(iSocket *sock) {
+    close_Socket(sock); /* no more notifications after this */
+    delete_Block(userData_Object(sock));
+}
+
+static void acceptHttp_(iAny *d, iService *sv, iSocket *sock) {
+    iUnused(sv);
+    add_Atomic(&benchConnections_, 1);
+    /* Clean up connections closed by the client so we won't run out of descriptors. */
+    iForEach(ObjectList, i, d) {
+        if (status_Socket((iSocket *) i.object) == disconnected_SocketStatus) {
+            closeHttp_((iSocket *) i.object);
+            remove_ObjectListIterator(&i);
+        }
+    }
+    setUserData_Object(sock, new_Block(0));
+    iConnect(Socket, sock, readyRead, sock, respondHttp_);
+    respondHttp_(NULL, sock); /* may have received data before we started observing */
+    pushBack_ObjectList(d, sock); /* only called in the listening thread */
+}
+
+static iAtomicInt benchFinished_;
+
+static void countFinished_(iAny *d, iWebSession *session, iWebRequest *web) {
+    iUnused(d, session, web);
+    add_Atomic(&benchFinished_, 1);
+}
+
+static void benchmarkWebRequest_(int count, uint16_t port) {
+    init_Mutex(&benchMutex_);
+    iObjectList *accepted = new_ObjectList();
+    iService *sv = new_Service(port);
+    iConnect(Service, sv, incomingAccepted, accepted, acceptHttp_);
+    if (!open_Service(sv)) {
+        puts("Failed to start the local HTTP server");
+        return;
+    }
+    const iString *url = collect_String(newFormat_String("http://localhost:%u/", port));
+    /* Separate requests each doing their own connection. */ {
+        set_Atomic(&benchConnections_, 0);
+        const iTime start = now_Time();
+        int ok = 0;
+        for (int i = 0; i < count; i++) {
+            iWebRequest *web = new_WebRequest();
+            setUrl_WebRequest(web, url);
+            ok += get_WebRequest(web);
+            iRelease(web);
+        }
+        printf("Unshared: %d/%d requests in %.3f s over %d connections\n",
+               ok, count, elapsedSeconds_Time(&start), value_Atomic(&benchConnections_));
+    }
+    /* Sequential requests in a shared session. */ {
+        iWebSession *session = new_WebSession();
+        set_Atomic(&benchConnections_, 0);
+        const iTime start = now_Time();
+        int ok = 0;
+        for (int i = 0; i < count; i++) {
+            iWebRequest *web = new_WebRequest();
+            setSession_WebRequest(web, session);
+            setUrl_WebRequest(web, url);
+            ok += get_WebRequest(web);
+            iRelease(web);
+        }
+        printf("Session:  %d/%d requests in %.3f s over %d connections\n",
+               ok, count, elapsedSeconds_Time(&start), value_Atomic(&benchConnections_));
+        iRelease(session);
+    }
+    /* Concurrent requests multiplexed on the session thread. */ {
+        iWebSession *session = new_WebSession();
+        set_Atomic(&benchFinished_, 0);
+        iConnect(WebSession, session, finished, session, countFinished_);
+        setMaxConnections_WebSession(session, 8, 8); /* stay below the service backlog */
+        set_Atomic(&benchConnections_, 0);
+        const iTime start = now_Time();
+        for (int i = 0; i < count; i++) {
+            iWebRequest *web = new_WebRequest();
+            setUrl_WebRequest(web, url);
+            submit_WebSession(session, web);
+            iRelease(web);
+        }
+        waitForIdle_WebSession(session);
+        printf("Async:    %d/%d requests in %.3f s over %d connections\n",
+               value_Atomic(&benchFinished_), count, elapsedSeconds_Time(&start),
+               value_Atomic(&benchConnections_));
+        /* Let the idle session thread exit; the next submission joins it and starts anew. */
+        sleep_Thread(2.5);
+        iWebRequest *web = new_WebRequest();
+        setUrl_WebRequest(web, url);
+        submit_WebSession(session, web);
+        iRelease(web);
+        waitForIdle_WebSession(session);
+        printf("Restart:  %d/%d requests finished\n", value_Atomic(&benchFinished_), count + 1);
+        iRelease(session);
+    }
+    close_Service(sv);
+    iRelease(sv);
+    iForEach(ObjectList, i, accepted) {
+        closeHttp_((iSocket *) i.object);
+    }
+    iRelease(accepted);
+}
+
+static void testWebSession_(uint16_t port) {
+    enum { numRequests = 20 };
+    init_Mutex(&benchMutex_);
+    iObjectList *accepted = new_ObjectList();
+    iService *sv = new_Service(port);
+    iConnect(Service, sv, incomingAccepted, accepted, acceptHttp_);
+    if (!open_Service(sv)) {
+        puts("Failed to start the local HTTP server");
+        return;
+    }
+    const iString *url = collect_String(newFormat_String("http://localhost:%u/", port));
+    iWebSession *session = new_WebSession();
+    iWebRequest *reqs[numRequests];
+    set_Atomic(&benchFinished_, 0);
+    iConnect(WebSession, session, finished, session, countFinished_);
+    const iTime start = now_Time();
+    for (int i = 0; i < numRequests; i++) {
+        reqs[i] = new_WebRequest();
+        setUrl_WebRequest(reqs[i], url);
+        submit_WebSession(session, reqs[i]);
+    }
+    waitForIdle_WebSession(session);
+    const double elapsed = elapsedSeconds_Time(&start);
+    int numOk = 0;
+    for (int i = 0; i < numRequests; i++) {
+        numOk += (status_WebRequest(reqs[i]) == finished_WebRequestStatus &&
+                  !cmpCStr_Block(result_WebRequest(reqs[i]), "hello"));
+        iRelease(reqs[i]);
+    }
+    printf("WebSession: %d/%d requests ok, %d finished, idle after %.3f s\n",
+           numOk, numRequests, value_Atomic(&benchFinished_), elapsed);
+    iAssert(numOk == numRequests);
+    iAssert(value_Atomic(&benchFinished_) == numRequests);
+    iAssert(numOngoing_WebSession(session) == 0);
+    iRelease(session);
+    close_Service(sv);
+    iRelease(sv);
+    iForEach(ObjectList, i, accepted) {
+        closeHttp_((iSocket *) i.object);
+    }
+    iRelease(accepted);
+}
+#endif
+
 #if defined (iHaveTlsRequest)
 void printTlsRequestProgress_(iAnyObject *obj) {
     iTlsRequest *d = obj;
@@ -156,6 +423,165 @@ void printTlsRequestResult_(iAnyObject *obj) {
     printf("--------TlsRequest-Result--------\n%s\n--------End-of-Result--------\n",
            cstr_Block(result));
 }
+
+static void benchmarkTlsRequest_(const iString *host, uint16_t port, int count) {
+    /* Sequential requests to the same server, e.g., `openssl s_server -www`. */
+    iBlock *pinned = NULL;
+    for (int pass = 0; pass < 3; pass++) {
+        setSessionCacheEnabled_TlsRequest(pass == 1);
+        resetHandshakeStats_TlsRequest();
+        const iTime start = now_Time();
+        int numOk = 0;
+        for (int i = 0; i < count; i++) {
+            iTlsRequest *tls = new_TlsRequest();
+            setHost_TlsRequest(tls, host, port);
+            setContent_TlsRequest(tls, collect_Block(newCStr_Block("GET / HTTP/1.0\r\n\r\n")));
+            setPinnedPublicKey_TlsRequest(tls, pass == 2 ? pinned : NULL);
+            submit_TlsRequest(tls);
+            waitForFinished_TlsRequest(tls);
+            if (status_TlsRequest(tls) == finished_TlsRequestStatus) {
+                numOk++;
+            }
+            if (!pinned && serverCertificate_TlsRequest(tls)) {
+                pinned = publicKeyFingerprint_TlsCertificate(serverCertificate_TlsRequest(tls));
+            }
+            iRelease(tls);
+        }
+        iTlsHandshakeStats stats;
+        handshakeStats_TlsRequest(&stats);
+        printf("%-13s %d/%d requests in %.3f s (full handshakes: %d, resumed: %d)\n",
+               pass == 0 ? "No cache:" : pass == 1 ? "Cache:" : "Pinned key:",
+               numOk, count, elapsedSeconds_Time(&start), stats.numFull, stats.numResumed);
+    }
+    delete_Block(pinned);
+}
+
+/* Echo server for exercising TLS on Service. */
+
+static void echoTls_(iAny *d, iSocket *sock) {
+    iUnused(d);
+    iBlock *data = readAll_Socket(sock);
+    write_Socket(sock, data);
+    delete_Block(data);
+}
+
+static void acceptTls_(iAny *d, iService *sv, iSocket *sock) {
+    iUnused(sv);
+    iForEach(ObjectList, i, d) {
+        if (status_Socket((iSocket *) i.object) == disconnected_SocketStatus) {
+            close_Socket((iSocket *) i.object);
+            remove_ObjectListIterator(&i);
+        }
+    }
+    iConnect(Socket, sock, readyRead, sock, echoTls_);
+    echoTls_(NULL, sock); /* may have received data before we started observing */
+    pushBack_ObjectList(d, sock); /* only called in the listening thread */
+}
+
+static void testTlsService_(int count, uint16_t port) {
+    iDate expiry;
+    initCurrent_Date(&expiry);
+    expiry.year++;
+    const iTlsCertificateName names[] = {
+        { subjectCommonName_TlsCertificateNameType, collectNewCStr_String("localhost") },
+        { 0, NULL }
+    };
+    iTlsCertificate *cert = newSelfSignedRSA_TlsCertificate(2048, expiry, names);
+    iObjectList *accepted = new_ObjectList();
+    iService *sv = new_Service(port);
+    iConnect(Service, sv, incomingAccepted, accepted, acceptTls_);
+    if (!setCertificate_Service(sv, cert) || !open_Service(sv)) {
+        puts("Failed to start the local TLS server");
+        return;
+    }
+    resetHandshakeStats_TlsRequest();
+    const iTime start = now_Time();
+    int numOk = 0;
+    for (int i = 0; i < count; i++) {
+        iString *msg = collect_String(newFormat_String("hello %d", i));
+        iTlsRequest *tls = new_TlsRequest();
+        setHost_TlsRequest(tls, collectNewCStr_String("localhost"), port);
+        setContent_TlsRequest(tls, utf8_String(msg));
+        submit_TlsRequest(tls);
+        while (status_TlsRequest(tls) == submitted_TlsRequestStatus &&
+               receivedBytes_TlsRequest(tls) < size_String(msg)) {
+            sleep_Thread(0.001);
+        }
+        iBlock *echo = collect_Block(readAll_TlsRequest(tls));
+        if (!cmp_Block(echo, utf8_String(msg)) &&
+            equal_TlsCertificate(serverCertificate_TlsRequest(tls), cert)) {
+            numOk++;
+        }
+        cancel_TlsRequest(tls);
+        iRelease(tls);
+    }
+    iTlsHandshakeStats stats;
+    handshakeStats_TlsRequest(&stats);
+    printf("TLS echo: %d/%d requests in %.3f s (full handshakes: %d, resumed: %d)\n",
+           numOk, count, elapsedSeconds_Time(&start), stats.numFull, stats.numResumed);
+    /* All requests in flight at once; they share the client's one reactor thread. */ {
+        const iTime startConcurrent = now_Time();
+        const iBlock *msg = collect_Block(newCStr_Block("concurrent"));
+        iTlsRequest **reqs = malloc(sizeof(iTlsRequest *) * count);
+        for (int i = 0; i < count; i++) {
+            reqs[i] = new_TlsRequest();
+            setHost_TlsRequest(reqs[i], collectNewCStr_String("localhost"), port);
+            setContent_TlsRequest(reqs[i], msg);
+            submit_TlsRequest(reqs[i]);
+        }
+        numOk = 0;
+        for (int i = 0; i < count; i++) {
+            while (status_TlsRequest(reqs[i]) == submitted_TlsRequestStatus &&
+                   receivedBytes_TlsRequest(reqs[i]) < size_Block(msg)) {
+                sleep_Thread(0.001);
+            }
+            iBlock *echo = readAll_TlsRequest(reqs[i]);
+            if (!cmp_Block(echo, msg)) {
+                numOk++;
+            }
+            delete_Block(echo);
+        }
+        for (int i = 0; i < count; i++) {
+            iRelease(reqs[i]); /* cancels the request */
+        }
+        free(reqs);
+        printf("TLS echo: %d/%d concurrent requests in %.3f s\n",
+               numOk, count, elapsedSeconds_Time(&startConcurrent));
+    }
+    /* A session cached by an unpinned request must not let a pinned one skip the check. */ {
+        iBlock *goodPin = publicKeyFingerprint_TlsCertificate(cert);
+        iBlock *wrongPin = new_Block(size_Block(goodPin)); /* zeroed */
+        const iBlock *pins[3] = { NULL, wrongPin, goodPin };
+        enum iTlsRequestStatus results[3];
+        for (int i = 0; i < 3; i++) {
+            iTlsRequest *tls = new_TlsRequest();
+            setHost_TlsRequest(tls, collectNewCStr_String("localhost"), port);
+            setContent_TlsRequest(tls, collect_Block(newCStr_Block("pinned")));
+            setPinnedPublicKey_TlsRequest(tls, pins[i]);
+            submit_TlsRequest(tls);
+            while (status_TlsRequest(tls) == submitted_TlsRequestStatus &&
+                   receivedBytes_TlsRequest(tls) < 6) {
+                sleep_Thread(0.001);
+            }
+            results[i] = receivedBytes_TlsRequest(tls) == 6 ? finished_TlsRequestStatus
+                                                              : status_TlsRequest(tls);
+            iRelease(tls);
+        }
+        printf("TLS pinning: unpinned %s, wrong pin %s, correct pin %s\n",
+               results[0] == finished_TlsRequestStatus ? "ok" : "FAILED",
+               results[1] == error_TlsRequestStatus ? "rejected" : "ACCEPTED",
+               results[2] == finished_TlsRequestStatus ? "ok" : "FAILED");
+        delete_Block(wrongPin);
+        delete_Block(goodPin);
+    }
+    close_Service(sv);
+    iRelease(sv);
+    iForEach(ObjectList, i, accepted) {
+        close_Socket((iSocket *) i.object);
+    }
+    iRelease(accepted);
+    delete_TlsCertificate(cert);
+}
 #endif
 
 int main(int argc, char *argv[]) {
@@ -199,8 +625,26 @@ int main(int argc, char *argv[]) {
             }
             return 0;
         }
+        iCommandLineArg *webBench = iClob(checkArgumentValuesN_CommandLine(cmdline, "webbench", 1, 2));
+        if (webBench) {
+            benchmarkWebRequest_(toInt_String(value_CommandLineArg(webBench, 0)),
+                                 size_StringList(values_CommandLineArg(webBench)) > 1
+                                     ? toInt_String(value_CommandLineArg(webBench, 1))
+                                     : 14667);
+            return 0;
+        }
 #endif
     }
+#if !defined (iPlatformWindows)
+    iCommandLineArg *acceptBench = iClob(checkArgumentValuesN_CommandLine(cmdline, "acceptbench", 1, 2));
+    if (acceptBench) {
+        benchmarkService_(toInt_String(value_CommandLineArg(acceptBench, 0)),
+                          size_StringList(values_CommandLineArg(acceptBench)) > 1
+                              ? toInt_String(value_CommandLineArg(acceptBench, 1))
+                              : 14669);
+        return 0;
+    }
+#endif
 #if defined (iHaveTlsRequest)
     /* Perform a TLS request. */ {
         if (contains_CommandLine(cmdline, "cert")) {
@@ -238,6 +682,21 @@ int main(int argc, char *argv[]) {
             delete_TlsCertificate(cert);
             return 0;
         }
+        iCommandLineArg *tlsBench = iClob(checkArgumentValues_CommandLine(cmdline, "tlsbench", 3));
+        if (tlsBench) {
+            benchmarkTlsRequest_(value_CommandLineArg(tlsBench, 0),
+                                 toInt_String(value_CommandLineArg(tlsBench, 1)),
+                                 toInt_String(value_CommandLineArg(tlsBench, 2)));
+            return 0;
+        }
+        iCommandLineArg *tlsService = iClob(checkArgumentValuesN_CommandLine(cmdline, "tlsservice", 1, 2));
+        if (tlsService) {
+            testTlsService_(toInt_String(value_CommandLineArg(tlsService, 0)),
+                            size_StringList(values_CommandLineArg(tlsService)) > 1
+                                ? toInt_String(value_CommandLineArg(tlsService, 1))
+                                : 14668);
+            return 0;
+        }
         iCommandLineArg *tlsArgs = iClob(checkArgumentValues_CommandLine(cmdline, "t;tls", 2));
         if (tlsArgs) {
             iTlsRequest *tls = iClob(new_TlsRequest());
@@ -274,6 +733,9 @@ int main(int argc, char *argv[]) {
         connectTo_("localhost");
     }
     else {
+#if defined (iHaveWebRequest)
+        testWebSession_(14670);
+#endif
         iCommandLineArg *arg = checkArgumentValuesN_CommandLine(cmdline, "h;host", 1, 1);
         if (arg) {
             connectTo_(cstr_String(value_CommandLineArg(arg, 0)));
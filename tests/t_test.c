@@ -26,19 +26,24 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
 
 #include <the_Foundation/array.h>
 #include <the_Foundation/block.h>
+#include <the_Foundation/btree.h>
 #include <the_Foundation/buffer.h>
 #include <the_Foundation/class.h>
 #include <the_Foundation/commandline.h>
+#include <the_Foundation/cpu.h>
+#include <the_Foundation/digest.h>
 #include <the_Foundation/file.h>
 #include <the_Foundation/fileinfo.h>
 #include <the_Foundation/garbage.h>
 #include <the_Foundation/hash.h>
+#include <the_Foundation/intset.h>
 #include <the_Foundation/map.h>
 #include <the_Foundation/math.h>
 #include <the_Foundation/hash.h>
 #include <the_Foundation/object.h>
 #include <the_Foundation/objectlist.h>
 #include <the_Foundation/path.h>
+#include <the_Foundation/random.h>
 #include <the_Foundation/ptrarray.h>
 #include <the_Foundation/ptrset.h>
 #include <the_Foundation/regexp.h>
@@ -47,8 +52,11 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
 #include <the_Foundation/stringarray.h>
 #include <the_Foundation/stringlist.h>
 #include <the_Foundation/stringhash.h>
+#include <the_Foundation/stringset.h>
 #include <the_Foundation/time.h>
+#include <the_Foundation/toml.h>
 #include <the_Foundation/thread.h>
+#include <the_Foundation/threadpool.h>
 #include <the_Foundation/xml.h>
 
 #include <stdio.h>
@@ -100,6 +108,17 @@ static void printBytes(const uint8_t *data, size_t size) {
     puts(" ]");
 }
 
+static iBool equalHex_(const uint8_t *data, size_t size, const char *hex) {
+    for (size_t i = 0; i < size; ++i) {
+        char byte[3];
+        snprintf(byte, sizeof(byte), "%02x", data[i]);
+        if (strncmp(byte, hex + 2 * i, 2)) {
+            return iFalse;
+        }
+    }
+    return strlen(hex) == 2 * size;
+}
+
 static void printIntArray(const iArray *d) {
     printf("%4lu :", size_Array(d));
     iConstForEach(Array, i, d) {
@@ -132,6 +151,32 @@ static int compareIntPairElements(const void *a, const void *b) {
     return iCmp(x[1], y[1]);
 }
 
+static int64_t firstIntKey(const void *a) {
+    return *(const int *) a;
+}
+
+static iBool isSortedStably(const iArray *pairs) {
+    for (size_t i = 1; i < size_Array(pairs); i++) {
+        const int *x = constAt_Array(pairs, i - 1);
+        const int *y = constAt_Array(pairs, i);
+        if (x[0] > y[0] || (x[0] == y[0] && x[1] > y[1])) {
+            return iFalse;
+        }
+    }
+    return iTrue;
+}
+
+iDeclareType(SortNode)
+
+struct Impl_SortNode {
+    iListNode node;
+    int value;
+};
+
+static int compareSortNodes(const void *a, const void *b) {
+    return iCmp(((const iSortNode *) a)->value, ((const iSortNode *) b)->value);
+}
+
 static int compareIntegers(iMapKey a, iMapKey b) {
     return iCmp(a, b);
 }
@@ -152,6 +197,118 @@ static iThreadResult run_WorkerThread(iThread *d) {
     return 12345;
 }
 
+static size_t queryXml_(const iXmlElement *elem, int rounds) {
+    /* Looks up each element's last child and attribute by name, many times over. */
+    size_t found = 0;
+    const iXmlElement *last = NULL;
+    for (const iXmlElement *child = elem->firstChild; child; child = child->nextSibling) {
+        found += queryXml_(child, rounds);
+        last = child;
+    }
+    const char *childName = last ? cstr_Rangecc(last->name) : "none";
+    const char *attrName  = elem->numAttribs ? cstr_Rangecc(elem->attribs[elem->numAttribs - 1].name)
+                                             : "none";
+    for (int i = 0; i < rounds; i++) {
+        found += (child_XmlElement(elem, childName) != NULL);
+        const iRangecc value = attribute_XmlElement(elem, attrName);
+        found += (value.start != NULL);
+    }
+    return found;
+}
+
+static void benchmarkXml_(const iString *path, int count) {
+    iFile *f = new_File(path);
+    if (!open_File(f, readOnly_FileMode | text_FileMode)) {
+        printf("cannot open %s\n", cstr_String(path));
+        iRelease(f);
+        return;
+    }
+    iString *src = readString_File(f);
+    iRelease(f);
+    iXmlDocument *doc = new_XmlDocument();
+    iTime start = now_Time();
+    iBool ok = iTrue;
+    for (int i = 0; i < count && ok; i++) {
+        ok = parse_XmlDocument(doc, src);
+    }
+    printf("parsed %zu bytes %d times in %.3f s (%s)\n", size_String(src), count,
+           elapsedSeconds_Time(&start), ok ? "ok" : "failed");
+    start = now_Time();
+    size_t found = queryXml_(&doc->root, 100);
+    printf("scanning lookups: %zu found in %.3f s\n", found, elapsedSeconds_Time(&start));
+    start = now_Time();
+    buildIndex_XmlDocument(doc);
+    printf("index built in %.3f s\n", elapsedSeconds_Time(&start));
+    start = now_Time();
+    found = queryXml_(&doc->root, 100);
+    printf("indexed lookups:  %zu found in %.3f s\n", found, elapsedSeconds_Time(&start));
+    start = now_Time();
+    delete_XmlDocument(doc);
+    printf("document deleted in %.6f s\n", elapsedSeconds_Time(&start));
+    delete_String(src);
+}
+
+static void countTomlValue_(void *context, const iString *table, const iString *key,
+                            const iTomlValue *value) {
+    iUnused(table, key);
+    double *sum = context;
+    *sum += value->type == string_TomlType ? size_String(value->value.string)
+                                           : number_TomlValue(value);
+}
+
+static void countTomlRangeValue_(void *context, iRangecc table, iRangecc key,
+                                 const iTomlValue *value) {
+    iUnused(table, key);
+    double *sum = context;
+    *sum += value->type == string_TomlType ? size_Range(&value->value.range)
+                                           : number_TomlValue(value);
+}
+
+static void appendTomlValue_(void *context, const iString *table, const iString *key,
+                             const iTomlValue *value) {
+    iString *out = context;
+    if (value->type == string_TomlType) {
+        appendFormat_String(out, "%s %s=%s; ", cstr_String(table), cstr_String(key),
+                            cstr_String(value->value.string));
+    }
+    else {
+        appendFormat_String(out, "%s %s=%g; ", cstr_String(table), cstr_String(key),
+                            number_TomlValue(value));
+    }
+}
+
+static void benchmarkToml_(int count) {
+    iString *src = new_String();
+    for (int i = 0; i < count; i++) {
+        if (i % 100 == 0) {
+            appendFormat_String(src, "\n[table%d]  # comment\n", i / 100);
+        }
+        switch (i % 5) {
+            case 0: appendFormat_String(src, "int%d = %d\n", i, i); break;
+            case 1: appendFormat_String(src, "float%d = %d.5  # half\n", i, i); break;
+            case 2: appendFormat_String(src, "str%d = \"value %d\"\n", i, i); break;
+            case 3: appendFormat_String(src, "esc%d = \"tab\\there\\n\"\n", i); break;
+            case 4: appendFormat_String(src, "flag%d = %s\n", i, i & 1 ? "true" : "false"); break;
+        }
+    }
+    iTomlParser *toml = new_TomlParser();
+    double sum = 0;
+    setHandlers_TomlParser(toml, NULL, countTomlValue_, &sum);
+    iTime start = now_Time();
+    iBool ok = parse_TomlParser(toml, src);
+    printf("TOML: %d keys (%zu bytes) with String handlers in %.3f s (%s, sum %.1f)\n", count,
+           size_String(src), elapsedSeconds_Time(&start), ok ? "ok" : "errors", sum);
+    sum = 0;
+    setHandlers_TomlParser(toml, NULL, NULL, NULL);
+    setRangeHandlers_TomlParser(toml, NULL, countTomlRangeValue_, &sum);
+    start = now_Time();
+    ok = parse_TomlParser(toml, src);
+    printf("TOML: %d keys (%zu bytes) with range handlers in %.3f s (%s, sum %.1f)\n", count,
+           size_String(src), elapsedSeconds_Time(&start), ok ? "ok" : "errors", sum);
+    delete_TomlParser(toml);
+    delete_String(src);
+}
+
 int main(int argc, char *argv[]) {
     init_Foundation();
     /* Test command line options parsing. */ {
@@ -212,6 +369,18 @@ int main(int argc, char *argv[]) {
         if (contains_CommandLine(cmdline, "d")) {
             puts("d option");
         }
+        arg = iClob(checkArgumentValues_CommandLine(cmdline, "tomlbench", 1));
+        if (arg) {
+            benchmarkToml_(toInt_String(value_CommandLineArg(arg, 0)));
+            return 0;
+        }
+        arg = iClob(checkArgumentValuesN_CommandLine(cmdline, "xmlbench", 1, 2));
+        if (arg) {
+            benchmarkXml_(value_CommandLineArg(arg, 0),
+                          size_StringList(values_CommandLineArg(arg)) > 1
+                              ? toInt_String(value_CommandLineArg(arg, 1)) : 1);
+            return 0;
+        }
         arg = iClob(checkArgumentValues_CommandLine(cmdline, "xml", 1));
         if (arg) {
             puts("xml option:");
@@ -341,6 +510,138 @@ int main(int argc, char *argv[]) {
         puts("");
         iRelease(olist);
     }
+    /* Test sorting large lists and arrays. */ {
+        enum { count = 200000 };
+        /* Sorted and reverse-sorted input. */
+        iSortNode *nodes = malloc(sizeof(iSortNode) * count);
+        iList list;
+        init_List(&list);
+        for (int i = 0; i < count; i++) {
+            nodes[i].value = (i < count / 2 ? i : count - i);
+            pushBack_List(&list, &nodes[i]);
+        }
+        iTime start = now_Time();
+        sort_List(&list, compareSortNodes);
+        int prev = -1;
+        size_t numSorted = 0;
+        iConstForEach(List, i, &list) {
+            const int value = ((const iSortNode *) i.value)->value;
+            numSorted += (value >= prev);
+            prev = value;
+        }
+        printf("Sorted a list of %d nodes in %.3f s (%s)\n", count, elapsedSeconds_Time(&start),
+               numSorted == count ? "ok" : "FAILED");
+        free(nodes);
+        /* Array of (key, original position) pairs; only the key is compared. */
+        iArray *pairs = new_Array(sizeof(int) * 2);
+        for (int i = 0; i < count; i++) {
+            pushBack_Array(pairs, (int[]){ iRandom(0, 1000), i });
+        }
+        iArray *copy = copy_Array(pairs);
+        start = now_Time();
+        qsort(data_Array(copy), size_Array(copy), copy->elementSize, compareIntElements);
+        printf("qsort:              %.3f s\n", elapsedSeconds_Time(&start));
+        setCopy_Array(copy, pairs);
+        start = now_Time();
+        sort_Array(copy, compareIntElements);
+        printf("sort_Array:         %.3f s (%s)\n", elapsedSeconds_Time(&start),
+               isSortedStably(copy) ? "stable" : "FAILED");
+        setCopy_Array(copy, pairs);
+        start = now_Time();
+        sortKey_Array(copy, firstIntKey);
+        printf("sortKey_Array:      %.3f s (%s)\n", elapsedSeconds_Time(&start),
+               isSortedStably(copy) ? "stable" : "FAILED");
+        iThreadPool *pool = newLimits_ThreadPool(4, 0);
+        setCopy_Array(copy, pairs);
+        start = now_Time();
+        sortParallel_Array(copy, compareIntElements, pool);
+        printf("sortParallel_Array: %.3f s (%s)\n", elapsedSeconds_Time(&start),
+               isSortedStably(copy) ? "stable" : "FAILED");
+        iRelease(pool);
+        delete_Array(copy);
+        delete_Array(pairs);
+        /* Strings. */
+        iStringList *strings = newStringsCStr_StringList("pear", "apple", "fig", "banana", NULL);
+        sort_StringList(strings, NULL);
+        iString *joined = joinCStr_StringList(strings, " ");
+        printf("Sorted strings: %s\n", cstr_String(joined));
+        iAssert(equal_String(joined, collectNewCStr_String("apple banana fig pear")));
+        delete_String(joined);
+        iRelease(strings);
+    }
+    /* Test building sets in bulk. */ {
+        enum { count = 20000 };
+        int *values = malloc(sizeof(int) * count);
+        for (int i = 0; i < count; i++) {
+            values[i] = iRandom(-count, count);
+        }
+        iIntSet *ints = new_IntSet();
+        iTime start = now_Time();
+        for (int i = 0; i < count; i++) {
+            insert_IntSet(ints, values[i]);
+        }
+        printf("insert_IntSet:  %.3f s\n", elapsedSeconds_Time(&start));
+        start = now_Time();
+        iIntSet *bulk = newN_IntSet(values, count);
+        printf("newN_IntSet:    %.3f s (%s)\n", elapsedSeconds_Time(&start),
+               equal_Array(&ints->values, &bulk->values) ? "ok" : "FAILED");
+        /* Merge the odd values into a set of the even ones. */
+        iIntSet *evens = new_IntSet();
+        iIntSet *odds  = new_IntSet();
+        iConstForEach(IntSet, i, ints) {
+            insert_IntSet(*i.value & 1 ? odds : evens, *i.value);
+        }
+        merge_IntSet(evens, odds);
+        printf("merge_IntSet: %s\n", equal_Array(&ints->values, &evens->values) ? "ok" : "FAILED");
+        delete_IntSet(odds);
+        delete_IntSet(evens);
+        delete_IntSet(bulk);
+        delete_IntSet(ints);
+        /* Pointers. */
+        const void **ptrValues = malloc(sizeof(void *) * count);
+        iPtrSet *ptrs = new_PtrSet();
+        for (int i = 0; i < count; i++) {
+            ptrValues[i] = values + (values[i] + count) / 2;
+            insert_PtrSet(ptrs, ptrValues[i]);
+        }
+        iPtrSet *bulkPtrs = new_PtrSet();
+        insertN_PtrSet(bulkPtrs, ptrValues, count);
+        free(ptrValues);
+        printf("insertN_PtrSet: %s\n", equal_Array(&ptrs->values, &bulkPtrs->values) ? "ok" : "FAILED");
+        delete_PtrSet(bulkPtrs);
+        delete_PtrSet(ptrs);
+        /* Strings. */
+        iString *strs = malloc(sizeof(iString) * count);
+        const iString **strPtrs = malloc(sizeof(iString *) * count);
+        for (int i = 0; i < count; i++) {
+            init_String(&strs[i]);
+            format_String(&strs[i], "%x", values[i] & 0xfff);
+            strPtrs[i] = &strs[i];
+        }
+        iStringSet *strings = new_StringSet();
+        start = now_Time();
+        for (int i = 0; i < count; i++) {
+            insert_StringSet(strings, &strs[i]);
+        }
+        printf("insert_StringSet: %.3f s\n", elapsedSeconds_Time(&start));
+        start = now_Time();
+        iStringSet *bulkStrings = newN_StringSet(strPtrs, count);
+        size_t numEqual = 0;
+        for (size_t i = 0; i < iMin(size_StringSet(strings), size_StringSet(bulkStrings)); i++) {
+            numEqual += equal_String(constAt_StringSet(strings, i), constAt_StringSet(bulkStrings, i));
+        }
+        printf("newN_StringSet:   %.3f s (%s)\n", elapsedSeconds_Time(&start),
+               numEqual == size_StringSet(strings) && numEqual == size_StringSet(bulkStrings)
+                   ? "ok" : "FAILED");
+        iRelease(bulkStrings);
+        iRelease(strings);
+        for (int i = 0; i < count; i++) {
+            deinit_String(&strs[i]);
+        }
+        free(strPtrs);
+        free(strs);
+        free(values);
+    }
     /* Test a character range. */ {
         const char *space = { "\t\r\xff\xff\xff\xff\n\v" }; /* bad UTF-8 in the middle */
         iRangecc spaceRange = { space, space + strlen(space) };
@@ -418,6 +719,152 @@ int main(int argc, char *argv[]) {
         delete_Map(map);
         iEndCollect();
     }
+    /* Test range queries and order statistics. */ {
+        enum { range = 3000 };
+        iMap *map = new_Map(compareIntegers);
+        iSortedArray *sorted = new_SortedArray(sizeof(int), compareIntElements);
+        iMapNode *nodes = calloc(range, sizeof(iMapNode));
+        for (int i = 0; i < 1000; i++) {
+            const int key = iRandom(0, range);
+            nodes[key].key = key;
+            insert_Map(map, &nodes[key]);
+            insert_SortedArray(sorted, &(int){ key });
+        }
+        for (int i = 0; i < 300; i++) {
+            const int key = iRandom(0, range);
+            remove_Map(map, key);
+            remove_SortedArray(sorted, &(int){ key });
+        }
+        size_t numErrors = 0;
+        for (int key = -1; key <= range; key++) {
+            /* Expected results by a linear scan. */
+            size_t rank = 0;
+            const iMapNode *floor = NULL, *ceiling = NULL;
+            iConstForEach(Map, i, map) {
+                if (i.value->key < key) rank++;
+                if (i.value->key <= key) floor = i.value;
+                if (i.value->key >= key && !ceiling) ceiling = i.value;
+            }
+            numErrors += (rank_Map(map, key) != rank);
+            numErrors += (floor_Map(map, key) != floor);
+            numErrors += (ceiling_Map(map, key) != ceiling);
+            numErrors += (at_Map(map, rank) != ceiling);
+            iMapConstIterator lower;
+            initLowerBound_MapConstIterator(&lower, map, key);
+            numErrors += (lower.value != ceiling);
+            iMapReverseConstIterator upper;
+            initUpperBound_MapReverseConstIterator(&upper, map, key);
+            numErrors += (upper.value != floor);
+            size_t pos;
+            numErrors += (lowerBound_SortedArray(sorted, &(int){ key }) != rank);
+            numErrors += (floor_SortedArray(sorted, &(int){ key }, &pos) != (floor != NULL));
+            numErrors += (floor && *(const int *) constAt_SortedArray(sorted, pos) != floor->key);
+            numErrors += (ceiling_SortedArray(sorted, &(int){ key }, &pos) != (ceiling != NULL));
+            numErrors += (ceiling && *(const int *) constAt_SortedArray(sorted, pos) != ceiling->key);
+        }
+        printf("Range queries on %zu keys: %s\n", size_Map(map), numErrors ? "FAILED" : "ok");
+        /* A window of keys. */
+        size_t numInWindow = 0;
+        iMapIterator win;
+        for (initLowerBound_MapIterator(&win, map, 1000);
+             win.value && win.value->key < 2000;
+             next_MapIterator(&win)) {
+            numInWindow++;
+        }
+        printf("Keys in [1000, 2000): %zu (%s)\n", numInWindow,
+               numInWindow == rank_Map(map, 2000) - rank_Map(map, 1000) &&
+                       numInWindow == lowerBound_SortedArray(sorted, &(int){ 2000 }) -
+                                          lowerBound_SortedArray(sorted, &(int){ 1000 })
+                   ? "ok"
+                   : "FAILED");
+        delete_SortedArray(sorted);
+        delete_Map(map);
+        free(nodes);
+    }
+    /* Test a B+tree map and compare it with a Map. */ {
+#if defined (NDEBUG)
+        enum { count = 200000 };
+#else
+        enum { count = 5000 }; /* Map verifies the whole tree after each change */
+#endif
+        iMapKey *keys = malloc(sizeof(iMapKey) * count);
+        iMapNode *nodes = malloc(sizeof(iMapNode) * count);
+        for (int i = 0; i < count; i++) {
+            keys[i] = ((iMapKey) rand() << 16) ^ rand();
+        }
+        iMap *map = new_Map(compareIntegers);
+        iBTree *tree = new_BTree(NULL);
+        iTime start = now_Time();
+        for (int i = 0; i < count; i++) {
+            nodes[i].key = keys[i];
+            insert_Map(map, &nodes[i]);
+        }
+        printf("Map insert:   %.3f s\n", elapsedSeconds_Time(&start));
+        start = now_Time();
+        for (int i = 0; i < count; i++) {
+            insert_BTree(tree, keys[i], &nodes[i]);
+        }
+        printf("BTree insert: %.3f s\n", elapsedSeconds_Time(&start));
+        size_t numFound = 0;
+        start = now_Time();
+        for (int i = 0; i < count; i++) {
+            numFound += (value_Map(map, keys[i]) != NULL);
+        }
+        printf("Map lookup:   %.3f s\n", elapsedSeconds_Time(&start));
+        start = now_Time();
+        for (int i = 0; i < count; i++) {
+            numFound += (value_BTree(tree, keys[i]) != NULL);
+        }
+        printf("BTree lookup: %.3f s\n", elapsedSeconds_Time(&start));
+        iMapKey sum = 0;
+        start = now_Time();
+        iConstForEach(Map, mi, map) {
+            sum += mi.value->key;
+        }
+        printf("Map scan:     %.3f s\n", elapsedSeconds_Time(&start));
+        start = now_Time();
+        iConstForEach(BTree, bi, tree) {
+            sum -= bi.key;
+        }
+        printf("BTree scan:   %.3f s\n", elapsedSeconds_Time(&start));
+        /* Both must have the same keys in the same order. */
+        size_t numSame = 0;
+        iBTreeConstIterator b;
+        init_BTreeConstIterator(&b, tree);
+        iConstForEach(Map, m, map) {
+            numSame += (b.value && b.key == m.value->key);
+            next_BTreeConstIterator(&b);
+        }
+        printf("BTree size %zu: %s\n", size_BTree(tree),
+               numFound == 2 * (size_t) count && sum == 0 && numSame == size_Map(map) &&
+                       size_BTree(tree) == size_Map(map)
+                   ? "ok"
+                   : "FAILED");
+        /* Range query from the middle of the key range. */
+        const iMapKey rangeStart = INT64_C(1) << 44, rangeEnd = INT64_C(1) << 45;
+        size_t numInRange = 0;
+        for (initLowerBound_BTreeConstIterator(&b, tree, rangeStart);
+             b.value && b.key < rangeEnd;
+             next_BTreeConstIterator(&b)) {
+            numInRange++;
+        }
+        iBTreeReverseConstIterator rb;
+        for (initLowerBound_BTreeReverseConstIterator(&rb, tree, rangeEnd);
+             rb.value && rb.key >= rangeStart;
+             next_BTreeReverseConstIterator(&rb)) {
+            numInRange--;
+        }
+        printf("Range query: %s\n", numInRange == 0 ? "ok" : "FAILED");
+        for (int i = 0; i < count; i += 2) {
+            remove_BTree(tree, keys[i]);
+            remove_Map(map, keys[i]);
+        }
+        printf("Size after removals: %zu %zu\n", size_BTree(tree), size_Map(map));
+        delete_BTree(tree);
+        delete_Map(map);
+        free(nodes);
+        free(keys);
+    }
     /* Test reference counting. */ {
         iTestObject *a = new_TestObject(123);
         iTestObject *b = ref_Object(a);
@@ -491,6 +938,149 @@ int main(int argc, char *argv[]) {
         printBytes((const uint8_t *) constBegin_Block(data_Buffer(buf)), size_Buffer(buf));
         iRelease(buf);
     }
+    /* Test streaming XML parsing. */ {
+        const char *xml = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                          "<!-- comment --><feed lang='en'>\n"
+                          "  <entry id=\"1\" title=\"a &amp; b\"/>\n"
+                          "  <entry id=\"2\">caf\xc3\xa9 &lt;3<![CDATA[<raw>]]></entry>\n"
+                          "</feed>\n";
+        iBuffer *buf = new_Buffer();
+        openData_Buffer(buf, collect_Block(newCStr_Block(xml)));
+        iXmlReader *rd = new_XmlReader(stream_Buffer(buf));
+        enum iXmlReaderEvent ev;
+        while ((ev = next_XmlReader(rd)) != end_XmlReaderEvent && ev != error_XmlReaderEvent) {
+            if (ev == startElement_XmlReaderEvent) {
+                printf("%*s<%s> %zu attribs, id=%s\n", (int) depth_XmlReader(rd) * 2, "",
+                       cstr_Rangecc(name_XmlReader(rd)), size_Array(attributes_XmlReader(rd)),
+                       cstr_Rangecc(attribute_XmlReader(rd, "id")));
+            }
+            else if (ev == endElement_XmlReaderEvent) {
+                printf("%*s</%s>\n", (int) depth_XmlReader(rd) * 2 + 2, "",
+                       cstr_Rangecc(name_XmlReader(rd)));
+            }
+            else if (ev == text_XmlReaderEvent || ev == cdata_XmlReaderEvent) {
+                iString *text = collect_String(decodedText_XmlReader(rd));
+                trim_String(text);
+                if (!isEmpty_String(text)) {
+                    printf("%*s[%s]\n", (int) depth_XmlReader(rd) * 2 + 2, "", cstr_String(text));
+                }
+            }
+        }
+        printf("XML reader finished: %s\n", ev == error_XmlReaderEvent ? errorMessage_XmlReader(rd) : "ok");
+        delete_XmlReader(rd);
+        iRelease(buf);
+    }
+    /* Only whitespace and markup are allowed around a single root element. */ {
+        static const struct { const char *xml; iBool isValid; } docs_[] = {
+            { " \n<r/>\n ",                        iTrue  },
+            { "<?xml version='1.0'?><!-- c --><r/>", iTrue  },
+            { "junk<r/>more junk<s/>",              iFalse },
+            { "<r/>junk",                           iFalse },
+            { "<r/><s/>",                           iFalse },
+            { "<![CDATA[x]]><r/>",                  iFalse },
+            { "  ",                                 iFalse },
+        };
+        int numOk = 0;
+        iForIndices(i, docs_) {
+            iBuffer *buf = new_Buffer();
+            openData_Buffer(buf, collect_Block(newCStr_Block(docs_[i].xml)));
+            iXmlReader *rd = new_XmlReader(stream_Buffer(buf));
+            enum iXmlReaderEvent ev;
+            while ((ev = next_XmlReader(rd)) != end_XmlReaderEvent && ev != error_XmlReaderEvent) {}
+            numOk += ((ev == end_XmlReaderEvent) == docs_[i].isValid);
+            delete_XmlReader(rd);
+            iRelease(buf);
+        }
+        printf("XML top-level checks: %d/%zu ok\n", numOk, iElemCount(docs_));
+        iAssert(numOk == (int) iElemCount(docs_));
+    }
+    /* Entities, UTF-8 sequences, and CDATA sections span the reader's buffer refills. */ {
+        static const char *unit_ = "caf\xc3\xa9 &amp; &#x263A;"; /* 20 bytes */
+        static const char *cdataUnit_ = "x]]y]z>";
+        enum { numUnits = 8000, numCData = 20000 };
+        int numOk = 0, numPads = 0;
+        for (int pad = 0; pad < 20; pad++, numPads++) {
+            iString *xml      = collectNewCStr_String("<r>");
+            iString *expected = collectNew_String();
+            iString *text     = collectNew_String();
+            iString *cdata    = collectNew_String();
+            iString *expCData = collectNew_String();
+            iBool isSplitValid = iTrue;
+            for (int i = 0; i < pad; i++) {
+                appendCStr_String(xml, "a");
+                appendCStr_String(expected, "a");
+            }
+            for (int i = 0; i < numUnits; i++) {
+                appendCStr_String(xml, unit_);
+                appendCStr_String(expected, "caf\xc3\xa9 & \xe2\x98\xba");
+            }
+            appendCStr_String(xml, "<![CDATA[");
+            for (int i = 0; i < numCData; i++) {
+                appendCStr_String(xml, cdataUnit_);
+                appendCStr_String(expCData, cdataUnit_);
+            }
+            appendCStr_String(xml, "]]></r>");
+            iBuffer *buf = new_Buffer();
+            openData_Buffer(buf, collect_Block(copy_Block(utf8_String(xml))));
+            iXmlReader *rd = new_XmlReader(stream_Buffer(buf));
+            enum iXmlReaderEvent ev;
+            while ((ev = next_XmlReader(rd)) != end_XmlReaderEvent && ev != error_XmlReaderEvent) {
+                const iRangecc range = text_XmlReader(rd);
+                if (ev == text_XmlReaderEvent) {
+                    if (((unsigned char) *range.start & 0xc0) == 0x80) {
+                        isSplitValid = iFalse; /* starts in the middle of a UTF-8 sequence */
+                    }
+                    append_String(text, collect_String(decodedText_XmlReader(rd)));
+                }
+                else if (ev == cdata_XmlReaderEvent) {
+                    appendRange_String(cdata, range);
+                }
+            }
+            numOk += (ev == end_XmlReaderEvent && isSplitValid && equal_String(text, expected) &&
+                      equal_String(cdata, expCData));
+            delete_XmlReader(rd);
+            iRelease(buf);
+        }
+        printf("XML reader across refills: %d/%d ok\n", numOk, numPads);
+        iAssert(numOk == numPads);
+    }
+    /* Test the compatibility accessors of XmlElement. */ {
+        iXmlDocument *doc = new_XmlDocument();
+        const iBool ok = parse_XmlDocument(
+            doc, collectNewCStr_String("<?xml version=\"1.0\"?>"
+                                       "<r><a x=\"1\" y=\"2\"/><b/><c>text</c></r>"));
+        const iXmlElement *root = &doc->root;
+        const iXmlElement *a = child_XmlElement(root, "a");
+        iPtrArray *children = children_XmlElement(root);
+        iArray *attribs = attributes_XmlElement(a ? a : root);
+        printf("XmlElement: %s, %zu children, %zu attributes\n", ok ? "ok" : "failed",
+               size_PtrArray(children), size_Array(attribs));
+        iAssert(ok);
+        iAssert(size_PtrArray(children) == 3);
+        iAssert(constAt_PtrArray(children, 2) == child_XmlElement(root, "c"));
+        iAssert(size_Array(attribs) == 2);
+        iAssert(equal_Rangecc(((const iXmlAttribute *) constAt_Array(attribs, 1))->value, "2"));
+        delete_Array(attribs);
+        delete_PtrArray(children);
+        delete_XmlDocument(doc);
+        iXmlElement *empty = new_XmlElement();
+        iAssert(!child_XmlElement(empty, "a") && isEmpty_Range(&empty->name));
+        delete_XmlElement(empty);
+    }
+    /* Test TOML with '#' and '=' inside quotes. */ {
+        iString *src = collectNewCStr_String("[a.\"b#c\"]  # comment\n"
+                                             "\"x#y=z\" = \"v#w\"  # comment\n"
+                                             "'lit#' = 5 # comment\n");
+        iString *found = collectNew_String();
+        iTomlParser *toml = new_TomlParser();
+        setHandlers_TomlParser(toml, NULL, appendTomlValue_, found);
+        const iBool ok = parse_TomlParser(toml, src);
+        delete_TomlParser(toml);
+        printf("TOML quoting: %s; %s\n", ok ? "ok" : "errors", cstr_String(found));
+        iAssert(ok);
+        iAssert(equal_String(found, collectNewCStr_String("a.\"b#c\" \"x#y=z\"=v#w; "
+                                                          "a.\"b#c\" 'lit#'=5; ")));
+    }
     /* Test MD5 hashing. */ {
         const iString test = iStringLiteral("message digest");
         uint8_t md5[16];
@@ -498,6 +1088,80 @@ int main(int argc, char *argv[]) {
         printf("MD5 hash of \"%s\": ", cstr_String(&test));
         printBytes(md5, 16);
     }
+    /* Test digests. */ {
+        const char *abcHashes[] = {
+            "900150983cd24fb0d6963f7d28e17f72",
+            "a9993e364706816aba3e25717850c26c9cd0d89d",
+            "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad",
+            "6437b3ac38465133ffb63b75273a8db548c558465d79db03fd359c6cd5bd9d85",
+        };
+        iForIndices(i, abcHashes) {
+            iDigest digest;
+            init_Digest(&digest, i);
+            update_Digest(&digest, "a", 1);
+            update_Digest(&digest, "bc", 2);
+            uint8_t out[iDigestMaxSize];
+            final_Digest(&digest, out);
+            const iBool isCorrect = equalHex_(out, size_Digest(&digest), abcHashes[i]);
+            printf("%s of \"abc\" (%s): ", name_DigestAlgorithm(i), isCorrect ? "OK" : "WRONG");
+            printBytes(out, size_Digest(&digest));
+            iAssert(isCorrect);
+        }
+        /* Hash a file in pieces, and compare with hashing it in memory. */
+        const size_t size = 32 * 1024 * 1024 + 777;
+        iBlock *data = new_Block(size);
+        iRandomEngine *rnd = new_RandomEngine(50);
+        fill_RandomEngine(rnd, data_Block(data), size / 8);
+        delete_RandomEngine(rnd);
+        remove("digest.bin");
+        iFile *f = newCStr_File("digest.bin");
+        if (open_File(f, writeOnly_FileMode)) {
+            write_File(f, data);
+            close_File(f);
+        }
+        iThreadPool *pool = new_ThreadPool();
+        iTime start = now_Time();
+        uint8_t md5[16];
+        iMd5Hash(constData_Block(data), size, md5);
+        printf("iMd5Hash: %.0f MB/s\n", size / elapsedSeconds_Time(&start) / 1.0e6);
+        for (int alg = 0; alg <= blake3_DigestAlgorithm; ++alg) {
+            iDigest digest;
+            init_Digest(&digest, alg);
+            start = now_Time();
+            updateBlock_Digest(&digest, data);
+            const double memTime = elapsedSeconds_Time(&start);
+            iBlock *expected = finalBlock_Digest(&digest);
+            if (alg == md5_DigestAlgorithm) {
+                iAssert(!memcmp(constData_Block(expected), md5, 16));
+            }
+            for (int parallel = 0; parallel < 2; ++parallel) {
+                if (parallel && alg != blake3_DigestAlgorithm) {
+                    continue;
+                }
+                open_File(f, readOnly_FileMode);
+                start = now_Time();
+                const size_t numRead = updateStream_Digest(&digest, stream_File(f),
+                                                           parallel ? pool : NULL);
+                const double fileTime = elapsedSeconds_Time(&start);
+                close_File(f);
+                iBlock *result = finalBlock_Digest(&digest);
+                const iBool isMatch = numRead == size && cmp_Block(result, expected) == 0;
+                printf("%-7s %s: memory %.0f MB/s, file %.0f MB/s%s\n",
+                       name_DigestAlgorithm(alg),
+                       isMatch ? "OK" : "MISMATCH",
+                       size / memTime / 1.0e6,
+                       size / fileTime / 1.0e6,
+                       parallel ? " (parallel)" : "");
+                iAssert(isMatch);
+                delete_Block(result);
+            }
+            delete_Block(expected);
+        }
+        iRelease(pool);
+        iRelease(f);
+        delete_Block(data);
+        remove("digest.bin");
+    }
 #if defined (iHavePcre)
     /* Test regular expressions. */ {
         iString *s = newCStr_String("Hello world Äöäö, there is a \U0001f698 out there.");
@@ -532,6 +1196,38 @@ int main(int argc, char *argv[]) {
         delete_Block(compr);
     }
 #endif
+    /* Test substring search on all code paths. */ {
+        char hay[1200];
+        for (size_t i = 0; i < sizeof(hay) - 1; i++) {
+            hay[i] = "abcab"[(i * 7 + i / 13) % 5];
+        }
+        hay[sizeof(hay) - 1] = 0;
+        memcpy(hay + 1000, "needle", 6);
+        static const char *needles_[] = { "needle", "n", "abca", "cabcab", "xyz", "e" };
+        static const size_t limits_[] = { 0, 5, 31, 33, 999, 1005, 1006, 5000 };
+        const int paths[] = { all_CpuFeature, sse2_CpuFeature, 0 };
+        int mismatches = 0;
+        iForIndices(p, paths) {
+            setEnabledFeatures_Cpu(paths[p]);
+            iForIndices(i, needles_) {
+                const size_t len = strlen(needles_[i]);
+                iForIndices(k, limits_) {
+                    /* The first occurrence that fits entirely within the limit. */
+                    const char *expected = NULL;
+                    for (size_t pos = 0; pos + len <= iMin(limits_[k], strlen(hay)); pos++) {
+                        if (!memcmp(hay + pos, needles_[i], len)) {
+                            expected = hay + pos;
+                            break;
+                        }
+                    }
+                    mismatches += (iStrStrN(hay, needles_[i], limits_[k]) != expected);
+                }
+            }
+        }
+        setEnabledFeatures_Cpu(all_CpuFeature);
+        printf("iStrStrN: %d mismatches\n", mismatches);
+        iAssert(mismatches == 0);
+    }
     /* Test Punycode. */ {
         const iString domain = iStringLiteral("räksmörgås");
         iString *puny = collect_String(punyEncode_Rangecc(range_String(&domain)));
@@ -27,6 +27,23 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.</small>
 #include <the_Foundation/future.h>
 #include <the_Foundation/threadpool.h>
 #include <the_Foundation/math.h>
+#include <the_Foundation/block.h>
+#include <the_Foundation/buffer.h>
+#include <the_Foundation/concurrenthash.h>
+#include <the_Foundation/mutex.h>
+#include <the_Foundation/process.h>
+#include <the_Foundation/promise.h>
+#include <the_Foundation/random.h>
+#include <the_Foundation/ring.h>
+#include <the_Foundation/stringhash.h>
+#include <the_Foundation/stringlist.h>
+#include <the_Foundation/time.h>
+
+#if !defined (iPlatformWindows)
+#   include <the_Foundation/task.h>
+#   include <sys/socket.h>
+#   include <unistd.h>
+#endif
 
 static atomic_int thrCounter;
 
@@ -41,6 +58,367 @@ static iThreadResult run_Worker_(iThread *d) {
     return value;
 }
 
+enum { currentThreadCalls_ = 2000000 };
+
+static iThreadResult run_CurrentThreadLookups_(iThread *d) {
+    intptr_t mismatches = 0;
+    for (int i = 0; i < currentThreadCalls_; ++i) {
+        mismatches += (current_Thread() != d);
+    }
+    return mismatches;
+}
+
+iDeclareStaticClass(CachedValue)
+iDeclareType(CachedValue)
+
+struct Impl_CachedValue {
+    iObject object;
+    int index;
+};
+
+static void deinit_CachedValue(iAnyObject *any) {
+    iUnused(any);
+}
+
+static iDefineClass(CachedValue)
+
+static iCachedValue *new_CachedValue(int index) {
+    iCachedValue *d = iNew(CachedValue);
+    d->index = index;
+    return d;
+}
+
+enum { cacheKeys_ = 4096, cacheOps_ = 800000 };
+
+static iString *cacheKeyStrings_[cacheKeys_];
+
+iDeclareType(CacheBench)
+
+struct Impl_CacheBench {
+    iConcurrentHash *concHash;
+    iStringHash *    hash; /* baseline: a single lock for the whole hash */
+    iMutex           mutex;
+    int              numOps;
+};
+
+static iAnyObject *createCachedValue_(const iBlock *key, void *context) {
+    iUnused(key);
+    return new_CachedValue((int) (intptr_t) context);
+}
+
+static uint32_t nextCacheIndex_(uint32_t *seed) {
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 17;
+    *seed ^= *seed << 5;
+    return *seed;
+}
+
+/* Mixed workload: 80% lookups, 10% replacing inserts, 10% lookups that may create. */
+static iThreadResult run_CacheBench_(iThread *d) {
+    const iCacheBench *bench = userData_Thread(d);
+    uint32_t seed = (uint32_t) (uintptr_t) d | 1;
+    intptr_t mismatches = 0;
+    for (int i = 0; i < bench->numOps; ++i) {
+        const uint32_t rnd   = nextCacheIndex_(&seed);
+        const int      index = rnd % cacheKeys_;
+        const iString *key   = cacheKeyStrings_[index];
+        const int      op    = (rnd >> 16) % 10;
+        iCachedValue * value = NULL;
+        if (bench->concHash) {
+            if (op == 0) {
+                iCachedValue *newValue = new_CachedValue(index);
+                insertString_ConcurrentHash(bench->concHash, key, newValue);
+                iRelease(newValue);
+                continue;
+            }
+            value = op == 1 ? valueOrCreateString_ConcurrentHash(bench->concHash, key,
+                                                                 createCachedValue_,
+                                                                 (void *) (intptr_t) index)
+                            : valueString_ConcurrentHash(bench->concHash, key);
+        }
+        else {
+            iMutex *mtx = iConstCast(iMutex *, &bench->mutex);
+            if (op == 0) {
+                iCachedValue *newValue = new_CachedValue(index);
+                iGuardMutex(mtx, insert_StringHash(bench->hash, key, newValue));
+                iRelease(newValue);
+                continue;
+            }
+            iGuardMutex(mtx, value = ref_Object(value_StringHash(bench->hash, key)));
+        }
+        mismatches += (!value || value->index != index);
+        iRelease(value);
+    }
+    return mismatches;
+}
+
+static void runCacheBench_(iCacheBench *bench, const char *label) {
+    for (int numThreads = 1; numThreads <= 64; numThreads *= 2) {
+        iThread *threads[64];
+        bench->numOps = cacheOps_ / numThreads;
+        const iTime startTime = now_Time();
+        for (int i = 0; i < numThreads; ++i) {
+            threads[i] = new_Thread(run_CacheBench_);
+            setUserData_Thread(threads[i], bench);
+            start_Thread(threads[i]);
+        }
+        iThreadResult mismatches = 0;
+        for (int i = 0; i < numThreads; ++i) {
+            mismatches += result_Thread(threads[i]);
+            iRelease(threads[i]);
+        }
+        const double elapsed = elapsedSeconds_Time(&startTime);
+        printf("%s with %2d thread(s): %5.2f M ops/s%s\n",
+               label, numThreads, bench->numOps * numThreads / elapsed / 1.0e6,
+               mismatches ? " -- MISMATCHED VALUES" : "");
+    }
+}
+
+enum { ringItems_ = 1000000, ringBatch_ = 64 };
+
+iDeclareType(RingBench)
+
+struct Impl_RingBench {
+    iRing * ring;
+    iQueue *queue;
+    int     numItems;
+    iBool   batched;
+};
+
+static iThreadResult run_RingProducer_(iThread *d) {
+    const iRingBench *bench = userData_Thread(d);
+    if (bench->queue) {
+        for (int i = 0; i < bench->numItems; ++i) {
+            iCachedValue *item = new_CachedValue(i);
+            put_Queue(bench->queue, item);
+            iRelease(item);
+        }
+    }
+    else if (bench->batched) {
+        int items[ringBatch_];
+        for (int i = 0; i < bench->numItems; i += ringBatch_) {
+            const int count = iMin(ringBatch_, bench->numItems - i);
+            for (int j = 0; j < count; ++j) {
+                items[j] = i + j;
+            }
+            pushN_Ring(bench->ring, items, count);
+        }
+    }
+    else {
+        for (int i = 0; i < bench->numItems; ++i) {
+            push_Ring(bench->ring, &i);
+        }
+    }
+    return 0;
+}
+
+static void runRingBench_(iRingBench *bench, int numProducers, const char *label) {
+    iThread *threads[8];
+    const int64_t numItems = (int64_t) bench->numItems * numProducers;
+    const iTime startTime = now_Time();
+    for (int i = 0; i < numProducers; ++i) {
+        threads[i] = new_Thread(run_RingProducer_);
+        setUserData_Thread(threads[i], bench);
+        start_Thread(threads[i]);
+    }
+    int64_t sum = 0;
+    if (bench->queue) {
+        for (int64_t i = 0; i < numItems; ++i) {
+            iCachedValue *item = take_Queue(bench->queue);
+            sum += item->index;
+            iRelease(item);
+        }
+    }
+    else {
+        int items[ringBatch_];
+        for (int64_t i = 0; i < numItems; ) {
+            const size_t count = popN_Ring(bench->ring, items, bench->batched ? ringBatch_ : 1);
+            for (size_t j = 0; j < count; ++j) {
+                sum += items[j];
+            }
+            i += count;
+        }
+    }
+    for (int i = 0; i < numProducers; ++i) {
+        join_Thread(threads[i]);
+        iRelease(threads[i]);
+    }
+    const double elapsed = elapsedSeconds_Time(&startTime);
+    const int64_t expected = (int64_t) bench->numItems * (bench->numItems - 1) / 2 * numProducers;
+    printf("%-26s %d producer(s): %6.2f M items/s%s\n",
+           label, numProducers, numItems / elapsed / 1.0e6,
+           sum != expected ? " -- WRONG SUM" : "");
+}
+
+enum { loopSize_ = 4000000 };
+
+static void squares_(void *context, size_t begin, size_t end) {
+    double *values = context;
+    for (size_t i = begin; i < end; ++i) {
+        values[i] = (double) i * (double) i;
+    }
+}
+
+static void sumValues_(void *context, size_t begin, size_t end, void *partial) {
+    const double *values = context;
+    uint64_t sum = 0;
+    for (size_t i = begin; i < end; ++i) {
+        sum += (uint64_t) values[i];
+    }
+    *(uint64_t *) partial += sum;
+}
+
+static void addSum_(void *context, void *result, const void *partial) {
+    iUnused(context);
+    *(uint64_t *) result += *(const uint64_t *) partial;
+}
+
+iDeclareType(LoopChunk)
+
+struct Impl_LoopChunk {
+    double *values;
+    size_t  begin;
+    size_t  end;
+};
+
+static void countInsideCircle_(void *context, size_t begin, size_t end, void *partial) {
+    iUnused(context);
+    uint64_t inside = 0;
+    for (size_t i = begin; i < end; ++i) {
+        const float x = iRandomf(), y = iRandomf();
+        inside += (x * x + y * y < 1.f);
+    }
+    *(uint64_t *) partial += inside;
+}
+
+static iThreadResult run_LoopChunk_(iThread *d) {
+    const iLoopChunk *chunk = userData_Thread(d);
+    squares_(chunk->values, chunk->begin, chunk->end);
+    return 0;
+}
+
+iDeclareType(NestedLoop)
+
+struct Impl_NestedLoop {
+    iThreadPool *pool;
+    double *     values;
+    size_t       begin;
+};
+
+/* A job that runs a parallel loop of its own in the same pool. */
+static void runNestedLoop_(void *context) {
+    const iNestedLoop *d = context;
+    parallelFor_ThreadPool(d->pool, d->begin, d->begin + loopSize_ / 8, 0, squares_, d->values);
+}
+
+static atomic_int stagesCalled_;
+
+/* Pipeline stages: each produces a new value from the previous one. */
+static iAnyObject *fetch_(iPromise *promise, void *context) {
+    iUnused(promise);
+    stagesCalled_++;
+    return new_CachedValue((int) (intptr_t) context);
+}
+
+static iAnyObject *decompress_(const iAnyObject *value, void *context) {
+    iUnused(context);
+    stagesCalled_++;
+    return new_CachedValue(((const iCachedValue *) value)->index * 2);
+}
+
+static iAnyObject *parse_(const iAnyObject *value, void *context) {
+    iUnused(context);
+    stagesCalled_++;
+    return new_CachedValue(((const iCachedValue *) value)->index + 1);
+}
+
+/* A stage that continues asynchronously by returning another promise. */
+static iAnyObject *refetch_(const iAnyObject *value, void *context) {
+    return newRun_Promise(context, fetch_, (void *) (intptr_t) ((const iCachedValue *) value)->index);
+}
+
+#if !defined (iPlatformWindows)
+enum { numEchoPairs_ = 200, numEchoRounds_ = 10, numSleepers_ = 1000 };
+
+iDeclareType(EchoTask)
+
+/* Both ends of a connection: the client sends a counter that the server sends back. */
+struct Impl_EchoTask {
+    int fd;
+    int round;
+    int value;
+    int numOk;
+};
+
+static atomic_int sleepersDone_;
+
+static enum iTaskStep echoClient_(iTask *task) {
+    iEchoTask *d = context_Task(task);
+    iTaskBegin(task);
+    for (d->round = 0; d->round < numEchoRounds_; d->round++) {
+        iAwaitWritable(task, d->fd, 5.0);
+        if (write(d->fd, &d->round, sizeof(d->round)) != sizeof(d->round)) break;
+        iAwaitReadable(task, d->fd, 5.0);
+        if (task->events & timeout_ReactorEvent) break;
+        if (read(d->fd, &d->value, sizeof(d->value)) != sizeof(d->value)) break;
+        d->numOk += (d->value == d->round);
+    }
+    close(d->fd);
+    iTaskEnd(task);
+}
+
+static enum iTaskStep echoServer_(iTask *task) {
+    iEchoTask *d = context_Task(task);
+    iTaskBegin(task);
+    for (;;) {
+        iAwaitReadable(task, d->fd, 5.0);
+        if (task->events & timeout_ReactorEvent) break;
+        if (read(d->fd, &d->value, sizeof(d->value)) != sizeof(d->value)) break; /* closed */
+        if (write(d->fd, &d->value, sizeof(d->value)) != sizeof(d->value)) break;
+        d->numOk++;
+    }
+    close(d->fd);
+    iTaskEnd(task);
+}
+
+static enum iTaskStep sleeper_(iTask *task) {
+    iTaskBegin(task);
+    iAwaitTimeout(task, 0.05);
+    iYieldTask(task);
+    iAwaitTimeout(task, 0.05);
+    sleepersDone_++;
+    iTaskEnd(task);
+}
+
+static enum iTaskStep readForever_(iTask *task) {
+    iTaskBegin(task);
+    iAwaitReadable(task, *(const int *) context_Task(task), 0.0);
+    iTaskEnd(task);
+}
+
+static enum iTaskStep awaitAll_(iTask *task) {
+    iTaskBegin(task);
+    iAwaitPromise(task, context_Task(task));
+    setResult_Task(task, value_Promise(context_Task(task)));
+    iTaskEnd(task);
+}
+#endif
+
+static atomic_int childBytes_;
+static atomic_int childrenFinished_;
+
+static void childOutput_(iAny *any, iProcess *proc, const iBlock *data) {
+    iUnused(any, proc);
+    childBytes_ += (int) size_Block(data);
+}
+
+static void childFinished_(iAny *any, iProcess *proc, int exitStatus) {
+    iUnused(any, proc);
+    if (exitStatus == 0) {
+        childrenFinished_++;
+    }
+}
+
 int main(int argc, char *argv[]) {
     iUnused(argc, argv);
     init_Foundation();
@@ -64,5 +442,333 @@ int main(int argc, char *argv[]) {
         iRelease(future);
         iRelease(pool);
     }
+    /* Look up the current thread concurrently in several threads. */ {
+        for (int numThreads = 1; numThreads <= 8; numThreads *= 2) {
+            iThread *threads[8];
+            const iTime startTime = now_Time();
+            for (int i = 0; i < numThreads; ++i) {
+                threads[i] = new_Thread(run_CurrentThreadLookups_);
+                start_Thread(threads[i]);
+            }
+            iThreadResult mismatches = 0;
+            for (int i = 0; i < numThreads; ++i) {
+                mismatches += result_Thread(threads[i]);
+                iRelease(threads[i]);
+            }
+            const double elapsed = elapsedSeconds_Time(&startTime);
+            printf("current_Thread with %d thread(s): %.1f M calls/s\n",
+                   numThreads, numThreads * currentThreadCalls_ / elapsed / 1.0e6);
+            iAssert(mismatches == 0);
+        }
+    }
+    /* Run loops in parallel. */ {
+        iThreadPool *pool = new_ThreadPool();
+        double *values = malloc(sizeof(double) * loopSize_);
+        iTime startTime = now_Time();
+        enum { numChunks = 64 };
+        iLoopChunk chunks[numChunks];
+        iFuture *future = new_Future();
+        for (int i = 0; i < numChunks; ++i) {
+            chunks[i] = (iLoopChunk){ values, (size_t) i * loopSize_ / numChunks,
+                                      (size_t) (i + 1) * loopSize_ / numChunks };
+            iThread *job = new_Thread(run_LoopChunk_);
+            setUserData_Thread(job, &chunks[i]);
+            iRelease(runPool_Future(future, job, pool));
+        }
+        wait_Future(future);
+        iRelease(future);
+        printf("Loop with a Thread per chunk: %.3f s\n", elapsedSeconds_Time(&startTime));
+        memset(values, 0, sizeof(double) * loopSize_);
+        startTime = now_Time();
+        parallelFor_ThreadPool(pool, 0, loopSize_, 0, squares_, values);
+        printf("parallelFor_ThreadPool: %.3f s\n", elapsedSeconds_Time(&startTime));
+        startTime = now_Time();
+        uint64_t sum = 0;
+        parallelReduce_ThreadPool(pool, 0, loopSize_, 0, sizeof(sum), &sum,
+                                  sumValues_, addSum_, values);
+        uint64_t expected = 0;
+        sumValues_(values, 0, loopSize_, &expected);
+        printf("parallelReduce_ThreadPool: %.3f s, sum %s\n", elapsedSeconds_Time(&startTime),
+               sum == expected ? "OK" : "WRONG");
+        /* Jobs that run parallel loops in the same pool. */
+        memset(values, 0, sizeof(double) * loopSize_);
+        iNestedLoop nested[8];
+        for (int i = 0; i < 8; ++i) {
+            nested[i] = (iNestedLoop){ pool, values, (size_t) i * loopSize_ / 8 };
+        }
+        runBatch_ThreadPool(pool, runNestedLoop_, nested, sizeof(nested[0]), 8);
+        size_t numWrong = 0;
+        for (size_t i = 0; i < loopSize_; ++i) {
+            numWrong += (values[i] != (double) i * (double) i);
+        }
+        printf("Nested parallel loops: %zu wrong values\n", numWrong);
+        /* Each thread draws from its own random engine. */
+        startTime = now_Time();
+        uint64_t inside = 0;
+        countInsideCircle_(NULL, 0, loopSize_, &inside);
+        const double serialTime = elapsedSeconds_Time(&startTime);
+        startTime = now_Time();
+        inside = 0;
+        parallelReduce_ThreadPool(pool, 0, loopSize_, 0, sizeof(inside), &inside,
+                                  countInsideCircle_, addSum_, NULL);
+        printf("Monte Carlo pi %.4f: serial %.1f, parallel %.1f M samples/s\n",
+               4.0 * inside / loopSize_, loopSize_ / serialTime / 1.0e6,
+               loopSize_ / elapsedSeconds_Time(&startTime) / 1.0e6);
+        free(values);
+        iRelease(pool);
+    }
+    /* Run pipelines of continuations in a pool. */ {
+        enum { numPipelines = 1000 };
+        iThreadPool *pool = new_ThreadPool();
+        iPromise *results[numPipelines];
+        const iTime startTime = now_Time();
+        for (int i = 0; i < numPipelines; ++i) {
+            iPromise *fetched = newRun_Promise(pool, fetch_, (void *) (intptr_t) i);
+            iPromise *decompressed = then_Promise(fetched, pool, decompress_, NULL);
+            results[i] = then_Promise(decompressed, pool, parse_, NULL);
+            iRelease(decompressed);
+            iRelease(fetched);
+        }
+        iPromise *all = newAll_Promise(results, numPipelines);
+        const enum iPromiseState allState = wait_Promise(all);
+        int numWrong = 0, index = 0;
+        iConstForEach(ObjectList, i, value_Promise(all)) {
+            const iCachedValue *value = value_Promise(i.object);
+            numWrong += (value->index != 2 * index++ + 1);
+        }
+        printf("%d pipelines finished in %.3f s: %s, %d stages called, %d wrong values\n",
+               numPipelines, elapsedSeconds_Time(&startTime),
+               allState == fulfilled_PromiseState ? "fulfilled" : "canceled",
+               (int) stagesCalled_, numWrong);
+        iAssert(allState == fulfilled_PromiseState);
+        iAssert(numWrong == 0);
+        iRelease(all);
+        /* The first finished result is enough. */
+        iPromise *any = newAny_Promise(results, numPipelines);
+        const enum iPromiseState anyState = wait_Promise(any);
+        printf("Any of the results: %s\n",
+               anyState == fulfilled_PromiseState ? "fulfilled" : "canceled");
+        iAssert(anyState == fulfilled_PromiseState);
+        iRelease(any);
+        for (int i = 0; i < numPipelines; ++i) {
+            iRelease(results[i]);
+        }
+        /* Groups do not keep pending promises alive: abandoning one cancels the group. */ {
+            iPromise *kept      = new_Promise();
+            iPromise *abandoned = new_Promise();
+            iPromise *group[]   = { kept, abandoned };
+            all = newAll_Promise(group, iElemCount(group));
+            any = newAny_Promise(group + 1, 1);
+            fulfill_Promise(kept, NULL);
+            iRelease(abandoned);
+            const enum iPromiseState abandonedAll = state_Promise(all);
+            const enum iPromiseState abandonedAny = state_Promise(any);
+            printf("Abandoned promise: all %s, any %s\n",
+                   abandonedAll == canceled_PromiseState ? "canceled" : "not canceled",
+                   abandonedAny == canceled_PromiseState ? "canceled" : "not canceled");
+            iAssert(abandonedAll == canceled_PromiseState);
+            iAssert(abandonedAny == canceled_PromiseState);
+            iRelease(any);
+            iRelease(all);
+            iRelease(kept);
+        }
+        /* Canceling a promise cancels everything that depends on it. */
+        stagesCalled_ = 0;
+        iPromise *source = new_Promise();
+        iPromise *stage1 = then_Promise(source, pool, decompress_, NULL);
+        iPromise *stage2 = then_Promise(stage1, NULL, parse_, NULL);
+        cancel_Promise(source);
+        fulfill_Promise(source, NULL);
+        const enum iPromiseState canceledState = wait_Promise(stage2);
+        printf("Canceled pipeline: %s, %d stages called\n",
+               canceledState == canceled_PromiseState ? "canceled" : "not canceled",
+               (int) stagesCalled_);
+        iAssert(canceledState == canceled_PromiseState);
+        iAssert(stagesCalled_ == 0);
+        iRelease(stage2);
+        iRelease(stage1);
+        iRelease(source);
+        /* A stage may return a promise of its own. */
+        iCachedValue *seed = new_CachedValue(42);
+        source = new_Promise();
+        stage1 = then_Promise(source, pool, refetch_, pool);
+        fulfill_Promise(source, seed);
+        wait_Promise(stage1);
+        const int chainedValue = ((const iCachedValue *) value_Promise(stage1))->index;
+        printf("Chained promise value: %d\n", chainedValue);
+        iAssert(chainedValue == 42);
+        iRelease(stage1);
+        iRelease(source);
+        iRelease(seed);
+        iRelease(pool);
+    }
+    /* Share a cache of objects between threads. */ {
+        iCacheBench bench = { .concHash = new_ConcurrentHash(), .hash = new_StringHash() };
+        init_Mutex(&bench.mutex);
+        for (int i = 0; i < cacheKeys_; ++i) {
+            cacheKeyStrings_[i] = newFormat_String("cache/key/%d", i);
+            iCachedValue *value = new_CachedValue(i);
+            insertString_ConcurrentHash(bench.concHash, cacheKeyStrings_[i], value);
+            insert_StringHash(bench.hash, cacheKeyStrings_[i], value);
+            iRelease(value);
+        }
+        runCacheBench_(&bench, "ConcurrentHash");
+        iConcurrentHash *concHash = bench.concHash;
+        bench.concHash = NULL;
+        runCacheBench_(&bench, "Locked StringHash");
+        size_t numRemoved = 0;
+        for (int i = 0; i < cacheKeys_; ++i) {
+            numRemoved += removeString_ConcurrentHash(concHash, cacheKeyStrings_[i]);
+            delete_String(cacheKeyStrings_[i]);
+        }
+        printf("Removed %zu values from ConcurrentHash (expected %d), %zu left\n",
+               numRemoved, cacheKeys_, size_ConcurrentHash(concHash));
+        iRelease(concHash);
+        iRelease(bench.hash);
+        deinit_Mutex(&bench.mutex);
+    }
+    /* Pass small items between threads. */ {
+        iRingBench bench = { .numItems = ringItems_ };
+        bench.ring = new_Ring(sizeof(int), 1024, singleProducer_RingMode);
+        runRingBench_(&bench, 1, "SPSC Ring");
+        bench.batched = iTrue;
+        runRingBench_(&bench, 1, "SPSC Ring, batches of 64");
+        delete_Ring(bench.ring);
+        bench.ring = new_Ring(sizeof(int), 1024, multiProducer_RingMode);
+        bench.numItems = ringItems_ / 4;
+        bench.batched = iFalse;
+        runRingBench_(&bench, 4, "MPSC Ring");
+        bench.batched = iTrue;
+        runRingBench_(&bench, 4, "MPSC Ring, batches of 64");
+        delete_Ring(bench.ring);
+        bench.ring = NULL;
+        bench.queue = new_Queue();
+        bench.numItems = ringItems_ / 10;
+        runRingBench_(&bench, 1, "Queue");
+        runRingBench_(&bench, 4, "Queue");
+        iRelease(bench.queue);
+    }
+#if !defined (iPlatformWindows)
+    /* Run many tasks on a few threads. */ {
+        iThreadPool *pool = newLimits_ThreadPool(2, 0);
+        iScheduler *sched = new_Scheduler(pool);
+        iEchoTask clients[numEchoPairs_], servers[numEchoPairs_];
+        iPromise *sleepers[numSleepers_];
+        const iTime startTime = now_Time();
+        for (int i = 0; i < numEchoPairs_; ++i) {
+            int fds[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds)) {
+                puts("socketpair failed");
+                return 1;
+            }
+            clients[i] = (iEchoTask){ .fd = fds[0] };
+            servers[i] = (iEchoTask){ .fd = fds[1] };
+            iRelease(spawn_Scheduler(sched, echoServer_, &servers[i]));
+            iRelease(spawn_Scheduler(sched, echoClient_, &clients[i]));
+        }
+        for (int i = 0; i < numSleepers_; ++i) {
+            sleepers[i] = spawn_Scheduler(sched, sleeper_, NULL);
+        }
+        iPromise *allSleepers = newAll_Promise(sleepers, numSleepers_);
+        iPromise *waiter = spawn_Scheduler(sched, awaitAll_, allSleepers);
+        wait_Scheduler(sched);
+        int numEchoed = 0, numServed = 0;
+        for (int i = 0; i < numEchoPairs_; ++i) {
+            numEchoed += clients[i].numOk;
+            numServed += servers[i].numOk;
+        }
+        printf("%d tasks on %zu threads finished in %.3f s: %d/%d echoed, %d served, "
+               "%d sleepers, awaited %zu results\n",
+               2 * numEchoPairs_ + numSleepers_ + 1, numThreads_ThreadPool(pool),
+               elapsedSeconds_Time(&startTime), numEchoed, numEchoPairs_ * numEchoRounds_,
+               numServed, (int) sleepersDone_,
+               size_ObjectList(value_Promise(waiter)));
+        iRelease(waiter);
+        iRelease(allSleepers);
+        for (int i = 0; i < numSleepers_; ++i) {
+            iRelease(sleepers[i]);
+        }
+        iRelease(sched);
+        iRelease(pool);
+    }
+    /* Deleting a scheduler cancels tasks that would otherwise wait forever. */ {
+        int fds[2];
+        if (pipe(fds)) {
+            puts("pipe failed");
+            return 1;
+        }
+        iScheduler *sched = new_Scheduler(NULL);
+        iPromise *never = new_Promise();
+        iPromise *reader = spawn_Scheduler(sched, readForever_, &fds[0]);
+        iPromise *waiter = spawn_Scheduler(sched, awaitAll_, never);
+        sleep_Thread(0.05); /* let them suspend */
+        iRelease(sched);
+        printf("Scheduler deleted with suspended tasks: reader %s, waiter %s\n",
+               isCanceled_Promise(reader) ? "canceled" : "not canceled",
+               isCanceled_Promise(waiter) ? "canceled" : "not canceled");
+        iAssert(isCanceled_Promise(reader));
+        iAssert(isCanceled_Promise(waiter));
+        iRelease(waiter);
+        iRelease(reader);
+        iRelease(never); /* deletes the canceled task that was waiting for it */
+        close(fds[1]);
+        close(fds[0]);
+    }
+    /* Run child processes concurrently, with their I/O done in a single thread. */ {
+        enum { numChildren = 100, inputSize = 256 * 1024 };
+        iBlock *input = new_Block(inputSize);
+        fill_Block(input, 'x');
+        iStringList *args = new_StringList();
+        pushBackCStr_StringList(args, "/bin/cat");
+        iProcess *procs[numChildren];
+        const iTime startTime = now_Time();
+        for (int i = 0; i < numChildren; i++) {
+            iBuffer *buf = new_Buffer();
+            open_Buffer(buf, input);
+            procs[i] = new_Process();
+            setArguments_Process(procs[i], args);
+            setInput_Process(procs[i], stream_Buffer(buf));
+            iConnect(Process, procs[i], outputReceived, procs[i], childOutput_);
+            iConnect(Process, procs[i], finished, procs[i], childFinished_);
+            if (!startAsync_Process(procs[i])) {
+                printf("Failed to start child process\n");
+            }
+            iRelease(buf);
+        }
+        for (int i = 0; i < numChildren; i++) {
+            waitForFinished_Process(procs[i]);
+            iRelease(procs[i]);
+        }
+        printf("%d child processes echoed %d bytes in %.3f s\n",
+               (int) childrenFinished_, (int) childBytes_,
+               elapsedSeconds_Time(&startTime));
+        iAssert(childrenFinished_ == numChildren);
+        iAssert(childBytes_ == numChildren * inputSize);
+        iRelease(args);
+        delete_Block(input);
+    }
+    /* A child reading stdin must see EOF when no input stream is set. */ {
+        iStringList *args = new_StringList();
+        pushBackCStr_StringList(args, "/bin/cat");
+        iProcess *proc = new_Process();
+        setArguments_Process(proc, args);
+        if (!startAsync_Process(proc)) {
+            printf("Failed to start child process\n");
+        }
+        const iTime startTime = now_Time();
+        while (exitStatus_Process(proc) < 0 && elapsedSeconds_Time(&startTime) < 5.0) {
+            sleep_Thread(0.01);
+        }
+        const int status = exitStatus_Process(proc);
+        if (status < 0) {
+            kill_Process(proc);
+        }
+        waitForFinished_Process(proc);
+        printf("Child without input exited with status %d\n", status);
+        iAssert(status == 0);
+        iRelease(proc);
+        iRelease(args);
+    }
+#endif
     return 0;
 }